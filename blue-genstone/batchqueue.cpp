@@ -0,0 +1,318 @@
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QProgressBar>
+#include <QThread>
+#include <QVBoxLayout>
+#include <algorithm>
+#include <set>
+#include "batchqueue.h"
+#include "framecache.h"
+#include "project.h"
+
+// Columns of the table
+#define COLUMN_PLATE 0
+#define COLUMN_STATUS 1
+#define COLUMN_PROGRESS 2
+#define COLUMN_TIME 3
+#define COLUMN_COUNT 4
+
+// Jobs get at least this many CPUs each, which is what limits how many run at once; blue-gen spends a lot of its time
+// writing, so a few plates at once keeps more of the CPUs busy than one plate using all of them
+#define CPUS_PER_JOB 4
+
+// How often the time of running jobs is updated, in milliseconds
+#define CLOCK_INTERVAL 250
+
+BatchQueue::BatchQueue(FrameCache *frames, QWidget *parent) :
+    QWidget(parent),
+    frames(frames)
+{
+    this->table = new QTableWidget(0, COLUMN_COUNT, this);
+    this->table->setHorizontalHeaderLabels(QStringList() << "Plate" << "Status" << "Progress" << "Time");
+    this->table->horizontalHeader()->setSectionResizeMode(COLUMN_STATUS, QHeaderView::Stretch);
+    this->table->verticalHeader()->setVisible(false);
+    this->table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    this->table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    this->add_projects_button = new QPushButton("Add Projects...", this);
+    this->cancel_button = new QPushButton("Cancel", this);
+    this->remove_button = new QPushButton("Remove", this);
+
+    QHBoxLayout *buttons = new QHBoxLayout();
+    buttons->addWidget(this->add_projects_button);
+    buttons->addStretch();
+    buttons->addWidget(this->cancel_button);
+    buttons->addWidget(this->remove_button);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(this->table);
+    layout->addLayout(buttons);
+
+    connect(this->add_projects_button, &QPushButton::clicked, this, &BatchQueue::add_projects);
+    connect(this->cancel_button, &QPushButton::clicked, this, &BatchQueue::cancel_selected);
+    connect(this->remove_button, &QPushButton::clicked, this, &BatchQueue::remove_finished);
+    connect(this->table, &QTableWidget::itemSelectionChanged, this, &BatchQueue::update_buttons);
+    connect(&this->clock, &QTimer::timeout, this, &BatchQueue::update_times);
+    this->clock.setInterval(CLOCK_INTERVAL);
+    this->update_buttons();
+}
+
+BatchQueue::~BatchQueue()
+{
+    // Stop anything that's still running while the frames are still around
+    for(auto &entry : this->entries) {
+        delete entry->generator;
+        entry->generator = nullptr;
+    }
+}
+
+void BatchQueue::add(const QString &name, const GenerationJob &job) {
+    this->append(name, job);
+    this->start_jobs();
+}
+
+void BatchQueue::set_window_output(const QString &path) {
+    this->window_output = path;
+    this->start_jobs();
+}
+
+bool BatchQueue::is_writing(const QString &path) const {
+    return std::any_of(this->entries.begin(), this->entries.end(), [&path](const std::unique_ptr<Entry> &entry) {
+        return entry->state == Entry::Running && entry->job.output_path == path;
+    });
+}
+
+BatchQueue::Entry *BatchQueue::append(const QString &name, const GenerationJob &job) {
+    Entry *entry = new Entry();
+    entry->name = name;
+    entry->job = job;
+    entry->job.frames = this->frames;
+    this->entries.emplace_back(entry);
+
+    int row = this->table->rowCount();
+    this->table->insertRow(row);
+    QTableWidgetItem *plate = new QTableWidgetItem(name);
+    plate->setToolTip(job.output_path);
+    this->table->setItem(row, COLUMN_PLATE, plate);
+    this->table->setItem(row, COLUMN_STATUS, new QTableWidgetItem());
+    this->table->setItem(row, COLUMN_TIME, new QTableWidgetItem());
+
+    QProgressBar *progress = new QProgressBar();
+    progress->setRange(0, 1000);
+    progress->setValue(0);
+    progress->setFormat("%p%");
+    this->table->setCellWidget(row, COLUMN_PROGRESS, progress);
+
+    this->set_status(entry, "Waiting...");
+    return entry;
+}
+
+// Rows are always in the same order as the entries
+int BatchQueue::row_of(const Entry *entry) const {
+    for(std::size_t e = 0; e < this->entries.size(); e++) {
+        if(this->entries[e].get() == entry) {
+            return static_cast<int>(e);
+        }
+    }
+    return -1;
+}
+
+void BatchQueue::set_status(const Entry *entry, const QString &status) {
+    int row = this->row_of(entry);
+    if(row >= 0) {
+        this->table->item(row, COLUMN_STATUS)->setText(status);
+        this->table->item(row, COLUMN_STATUS)->setToolTip(status);
+    }
+}
+
+void BatchQueue::update_times() {
+    for(std::size_t e = 0; e < this->entries.size(); e++) {
+        Entry *entry = this->entries[e].get();
+        if(entry->state == Entry::Queued) {
+            continue;
+        }
+        qint64 elapsed = entry->state == Entry::Running ? entry->timer.elapsed() : entry->elapsed;
+        this->table->item(static_cast<int>(e), COLUMN_TIME)->setText(QString::number(elapsed / 1000.0, 'f', 1) + " s");
+    }
+}
+
+void BatchQueue::update_buttons() {
+    bool can_cancel = false;
+    bool can_remove = false;
+    for(auto &index : this->table->selectionModel()->selectedRows()) {
+        Entry::State state = this->entries[static_cast<std::size_t>(index.row())]->state;
+        can_cancel = can_cancel || state != Entry::Finished;
+        can_remove = can_remove || state == Entry::Finished;
+    }
+    this->cancel_button->setEnabled(can_cancel);
+    this->remove_button->setEnabled(can_remove);
+}
+
+void BatchQueue::start_jobs() {
+    int cpus = std::max(1, QThread::idealThreadCount());
+    int limit = std::max(1, cpus / CPUS_PER_JOB);
+
+    int running = 0;
+    int queued = 0;
+    std::set<QString> outputs;
+    if(!this->window_output.isEmpty()) {
+        outputs.insert(this->window_output);
+    }
+    for(auto &entry : this->entries) {
+        if(entry->state == Entry::Running) {
+            running++;
+            outputs.insert(entry->job.output_path);
+        }
+        else if(entry->state == Entry::Queued) {
+            queued++;
+        }
+    }
+
+    for(auto &entry : this->entries) {
+        if(running >= limit) {
+            break;
+        }
+
+        // Two jobs writing the same file would ruin it, so the second one waits for the first
+        if(entry->state != Entry::Queued || outputs.count(entry->job.output_path)) {
+            continue;
+        }
+
+        // Split the CPUs between everything that's about to be running
+        entry->job.threads = static_cast<unsigned int>(std::max(1, cpus / std::min(limit, running + queued)));
+        running++;
+        queued--;
+        outputs.insert(entry->job.output_path);
+
+        Entry *started = entry.get();
+        started->state = Entry::Running;
+        started->generator = new Generator(this);
+        connect(started->generator, &Generator::progress, this, [this, started](int stage, quint64 done, quint64 total) {
+            this->job_progress(started, stage, done, total);
+        });
+        connect(started->generator, &Generator::finished, this, [this, started](const GenerationResult &result) {
+            this->job_finished(started, result);
+        });
+        this->set_status(started, "Generating...");
+        started->timer.start();
+        started->generator->start(started->job);
+    }
+
+    if(running > 0) {
+        this->clock.start();
+    }
+    else {
+        this->clock.stop();
+    }
+    this->update_times();
+    this->update_buttons();
+}
+
+void BatchQueue::add_projects() {
+    QStringList opened = QFileDialog::getOpenFileNames(this, "Add Projects", QString(), "blue-genstone Project (*.bgsp)");
+    for(auto &path : opened) {
+        QString name = QFileInfo(path).completeBaseName();
+        Project project;
+        QString error = project.load(path);
+
+        // What was known about the frames saves having to look at them all again
+        for(auto frame = project.frames.constBegin(); frame != project.frames.constEnd(); frame++) {
+            this->frames->remember(frame.key(), frame.value());
+        }
+
+        GenerationJob job;
+        job.sequences = project.sequences;
+        job.output_path = project.output_path;
+        if(error.isEmpty()) {
+            if(project.output_path.isEmpty()) {
+                error = "( ')> But where would I save it?";
+            }
+            else if(std::none_of(project.sequences.begin(), project.sequences.end(), [](const std::vector<QString> &sequence) { return !sequence.empty(); })) {
+                error = "( ')> You need to select some bitmaps first!";
+            }
+            else if(!Generator::parse_dummy_space(project.dummy_space, job.dummy_space)) {
+                error = "(v)> Dummy color must be a valid hex code (i.e. 00FFFF).";
+            }
+        }
+
+        // Projects that can't be generated stay in the list so it's clear why they didn't
+        Entry *entry = this->append(name, job);
+        if(!error.isEmpty()) {
+            entry->state = Entry::Finished;
+            this->set_status(entry, error);
+        }
+    }
+    this->start_jobs();
+}
+
+void BatchQueue::cancel_selected() {
+    for(auto &index : this->table->selectionModel()->selectedRows()) {
+        Entry *entry = this->entries[static_cast<std::size_t>(index.row())].get();
+        if(entry->state == Entry::Running) {
+            entry->generator->cancel();
+            this->set_status(entry, "Stopping...");
+        }
+        else if(entry->state == Entry::Queued) {
+            entry->state = Entry::Finished;
+            this->set_status(entry, "( ')> Okay, I won't.");
+        }
+    }
+    this->update_buttons();
+}
+
+void BatchQueue::remove_finished() {
+    // Go from the bottom up so the rows above stay where they are
+    std::vector<int> rows;
+    for(auto &index : this->table->selectionModel()->selectedRows()) {
+        if(this->entries[static_cast<std::size_t>(index.row())]->state == Entry::Finished) {
+            rows.push_back(index.row());
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    for(auto row = rows.rbegin(); row != rows.rend(); row++) {
+        this->table->removeRow(*row);
+        this->entries.erase(this->entries.begin() + *row);
+    }
+    this->update_buttons();
+}
+
+void BatchQueue::job_progress(Entry *entry, int stage, quint64 done, quint64 total) {
+    int row = this->row_of(entry);
+    if(row < 0) {
+        return;
+    }
+
+    // Progress bars only go up to INT_MAX, so use tenths of a percent
+    QProgressBar *progress = static_cast<QProgressBar *>(this->table->cellWidget(row, COLUMN_PROGRESS));
+    progress->setFormat(Generator::progress_format(stage));
+    progress->setValue(total == 0 ? 1000 : static_cast<int>(done * 1000 / total));
+}
+
+void BatchQueue::job_finished(Entry *entry, const GenerationResult &result) {
+    entry->state = Entry::Finished;
+    entry->elapsed = entry->timer.elapsed();
+
+    // Its session holds on to the whole plate, which isn't worth keeping around for a plate that's done
+    entry->generator->deleteLater();
+    entry->generator = nullptr;
+
+    QProgressBar *progress = static_cast<QProgressBar *>(this->table->cellWidget(this->row_of(entry), COLUMN_PROGRESS));
+    progress->setFormat("%p%");
+    switch(result.status) {
+        case GenerationResult::Succeeded:
+            progress->setValue(1000);
+            this->set_status(entry, QString("(^)> Yay! I made a %1x%2 image.").arg(result.width).arg(result.height));
+            break;
+        case GenerationResult::Cancelled:
+            this->set_status(entry, "( ')> Okay, I stopped.");
+            break;
+        case GenerationResult::Failed:
+            this->set_status(entry, result.message);
+            break;
+    }
+
+    // Something else may have been waiting on it or for a free spot
+    this->start_jobs();
+}
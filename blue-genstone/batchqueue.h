@@ -0,0 +1,77 @@
+#ifndef BATCHQUEUE_H
+#define BATCHQUEUE_H
+
+#include <QElapsedTimer>
+#include <QPushButton>
+#include <QString>
+#include <QTableWidget>
+#include <QTimer>
+#include <QWidget>
+#include <memory>
+#include <vector>
+#include "generator.h"
+
+class FrameCache;
+
+// Plates queued up to be generated in the background, several at once, each with its own progress, status and time;
+// they share the window's decoded frames and split the CPUs between them
+class BatchQueue : public QWidget
+{
+    Q_OBJECT
+
+public:
+    // frames has to outlive the queue
+    explicit BatchQueue(FrameCache *frames, QWidget *parent = nullptr);
+    ~BatchQueue() override;
+
+    // Queue a plate; it starts as soon as there's room
+    void add(const QString &name, const GenerationJob &job);
+
+    // The window's own Generate is writing to path, or nothing if path is empty; jobs writing there wait until it's done
+    void set_window_output(const QString &path);
+
+    // Is a running job writing to path?
+    bool is_writing(const QString &path) const;
+
+private:
+    struct Entry {
+        enum State {
+            Queued,
+            Running,
+            Finished
+        };
+        State state = Queued;
+        QString name;
+        GenerationJob job;
+        Generator *generator = nullptr;
+        QElapsedTimer timer;
+        qint64 elapsed = 0;
+    };
+    std::vector<std::unique_ptr<Entry>> entries;
+    FrameCache *frames;
+    QString window_output;
+
+    QTableWidget *table;
+    QPushButton *add_projects_button;
+    QPushButton *cancel_button;
+    QPushButton *remove_button;
+
+    // Updates the time of whatever is running
+    QTimer clock;
+
+    Entry *append(const QString &name, const GenerationJob &job);
+    int row_of(const Entry *entry) const;
+    void set_status(const Entry *entry, const QString &status);
+    void update_times();
+    void update_buttons();
+    void start_jobs();
+
+    void add_projects();
+    void cancel_selected();
+    void remove_finished();
+
+    void job_progress(Entry *entry, int stage, quint64 done, quint64 total);
+    void job_finished(Entry *entry, const GenerationResult &result);
+};
+
+#endif // BATCHQUEUE_H
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -27,12 +27,45 @@ win32:CONFIG += static
 
 SOURCES += \
         aboutdialog.cpp \
+        batchqueue.cpp \
         main.cpp \
-        bluegenstone.cpp
+        bluegenstone.cpp \
+        framecache.cpp \
+        generator.cpp \
+        platepreview.cpp \
+        project.cpp \
+        sequencemodel.cpp \
+        thumbnails.cpp
 
 HEADERS += \
         aboutdialog.h \
-        bluegenstone.h
+        batchqueue.h \
+        bluegenstone.h \
+        framecache.h \
+        generator.h \
+        platepreview.h \
+        project.h \
+        sequencemodel.h \
+        thumbnails.h
+
+# The plate generator is linked in directly
+INCLUDEPATH += ../src
+SOURCES += \
+        ../src/bluegen.c \
+        ../src/frames.c \
+        ../src/input.c \
+        ../src/perf.c \
+        ../src/pngimage.c \
+        ../src/progress.c \
+        ../src/rawimage.c \
+        ../src/scheduler.c \
+        ../src/stats.c \
+        ../src/stb_impl.c \
+        ../src/trace.c
+QMAKE_CFLAGS += -std=gnu99
+LIBS += -ltiff
+unix: LIBS += -lpthread
+win32: LIBS += -lpsapi
 
 FORMS += \
         aboutdialog.ui \
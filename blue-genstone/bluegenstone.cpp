@@ -1,97 +1,132 @@
-#include <QDebug>
-#include <QStringListModel>
+#include <QItemSelection>
 #include <QFileDialog>
-#include <QProcess>
+#include <QFileInfo>
 #include <QDragEnterEvent>
 #include <QDropEvent>
 #include <QMimeData>
+#include <algorithm>
 #include "bluegenstone.h"
 #include "ui_bluegenstone.h"
 #include "aboutdialog.h"
+#include "project.h"
+
+// How much memory frames decoded ahead of time may take up
+#define FRAME_CACHE_MIB 1024
 
 BlueGenstone::BlueGenstone(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::BlueGenstone)
+    ui(new Ui::BlueGenstone),
+    frame_cache(FRAME_CACHE_MIB)
 {
     ui->setupUi(this);
     ui->statusText->setVisible(false);
+    this->thumbnail_model = new ThumbnailModel(&this->thumbnails, this);
+    this->thumbnail_model->setSourceModel(&this->sequence_model);
+    ui->bitmapList->setModel(this->thumbnail_model);
+    ui->sequenceComboBox->setModel(&this->sequence_model);
+
+    // Anything that changes what's in the sequences changes the plate
+    connect(&this->sequence_model, &SequenceModel::rowsInserted, this, &BlueGenstone::update_preview);
+    connect(&this->sequence_model, &SequenceModel::rowsRemoved, this, &BlueGenstone::update_preview);
+    connect(&this->sequence_model, &SequenceModel::rowsMoved, this, &BlueGenstone::update_preview);
+    connect(&this->sequence_model, &SequenceModel::modelReset, this, &BlueGenstone::update_preview);
+    connect(&this->sequence_model, &SequenceModel::modelReset, this, &BlueGenstone::update_sequence_buttons);
+    connect(&this->sequence_model, &SequenceModel::rowsInserted, this, &BlueGenstone::update_sequence_buttons);
+    connect(&this->sequence_model, &SequenceModel::rowsRemoved, this, &BlueGenstone::update_sequence_buttons);
+    connect(&this->sequence_model, &SequenceModel::rowsInserted, this, &BlueGenstone::frames_inserted);
+    this->set_generating(false);
+    connect(&this->generator, &Generator::progress, this, &BlueGenstone::generation_progress);
+    connect(&this->generator, &Generator::finished, this, &BlueGenstone::generation_finished);
+
+    this->batch_queue = new BatchQueue(&this->frame_cache);
+    this->batch_dock = new QDockWidget("Batch", this);
+    this->batch_dock->setObjectName("batchDock");
+    this->batch_dock->setWidget(this->batch_queue);
+    this->addDockWidget(Qt::BottomDockWidgetArea, this->batch_dock);
+    this->batch_dock->hide();
+
     this->add_sequence();
     this->on_dummySpaceColor_textChanged("");
 }
 
 BlueGenstone::~BlueGenstone()
 {
+    // Members go before child widgets do, so the queue has to be stopped while the frame cache is still here
+    delete this->batch_dock;
     delete ui;
 }
 
 void BlueGenstone::add_sequence() {
-    this->sequences.emplace_back();
-    this->update_sequence_buttons();
-
-    ui->sequenceComboBox->setCurrentIndex(static_cast<int>(this->sequences.size() - 1));
+    this->sequence_model.add_sequence();
+    ui->sequenceComboBox->setCurrentIndex(this->sequence_model.rowCount() - 1);
 }
 
-void BlueGenstone::delete_sequence(std::vector<Sequence>::difference_type sequence_index) {
-    this->sequences.erase(this->sequences.begin() + sequence_index);
-    this->update_sequence_buttons();
+void BlueGenstone::delete_sequence(int sequence_index) {
+    this->sequence_model.removeRow(sequence_index);
 
-    if(static_cast<std::size_t>(sequence_index) == this->sequences.size()) {
+    if(sequence_index == this->sequence_model.rowCount()) {
         sequence_index--;
     }
 
-    ui->sequenceComboBox->setCurrentIndex(static_cast<int>(sequence_index));
+    // The combo box may already be on that row, in which case it won't tell us it changed
+    ui->sequenceComboBox->setCurrentIndex(sequence_index);
+    this->update_sequence_interface();
 }
 
-// So the user doesn't make a million sequences by accident lol
-#define MAX_SEQUENCES 255
-
 // Typing this is long. Let's make it shorter
 int BlueGenstone::current_index() {
     return ui->sequenceComboBox->currentIndex();
 }
 
 void BlueGenstone::update_sequence_buttons() {
-    auto sequence_count = this->sequences.size();
+    // There's always at least one sequence
+    ui->sequenceDeleteButton->setEnabled(this->sequence_model.rowCount() > 1);
+}
 
-    if(sequence_count == 1) {
-        ui->sequenceDeleteButton->setEnabled(false);
-    }
-    else {
-        ui->sequenceDeleteButton->setEnabled(true);
-    }
+QModelIndex BlueGenstone::current_sequence() {
+    return this->sequence_model.index(this->current_index(), 0);
+}
 
-    if(sequence_count == MAX_SEQUENCES) {
-        ui->sequenceAddButton->setEnabled(false);
-    }
-    else {
-        ui->sequenceAddButton->setEnabled(true);
+std::vector<int> BlueGenstone::selected_rows() {
+    std::vector<int> rows;
+    for(auto &index : ui->bitmapList->selectionModel()->selectedIndexes()) {
+        rows.push_back(index.row());
     }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
 
-    // Disable signals so we don't call update_sequence_interface() 9000 times
-    ui->sequenceComboBox->blockSignals(true);
-    ui->sequenceComboBox->clear();
-
-    // The sequence names are basically just Sequence #0, Sequence #1, etc.
-    for(std::size_t i = 0; i < sequence_count; i++) {
-        ui->sequenceComboBox->addItem(QString("Sequence #") + QString::number(i));
+void BlueGenstone::select_rows(const std::vector<int> &rows) {
+    QModelIndex root = ui->bitmapList->rootIndex();
+    QItemSelection selection;
+    for(int row : rows) {
+        QModelIndex index = this->thumbnail_model->index(row, 0, root);
+        selection.select(index, index);
+    }
+    ui->bitmapList->selectionModel()->select(selection, QItemSelectionModel::ClearAndSelect);
+    if(!rows.empty()) {
+        ui->bitmapList->selectionModel()->setCurrentIndex(this->thumbnail_model->index(rows.front(), 0, root), QItemSelectionModel::NoUpdate);
     }
-
-    // Set the current index to -1 so it can be set to something else while still calling update_sequence_interface()
-    ui->sequenceComboBox->setCurrentIndex(-1);
-    ui->sequenceComboBox->blockSignals(false);
 }
 
 void BlueGenstone::update_sequence_interface() {
-    // Create a new model
-    QStringListModel *model = new QStringListModel();
-    QStringList new_list;
-    for(auto &bitmap : this->sequences[static_cast<std::size_t>(this->current_index())].paths) {
-        new_list.push_back(bitmap);
+    // Show the frames of the current sequence; they update themselves from here on
+    ui->bitmapList->setRootIndex(this->thumbnail_model->mapFromSource(this->current_sequence()));
+}
+
+void BlueGenstone::update_preview() {
+    std::vector<std::vector<QString>> sequences = this->sequence_model.paths();
+
+    // Use the default color while a new one is still being typed
+    BlueGenPixel dummy_space = { 0x00, 0xFF, 0xFF, 0xFF };
+    if(!this->dummy_space_color(dummy_space)) {
+        dummy_space = { 0x00, 0xFF, 0xFF, 0xFF };
     }
-    model->setStringList(new_list);
+    ui->platePreview->set_sequences(sequences, dummy_space);
+}
 
-    // Set the model for our bitmap list
-    ui->bitmapList->setModel(model);
+bool BlueGenstone::dummy_space_color(BlueGenPixel &color) {
+    return Generator::parse_dummy_space(ui->dummySpaceColor->text(), color);
 }
 
 void BlueGenstone::on_sequenceAddButton_clicked()
@@ -113,15 +148,12 @@ void BlueGenstone::on_bitmapAddButton_clicked()
 {
     // Prepare a list of allowed extensions
     QStringList allowed_extensions;
-    allowed_extensions.push_back("Allowed Images (*.tif *.tiff *.png *.bmp *.tga)");
+    allowed_extensions.push_back("Allowed Images (*.tif *.tiff *.png *.bmp *.tga *.gif)");
 
-    auto files = this->open_file(allowed_extensions, true);
-    for(QString file : files) {
-        this->add_file(file);
-    }
+    this->add_files(this->open_file(allowed_extensions, true));
 }
 
-QStringList BlueGenstone::open_file(const QStringList &valid_files, bool multiple, bool save) {
+QStringList BlueGenstone::open_file(const QStringList &valid_files, bool multiple, bool save, const QString &default_suffix) {
     QFileDialog qfd;
 
     if(this->last_directory) {
@@ -136,7 +168,7 @@ QStringList BlueGenstone::open_file(const QStringList &valid_files, bool multipl
     if(save) {
         qfd.setFileMode(QFileDialog::FileMode::AnyFile);
         qfd.setAcceptMode(QFileDialog::AcceptMode::AcceptSave);
-        qfd.setDefaultSuffix("tif");
+        qfd.setDefaultSuffix(default_suffix);
     }
     else {
         qfd.setAcceptMode(QFileDialog::AcceptMode::AcceptOpen);
@@ -154,53 +186,43 @@ QStringList BlueGenstone::open_file(const QStringList &valid_files, bool multipl
 
 void BlueGenstone::on_bitmapDeleteButton_clicked()
 {
-    int selected_thing = ui->bitmapList->currentIndex().row();
-    if(selected_thing >= 0) {
-        auto &paths = this->sequences[static_cast<std::size_t>(this->current_index())].paths;
-        paths.erase(paths.begin() + selected_thing);
-        this->update_sequence_interface();
+    // Go from the bottom up so the rows above stay where they are
+    std::vector<int> rows = this->selected_rows();
+    QModelIndex sequence = this->current_sequence();
+    for(auto row = rows.rbegin(); row != rows.rend(); row++) {
+        this->sequence_model.removeRow(*row, sequence);
     }
 }
 
 void BlueGenstone::on_bitmapMoveUpButton_clicked()
 {
-    int selected_thing = ui->bitmapList->currentIndex().row();
-    if(selected_thing > 0) {
-        auto &paths = this->sequences[static_cast<std::size_t>(this->current_index())].paths;
-        std::size_t selected_thing_index = static_cast<std::size_t>(selected_thing);
-
-        QString a = paths[selected_thing_index];
-        QString b = paths[selected_thing_index - 1];
-
-        paths[selected_thing_index] = b;
-        paths[selected_thing_index - 1] = a;
-
-        this->update_sequence_interface();
+    std::vector<int> rows = this->selected_rows();
+    if(rows.empty() || rows.front() == 0) {
+        return;
+    }
 
-        ui->bitmapList->setCurrentIndex(ui->bitmapList->model()->index(selected_thing - 1,0));
+    QModelIndex sequence = this->current_sequence();
+    for(int &row : rows) {
+        this->sequence_model.moveRow(sequence, row, sequence, row - 1);
+        row--;
     }
+    this->select_rows(rows);
 }
 
 void BlueGenstone::on_bitmapMoveDownButton_clicked()
 {
-    int selected_thing = ui->bitmapList->currentIndex().row();
-    if(selected_thing >= 0) {
-        auto &paths = this->sequences[static_cast<std::size_t>(this->current_index())].paths;
-        std::size_t selected_thing_index = static_cast<std::size_t>(selected_thing);
-        if(selected_thing_index == paths.size() - 1) {
-            return;
-        }
-
-        QString a = paths[selected_thing_index];
-        QString b = paths[selected_thing_index + 1];
-
-        paths[selected_thing_index] = b;
-        paths[selected_thing_index + 1] = a;
-
-        this->update_sequence_interface();
+    std::vector<int> rows = this->selected_rows();
+    QModelIndex sequence = this->current_sequence();
+    if(rows.empty() || rows.back() == this->sequence_model.rowCount(sequence) - 1) {
+        return;
+    }
 
-        ui->bitmapList->setCurrentIndex(ui->bitmapList->model()->index(selected_thing + 1,0));
+    // Moving a row down means putting it before the row after the next one
+    for(auto row = rows.rbegin(); row != rows.rend(); row++) {
+        this->sequence_model.moveRow(sequence, *row, sequence, *row + 2);
+        (*row)++;
     }
+    this->select_rows(rows);
 }
 
 void BlueGenstone::on_findOutputTIFFButton_clicked()
@@ -215,67 +237,106 @@ void BlueGenstone::on_findOutputTIFFButton_clicked()
     }
 }
 
-void BlueGenstone::on_generateTIFFButton_clicked()
-{
+bool BlueGenstone::make_job(GenerationJob &job) {
     // Begin by checking if we have a place to save it
     QString output_tiff = ui->outputTIFFPath->text();
     if(output_tiff.isEmpty()) {
         this->set_status("( ')> But where would I save it?");
         ui->outputTIFFPath->setFocus();
-        return;
+        return false;
     }
 
     // Next, we need to see if we have bitmaps
-    bool have_bitmaps = false;
-    for(auto &s : this->sequences) {
-        if(s.paths.size()) {
-            have_bitmaps = true;
-            break;
-        }
-    }
-    if(!have_bitmaps) {
+    if(!this->sequence_model.has_bitmaps()) {
         this->set_status("( ')> You need to select some bitmaps first!");
         ui->boxOfSequences->setFocus();
-        return;
+        return false;
     }
 
-    // Start with the process thing
-    QProcess p;
-    QStringList arguments;
+    job.output_path = output_tiff;
+    job.sequences = this->sequence_model.paths();
+    job.frames = &this->frame_cache;
 
-    if(ui->dummySpaceColor->text().size() != 0) {
-        arguments.push_back("-d");
-        arguments.push_back(ui->dummySpaceColor->text());
+    if(!this->dummy_space_color(job.dummy_space)) {
+        this->set_status("(v)> Dummy color must be a valid hex code (i.e. 00FFFF).");
+        ui->dummySpaceColor->setFocus();
+        return false;
     }
+    return true;
+}
 
-    arguments.push_back(output_tiff);
-    for(auto &s : this->sequences) {
-        arguments.push_back("-s");
-        for(auto &p : s.paths) {
-            arguments.push_back(p);
-        }
+void BlueGenstone::on_generateTIFFButton_clicked()
+{
+    GenerationJob job;
+    if(!this->make_job(job)) {
+        return;
+    }
+
+    // Two plates writing the same file would ruin it, so the queue holds off on that file until this is done
+    if(this->batch_queue->is_writing(job.output_path)) {
+        this->set_status(QString("( ')> The batch queue is already making ") + job.output_path + ".");
+        return;
     }
+    this->batch_queue->set_window_output(job.output_path);
 
     // Run it
-#ifdef _WIN32
-#define BG_EXECUTABLE "blue-gen.exe"
-#else
-#define BG_EXECUTABLE "blue-gen"
-#endif
-    p.start(BG_EXECUTABLE, arguments);
-    p.waitForFinished(-1);
-    auto err = p.readAllStandardError();
-    auto out = p.readAllStandardOutput();
-
-    if(p.error() == QProcess::FailedToStart) {
-        this->set_status("(X)> Failed to open blue-gen.");
+    this->set_generating(true);
+    this->generator.start(job);
+}
+
+void BlueGenstone::on_queueButton_clicked()
+{
+    GenerationJob job;
+    if(!this->make_job(job)) {
         return;
     }
-    else if(p.exitCode() == 0) {
-        this->set_status(QString::fromUtf8(out).replace("\r", "").replace("\n", ""));
+
+    // Name it after the plate, since that's what's different between them
+    this->batch_queue->add(QFileInfo(job.output_path).completeBaseName(), job);
+    this->batch_dock->show();
+    this->set_status(QString("(^)> Queued ") + job.output_path + ".");
+}
+
+void BlueGenstone::on_cancelButton_clicked()
+{
+    ui->cancelButton->setEnabled(false);
+    this->generator.cancel();
+}
+
+void BlueGenstone::generation_progress(int stage, quint64 done, quint64 total) {
+    ui->progressBar->setFormat(Generator::progress_format(stage));
+
+    // Progress bars only go up to INT_MAX, so use tenths of a percent
+    ui->progressBar->setValue(total == 0 ? 1000 : static_cast<int>(done * 1000 / total));
+}
+
+void BlueGenstone::generation_finished(const GenerationResult &result) {
+    this->set_generating(false);
+    this->batch_queue->set_window_output(QString());
+
+    switch(result.status) {
+        case GenerationResult::Succeeded:
+            this->set_status(QString("(^)> Yay! I made a %1x%2 image.").arg(result.width).arg(result.height));
+            break;
+        case GenerationResult::Cancelled:
+            this->set_status("( ')> Okay, I stopped.");
+            break;
+        case GenerationResult::Failed:
+            this->set_status(result.message);
+            break;
     }
-    else {
-        this->set_status(QString::fromUtf8(err).replace("\r", "").replace("\n", ""));
+}
+
+void BlueGenstone::set_generating(bool generating) {
+    ui->generateTIFFButton->setEnabled(!generating);
+    ui->progressBar->setVisible(generating);
+    ui->progressBar->setRange(0, 1000);
+    ui->progressBar->setValue(0);
+    ui->progressBar->setFormat("%p%");
+    ui->cancelButton->setVisible(generating);
+    ui->cancelButton->setEnabled(generating);
+    if(generating) {
+        ui->statusText->setVisible(false);
     }
 }
 
@@ -292,6 +353,7 @@ void BlueGenstone::on_dummySpaceColor_textChanged(const QString &text)
     else if(text.size() == 0) {
         ui->colorViewer->setStyleSheet("* { background-color: #00FFFF}");
     }
+    this->update_preview();
 }
 
 void BlueGenstone::on_aboutButton_clicked()
@@ -299,10 +361,83 @@ void BlueGenstone::on_aboutButton_clicked()
     AboutDialog().exec();
 }
 
-void BlueGenstone::add_file(const QString &file) {
-    this->sequences[static_cast<std::size_t>(this->current_index())].paths.push_back(file);
+void BlueGenstone::on_openProjectButton_clicked()
+{
+    QStringList opened = this->open_file(QStringList() << "blue-genstone Project (*.bgsp)", false);
+    if(opened.size() != 1) {
+        return;
+    }
+
+    Project project;
+    QString error = project.load(opened[0]);
+    if(!error.isEmpty()) {
+        this->set_status(error);
+        return;
+    }
+
+    // What was known about the frames goes in first so it's there if they're generated before they're decoded again
+    for(auto frame = project.frames.constBegin(); frame != project.frames.constEnd(); frame++) {
+        this->frame_cache.remember(frame.key(), frame.value());
+    }
+
+    // There's always at least one sequence
+    if(project.sequences.empty()) {
+        project.sequences.emplace_back();
+    }
+    this->sequence_model.set_paths(project.sequences);
+    ui->sequenceComboBox->setCurrentIndex(0);
     this->update_sequence_interface();
-    //ui->bitmapList->setCurrentIndex(ui->bitmapList->model()->index(ui->bitmapList->model()->rowCount() - 1,0));
+    ui->dummySpaceColor->setText(project.dummy_space);
+    ui->outputTIFFPath->setText(project.output_path);
+
+    // Resetting the model doesn't say which rows were inserted, so start decoding them here
+    QStringList paths;
+    for(auto &sequence : project.sequences) {
+        paths.append(QStringList(sequence.begin(), sequence.end()));
+    }
+    this->frame_cache.prefetch(paths);
+    this->set_status(QString("(^)> Opened ") + opened[0] + ".");
+}
+
+void BlueGenstone::on_saveProjectButton_clicked()
+{
+    QStringList opened = this->open_file(QStringList() << "blue-genstone Project (*.bgsp)", false, true, "bgsp");
+    if(opened.size() != 1) {
+        return;
+    }
+
+    Project project;
+    project.sequences = this->sequence_model.paths();
+    project.dummy_space = ui->dummySpaceColor->text();
+    project.output_path = ui->outputTIFFPath->text();
+    for(auto &sequence : project.sequences) {
+        for(auto &path : sequence) {
+            FrameCache::Info info;
+            if(!project.frames.contains(path) && this->frame_cache.info(path, info)) {
+                project.frames.insert(path, info);
+            }
+        }
+    }
+
+    QString error = project.save(opened[0]);
+    this->set_status(error.isEmpty() ? QString("(^)> Saved ") + opened[0] + "." : error);
+}
+
+void BlueGenstone::add_files(const QStringList &files) {
+    this->sequence_model.add_paths(this->current_index(), -1, files);
+}
+
+void BlueGenstone::frames_inserted(const QModelIndex &parent, int first, int last) {
+    if(!parent.isValid()) {
+        return;
+    }
+
+    // Start decoding them now so generating doesn't have to
+    QStringList paths;
+    for(int row = first; row <= last; row++) {
+        paths.push_back(this->sequence_model.index(row, 0, parent).data().toString());
+    }
+    this->frame_cache.prefetch(paths);
 }
 
 void BlueGenstone::dragEnterEvent(QDragEnterEvent *event) {
@@ -310,7 +445,9 @@ void BlueGenstone::dragEnterEvent(QDragEnterEvent *event) {
 }
 
 void BlueGenstone::dropEvent(QDropEvent *event) {
+    QStringList files;
     for(auto &url : event->mimeData()->urls()) {
-        this->add_file(url.toLocalFile());
+        files.push_back(url.toLocalFile());
     }
+    this->add_files(files);
 }
@@ -1,7 +1,13 @@
 #ifndef BLUEGENSTONE_H
 #define BLUEGENSTONE_H
 
+#include <QDockWidget>
 #include <QMainWindow>
+#include "batchqueue.h"
+#include "framecache.h"
+#include "generator.h"
+#include "sequencemodel.h"
+#include "thumbnails.h"
 
 namespace Ui {
 class BlueGenstone;
@@ -34,31 +40,65 @@ private slots:
 
     void on_generateTIFFButton_clicked();
 
+    void on_queueButton_clicked();
+
     void on_dummySpaceColor_textChanged(const QString &arg1);
 
     void on_aboutButton_clicked();
 
-private:
-    struct Sequence {
-        std::vector<QString> paths;
-    };
+    void on_openProjectButton_clicked();
+
+    void on_saveProjectButton_clicked();
+
+    void on_cancelButton_clicked();
 
-    std::vector<Sequence> sequences;
+    void generation_progress(int stage, quint64 done, quint64 total);
+
+    void generation_finished(const GenerationResult &result);
+
+private:
+    SequenceModel sequence_model;
 
     Ui::BlueGenstone *ui;
 
     int current_index();
+    QModelIndex current_sequence();
     void add_sequence();
-    void delete_sequence(std::vector<Sequence>::difference_type sequence_index);
+    void delete_sequence(int sequence_index);
     void update_sequence_buttons();
     void update_sequence_interface();
 
-    QStringList open_file(const QStringList &valid_files, bool multiple, bool save = false);
+    // Rows selected in the bitmap list, from top to bottom
+    std::vector<int> selected_rows();
+    void select_rows(const std::vector<int> &rows);
+    void update_preview();
+
+    // Get the dummy space color that was typed in, if it's valid; if nothing was typed in, color is left alone
+    bool dummy_space_color(BlueGenPixel &color);
+
+    // Copy everything over into a job so the sequences can still be edited while it's generating; if something's
+    // missing, this says what and returns false
+    bool make_job(GenerationJob &job);
+
+    QStringList open_file(const QStringList &valid_files, bool multiple, bool save = false, const QString &default_suffix = "tif");
     QString *last_directory = nullptr;
 
     void set_status(const QString &status);
 
-    void add_file(const QString &file);
+    // Declared before the generator so it's still around until the generator stops
+    FrameCache frame_cache;
+    Generator generator;
+
+    // Plates generated in the background; it's deleted before the frame cache so its jobs stop first
+    QDockWidget *batch_dock;
+    BatchQueue *batch_queue;
+
+    ThumbnailCache thumbnails;
+    ThumbnailModel *thumbnail_model;
+    void set_generating(bool generating);
+
+    void add_files(const QStringList &files);
+    void frames_inserted(const QModelIndex &parent, int first, int last);
 
     void dragEnterEvent(QDragEnterEvent *event);
     void dropEvent(QDropEvent *event);
@@ -0,0 +1,214 @@
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "framecache.h"
+
+// Pixels handed to blue-gen are shared with the cache, so they're counted and freed by whoever lets go of them last;
+// the count goes right before the pixels, since blue-gen only gives the pixels back when it frees them
+struct SharedPixels {
+    std::atomic<int> references;
+};
+#define SHARED_PIXELS_OFFSET 16
+static_assert(sizeof(SharedPixels) <= SHARED_PIXELS_OFFSET, "the reference count has to fit before the pixels");
+
+static std::uint8_t *allocate_shared_pixels(std::size_t size) {
+    void *block = std::malloc(SHARED_PIXELS_OFFSET + size);
+    if(!block) {
+        throw std::bad_alloc();
+    }
+    new (block) SharedPixels { { 1 } };
+    return static_cast<std::uint8_t *>(block) + SHARED_PIXELS_OFFSET;
+}
+
+static SharedPixels *shared_pixels_of(void *pixels) {
+    return reinterpret_cast<SharedPixels *>(static_cast<std::uint8_t *>(pixels) - SHARED_PIXELS_OFFSET);
+}
+
+static void release_shared_pixels(void *pixels) {
+    SharedPixels *shared = shared_pixels_of(pixels);
+    if(shared->references.fetch_sub(1) == 1) {
+        shared->~SharedPixels();
+        std::free(shared);
+    }
+}
+
+FrameCache::Frame::~Frame() {
+    if(this->image.pixels) {
+        free_bluegen_image(&this->image);
+    }
+}
+
+FrameCache::FrameCache(int max_mib) :
+    frames(max_mib * 1024)
+{
+    // Leave a thread for the window and the thumbnails
+    this->pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+}
+
+FrameCache::~FrameCache()
+{
+    // Frames blue-gen is still using stay around until it lets go of them
+    this->pool.clear();
+    this->pool.waitForDone();
+}
+
+void FrameCache::prefetch(const QStringList &paths) {
+    QMutexLocker lock(&this->mutex);
+    for(auto &path : paths) {
+        // Files that failed to decode are tried again once they change
+        Frame *frame = this->frames.object(path);
+        if(frame && !frame->message.isEmpty()) {
+            QFileInfo info(path);
+            if(frame->modified != info.lastModified() || frame->size != info.size()) {
+                this->frames.remove(path);
+            }
+        }
+        if(this->frames.contains(path) || this->pending.contains(path)) {
+            continue;
+        }
+        this->pending.insert(path);
+        this->pool.start([this, path]() {
+            this->decode(path);
+        });
+    }
+}
+
+void FrameCache::clear() {
+    this->pool.clear();
+    QMutexLocker lock(&this->mutex);
+    this->frames.clear();
+    this->infos.clear();
+    this->pending.clear();
+}
+
+bool FrameCache::info(const QString &path, Info &info) {
+    QMutexLocker lock(&this->mutex);
+    auto found = this->infos.constFind(path);
+    if(found == this->infos.constEnd()) {
+        return false;
+    }
+    info = *found;
+    return true;
+}
+
+void FrameCache::remember(const QString &path, const Info &info) {
+    QMutexLocker lock(&this->mutex);
+    if(!this->infos.contains(path)) {
+        this->infos.insert(path, info);
+    }
+}
+
+QByteArray FrameCache::hash_file(const QString &path) {
+    QFile file(path);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if(!file.open(QIODevice::ReadOnly) || !hash.addData(&file)) {
+        return QByteArray();
+    }
+    return hash.result();
+}
+
+void FrameCache::decode(const QString &path) {
+    Frame *frame = nullptr;
+    Info info;
+    QFile file(path);
+    if(file.open(QIODevice::ReadOnly)) {
+        QFileInfo file_info(path);
+        frame = new Frame();
+        frame->modified = file_info.lastModified();
+        frame->size = file_info.size();
+
+        // Read it ourselves so it can be hashed on the way
+        QByteArray data = file.readAll();
+        BlueGenImage decoded;
+        BlueGenError error;
+        if(load_file_from_memory(&decoded, QFile::encodeName(path).constData(), reinterpret_cast<const std::uint8_t *>(data.constData()), static_cast<std::size_t>(data.size()), &error) != 0) {
+            frame->message = QFile::decodeName(error.message);
+            QMutexLocker lock(&this->mutex);
+            this->pending.remove(path);
+            this->frames.insert(path, frame, 1);
+            return;
+        }
+        info.modified = frame->modified;
+        info.size = frame->size;
+        info.width = decoded.width;
+        info.height = decoded.height;
+        info.format = decoded.format;
+        info.hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+        summarize_bluegen_image(&decoded, &info.colors);
+
+        std::size_t size = static_cast<std::size_t>(decoded.width) * decoded.height * decoded.format;
+        frame->image = decoded;
+        frame->image.pixels = allocate_shared_pixels(size);
+        frame->image.free = release_shared_pixels;
+        std::memcpy(frame->image.pixels, decoded.pixels, size);
+        free_bluegen_image(&decoded);
+    }
+
+    QMutexLocker lock(&this->mutex);
+    this->pending.remove(path);
+    if(frame) {
+        this->infos.insert(path, info);
+        std::size_t size = static_cast<std::size_t>(frame->image.width) * frame->image.height * frame->image.format;
+        this->frames.insert(path, frame, std::max(1, static_cast<int>(size / 1024)));
+    }
+}
+
+bool FrameCache::lookup(void *context, const char *path, BlueGenImage *image) {
+    FrameCache *cache = static_cast<FrameCache *>(context);
+    QString key = QFile::decodeName(path);
+    QFileInfo info(key);
+
+    QMutexLocker lock(&cache->mutex);
+    Frame *frame = cache->frames.object(key);
+    if(!frame) {
+        return false;
+    }
+
+    // It was changed after it was decoded, so it has to be decoded again
+    if(frame->modified != info.lastModified() || frame->size != info.size()) {
+        cache->frames.remove(key);
+        return false;
+    }
+
+    // It failed to decode, so let blue-gen decode it and report why
+    if(!frame->message.isEmpty()) {
+        return false;
+    }
+
+    shared_pixels_of(frame->image.pixels)->references.fetch_add(1);
+    *image = frame->image;
+    return true;
+}
+
+bool FrameCache::color_lookup(void *context, const char *path, BlueGenColorSummary *summary) {
+    FrameCache *cache = static_cast<FrameCache *>(context);
+    QString key = QFile::decodeName(path);
+    QFileInfo file_info(key);
+    Info info;
+    if(!cache->info(key, info)) {
+        return false;
+    }
+
+    // A file that was touched but still has the same contents, such as one that was checked out again, is still good;
+    // hashing it is still cheaper than scanning it
+    if(info.modified != file_info.lastModified() || info.size != file_info.size()) {
+        bool same = info.size == file_info.size() && !info.hash.isEmpty() && FrameCache::hash_file(key) == info.hash;
+        QMutexLocker lock(&cache->mutex);
+        if(!same) {
+            cache->infos.remove(key);
+            return false;
+        }
+        info.modified = file_info.lastModified();
+        cache->infos.insert(key, info);
+    }
+
+    *summary = info.colors;
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <cstdint>
+#include "scheduler.h"
+
+// Frames decoded in the background as soon as they're added, so generating only has to put them together and write
+// them; the least recently used frames are dropped once they take up too much memory, but what was learned about
+// them is kept
+class FrameCache
+{
+public:
+    // What's known about a file; the hash is of its contents, so a file that was only touched can still be trusted
+    struct Info {
+        QDateTime modified;
+        qint64 size = 0;
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        BlueGenPixelFormat format = BLUEGEN_FORMAT_RGBA;
+        QByteArray hash;
+        BlueGenColorSummary colors = {};
+    };
+
+    explicit FrameCache(int max_mib);
+    ~FrameCache();
+
+    // Start decoding files that aren't already decoded or being decoded
+    void prefetch(const QStringList &paths);
+
+    // Drop everything
+    void clear();
+
+    // Get what's known about a file, if it was decoded or remembered
+    bool info(const QString &path, Info &info);
+
+    // Remember what was known about a file from before, such as in a project, unless something newer is known
+    void remember(const QString &path, const Info &info);
+
+    // A BlueGenImageLookup; context is the cache
+    static bool lookup(void *context, const char *path, BlueGenImage *image);
+
+    // A BlueGenColorLookup; context is the cache
+    static bool color_lookup(void *context, const char *path, BlueGenColorSummary *summary);
+
+private:
+    // A decoded frame along with what the file looked like when it was decoded, so edited files aren't used; if it
+    // couldn't be decoded, there's no image, just why, so it isn't tried again until the file changes
+    struct Frame {
+        BlueGenImage image = {};
+        QDateTime modified;
+        qint64 size = 0;
+        QString message;
+        ~Frame();
+    };
+
+    QMutex mutex;
+    QCache<QString, Frame> frames;
+    QHash<QString, Info> infos;
+    QSet<QString> pending;
+    QThreadPool pool;
+
+    void decode(const QString &path);
+
+    static QByteArray hash_file(const QString &path);
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,159 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QByteArray>
+#include <QtConcurrent/QtConcurrent>
+#include "generator.h"
+#include "framecache.h"
+
+Generator::Generator(QObject *parent) :
+    QObject(parent),
+    cancelled(false),
+    session(open_bluegen_session()),
+    last_stage(-1),
+    last_permille(-1)
+{
+    connect(&this->watcher, &QFutureWatcher<GenerationResult>::finished, this, [this]() {
+        emit this->finished(this->watcher.result());
+    });
+}
+
+Generator::~Generator()
+{
+    // The worker thread uses our members, so it has to stop before we go away
+    this->cancel();
+    this->watcher.waitForFinished();
+    close_bluegen_session(this->session);
+}
+
+bool Generator::is_running() const {
+    return this->watcher.isRunning();
+}
+
+void Generator::start(const GenerationJob &job) {
+    if(this->is_running()) {
+        return;
+    }
+
+    this->cancelled = false;
+    this->last_stage = -1;
+    this->last_permille = -1;
+    this->watcher.setFuture(QtConcurrent::run([this, job]() {
+        return this->run(job);
+    }));
+}
+
+void Generator::cancel() {
+    this->cancelled = true;
+}
+
+bool Generator::report_progress(void *context, BlueGenProgressStage stage, std::uint64_t done, std::uint64_t total) {
+    Generator *generator = static_cast<Generator *>(context);
+
+    // blue-gen never calls this from two threads at once, so the last progress doesn't need a lock
+    int permille = total == 0 ? 1000 : static_cast<int>(done * 1000 / total);
+    if(static_cast<int>(stage) != generator->last_stage || permille != generator->last_permille) {
+        generator->last_stage = static_cast<int>(stage);
+        generator->last_permille = permille;
+        emit generator->progress(static_cast<int>(stage), done, total);
+    }
+
+    return !generator->cancelled;
+}
+
+QString Generator::check_paths(const std::vector<std::vector<QString>> &sequences) {
+    for(auto &sequence : sequences) {
+        for(auto &path : sequence) {
+            if(!QFileInfo(path).isReadable()) {
+                return QString("(v)> Failed to open ") + path + "!";
+            }
+            if(bluegen_file_type(QFile::encodeName(path).constData()) == BLUEGEN_FILE_UNKNOWN) {
+                return QString("(v)> Failed to open ") + path + "! Unknown file type...";
+            }
+        }
+    }
+    return QString();
+}
+
+QString Generator::progress_format(int stage) {
+    switch(stage) {
+        case BLUEGEN_PROGRESS_PROBE:
+            return "Reading headers... %p%";
+        case BLUEGEN_PROGRESS_DECODE:
+            return "Decoding... %p%";
+        case BLUEGEN_PROGRESS_WRITE:
+            return "Writing... %p%";
+    }
+    return "%p%";
+}
+
+bool Generator::parse_dummy_space(const QString &text, BlueGenPixel &color) {
+    if(text.size() == 0) {
+        return true;
+    }
+
+    bool valid;
+    unsigned int value = text.toUInt(&valid, 16);
+    if(!valid || text.size() != 6) {
+        return false;
+    }
+    color.red = static_cast<std::uint8_t>(value >> 16);
+    color.green = static_cast<std::uint8_t>(value >> 8);
+    color.blue = static_cast<std::uint8_t>(value);
+    return true;
+}
+
+GenerationResult Generator::run(const GenerationJob &job) {
+    GenerationResult result;
+    std::vector<QByteArray> paths;
+    for(auto &sequence : job.sequences) {
+        for(auto &path : sequence) {
+            paths.push_back(QFile::encodeName(path));
+        }
+    }
+
+    std::vector<const char *> path_pointers;
+    for(auto &path : paths) {
+        path_pointers.push_back(path.constData());
+    }
+
+    std::vector<BlueGenFileSequence> sequences;
+    std::size_t first_path = 0;
+    for(auto &sequence : job.sequences) {
+        BlueGenFileSequence file_sequence;
+        file_sequence.paths = path_pointers.data() + first_path;
+        file_sequence.path_count = sequence.size();
+        file_sequence.all_frames = false;
+        sequences.push_back(file_sequence);
+        first_path += sequence.size();
+    }
+
+    BlueGenScheduleOptions options = { job.threads, 0, BLUEGEN_READER_AUTO, false, Generator::report_progress, this, nullptr, nullptr, this->session, nullptr };
+    if(job.frames) {
+        options.lookup = FrameCache::lookup;
+        options.color_lookup = FrameCache::color_lookup;
+        options.lookup_context = job.frames;
+    }
+    QByteArray output_path = QFile::encodeName(job.output_path);
+    BlueGenImage output;
+    BlueGenError error;
+    int failed = generate_bluegen_image_from_files(sequences.data(), sequences.size(), &job.dummy_space, &options, &output, output_path.constData(), &error);
+
+    // If it was cancelled, blue-gen already freed the plate
+    if(output.pixels) {
+        free_bluegen_image(&output);
+    }
+
+    if(!failed) {
+        result.status = GenerationResult::Succeeded;
+        result.width = output.width;
+        result.height = output.height;
+        result.bitmap_count = paths.size();
+    }
+    else if(this->cancelled) {
+        result.status = GenerationResult::Cancelled;
+    }
+    else {
+        result.message = QFile::decodeName(error.message);
+    }
+    return result;
+}
@@ -0,0 +1,95 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <QObject>
+#include <QString>
+#include <QFutureWatcher>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "scheduler.h"
+
+class FrameCache;
+
+// Everything needed to make a color plate, copied so the sequences can be edited while it's being made
+struct GenerationJob {
+    std::vector<std::vector<QString>> sequences;
+    BlueGenPixel dummy_space = { 0x00, 0xFF, 0xFF, 0xFF };
+    QString output_path;
+
+    // Frames that were already decoded, if any; it has to outlive the generator
+    FrameCache *frames = nullptr;
+
+    // Number of threads to decode with; 0 uses one per CPU
+    unsigned int threads = 0;
+};
+
+struct GenerationResult {
+    enum Status {
+        Succeeded,
+        Cancelled,
+        Failed
+    };
+    Status status = Failed;
+
+    // Size of the color plate, if it was made
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+
+    // Number of files the plate was made from
+    std::size_t bitmap_count = 0;
+
+    // What went wrong, if it failed
+    QString message;
+};
+
+// Runs blue-gen on a worker thread so the window stays responsive, reporting progress as it goes
+class Generator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Generator(QObject *parent = nullptr);
+    ~Generator();
+
+    bool is_running() const;
+
+    // Start generating; does nothing if it's already running
+    void start(const GenerationJob &job);
+
+    // Stop as soon as possible; finished() is still emitted, with a status of Cancelled
+    void cancel();
+
+    // Check that every file can be opened and is a type blue-gen knows, without decoding any; returns what's wrong,
+    // or an empty string if nothing is
+    static QString check_paths(const std::vector<std::vector<QString>> &sequences);
+
+    // Progress bar format for a BlueGenProgressStage
+    static QString progress_format(int stage);
+
+    // Parse a dummy space color typed in as hex (i.e. 00FFFF); if it's empty, color is left alone
+    static bool parse_dummy_space(const QString &text, BlueGenPixel &color);
+
+signals:
+    // stage is a BlueGenProgressStage
+    void progress(int stage, quint64 done, quint64 total);
+    void finished(const GenerationResult &result);
+
+private:
+    QFutureWatcher<GenerationResult> watcher;
+    std::atomic<bool> cancelled;
+
+    // What was generated last time, so generating again after moving a few frames around only redoes what changed;
+    // only one job runs at a time, so it's never used by two at once
+    BlueGenSession *session;
+
+    // Last progress reported, so the window isn't flooded with one signal per file
+    int last_stage;
+    int last_permille;
+
+    GenerationResult run(const GenerationJob &job);
+    static bool report_progress(void *context, BlueGenProgressStage stage, std::uint64_t done, std::uint64_t total);
+};
+
+#endif // GENERATOR_H
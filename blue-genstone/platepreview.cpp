@@ -0,0 +1,469 @@
+#include <QFile>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QPixmap>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cmath>
+#include "platepreview.h"
+#include "generator.h"
+
+// Tiles are this many pixels across at whatever level they're drawn at
+#define TILE_SIZE 256
+
+// How much drawn tiles and decoded frames may take up, in KiB
+#define TILE_CACHE_KIB (64 * 1024)
+#define FRAME_CACHE_KIB (256 * 1024)
+
+// How far in and out the preview can zoom
+#define MIN_ZOOM (1.0 / 4096.0)
+#define MAX_ZOOM 32.0
+#define MAX_LEVEL 12
+
+static void free_wrapped_image(void *info) {
+    BlueGenImage *image = static_cast<BlueGenImage *>(info);
+    free_bluegen_image(image);
+    delete image;
+}
+
+// Wrap an RGBA image from blue-gen in a QImage without copying it; the QImage frees it when the last copy goes away
+static QImage wrap_image(const BlueGenImage &image) {
+    BlueGenImage *owned = new BlueGenImage(image);
+    if(image.width == 0 || image.height == 0) {
+        free_wrapped_image(owned);
+        return QImage();
+    }
+    return QImage(owned->pixels, static_cast<int>(owned->width), static_cast<int>(owned->height), static_cast<int>(owned->width * 4), QImage::Format_RGBA8888, free_wrapped_image, owned);
+}
+
+// Look at a wrapped image as a blue-gen image again, without copying it
+static BlueGenImage view_image(const QImage &image) {
+    BlueGenImage view;
+    view.pixels = const_cast<uint8_t *>(image.constBits());
+    view.format = BLUEGEN_FORMAT_RGBA;
+    view.width = static_cast<uint32_t>(image.width());
+    view.height = static_cast<uint32_t>(image.height());
+    view.free = nullptr;
+    return view;
+}
+
+static int image_cost(const QImage &image) {
+    return std::max(1, image.bytesPerLine() * image.height() / 1024);
+}
+
+// Size of something at a level, where each level is half the size of the last, rounded up
+static quint32 shrink(quint64 size, unsigned int level) {
+    return static_cast<quint32>((size + (1ull << level) - 1) >> level);
+}
+
+static quint64 tile_key(unsigned int level, quint32 tile_x, quint32 tile_y) {
+    return (static_cast<quint64>(level) << 58) | (static_cast<quint64>(tile_y) << 29) | tile_x;
+}
+
+PreviewFrameCache::PreviewFrameCache(int max_kib) :
+    images(max_kib)
+{
+}
+
+QImage PreviewFrameCache::get(const QString &path, unsigned int level) {
+    QString key = path + '\n' + QString::number(level);
+    {
+        QMutexLocker lock(&this->mutex);
+        QImage *cached = this->images.object(key);
+        if(cached) {
+            return *cached;
+        }
+    }
+
+    // Each level is made from the one before it, which is cached too, since zooming in and out goes through them all
+    QImage image;
+    if(level == 0) {
+        BlueGenImage decoded;
+        if(load_file(&decoded, QFile::encodeName(path).constData(), nullptr) != 0) {
+            image = QImage();
+        }
+        else if(decoded.format == BLUEGEN_FORMAT_RGBA) {
+            image = wrap_image(decoded);
+        }
+        else {
+            BlueGenImage expanded;
+            expand_bluegen_image(&decoded, &expanded);
+            free_bluegen_image(&decoded);
+            image = wrap_image(expanded);
+        }
+    }
+    else {
+        QImage larger = this->get(path, level - 1);
+        if(larger.isNull()) {
+            return larger;
+        }
+        BlueGenImage view = view_image(larger);
+        BlueGenImage halved;
+        halve_bluegen_image(&view, &halved);
+        image = wrap_image(halved);
+    }
+
+    QMutexLocker lock(&this->mutex);
+    this->images.insert(key, new QImage(image), image_cost(image));
+    return image;
+}
+
+void PreviewFrameCache::clear() {
+    QMutexLocker lock(&this->mutex);
+    this->images.clear();
+}
+
+PlatePreview::Plate::~Plate() {
+    free_bluegen_layout(&this->layout);
+}
+
+PlatePreview::PlatePreview(QWidget *parent) :
+    QAbstractScrollArea(parent),
+    frames(std::make_shared<PreviewFrameCache>(FRAME_CACHE_KIB)),
+    current_generation(std::make_shared<std::atomic<quint64>>(0)),
+    tiles(TILE_CACHE_KIB)
+{
+    this->layout_timer.setSingleShot(true);
+    this->layout_timer.setInterval(250);
+    connect(&this->layout_timer, &QTimer::timeout, this, &PlatePreview::lay_out);
+    this->viewport()->setBackgroundRole(QPalette::Dark);
+    this->viewport()->setAutoFillBackground(true);
+}
+
+PlatePreview::~PlatePreview()
+{
+    // Anything still running calls back into us, so it has to finish first
+    this->current_generation->store(++this->generation);
+    this->pool.clear();
+    this->pool.waitForDone();
+    this->layout_pool.waitForDone();
+}
+
+void PlatePreview::set_sequences(const std::vector<std::vector<QString>> &sequences, const BlueGenPixel &dummy_space) {
+    this->next_sequences = sequences;
+    this->next_dummy_space = dummy_space;
+    this->layout_timer.start();
+}
+
+// Stop laying out a plate once the sequences have changed again
+struct LayoutCheck {
+    std::shared_ptr<std::atomic<quint64>> current_generation;
+    quint64 generation;
+};
+
+static bool still_current(void *context, BlueGenProgressStage, std::uint64_t, std::uint64_t) {
+    const LayoutCheck *check = static_cast<const LayoutCheck *>(context);
+    return check->current_generation->load() == check->generation;
+}
+
+void PlatePreview::lay_out() {
+    this->current_generation->store(++this->generation);
+    this->pool.clear();
+    this->pending_tiles.clear();
+    this->tiles.clear();
+
+    bool have_bitmaps = false;
+    for(auto &sequence : this->next_sequences) {
+        have_bitmaps = have_bitmaps || !sequence.empty();
+    }
+    this->message = have_bitmaps ? Generator::check_paths(this->next_sequences) : QString();
+    if(!have_bitmaps || !this->message.isEmpty()) {
+        this->plate.reset();
+        this->update_scroll_bars();
+        this->viewport()->update();
+        return;
+    }
+
+    // Only the headers are read, so this is quick even with thousands of files
+    quint64 generation = this->generation;
+    auto current_generation = this->current_generation;
+    auto sequences = this->next_sequences;
+    BlueGenPixel dummy_space = this->next_dummy_space;
+    this->layout_pool.start([this, generation, current_generation, sequences, dummy_space]() {
+        std::vector<QByteArray> paths;
+        for(auto &sequence : sequences) {
+            for(auto &path : sequence) {
+                paths.push_back(QFile::encodeName(path));
+            }
+        }
+        std::vector<const char *> path_pointers;
+        for(auto &path : paths) {
+            path_pointers.push_back(path.constData());
+        }
+        std::vector<BlueGenFileSequence> file_sequences;
+        std::size_t first_path = 0;
+        for(auto &sequence : sequences) {
+            BlueGenFileSequence file_sequence;
+            file_sequence.paths = path_pointers.data() + first_path;
+            file_sequence.path_count = sequence.size();
+            file_sequence.all_frames = false;
+            file_sequences.push_back(file_sequence);
+            first_path += sequence.size();
+        }
+
+        LayoutCheck check = { current_generation, generation };
+        BlueGenScheduleOptions options = { 0, 0, BLUEGEN_READER_AUTO, false, still_current, &check, nullptr, nullptr, nullptr, nullptr };
+        auto plate = std::make_shared<Plate>();
+        plate->paths = sequences;
+        plate->dummy_space = dummy_space;
+        BlueGenError error;
+        if(layout_bluegen_files(file_sequences.data(), file_sequences.size(), &options, &plate->layout, nullptr, &error) != 0) {
+            // It's only cancelled if the sequences changed, in which case nobody wants to know
+            if(current_generation->load() != generation) {
+                return;
+            }
+            QString message = QFile::decodeName(error.message);
+            QMetaObject::invokeMethod(this, [this, generation, message]() {
+                this->layout_failed(generation, message);
+            }, Qt::QueuedConnection);
+            return;
+        }
+        QMetaObject::invokeMethod(this, [this, generation, plate]() {
+            this->plate_ready(generation, plate);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PlatePreview::plate_ready(quint64 generation, std::shared_ptr<const Plate> plate) {
+    if(generation != this->generation) {
+        return;
+    }
+
+    // Fit the whole plate in the first time there is one
+    bool first = !this->plate;
+    this->plate = plate;
+    if(first) {
+        QSize view = this->viewport()->size();
+        double fit = std::min(static_cast<double>(view.width()) / plate->layout.width, static_cast<double>(view.height()) / plate->layout.height);
+        this->zoom = std::max(MIN_ZOOM, std::min(1.0, fit));
+    }
+    this->update_scroll_bars();
+    this->viewport()->update();
+}
+
+void PlatePreview::layout_failed(quint64 generation, const QString &message) {
+    if(generation != this->generation) {
+        return;
+    }
+    this->message = message;
+    this->plate.reset();
+    this->update_scroll_bars();
+    this->viewport()->update();
+}
+
+void PlatePreview::tile_ready(quint64 generation, quint64 key, const QImage &tile) {
+    if(generation != this->generation) {
+        return;
+    }
+    this->pending_tiles.remove(key);
+    this->tiles.insert(key, new QImage(tile), image_cost(tile));
+    this->viewport()->update();
+}
+
+void PlatePreview::update_scroll_bars() {
+    QSize view = this->viewport()->size();
+    int width = this->plate ? static_cast<int>(std::ceil(this->plate->layout.width * this->zoom)) : 0;
+    int height = this->plate ? static_cast<int>(std::ceil(this->plate->layout.height * this->zoom)) : 0;
+    this->horizontalScrollBar()->setRange(0, std::max(0, width - view.width()));
+    this->horizontalScrollBar()->setPageStep(view.width());
+    this->horizontalScrollBar()->setSingleStep(std::max(1, view.width() / 10));
+    this->verticalScrollBar()->setRange(0, std::max(0, height - view.height()));
+    this->verticalScrollBar()->setPageStep(view.height());
+    this->verticalScrollBar()->setSingleStep(std::max(1, view.height() / 10));
+}
+
+void PlatePreview::set_zoom(double zoom, const QPointF &anchor) {
+    zoom = std::max(MIN_ZOOM, std::min(MAX_ZOOM, zoom));
+
+    // Keep whatever is under the anchor where it is
+    QPointF scroll(this->horizontalScrollBar()->value(), this->verticalScrollBar()->value());
+    QPointF plate_point = (anchor + scroll) / this->zoom;
+    this->zoom = zoom;
+    this->update_scroll_bars();
+    QPointF new_scroll = plate_point * zoom - anchor;
+    this->horizontalScrollBar()->setValue(static_cast<int>(new_scroll.x()));
+    this->verticalScrollBar()->setValue(static_cast<int>(new_scroll.y()));
+    this->viewport()->update();
+}
+
+unsigned int PlatePreview::level() const {
+    // Draw from the smallest level that's still at least as big as it is on screen
+    unsigned int level = 0;
+    while(level < MAX_LEVEL && this->zoom * (1 << (level + 1)) <= 1.0) {
+        level++;
+    }
+    return level;
+}
+
+void PlatePreview::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    this->update_scroll_bars();
+}
+
+void PlatePreview::wheelEvent(QWheelEvent *event) {
+    if(event->modifiers() & Qt::ControlModifier) {
+        this->set_zoom(this->zoom * std::pow(1.25, event->angleDelta().y() / 120.0), event->position());
+        event->accept();
+    }
+    else {
+        QAbstractScrollArea::wheelEvent(event);
+    }
+}
+
+void PlatePreview::scrollContentsBy(int, int) {
+    this->viewport()->update();
+}
+
+bool PlatePreview::draw_tile(QPainter &painter, unsigned int level, quint32 tile_x, quint32 tile_y, double scale, const QPointF &offset) {
+    QImage *tile = this->tiles.object(tile_key(level, tile_x, tile_y));
+    if(!tile) {
+        return false;
+    }
+    QRectF target(tile_x * TILE_SIZE * scale - offset.x(), tile_y * TILE_SIZE * scale - offset.y(), tile->width() * scale, tile->height() * scale);
+    painter.drawImage(target, *tile);
+    return true;
+}
+
+void PlatePreview::request_tile(unsigned int level, quint32 tile_x, quint32 tile_y) {
+    quint64 key = tile_key(level, tile_x, tile_y);
+    if(this->pending_tiles.contains(key)) {
+        return;
+    }
+    this->pending_tiles.insert(key);
+
+    std::shared_ptr<const Plate> plate = this->plate;
+    std::shared_ptr<PreviewFrameCache> frames = this->frames;
+    quint64 generation = this->generation;
+    auto current_generation = this->current_generation;
+    this->pool.start([this, plate, frames, generation, current_generation, key, level, tile_x, tile_y]() {
+        if(current_generation->load() != generation) {
+            return;
+        }
+        QImage tile = render_tile(*plate, *frames, level, tile_x, tile_y);
+        QMetaObject::invokeMethod(this, [this, generation, key, tile]() {
+            this->tile_ready(generation, key, tile);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PlatePreview::paintEvent(QPaintEvent *) {
+    QPainter painter(this->viewport());
+    if(!this->plate) {
+        painter.drawText(this->viewport()->rect(), Qt::AlignCenter | Qt::TextWordWrap, this->message);
+        return;
+    }
+
+    // Tiles for a level we've zoomed away from aren't needed anymore
+    unsigned int level = this->level();
+    if(level != this->last_level) {
+        this->pool.clear();
+        this->pending_tiles.clear();
+        this->last_level = level;
+    }
+
+    const BlueGenLayout &layout = this->plate->layout;
+    double scale = this->zoom * (1 << level);
+    QPointF offset(this->horizontalScrollBar()->value(), this->verticalScrollBar()->value());
+    quint32 level_width = shrink(layout.width, level);
+    quint32 level_height = shrink(layout.height, level);
+
+    // Show transparent pixels over a checkerboard
+    QPixmap checkers(16, 16);
+    checkers.fill(Qt::white);
+    {
+        QPainter checker_painter(&checkers);
+        checker_painter.fillRect(0, 0, 8, 8, QColor(204, 204, 204));
+        checker_painter.fillRect(8, 8, 8, 8, QColor(204, 204, 204));
+    }
+    painter.fillRect(QRectF(-offset, QSizeF(level_width * scale, level_height * scale)), QBrush(checkers));
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, scale < 1.0);
+
+    QRectF visible(offset, QSizeF(this->viewport()->size()));
+    quint32 first_x = static_cast<quint32>(visible.left() / scale / TILE_SIZE);
+    quint32 first_y = static_cast<quint32>(visible.top() / scale / TILE_SIZE);
+    quint32 last_x = std::min(static_cast<quint32>(visible.right() / scale / TILE_SIZE), (level_width - 1) / TILE_SIZE);
+    quint32 last_y = std::min(static_cast<quint32>(visible.bottom() / scale / TILE_SIZE), (level_height - 1) / TILE_SIZE);
+    for(quint32 tile_y = first_y; tile_y <= last_y; tile_y++) {
+        for(quint32 tile_x = first_x; tile_x <= last_x; tile_x++) {
+            if(this->draw_tile(painter, level, tile_x, tile_y, scale, offset)) {
+                continue;
+            }
+            this->request_tile(level, tile_x, tile_y);
+
+            // Stretch a coarser tile over it until it's drawn, if there is one
+            painter.save();
+            painter.setClipRect(QRectF(tile_x * TILE_SIZE * scale - offset.x(), tile_y * TILE_SIZE * scale - offset.y(), TILE_SIZE * scale, TILE_SIZE * scale));
+            for(unsigned int coarser = 1; coarser <= 4 && level + coarser <= MAX_LEVEL; coarser++) {
+                if(this->draw_tile(painter, level + coarser, tile_x >> coarser, tile_y >> coarser, scale * (1 << coarser), offset)) {
+                    break;
+                }
+            }
+            painter.restore();
+        }
+    }
+}
+
+QImage PlatePreview::render_tile(const Plate &plate, PreviewFrameCache &frames, unsigned int level, quint32 tile_x, quint32 tile_y) {
+    const BlueGenLayout &layout = plate.layout;
+    quint32 left = tile_x * TILE_SIZE;
+    quint32 top = tile_y * TILE_SIZE;
+    quint32 width = std::min<quint32>(TILE_SIZE, shrink(layout.width, level) - left);
+    quint32 height = std::min<quint32>(TILE_SIZE, shrink(layout.height, level) - top);
+
+    BlueGenImage pixels;
+    initialize_bluegen_image(&pixels, width, height, BLUEGEN_FORMAT_RGBA);
+    QImage tile = wrap_image(pixels);
+
+    // The separators are whatever blue-gen would pick if no bitmap used the usual colors
+    QColor blue(0x00, 0x00, 0xFF);
+    QColor magenta(0xFF, 0x00, 0xFF);
+    QColor dummy_space(plate.dummy_space.red, plate.dummy_space.green, plate.dummy_space.blue);
+
+    // Draw in level coordinates, copying frames as they are like blue-gen does rather than blending them
+    QPainter painter(&tile);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.translate(-static_cast<int>(left), -static_cast<int>(top));
+    painter.fillRect(QRect(static_cast<int>(left), static_cast<int>(top), static_cast<int>(width), static_cast<int>(height)), blue);
+    painter.fillRect(QRect(1 >> level, 0, 1, 1), magenta);
+    painter.fillRect(QRect(2 >> level, 0, 1, 1), dummy_space);
+
+    for(std::size_t b = 0; b < layout.band_count; b++) {
+        const BlueGenBand &band = layout.bands[b];
+        quint32 band_top = band.y >> level;
+        quint32 band_bottom = shrink(bluegen_band_end(&layout, b), level);
+        if(band_bottom <= top || band_top >= top + height) {
+            continue;
+        }
+        painter.fillRect(QRect(static_cast<int>(left), static_cast<int>(band_top), static_cast<int>(width), 1), magenta);
+
+        // Frames go from left to right, so skip straight to the first one that reaches the tile
+        const BlueGenRect *begin = band.frames;
+        const BlueGenRect *end = begin + band.frame_count;
+        const BlueGenRect *frame = std::lower_bound(begin, end, left, [level](const BlueGenRect &rect, quint32 x) {
+            return shrink(static_cast<quint64>(rect.x) + rect.width, level) <= x;
+        });
+        for(; frame < end && (frame->x >> level) < left + width; frame++) {
+            std::size_t index = static_cast<std::size_t>(frame - begin);
+            if(shrink(static_cast<quint64>(frame->y) + frame->height, level) <= top || index >= plate.paths[b].size()) {
+                continue;
+            }
+            QImage image = frames.get(plate.paths[b][index], level);
+            if(!image.isNull()) {
+                painter.drawImage(QPoint(static_cast<int>(frame->x >> level), static_cast<int>(frame->y >> level)), image);
+                continue;
+            }
+
+            // Frames that can't be decoded get a crossed out box, so the rest of the plate can still be previewed
+            QRect box(static_cast<int>(frame->x >> level), static_cast<int>(frame->y >> level), static_cast<int>(shrink(frame->width, level)), static_cast<int>(shrink(frame->height, level)));
+            painter.fillRect(box, QColor(128, 128, 128));
+            painter.setPen(QColor(64, 64, 64));
+            painter.drawRect(box.adjusted(0, 0, -1, -1));
+            painter.drawLine(box.topLeft(), box.bottomRight());
+            painter.drawLine(box.topRight(), box.bottomLeft());
+        }
+    }
+    painter.end();
+    return tile;
+}
@@ -0,0 +1,101 @@
+#ifndef PLATEPREVIEW_H
+#define PLATEPREVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "scheduler.h"
+
+// Frames decoded for the preview, along with each smaller mip of them that has been drawn; safe to use from any thread
+class PreviewFrameCache
+{
+public:
+    explicit PreviewFrameCache(int max_kib);
+
+    // Get a frame shrunk level times, decoding and shrinking it if it isn't cached; a frame that can't be decoded is
+    // a null image, which is cached too so it isn't tried again for every tile
+    QImage get(const QString &path, unsigned int level);
+
+    void clear();
+
+private:
+    QMutex mutex;
+    QCache<QString, QImage> images;
+};
+
+// Shows what the color plate will look like without making it, drawing only the tiles that can be seen at the zoom
+// level they're seen at
+class PlatePreview : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit PlatePreview(QWidget *parent = nullptr);
+    ~PlatePreview() override;
+
+    // Lay out the plate again after a short delay, so a burst of edits only lays it out once
+    void set_sequences(const std::vector<std::vector<QString>> &sequences, const BlueGenPixel &dummy_space);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+private:
+    // Everything a tile needs to be drawn, which stays the same until the sequences change
+    struct Plate {
+        BlueGenLayout layout;
+        std::vector<std::vector<QString>> paths;
+        BlueGenPixel dummy_space;
+        ~Plate();
+    };
+
+    std::shared_ptr<const Plate> plate;
+    std::shared_ptr<PreviewFrameCache> frames;
+
+    // Bumped whenever the sequences change, so anything started for the old ones is thrown away
+    quint64 generation = 0;
+    std::shared_ptr<std::atomic<quint64>> current_generation;
+
+    // Drawn tiles, and tiles being drawn
+    QCache<quint64, QImage> tiles;
+    QSet<quint64> pending_tiles;
+    QThreadPool pool;
+    unsigned int last_level = 0;
+
+    // Plates are laid out on their own pool so clearing tiles that aren't needed anymore can't drop them
+    QThreadPool layout_pool;
+
+    QTimer layout_timer;
+    std::vector<std::vector<QString>> next_sequences;
+    BlueGenPixel next_dummy_space = { 0x00, 0xFF, 0xFF, 0xFF };
+
+    // Shown instead of the plate if it can't be laid out
+    QString message;
+
+    // Size on screen of one pixel of the plate
+    double zoom = 1.0;
+
+    void lay_out();
+    void plate_ready(quint64 generation, std::shared_ptr<const Plate> plate);
+    void layout_failed(quint64 generation, const QString &message);
+    void tile_ready(quint64 generation, quint64 key, const QImage &tile);
+    void update_scroll_bars();
+    void set_zoom(double zoom, const QPointF &anchor);
+    unsigned int level() const;
+    bool draw_tile(QPainter &painter, unsigned int level, quint32 tile_x, quint32 tile_y, double scale, const QPointF &offset);
+    void request_tile(unsigned int level, quint32 tile_x, quint32 tile_y);
+
+    static QImage render_tile(const Plate &plate, PreviewFrameCache &frames, unsigned int level, quint32 tile_x, quint32 tile_y);
+};
+
+#endif // PLATEPREVIEW_H
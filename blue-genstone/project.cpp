@@ -0,0 +1,125 @@
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include "project.h"
+
+// Project files start with this, then the version, then everything else compressed
+#define PROJECT_MAGIC 0x42475350
+#define PROJECT_VERSION 1
+
+// Bits of the color summary
+#define PROJECT_TRANSLUCENT 1
+#define PROJECT_BLUE 2
+#define PROJECT_MAGENTA 4
+
+QString Project::save(const QString &path) const {
+    QDir directory = QFileInfo(path).absoluteDir();
+
+    QByteArray body;
+    QDataStream stream(&body, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << this->dummy_space;
+    stream << (this->output_path.isEmpty() ? QString() : directory.relativeFilePath(this->output_path));
+    stream << static_cast<quint32>(this->sequences.size());
+    for(auto &sequence : this->sequences) {
+        stream << static_cast<quint32>(sequence.size());
+        for(auto &frame : sequence) {
+            stream << directory.relativeFilePath(frame);
+        }
+    }
+
+    // Each file is only saved once, even if it's in more than one sequence
+    stream << static_cast<quint32>(this->frames.size());
+    for(auto frame = this->frames.constBegin(); frame != this->frames.constEnd(); frame++) {
+        const FrameCache::Info &info = frame.value();
+        quint8 colors = (info.colors.translucent ? PROJECT_TRANSLUCENT : 0) | (info.colors.blue ? PROJECT_BLUE : 0) | (info.colors.magenta ? PROJECT_MAGENTA : 0);
+        stream << directory.relativeFilePath(frame.key()) << info.modified.toMSecsSinceEpoch() << info.size;
+        stream << info.width << info.height << static_cast<quint8>(info.format) << info.hash << colors;
+    }
+
+    // Write it somewhere else first so a failed save doesn't take the old project with it
+    QSaveFile file(path);
+    if(!file.open(QIODevice::WriteOnly)) {
+        return QString("(v)> Failed to open ") + path + "!";
+    }
+    QDataStream header(&file);
+    header.setVersion(QDataStream::Qt_6_0);
+    header << static_cast<quint32>(PROJECT_MAGIC) << static_cast<quint32>(PROJECT_VERSION) << qCompress(body);
+    if(header.status() != QDataStream::Ok || !file.commit()) {
+        return QString("(v)> Failed to write ") + path + "!";
+    }
+    return QString();
+}
+
+QString Project::load(const QString &path) {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) {
+        return QString("(v)> Failed to open ") + path + "!";
+    }
+
+    QDataStream header(&file);
+    header.setVersion(QDataStream::Qt_6_0);
+    quint32 magic, version;
+    QByteArray compressed;
+    header >> magic >> version;
+    if(header.status() != QDataStream::Ok || magic != PROJECT_MAGIC) {
+        return QString("(v)> ") + path + " isn't a blue-genstone project.";
+    }
+    if(version != PROJECT_VERSION) {
+        return QString("(v)> ") + path + " was saved by a different version of blue-genstone.";
+    }
+    header >> compressed;
+    QByteArray body = qUncompress(compressed);
+
+    QDir directory = QFileInfo(path).absoluteDir();
+    QDataStream stream(&body, QIODevice::ReadOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    Project project;
+    QString output_path;
+    quint32 sequence_count;
+    stream >> project.dummy_space >> output_path >> sequence_count;
+    if(!output_path.isEmpty()) {
+        project.output_path = QDir::cleanPath(directory.absoluteFilePath(output_path));
+    }
+
+    // Counts are checked against what's left so a broken file can't make us allocate everything
+    for(quint32 s = 0; s < sequence_count && stream.status() == QDataStream::Ok; s++) {
+        quint32 frame_count;
+        stream >> frame_count;
+        if(static_cast<qsizetype>(frame_count) > body.size()) {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+        std::vector<QString> sequence;
+        for(quint32 f = 0; f < frame_count && stream.status() == QDataStream::Ok; f++) {
+            QString frame;
+            stream >> frame;
+            sequence.push_back(QDir::cleanPath(directory.absoluteFilePath(frame)));
+        }
+        project.sequences.push_back(sequence);
+    }
+
+    quint32 info_count = 0;
+    stream >> info_count;
+    for(quint32 i = 0; i < info_count && stream.status() == QDataStream::Ok; i++) {
+        QString frame;
+        qint64 modified;
+        quint8 format, colors;
+        FrameCache::Info info;
+        stream >> frame >> modified >> info.size >> info.width >> info.height >> format >> info.hash >> colors;
+        info.modified = QDateTime::fromMSecsSinceEpoch(modified);
+        info.format = static_cast<BlueGenPixelFormat>(format);
+        info.colors.translucent = colors & PROJECT_TRANSLUCENT;
+        info.colors.blue = colors & PROJECT_BLUE;
+        info.colors.magenta = colors & PROJECT_MAGENTA;
+        project.frames.insert(QDir::cleanPath(directory.absoluteFilePath(frame)), info);
+    }
+
+    if(body.isEmpty() || stream.status() != QDataStream::Ok) {
+        return QString("(v)> ") + path + " is damaged.";
+    }
+    *this = project;
+    return QString();
+}
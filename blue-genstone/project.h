@@ -0,0 +1,25 @@
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include <QHash>
+#include <QString>
+#include <vector>
+#include "framecache.h"
+
+// Project files hold everything typed into the window, along with what's known about each frame, so a big project
+// can be opened again without having to look at every file before it's generated
+struct Project {
+    std::vector<std::vector<QString>> sequences;
+    QString dummy_space;
+    QString output_path;
+
+    // What's known about each file, by path; files that weren't decoded yet are left out
+    QHash<QString, FrameCache::Info> frames;
+
+    // Paths are saved relative to the project so it can be moved along with its files; these return what went wrong,
+    // or an empty string if nothing did
+    QString save(const QString &path) const;
+    QString load(const QString &path);
+};
+
+#endif // PROJECT_H
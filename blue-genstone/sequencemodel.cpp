@@ -0,0 +1,259 @@
+#include <QDataStream>
+#include <QMimeData>
+#include <QUrl>
+#include <algorithm>
+#include "sequencemodel.h"
+
+// Frames dragged around inside the bitmap list
+#define FRAME_MIME_TYPE "application/x-blue-genstone-frames"
+
+SequenceModel::SequenceModel(QObject *parent) :
+    QAbstractItemModel(parent)
+{
+}
+
+std::vector<std::vector<QString>> SequenceModel::paths() const {
+    std::vector<std::vector<QString>> paths;
+    paths.reserve(this->sequences.size());
+    for(auto &sequence : this->sequences) {
+        paths.push_back(sequence->paths);
+    }
+    return paths;
+}
+
+bool SequenceModel::has_bitmaps() const {
+    for(auto &sequence : this->sequences) {
+        if(!sequence->paths.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SequenceModel::add_sequence() {
+    int row = static_cast<int>(this->sequences.size());
+    this->beginInsertRows(QModelIndex(), row, row);
+    this->sequences.emplace_back(new Sequence());
+    this->sequences.back()->row = row;
+    this->endInsertRows();
+}
+
+void SequenceModel::add_paths(int sequence, int row, const QStringList &paths) {
+    if(paths.isEmpty() || sequence < 0 || static_cast<std::size_t>(sequence) >= this->sequences.size()) {
+        return;
+    }
+
+    auto &frames = this->sequences[static_cast<std::size_t>(sequence)]->paths;
+    if(row < 0 || static_cast<std::size_t>(row) > frames.size()) {
+        row = static_cast<int>(frames.size());
+    }
+
+    // Insert everything at once so dropping thousands of files is one update
+    this->beginInsertRows(this->index(sequence, 0), row, row + static_cast<int>(paths.size()) - 1);
+    frames.insert(frames.begin() + row, paths.begin(), paths.end());
+    this->endInsertRows();
+}
+
+void SequenceModel::set_paths(const std::vector<std::vector<QString>> &paths) {
+    this->beginResetModel();
+    this->sequences.clear();
+    for(auto &frames : paths) {
+        this->sequences.emplace_back(new Sequence());
+        this->sequences.back()->paths = frames;
+        this->sequences.back()->row = static_cast<int>(this->sequences.size()) - 1;
+    }
+    this->endResetModel();
+}
+
+SequenceModel::Sequence *SequenceModel::sequence_of(const QModelIndex &parent) const {
+    if(!parent.isValid() || parent.internalPointer() || static_cast<std::size_t>(parent.row()) >= this->sequences.size()) {
+        return nullptr;
+    }
+    return this->sequences[static_cast<std::size_t>(parent.row())].get();
+}
+
+void SequenceModel::renumber(int first) {
+    for(std::size_t s = static_cast<std::size_t>(first); s < this->sequences.size(); s++) {
+        this->sequences[s]->row = static_cast<int>(s);
+    }
+
+    // Sequences are named after their row, so the ones after it have new names
+    if(static_cast<std::size_t>(first) < this->sequences.size()) {
+        emit this->dataChanged(this->index(first, 0), this->index(static_cast<int>(this->sequences.size()) - 1, 0), { Qt::DisplayRole });
+    }
+}
+
+QModelIndex SequenceModel::index(int row, int column, const QModelIndex &parent) const {
+    if(row < 0 || column != 0) {
+        return QModelIndex();
+    }
+
+    // Sequences have no internal pointer, and frames point to their sequence
+    if(!parent.isValid()) {
+        return static_cast<std::size_t>(row) < this->sequences.size() ? this->createIndex(row, column) : QModelIndex();
+    }
+    Sequence *sequence = this->sequence_of(parent);
+    if(!sequence || static_cast<std::size_t>(row) >= sequence->paths.size()) {
+        return QModelIndex();
+    }
+    return this->createIndex(row, column, sequence);
+}
+
+QModelIndex SequenceModel::parent(const QModelIndex &index) const {
+    const Sequence *sequence = index.isValid() ? static_cast<const Sequence *>(index.internalPointer()) : nullptr;
+    return sequence ? this->createIndex(sequence->row, 0) : QModelIndex();
+}
+
+int SequenceModel::rowCount(const QModelIndex &parent) const {
+    if(!parent.isValid()) {
+        return static_cast<int>(this->sequences.size());
+    }
+    Sequence *sequence = this->sequence_of(parent);
+    return sequence ? static_cast<int>(sequence->paths.size()) : 0;
+}
+
+int SequenceModel::columnCount(const QModelIndex &) const {
+    return 1;
+}
+
+QVariant SequenceModel::data(const QModelIndex &index, int role) const {
+    if(!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole)) {
+        return QVariant();
+    }
+
+    // The sequence names are basically just Sequence #0, Sequence #1, etc.
+    const Sequence *sequence = static_cast<const Sequence *>(index.internalPointer());
+    if(!sequence) {
+        return QString("Sequence #") + QString::number(index.row());
+    }
+    return sequence->paths[static_cast<std::size_t>(index.row())];
+}
+
+Qt::ItemFlags SequenceModel::flags(const QModelIndex &index) const {
+    if(!index.isValid()) {
+        return Qt::NoItemFlags;
+    }
+    else if(!index.internalPointer()) {
+        return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsDropEnabled;
+    }
+    else {
+        return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsDragEnabled | Qt::ItemNeverHasChildren;
+    }
+}
+
+bool SequenceModel::removeRows(int row, int count, const QModelIndex &parent) {
+    if(row < 0 || count <= 0) {
+        return false;
+    }
+
+    if(!parent.isValid()) {
+        if(static_cast<std::size_t>(row + count) > this->sequences.size()) {
+            return false;
+        }
+        this->beginRemoveRows(parent, row, row + count - 1);
+        this->sequences.erase(this->sequences.begin() + row, this->sequences.begin() + row + count);
+        this->endRemoveRows();
+        this->renumber(row);
+        return true;
+    }
+
+    Sequence *sequence = this->sequence_of(parent);
+    if(!sequence || static_cast<std::size_t>(row + count) > sequence->paths.size()) {
+        return false;
+    }
+    this->beginRemoveRows(parent, row, row + count - 1);
+    sequence->paths.erase(sequence->paths.begin() + row, sequence->paths.begin() + row + count);
+    this->endRemoveRows();
+    return true;
+}
+
+bool SequenceModel::moveRows(const QModelIndex &source_parent, int source_row, int count, const QModelIndex &destination_parent, int destination_child) {
+    // Only frames can be moved, but they can be moved to another sequence
+    Sequence *source = this->sequence_of(source_parent);
+    Sequence *destination = this->sequence_of(destination_parent);
+    if(!source || !destination || source_row < 0 || count <= 0 || static_cast<std::size_t>(source_row + count) > source->paths.size() || destination_child < 0 || static_cast<std::size_t>(destination_child) > destination->paths.size()) {
+        return false;
+    }
+
+    // This fails if the rows would end up where they already are
+    if(!this->beginMoveRows(source_parent, source_row, source_row + count - 1, destination_parent, destination_child)) {
+        return false;
+    }
+    std::vector<QString> moved(source->paths.begin() + source_row, source->paths.begin() + source_row + count);
+    source->paths.erase(source->paths.begin() + source_row, source->paths.begin() + source_row + count);
+    if(source == destination && destination_child > source_row) {
+        destination_child -= count;
+    }
+    destination->paths.insert(destination->paths.begin() + destination_child, moved.begin(), moved.end());
+    this->endMoveRows();
+    return true;
+}
+
+Qt::DropActions SequenceModel::supportedDropActions() const {
+    return Qt::MoveAction | Qt::CopyAction;
+}
+
+QStringList SequenceModel::mimeTypes() const {
+    return QStringList() << FRAME_MIME_TYPE << "text/uri-list";
+}
+
+QMimeData *SequenceModel::mimeData(const QModelIndexList &indexes) const {
+    // Keep them in the order they're in rather than the order they were selected in
+    QModelIndexList frames;
+    for(auto &index : indexes) {
+        if(index.isValid() && index.internalPointer()) {
+            frames.push_back(index);
+        }
+    }
+    std::sort(frames.begin(), frames.end());
+
+    QStringList paths;
+    for(auto &index : frames) {
+        paths.push_back(this->data(index).toString());
+    }
+
+    QByteArray encoded;
+    QDataStream stream(&encoded, QIODevice::WriteOnly);
+    stream << paths;
+
+    QMimeData *data = new QMimeData();
+    data->setData(FRAME_MIME_TYPE, encoded);
+    return data;
+}
+
+bool SequenceModel::dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int, const QModelIndex &parent) {
+    if(action == Qt::IgnoreAction) {
+        return true;
+    }
+
+    // Dropping onto a frame puts them before it
+    QModelIndex sequence = parent;
+    if(sequence.isValid() && sequence.internalPointer()) {
+        row = sequence.row();
+        sequence = sequence.parent();
+    }
+    if(!this->sequence_of(sequence)) {
+        return false;
+    }
+
+    // Frames dragged from the list are copied here, and the list then removes the originals if they were moved
+    QStringList paths;
+    if(data->hasFormat(FRAME_MIME_TYPE)) {
+        QByteArray encoded = data->data(FRAME_MIME_TYPE);
+        QDataStream stream(&encoded, QIODevice::ReadOnly);
+        stream >> paths;
+    }
+    else if(data->hasUrls()) {
+        for(auto &url : data->urls()) {
+            if(url.isLocalFile()) {
+                paths.push_back(url.toLocalFile());
+            }
+        }
+    }
+    if(paths.isEmpty()) {
+        return false;
+    }
+
+    this->add_paths(sequence.row(), row, paths);
+    return true;
+}
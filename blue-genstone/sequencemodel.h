@@ -0,0 +1,58 @@
+#ifndef SEQUENCEMODEL_H
+#define SEQUENCEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <vector>
+
+// Every sequence and the frames in it, as a tree with sequences at the top and the paths of their frames under them;
+// edits emit only the rows they touch, so views never have to be rebuilt
+class SequenceModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    explicit SequenceModel(QObject *parent = nullptr);
+
+    // Copy the paths out, one list per sequence, for handing to blue-gen
+    std::vector<std::vector<QString>> paths() const;
+    bool has_bitmaps() const;
+
+    void add_sequence();
+
+    // Insert paths into a sequence before the given row, or at the end if row is -1
+    void add_paths(int sequence, int row, const QStringList &paths);
+
+    // Replace every sequence at once, such as when opening a project
+    void set_paths(const std::vector<std::vector<QString>> &paths);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &index) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool moveRows(const QModelIndex &source_parent, int source_row, int count, const QModelIndex &destination_parent, int destination_child) override;
+
+    Qt::DropActions supportedDropActions() const override;
+    QStringList mimeTypes() const override;
+    QMimeData *mimeData(const QModelIndexList &indexes) const override;
+    bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent) override;
+
+private:
+    // Frames point back to their sequence, which keeps its own row so finding a frame's parent doesn't need a search
+    struct Sequence {
+        std::vector<QString> paths;
+        int row;
+    };
+    std::vector<std::unique_ptr<Sequence>> sequences;
+
+    Sequence *sequence_of(const QModelIndex &parent) const;
+    void renumber(int first);
+};
+
+#endif // SEQUENCEMODEL_H
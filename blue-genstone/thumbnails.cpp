@@ -0,0 +1,246 @@
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QPixmap>
+#include <QStandardPaths>
+#include <algorithm>
+#include "thumbnails.h"
+
+// How much thumbnails may take up in memory, in KiB; the disk cache isn't limited
+#define THUMBNAIL_CACHE_KIB (32 * 1024)
+
+static const char *format_name(BlueGenPixelFormat format) {
+    switch(format) {
+        case BLUEGEN_FORMAT_GRAY:
+            return "Gray";
+        case BLUEGEN_FORMAT_GRAY_ALPHA:
+            return "Gray + alpha";
+        case BLUEGEN_FORMAT_RGB:
+            return "RGB";
+        case BLUEGEN_FORMAT_RGBA:
+            return "RGBA";
+    }
+    return "?";
+}
+
+static int thumbnail_cost(const Thumbnail &thumbnail) {
+    return std::max(1, thumbnail.image.bytesPerLine() * thumbnail.image.height() / 1024);
+}
+
+// Where a thumbnail of this version of the file goes in the disk cache, or an empty string if there's nowhere to put it
+static QString disk_path(const QString &path) {
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if(directory.isEmpty()) {
+        return QString();
+    }
+    directory += "/thumbnails";
+    if(!QDir().mkpath(directory)) {
+        return QString();
+    }
+
+    // Editing the file changes its modification time or size, so old thumbnails are never found again
+    QFileInfo info(path);
+    QString key = info.absoluteFilePath() + '\n' + QString::number(info.lastModified().toMSecsSinceEpoch()) + '\n' + QString::number(info.size()) + '\n' + QString::number(THUMBNAIL_SIZE);
+    return directory + '/' + QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex() + ".png";
+}
+
+ThumbnailCache::ThumbnailCache(QObject *parent) :
+    QObject(parent),
+    thumbnails(THUMBNAIL_CACHE_KIB)
+{
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    // Anything still running calls back into us, so it has to finish first
+    this->pool.clear();
+    this->pool.waitForDone();
+}
+
+const Thumbnail *ThumbnailCache::get(const QString &path) {
+    Thumbnail *thumbnail = this->thumbnails.object(path);
+    if(thumbnail || this->pending.contains(path)) {
+        return thumbnail;
+    }
+
+    this->pending.insert(path);
+    this->pool.start([this, path]() {
+        Thumbnail thumbnail = make_thumbnail(path);
+        QMetaObject::invokeMethod(this, [this, path, thumbnail]() {
+            this->finished(path, thumbnail);
+        }, Qt::QueuedConnection);
+    });
+    return nullptr;
+}
+
+void ThumbnailCache::finished(const QString &path, const Thumbnail &thumbnail) {
+    this->pending.remove(path);
+
+    // Pixmaps can only be made on the GUI thread
+    Thumbnail *ready = new Thumbnail(thumbnail);
+    if(!ready->image.isNull()) {
+        ready->icon = QIcon(QPixmap::fromImage(ready->image));
+    }
+    this->thumbnails.insert(path, ready, thumbnail_cost(*ready));
+    emit this->thumbnail_ready(path);
+}
+
+Thumbnail ThumbnailCache::make_thumbnail(const QString &path) {
+    Thumbnail thumbnail;
+
+    QString cached_path = disk_path(path);
+    if(!cached_path.isEmpty() && QFile::exists(cached_path)) {
+        QImageReader reader(cached_path);
+        QImage image = reader.read();
+        if(!image.isNull()) {
+            thumbnail.image = image;
+            thumbnail.width = image.text("Width").toUInt();
+            thumbnail.height = image.text("Height").toUInt();
+            thumbnail.format = static_cast<BlueGenPixelFormat>(image.text("Format").toInt());
+            return thumbnail;
+        }
+    }
+
+    BlueGenImage image;
+    BlueGenError error;
+    if(load_file(&image, QFile::encodeName(path).constData(), &error) != 0) {
+        thumbnail.message = QFile::decodeName(error.message);
+        return thumbnail;
+    }
+    thumbnail.width = image.width;
+    thumbnail.height = image.height;
+    thumbnail.format = image.format;
+
+    // Halve it until it's close, which is much faster on big frames than scaling it down in one go
+    while(image.width > THUMBNAIL_SIZE * 2 || image.height > THUMBNAIL_SIZE * 2) {
+        BlueGenImage halved;
+        halve_bluegen_image(&image, &halved);
+        free_bluegen_image(&image);
+        image = halved;
+    }
+    if(image.format != BLUEGEN_FORMAT_RGBA) {
+        BlueGenImage expanded;
+        expand_bluegen_image(&image, &expanded);
+        free_bluegen_image(&image);
+        image = expanded;
+    }
+
+    if(image.width > 0 && image.height > 0) {
+        QImage view(image.pixels, static_cast<int>(image.width), static_cast<int>(image.height), static_cast<int>(image.width * 4), QImage::Format_RGBA8888);
+        if(image.width > THUMBNAIL_SIZE || image.height > THUMBNAIL_SIZE) {
+            thumbnail.image = view.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        else {
+            thumbnail.image = view.copy();
+        }
+    }
+    free_bluegen_image(&image);
+
+    // Failing to write the disk cache just means decoding it again next time
+    if(!cached_path.isEmpty() && !thumbnail.image.isNull()) {
+        QImage saved = thumbnail.image;
+        saved.setText("Width", QString::number(thumbnail.width));
+        saved.setText("Height", QString::number(thumbnail.height));
+        saved.setText("Format", QString::number(static_cast<int>(thumbnail.format)));
+        saved.save(cached_path, "PNG");
+    }
+    return thumbnail;
+}
+
+ThumbnailModel::ThumbnailModel(ThumbnailCache *cache, QObject *parent) :
+    QIdentityProxyModel(parent),
+    cache(cache)
+{
+    connect(cache, &ThumbnailCache::thumbnail_ready, this, &ThumbnailModel::thumbnail_ready);
+    connect(this, &QAbstractItemModel::rowsInserted, this, &ThumbnailModel::add_rows);
+    connect(this, &QAbstractItemModel::rowsAboutToBeRemoved, this, &ThumbnailModel::remove_rows);
+    connect(this, &QAbstractItemModel::modelReset, this, &ThumbnailModel::reset_rows);
+}
+
+QVariant ThumbnailModel::data(const QModelIndex &index, int role) const {
+    // Only frames have thumbnails, not the sequences they're in
+    if(!index.parent().isValid() || (role != Qt::DisplayRole && role != Qt::DecorationRole && role != Qt::ToolTipRole)) {
+        return QIdentityProxyModel::data(index, role);
+    }
+
+    QString path = this->path_of(index);
+    if(role == Qt::ToolTipRole) {
+        return path;
+    }
+
+    // Rows are only asked for when they're shown, so only those get decoded
+    const Thumbnail *thumbnail = this->cache->get(path);
+    if(role == Qt::DecorationRole) {
+        // Always give an icon, even an empty one, so every row is as tall as the icon size
+        return thumbnail ? thumbnail->icon : QIcon();
+    }
+
+    if(!thumbnail) {
+        return path + "\nLoading...";
+    }
+    else if(!thumbnail->message.isEmpty()) {
+        return path + '\n' + thumbnail->message;
+    }
+    else {
+        return path + '\n' + QString("%1x%2 %3").arg(thumbnail->width).arg(thumbnail->height).arg(format_name(thumbnail->format));
+    }
+}
+
+QString ThumbnailModel::path_of(const QModelIndex &index) const {
+    return QIdentityProxyModel::data(index, Qt::DisplayRole).toString();
+}
+
+void ThumbnailModel::add_rows(const QModelIndex &parent, int first, int last) {
+    for(int row = first; row <= last; row++) {
+        QModelIndex index = this->index(row, 0, parent);
+
+        // A sequence brings whatever frames are already in it
+        if(!parent.isValid()) {
+            int frames = this->rowCount(index);
+            if(frames > 0) {
+                this->add_rows(index, 0, frames - 1);
+            }
+            continue;
+        }
+        this->rows[this->path_of(index)].append(QPersistentModelIndex(index));
+    }
+}
+
+void ThumbnailModel::remove_rows(const QModelIndex &parent, int first, int last) {
+    for(int row = first; row <= last; row++) {
+        QModelIndex index = this->index(row, 0, parent);
+        if(!parent.isValid()) {
+            int frames = this->rowCount(index);
+            if(frames > 0) {
+                this->remove_rows(index, 0, frames - 1);
+            }
+            continue;
+        }
+        QString path = this->path_of(index);
+        QList<QPersistentModelIndex> &indexes = this->rows[path];
+        indexes.removeAll(QPersistentModelIndex(index));
+        if(indexes.isEmpty()) {
+            this->rows.remove(path);
+        }
+    }
+}
+
+void ThumbnailModel::reset_rows() {
+    this->rows.clear();
+    int sequences = this->rowCount();
+    if(sequences > 0) {
+        this->add_rows(QModelIndex(), 0, sequences - 1);
+    }
+}
+
+void ThumbnailModel::thumbnail_ready(const QString &path) {
+    // The same file can be in more than one sequence
+    for(auto &index : this->rows.value(path)) {
+        if(index.isValid()) {
+            emit this->dataChanged(index, index, { Qt::DisplayRole, Qt::DecorationRole });
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+
+#include <QCache>
+#include <QHash>
+#include <QIcon>
+#include <QIdentityProxyModel>
+#include <QImage>
+#include <QList>
+#include <QObject>
+#include <QPersistentModelIndex>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <cstdint>
+#include "scheduler.h"
+
+// Thumbnails are at most this many pixels across
+#define THUMBNAIL_SIZE 48
+
+struct Thumbnail {
+    QImage image;
+    QIcon icon;
+
+    // Size and format of the whole file, as blue-gen will see it
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    BlueGenPixelFormat format = BLUEGEN_FORMAT_RGBA;
+
+    // Set if the file can't be read, in which case there is no image
+    QString message;
+};
+
+// Decodes thumbnails on a thread pool, keeping them in memory and on disk so they only have to be decoded once per
+// version of a file
+class ThumbnailCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ThumbnailCache(QObject *parent = nullptr);
+    ~ThumbnailCache() override;
+
+    // Get a thumbnail if it's ready; if not, it's queued and thumbnail_ready() is emitted once it is
+    const Thumbnail *get(const QString &path);
+
+signals:
+    void thumbnail_ready(const QString &path);
+
+private:
+    QCache<QString, Thumbnail> thumbnails;
+    QSet<QString> pending;
+    QThreadPool pool;
+
+    void finished(const QString &path, const Thumbnail &thumbnail);
+
+    static Thumbnail make_thumbnail(const QString &path);
+};
+
+// Adds thumbnails, dimensions and formats to the frames of a SequenceModel, filling them in as they're decoded
+class ThumbnailModel : public QIdentityProxyModel
+{
+    Q_OBJECT
+
+public:
+    explicit ThumbnailModel(ThumbnailCache *cache, QObject *parent = nullptr);
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private:
+    ThumbnailCache *cache;
+
+    // Rows showing each file, so a thumbnail being ready only updates those; they're persistent so they follow rows
+    // that move
+    QHash<QString, QList<QPersistentModelIndex>> rows;
+
+    QString path_of(const QModelIndex &index) const;
+    void add_rows(const QModelIndex &parent, int first, int last);
+    void remove_rows(const QModelIndex &parent, int first, int last);
+    void reset_rows();
+    void thumbnail_ready(const QString &path);
+};
+
+#endif // THUMBNAILS_H
@@ -0,0 +1,573 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include "bluegen.h"
+#include "scheduler.h"
+#include "stats.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+typedef enum InputType {
+    INPUT_PNG,
+    INPUT_BMP,
+    INPUT_TIFF
+} InputType;
+
+static const char *INPUT_EXTENSIONS[] = { "png", "bmp", "tif" };
+
+typedef struct Workload {
+    /** Name used on the command line and in the results */
+    const char *name;
+
+    /** Number of sequences */
+    size_t sequence_count;
+
+    /** Number of frames in each sequence */
+    size_t frame_count;
+
+    /** Dimensions of each frame */
+    uint32_t width;
+    uint32_t height;
+
+    /** Format the frames are generated and stored in */
+    BlueGenPixelFormat format;
+
+    /** File type the frames are written as before being loaded */
+    InputType input;
+
+    /** Fill in a frame's pixels */
+    void (*fill)(BlueGenImage *image, size_t sequence, size_t frame);
+} Workload;
+
+// Deterministic xorshift so every build gets the same workloads
+static uint32_t rng_state;
+static void seed(size_t sequence, size_t frame) {
+    rng_state = 0x9E3779B9u ^ (uint32_t)(sequence * 0x85EBCA6Bu) ^ (uint32_t)(frame * 0xC2B2AE35u);
+    if(rng_state == 0) {
+        rng_state = 1;
+    }
+}
+static uint32_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// A blob of random colors on a transparent background, like a particle sprite
+static void fill_sprite(BlueGenImage *image, size_t sequence, size_t frame) {
+    seed(sequence, frame);
+    uint32_t w = image->width, h = image->height;
+    uint8_t *p = image->pixels;
+    for(uint32_t y = 0; y < h; y++) {
+        for(uint32_t x = 0; x < w; x++, p += 4) {
+            int32_t dx = (int32_t)(x * 2) - (int32_t)w, dy = (int32_t)(y * 2) - (int32_t)h;
+            uint32_t r = next_random();
+            bool inside = (uint32_t)(dx * dx + dy * dy) < w * h / 2;
+            p[0] = (uint8_t)r;
+            p[1] = (uint8_t)(r >> 8);
+            p[2] = (uint8_t)(r >> 16);
+            p[3] = inside ? (uint8_t)(r >> 24) | 0x80 : 0x00;
+        }
+    }
+}
+
+// Smooth gradients with a bit of noise, like a large photographic frame
+static void fill_gradient(BlueGenImage *image, size_t sequence, size_t frame) {
+    seed(sequence, frame);
+    uint32_t w = image->width, h = image->height;
+    size_t channels = image->format;
+    uint8_t *p = image->pixels;
+    for(uint32_t y = 0; y < h; y++) {
+        for(uint32_t x = 0; x < w; x++, p += channels) {
+            uint32_t noise = next_random() & 0x7;
+            uint8_t values[4] = { (uint8_t)(x * 255 / w + noise), (uint8_t)(y * 255 / h + noise), (uint8_t)((x + y) * 127 / (w + h) + frame), 0xFF };
+            memcpy(p, values, channels);
+        }
+    }
+}
+
+// Random colors with rows of pure blue and magenta, so replacement separators have to be found
+static void fill_separators(BlueGenImage *image, size_t sequence, size_t frame) {
+    seed(sequence, frame);
+    uint32_t w = image->width, h = image->height;
+    size_t channels = image->format;
+    uint8_t *p = image->pixels;
+    for(uint32_t y = 0; y < h; y++) {
+        for(uint32_t x = 0; x < w; x++, p += channels) {
+            uint32_t r = next_random();
+            uint8_t values[4] = { (uint8_t)r, (uint8_t)(r >> 8), (uint8_t)(r >> 16), 0xFF };
+            if(y % 8 == 0) {
+                values[0] = (x & 1) ? 0xFF : 0x00;
+                values[1] = 0x00;
+                values[2] = 0xFF;
+            }
+            memcpy(p, values, channels);
+        }
+    }
+}
+
+// Every color with blue below 0x80, plus blue and magenta, so increment_pixel has to walk 2^23 candidates
+static void fill_exhaustive(BlueGenImage *image, size_t sequence, size_t frame) {
+    (void)sequence;
+    (void)frame;
+    uint32_t w = image->width, h = image->height;
+    uint8_t *p = image->pixels;
+    for(uint32_t i = 0; i < w * (h - 1); i++, p += 4) {
+        p[0] = (uint8_t)i;
+        p[1] = (uint8_t)(i >> 8);
+        p[2] = (uint8_t)((i >> 16) & 0x7F);
+        p[3] = 0xFF;
+    }
+    for(uint32_t x = 0; x < w; x++, p += 4) {
+        p[0] = (x == 1) ? 0xFF : 0x00;
+        p[1] = 0x00;
+        p[2] = (x <= 1) ? 0xFF : 0x00;
+        p[3] = 0xFF;
+    }
+}
+
+// Noisy grayscale, like an effect mask
+static void fill_mask(BlueGenImage *image, size_t sequence, size_t frame) {
+    seed(sequence, frame);
+    size_t count = (size_t)image->width * image->height;
+    for(size_t i = 0; i < count; i++) {
+        image->pixels[i] = (uint8_t)(next_random() >> 24);
+    }
+}
+
+static const Workload WORKLOADS[] = {
+    { "many-small-sprites", 64, 32, 32, 32, BLUEGEN_FORMAT_RGBA, INPUT_PNG, fill_sprite },
+    { "few-huge-frames", 2, 2, 2048, 2048, BLUEGEN_FORMAT_RGBA, INPUT_TIFF, fill_gradient },
+    { "separators-used", 8, 8, 128, 128, BLUEGEN_FORMAT_RGB, INPUT_BMP, fill_separators },
+    { "near-exhaustive-colors", 1, 1, 4096, 2049, BLUEGEN_FORMAT_RGBA, INPUT_TIFF, fill_exhaustive },
+    { "grayscale-masks", 16, 16, 256, 256, BLUEGEN_FORMAT_GRAY, INPUT_PNG, fill_mask }
+};
+#define WORKLOAD_COUNT (sizeof(WORKLOADS) / sizeof(*WORKLOADS))
+
+static void put_u32be(uint8_t *p, uint32_t v) { p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v; }
+static void put_u16le(uint8_t *p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void put_u32le(uint8_t *p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24); }
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length) {
+    static uint32_t table[256];
+    if(table[1] == 0) {
+        for(uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for(size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void write_png_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t length) {
+    uint8_t header[8];
+    put_u32be(header, length);
+    memcpy(header + 4, type, 4);
+    fwrite(header, sizeof(header), 1, f);
+    if(length) {
+        fwrite(data, length, 1, f);
+    }
+    uint8_t crc[4];
+    put_u32be(crc, crc32_update(crc32_update(0, (const uint8_t *)type, 4), data, length));
+    fwrite(crc, sizeof(crc), 1, f);
+}
+
+// Write a PNG using stored (uncompressed) deflate blocks; this keeps the encoder tiny, and decoding still goes through
+// stb's zlib and unfiltering paths
+static void write_png(const BlueGenImage *image, const char *path) {
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    static const uint8_t COLOR_TYPES[5] = { 0, 0, 4, 2, 6 };
+
+    size_t row_size = (size_t)image->width * image->format;
+    size_t raw_size = (row_size + 1) * image->height;
+    uint8_t *raw = malloc(raw_size);
+    for(uint32_t y = 0; y < image->height; y++) {
+        raw[y * (row_size + 1)] = 0;
+        memcpy(raw + y * (row_size + 1) + 1, image->pixels + y * row_size, row_size);
+    }
+
+    size_t block_count = raw_size / 65535 + 1;
+    size_t zlib_size = 2 + raw_size + block_count * 5 + 4;
+    uint8_t *zlib = malloc(zlib_size);
+    uint8_t *z = zlib;
+    *z++ = 0x78;
+    *z++ = 0x01;
+    uint32_t a = 1, b = 0;
+    for(size_t offset = 0, block = 0; block < block_count; block++) {
+        size_t length = raw_size - offset < 65535 ? raw_size - offset : 65535;
+        *z++ = block + 1 == block_count ? 1 : 0;
+        put_u16le(z, (uint32_t)length);
+        put_u16le(z + 2, (uint32_t)~length & 0xFFFF);
+        z += 4;
+        memcpy(z, raw + offset, length);
+        for(size_t i = 0; i < length; i++) {
+            a = (a + raw[offset + i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        z += length;
+        offset += length;
+    }
+    put_u32be(z, (b << 16) | a);
+
+    uint8_t ihdr[13];
+    put_u32be(ihdr, image->width);
+    put_u32be(ihdr + 4, image->height);
+    ihdr[8] = 8;
+    ihdr[9] = COLOR_TYPES[image->format];
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    FILE *f = fopen(path, "wb");
+    if(!f) {
+        fprintf(stderr, "(v)> Failed to open %s for writing.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fwrite(SIGNATURE, sizeof(SIGNATURE), 1, f);
+    write_png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    write_png_chunk(f, "IDAT", zlib, (uint32_t)zlib_size);
+    write_png_chunk(f, "IEND", NULL, 0);
+    fclose(f);
+
+    free(raw);
+    free(zlib);
+}
+
+// Write a bottom-up 24-bit or 32-bit BMP
+static void write_bmp(const BlueGenImage *image, const char *path) {
+    size_t channels = image->format == BLUEGEN_FORMAT_RGBA ? 4 : 3;
+    size_t row_size = ((size_t)image->width * channels + 3) & ~(size_t)3;
+    uint8_t header[54] = { 'B', 'M' };
+    put_u32le(header + 2, (uint32_t)(sizeof(header) + row_size * image->height));
+    put_u32le(header + 10, sizeof(header));
+    put_u32le(header + 14, 40);
+    put_u32le(header + 18, image->width);
+    put_u32le(header + 22, image->height);
+    put_u16le(header + 26, 1);
+    put_u16le(header + 28, (uint32_t)channels * 8);
+    put_u32le(header + 34, (uint32_t)(row_size * image->height));
+
+    FILE *f = fopen(path, "wb");
+    if(!f) {
+        fprintf(stderr, "(v)> Failed to open %s for writing.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fwrite(header, sizeof(header), 1, f);
+
+    uint8_t *row = calloc(row_size, 1);
+    for(uint32_t y = image->height; y > 0; y--) {
+        const uint8_t *input = image->pixels + (size_t)(y - 1) * image->width * image->format;
+        for(uint32_t x = 0; x < image->width; x++, input += image->format) {
+            uint8_t *output = row + x * channels;
+            output[0] = input[2];
+            output[1] = input[1];
+            output[2] = input[0];
+            if(channels == 4) {
+                output[3] = input[3];
+            }
+        }
+        fwrite(row, row_size, 1, f);
+    }
+    free(row);
+    fclose(f);
+}
+
+static void write_input(const BlueGenImage *image, InputType input, const char *path) {
+    switch(input) {
+        case INPUT_PNG:
+            write_png(image, path);
+            break;
+        case INPUT_BMP:
+            write_bmp(image, path);
+            break;
+        case INPUT_TIFF:
+            if(write_tiff(image, path) != 0) {
+                fprintf(stderr, "(v)> Failed to open %s for writing.\n", path);
+                exit(EXIT_FAILURE);
+            }
+            break;
+    }
+}
+
+typedef struct StageResult {
+    /** Best time of all iterations */
+    BlueGenTime best;
+
+    /** Number of pixels and bytes the stage processes per iteration */
+    uint64_t pixels;
+    uint64_t bytes;
+} StageResult;
+
+static void run_workload(const Workload *workload, int iterations, const char *temp_dir, const BlueGenScheduleOptions *schedule_options) {
+    // Generate the inputs and write them out; this isn't timed
+    size_t frame_total = workload->sequence_count * workload->frame_count;
+    char **paths = malloc(frame_total * sizeof(*paths));
+    uint64_t input_file_bytes = 0;
+    for(size_t s = 0, n = 0; s < workload->sequence_count; s++) {
+        for(size_t f = 0; f < workload->frame_count; f++, n++) {
+            BlueGenImage image;
+            initialize_bluegen_image(&image, workload->width, workload->height, workload->format);
+            workload->fill(&image, s, f);
+
+            size_t path_size = strlen(temp_dir) + 64;
+            paths[n] = malloc(path_size);
+            snprintf(paths[n], path_size, "%s/bluegen-bench-%d-%zu.%s", temp_dir, (int)getpid(), n, INPUT_EXTENSIONS[workload->input]);
+            write_input(&image, workload->input, paths[n]);
+            free_bluegen_image(&image);
+
+            struct stat file_stat;
+            if(stat(paths[n], &file_stat) == 0) {
+                input_file_bytes += (uint64_t)file_stat.st_size;
+            }
+        }
+    }
+
+    char output_path[4096];
+    snprintf(output_path, sizeof(output_path), "%s/bluegen-bench-%d-plate.tif", temp_dir, (int)getpid());
+
+    StageResult results[BLUEGEN_STAGE_COUNT];
+    memset(results, 0, sizeof(results));
+    uint64_t pixels_scanned = 0, candidates_tried = 0, peak_rss = 0;
+    uint32_t plate_width = 0, plate_height = 0;
+
+    // Each sequence is its own run of the paths, like blue-gen is given them on the command line
+    BlueGenFileSequence *sequences = malloc(workload->sequence_count * sizeof(*sequences));
+    for(size_t s = 0; s < workload->sequence_count; s++) {
+        sequences[s].paths = (const char **)(paths + s * workload->frame_count);
+        sequences[s].path_count = workload->frame_count;
+        sequences[s].all_frames = false;
+    }
+    for(int it = 0; it < iterations; it++) {
+        bluegen_stats_reset();
+
+        // Read, decode, generate and write the plate the same way blue-gen does
+        BlueGenImage plate;
+        BlueGenError error;
+        if(generate_bluegen_image_from_files(sequences, workload->sequence_count, &(BlueGenPixel){ 0x00, 0xFF, 0xFF, 0xFF }, schedule_options, &plate, output_path, &error) != 0) {
+            fprintf(stderr, "%s\n", error.message);
+            exit(EXIT_FAILURE);
+        }
+
+        plate_width = plate.width;
+        plate_height = plate.height;
+        free_bluegen_image(&plate);
+
+        // Keep the best time of each stage
+        const BlueGenStats *stats = bluegen_stats_get();
+        for(int i = 0; i < BLUEGEN_STAGE_COUNT; i++) {
+            if(it == 0 || stats->stages[i].wall < results[i].best.wall) {
+                results[i].best = stats->stages[i];
+            }
+        }
+        pixels_scanned = stats->pixels_scanned;
+        candidates_tried = stats->candidates_tried;
+        results[BLUEGEN_STAGE_WRITE].bytes = stats->bytes_written;
+    }
+    peak_rss = bluegen_stats_peak_rss();
+
+    uint64_t input_pixels = (uint64_t)frame_total * workload->width * workload->height;
+    uint64_t decoded_bytes = input_pixels * workload->format;
+    uint64_t plate_pixels = (uint64_t)plate_width * plate_height;
+    results[BLUEGEN_STAGE_DECODE].pixels = input_pixels;
+    results[BLUEGEN_STAGE_DECODE].bytes = input_file_bytes;
+    results[BLUEGEN_STAGE_SCAN].pixels = pixels_scanned;
+    results[BLUEGEN_STAGE_SCAN].bytes = decoded_bytes;
+    results[BLUEGEN_STAGE_LAYOUT].pixels = input_pixels;
+    results[BLUEGEN_STAGE_LAYOUT].bytes = 0;
+    results[BLUEGEN_STAGE_BLIT].pixels = plate_pixels;
+    results[BLUEGEN_STAGE_BLIT].bytes = plate_pixels * sizeof(BlueGenPixel);
+    results[BLUEGEN_STAGE_WRITE].pixels = plate_pixels;
+
+    // One JSON object per line so results from two builds can be diffed or joined by name
+    printf("{\"workload\":\"%s\",\"iterations\":%d,\"frames\":%zu,\"input_pixels\":%llu,\"input_bytes\":%llu,\"plate_width\":%u,\"plate_height\":%u,"
+           "\"pixels_scanned\":%llu,\"candidates_tried\":%llu,\"peak_rss\":%llu,\"stages\":{",
+           workload->name, iterations, frame_total, (unsigned long long)input_pixels, (unsigned long long)input_file_bytes, plate_width, plate_height,
+           (unsigned long long)pixels_scanned, (unsigned long long)candidates_tried, (unsigned long long)peak_rss);
+    for(int i = 0; i < BLUEGEN_STAGE_COUNT; i++) {
+        const StageResult *r = results + i;
+        double wall = r->best.wall > 0.0 ? r->best.wall : 1.0E-9;
+        printf("%s\"%s\":{\"wall\":%.9f,\"cpu\":%.9f,\"pixels_per_s\":%.1f,\"mb_per_s\":%.3f", i ? "," : "", bluegen_stage_name(i),
+               r->best.wall, r->best.cpu, (double)r->pixels / wall, (double)r->bytes / wall / 1.0E6);
+        if(bluegen_perf_enabled()) {
+            printf(",\"counters\":");
+            bluegen_json_counters(stdout, r->best.counters);
+        }
+        printf("}");
+    }
+    printf("}}\n");
+    fflush(stdout);
+
+    for(size_t n = 0; n < frame_total; n++) {
+        remove(paths[n]);
+        free(paths[n]);
+    }
+    remove(output_path);
+    free(paths);
+    free(sequences);
+}
+
+int main(int argc, char **argv) {
+    int longindex = 0, opt;
+    int iterations = 3;
+    BlueGenScheduleOptions schedule_options = { 0, 0, BLUEGEN_READER_AUTO, false, NULL, NULL, NULL, NULL, NULL, NULL };
+    const char *temp_dir = getenv("TMPDIR");
+    const char **selected = malloc(argc * sizeof(*selected));
+    size_t selected_count = 0;
+
+#ifdef _WIN32
+    if(!temp_dir) {
+        temp_dir = getenv("TEMP");
+    }
+#endif
+    if(!temp_dir) {
+        temp_dir = ".";
+    }
+
+    static struct option options[] = {
+        {"help",  no_argument, 0, 'h'},
+        {"iterations",  required_argument, 0, 'i'},
+        {"workload",  required_argument, 0, 'w'},
+        {"temp-dir",  required_argument, 0, 't'},
+        {"list",  no_argument, 0, 'l'},
+        {"perf-counters",  no_argument, 0, 'p'},
+        {"threads",  required_argument, 0, 'j'},
+        {"max-memory",  required_argument, 0, 'm'},
+        {"reader",  required_argument, 0, 'r'},
+        {0, 0, 0, 0 }
+    };
+
+    while((opt = getopt_long(argc, argv, "hi:w:t:lpj:m:r:", options, &longindex)) != -1) {
+        switch(opt) {
+            case 'i':
+                iterations = atoi(optarg);
+                if(iterations < 1) {
+                    fprintf(stderr, "(v)> Iterations must be at least 1.\n");
+                    return 1;
+                }
+                break;
+
+            case 'w':
+                selected[selected_count++] = optarg;
+                break;
+
+            case 't':
+                temp_dir = optarg;
+                break;
+
+            case 'j': {
+                int threads = atoi(optarg);
+                if(threads < 1) {
+                    fprintf(stderr, "(v)> Threads must be at least 1.\n");
+                    return 1;
+                }
+                schedule_options.threads = (unsigned int)threads;
+                break;
+            }
+
+            case 'm':
+                if(parse_bluegen_size(optarg, &schedule_options.max_memory) != 0) {
+                    fprintf(stderr, "(v)> Memory limit must be a size in bytes, optionally ending in K, M, or G (i.e. 4G).\n");
+                    return 1;
+                }
+                break;
+
+            case 'r':
+                if(strcmp(optarg, "auto") == 0) {
+                    schedule_options.reader = BLUEGEN_READER_AUTO;
+                }
+                else if(strcmp(optarg, "io_uring") == 0) {
+                    schedule_options.reader = BLUEGEN_READER_IO_URING;
+                }
+                else if(strcmp(optarg, "threads") == 0) {
+                    schedule_options.reader = BLUEGEN_READER_THREADS;
+                }
+                else if(strcmp(optarg, "mmap") == 0) {
+                    schedule_options.reader = BLUEGEN_READER_MMAP;
+                }
+                else {
+                    fprintf(stderr, "(v)> Reader must be auto, io_uring, mmap, or threads.\n");
+                    return 1;
+                }
+                break;
+
+            case 'p':
+                if(bluegen_perf_enable() == 0) {
+                    fprintf(stderr, "(v)> Performance counters aren't available here, so only times will be shown.\n");
+                }
+                break;
+
+            case 'l':
+                for(size_t w = 0; w < WORKLOAD_COUNT; w++) {
+                    printf("%s\n", WORKLOADS[w].name);
+                }
+                return 0;
+
+            default:
+                fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+                fprintf(stderr, "Runs synthetic workloads through the same reading, decoding, and writing\n");
+                fprintf(stderr, "pipeline as blue-gen, printing the best time of each stage as one JSON object\n");
+                fprintf(stderr, "per workload.\n\n");
+                fprintf(stderr, "Options:\n");
+                fprintf(stderr, "    --iterations,-i <n>        Run each workload n times. Default: 3\n");
+                fprintf(stderr, "    --workload,-w <name>       Only run the given workload; can be repeated\n");
+                fprintf(stderr, "    --list,-l                  List the workloads and exit\n");
+                fprintf(stderr, "    --perf-counters,-p         Also report the hardware counters of each stage\n");
+                fprintf(stderr, "                               from the same iteration as its best time (Linux)\n");
+                fprintf(stderr, "    --threads,-j <n>           Decode up to n images at once. Default: one per CPU\n");
+                fprintf(stderr, "    --max-memory,-m <size>     Limit how much memory decoded images and the color\n");
+                fprintf(stderr, "                               plate may use at once (i.e. 4G or 512M).\n");
+                fprintf(stderr, "                               Default: no limit\n");
+                fprintf(stderr, "    --reader,-r <reader>       How to read input files: io_uring (Linux 5.6+),\n");
+                fprintf(stderr, "                               threads, mmap, or auto. Default: auto\n");
+                fprintf(stderr, "    --temp-dir,-t <dir>        Directory for the generated inputs and plate.\n");
+                fprintf(stderr, "                               Default: $TMPDIR or the current directory\n");
+                fprintf(stderr, "    --help,-h                  Show help\n\n");
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    for(size_t i = 0; i < selected_count; i++) {
+        bool found = false;
+        for(size_t w = 0; w < WORKLOAD_COUNT; w++) {
+            found = found || strcmp(selected[i], WORKLOADS[w].name) == 0;
+        }
+        if(!found) {
+            fprintf(stderr, "(v)> Unknown workload %s. Use --list to see them.\n", selected[i]);
+            return 1;
+        }
+    }
+
+    bluegen_stats_enable();
+    for(size_t w = 0; w < WORKLOAD_COUNT; w++) {
+        bool run = selected_count == 0;
+        for(size_t i = 0; i < selected_count; i++) {
+            run = run || strcmp(selected[i], WORKLOADS[w].name) == 0;
+        }
+        if(run) {
+            run_workload(WORKLOADS + w, iterations, temp_dir, &schedule_options);
+        }
+    }
+
+    free(selected);
+    return 0;
+}
@@ -5,19 +5,62 @@
  */
 
 #include <stdlib.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
 #include <tiffio.h>
 #include "bluegen.h"
+#include "stats.h"
+#include "trace.h"
 #include "stb_image.h"
 
+// BLUEGEN_NO_SIMD skips these, as in rawimage.c
+#if !defined(BLUEGEN_NO_SIMD)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define USE_SSSE3
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define USE_NEON
+#endif
+#endif
+
 #define BITMAP_SPACING 4
 #define SEQUENCE_SPACING 1
 #define BLUE_GAP 1
 #define COLOR_PLATE_GAP (SEQUENCE_SPACING + BLUE_GAP * 2)
 
-void initialize_bluegen_image(BlueGenImage *image, uint32_t width, uint32_t height) {
-    image->pixels = calloc(width * height, sizeof(*image->pixels));
+typedef struct TIFFTag {
+    uint16_t type;
+    uint16_t size;
+    uint32_t count;
+    uint32_t data_offset;
+} TIFFTag;
+
+static const uint16_t BITS_PER_SAMPLE[4] = { 0x8, 0x8, 0x8, 0x8 };
+
+void set_bluegen_error(BlueGenError *error, const char *path, const char *format, ...) {
+    if(!error) {
+        return;
+    }
+    error->path = path;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error->message, sizeof(error->message), format, args);
+    va_end(args);
+}
+
+void initialize_bluegen_image(BlueGenImage *image, uint32_t width, uint32_t height, BlueGenPixelFormat format) {
+    image->pixels = calloc((size_t)width * height, (size_t)format);
+    image->format = format;
     image->height = height;
     image->width = width;
     image->free = free;
@@ -26,34 +69,230 @@ void free_bluegen_image(BlueGenImage *image) {
     image->free(image->pixels);
 }
 
-// Determine if the color is safe
-bool is_safe_color(const BlueGenPixel *pixel, const BlueGenImageSequence *sequences, size_t sequence_count) {
-    for(size_t s = 0; s < sequence_count; s++) {
-        const BlueGenImageSequence *sequence = sequences + s;
-        for(size_t i = 0; i < sequence->image_count; i++) {
-            const BlueGenImage *image = sequence->images + i;
-            for(size_t y = 0; y < image->height; y++) {
-                for(size_t x = 0; x < image->width; x++) {
-                    const BlueGenPixel *image_pixel = image->pixels + x + y * image->width;
-                    if(pixel->red == image_pixel->red && pixel->green == image_pixel->green && pixel->blue == image_pixel->blue) {
-                        return false;
-                    }
-                }
-            }
+#define OCCUPANCY_INDEX(r, g, b) ((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16))
+#define MARK_OCCUPIED(occupancy, index) ((occupancy)[(index) >> 5] |= (uint32_t)1 << ((index) & 31))
+
+// The flags come after the colors; this one is set if any pixel wasn't fully opaque
+#define OCCUPANCY_FLAGS ((1 << 24) / 32)
+#define OCCUPANCY_TRANSLUCENT 1
+
+// Expand one pixel of each format to red, green, blue, and alpha
+#define EXPAND_GRAY(p, r, g, b, a) r = g = b = (p)[0]; a = 0xFF
+#define EXPAND_GRAY_ALPHA(p, r, g, b, a) r = g = b = (p)[0]; a = (p)[1]
+#define EXPAND_RGB(p, r, g, b, a) r = (p)[0]; g = (p)[1]; b = (p)[2]; a = 0xFF
+#define EXPAND_RGBA(p, r, g, b, a) r = (p)[0]; g = (p)[1]; b = (p)[2]; a = (p)[3]
+
+// Generate the per-format kernels so the channel expansion happens while pixels are scanned and copied, not on load;
+// scanning also ANDs together every alpha value, so it's 0xFF if everything was opaque
+#define DEFINE_SCAN_KERNEL(name, channels, EXPAND) \
+    static uint8_t scan_colors_##name(uint32_t *occupancy, const uint8_t *input, size_t pixel_count) { \
+        uint8_t alpha = 0xFF; \
+        for(size_t i = 0; i < pixel_count; i++, input += channels) { \
+            uint8_t r, g, b, a; \
+            EXPAND(input, r, g, b, a); \
+            alpha &= a; \
+            uint32_t index = OCCUPANCY_INDEX(r, g, b); \
+            MARK_OCCUPIED(occupancy, index); \
+        } \
+        return alpha; \
+    }
+#define DEFINE_BLIT_KERNEL(name, channels, EXPAND) \
+    static void blit_row_##name(BlueGenPixel *output, const uint8_t *input, uint32_t width) { \
+        for(uint32_t x = 0; x < width; x++, input += channels) { \
+            EXPAND(input, output[x].red, output[x].green, output[x].blue, output[x].alpha); \
+        } \
+    }
+
+DEFINE_SCAN_KERNEL(gray, 1, EXPAND_GRAY)
+DEFINE_SCAN_KERNEL(gray_alpha, 2, EXPAND_GRAY_ALPHA)
+DEFINE_SCAN_KERNEL(rgb, 3, EXPAND_RGB)
+DEFINE_SCAN_KERNEL(rgba, 4, EXPAND_RGBA)
+
+// RGBA rows are already in the output layout, so they're just copied
+DEFINE_BLIT_KERNEL(gray, 1, EXPAND_GRAY)
+DEFINE_BLIT_KERNEL(gray_alpha, 2, EXPAND_GRAY_ALPHA)
+DEFINE_BLIT_KERNEL(rgb, 3, EXPAND_RGB)
+
+// Summarizing only looks for the two colors separators would rather be, plus the alpha, like scanning does
+#define DEFINE_SUMMARY_KERNEL(name, channels, EXPAND) \
+    static void summarize_colors_##name(BlueGenColorSummary *summary, const uint8_t *input, size_t pixel_count) { \
+        uint8_t alpha = 0xFF; \
+        for(size_t i = 0; i < pixel_count; i++, input += channels) { \
+            uint8_t r, g, b, a; \
+            EXPAND(input, r, g, b, a); \
+            alpha &= a; \
+            if(g == 0x00 && b == 0xFF) { \
+                summary->blue |= r == 0x00; \
+                summary->magenta |= r == 0xFF; \
+            } \
+        } \
+        summary->translucent |= alpha != 0xFF; \
+    }
+
+DEFINE_SUMMARY_KERNEL(gray, 1, EXPAND_GRAY)
+DEFINE_SUMMARY_KERNEL(gray_alpha, 2, EXPAND_GRAY_ALPHA)
+DEFINE_SUMMARY_KERNEL(rgb, 3, EXPAND_RGB)
+DEFINE_SUMMARY_KERNEL(rgba, 4, EXPAND_RGBA)
+
+uint32_t *allocate_bluegen_occupancy(void) {
+    return calloc(BLUEGEN_OCCUPANCY_WORDS, sizeof(uint32_t));
+}
+
+void merge_bluegen_occupancy(uint32_t *occupancy, const uint32_t *other) {
+    for(size_t i = 0; i < BLUEGEN_OCCUPANCY_WORDS; i++) {
+        occupancy[i] |= other[i];
+    }
+}
+
+bool bluegen_occupancy_opaque(const uint32_t *occupancy) {
+    return (occupancy[OCCUPANCY_FLAGS] & OCCUPANCY_TRANSLUCENT) == 0;
+}
+
+void scan_bluegen_image(uint32_t *occupancy, const BlueGenImage *image) {
+    size_t pixel_count = (size_t)image->width * image->height;
+    uint8_t alpha = 0xFF;
+    switch(image->format) {
+        case BLUEGEN_FORMAT_GRAY:
+            scan_colors_gray(occupancy, image->pixels, pixel_count);
+            break;
+        case BLUEGEN_FORMAT_GRAY_ALPHA:
+            alpha = scan_colors_gray_alpha(occupancy, image->pixels, pixel_count);
+            break;
+        case BLUEGEN_FORMAT_RGB:
+            scan_colors_rgb(occupancy, image->pixels, pixel_count);
+            break;
+        case BLUEGEN_FORMAT_RGBA:
+            alpha = scan_colors_rgba(occupancy, image->pixels, pixel_count);
+            break;
+    }
+    if(alpha != 0xFF) {
+        occupancy[OCCUPANCY_FLAGS] |= OCCUPANCY_TRANSLUCENT;
+    }
+    BLUEGEN_STATS_COUNT(pixels_scanned, pixel_count);
+}
+
+// Copy an image row into the output, expanding it to RGBA
+static void blit_row(BlueGenPixel *output, const uint8_t *input, uint32_t width, BlueGenPixelFormat format) {
+    switch(format) {
+        case BLUEGEN_FORMAT_GRAY:
+            blit_row_gray(output, input, width);
+            break;
+        case BLUEGEN_FORMAT_GRAY_ALPHA:
+            blit_row_gray_alpha(output, input, width);
+            break;
+        case BLUEGEN_FORMAT_RGB:
+            blit_row_rgb(output, input, width);
+            break;
+        case BLUEGEN_FORMAT_RGBA:
+            memcpy(output, input, width * sizeof(*output));
+            break;
+    }
+}
+
+void expand_bluegen_image(const BlueGenImage *input, BlueGenImage *output) {
+    initialize_bluegen_image(output, input->width, input->height, BLUEGEN_FORMAT_RGBA);
+    BlueGenPixel *output_pixels = (BlueGenPixel *)output->pixels;
+    size_t stride = (size_t)input->width * input->format;
+    for(uint32_t y = 0; y < input->height; y++) {
+        blit_row(output_pixels + (size_t)y * input->width, input->pixels + y * stride, input->width, input->format);
+    }
+}
+
+// Average each 2x2 block of two RGBA rows into one row of half the width, rounding to nearest
+static void halve_row(BlueGenPixel *output, const uint8_t *top, const uint8_t *bottom, uint32_t output_width) {
+    uint32_t x = 0;
+#if defined(USE_NEON)
+    for(; x + 8 <= output_width; x += 8) {
+        uint8x16x4_t a = vld4q_u8(top + (size_t)x * 8);
+        uint8x16x4_t b = vld4q_u8(bottom + (size_t)x * 8);
+        uint8x8x4_t result;
+        for(int c = 0; c < 4; c++) {
+            result.val[c] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(a.val[c]), b.val[c]), 2);
         }
+        vst4_u8((uint8_t *)(output + x), result);
     }
+#elif defined(USE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    for(; x + 4 <= output_width; x += 4) {
+        __m128i sums[4];
+        for(int half = 0; half < 2; half++) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(top + (size_t)x * 8 + half * 16));
+            __m128i b = _mm_loadu_si128((const __m128i *)(bottom + (size_t)x * 8 + half * 16));
+            sums[half * 2] = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            sums[half * 2 + 1] = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        }
 
-    return true;
+        // Each sum holds two pixels side by side, so add its halves together
+        __m128i result[2];
+        for(int half = 0; half < 2; half++) {
+            __m128i left = _mm_add_epi16(sums[half * 2], _mm_srli_si128(sums[half * 2], 8));
+            __m128i right = _mm_add_epi16(sums[half * 2 + 1], _mm_srli_si128(sums[half * 2 + 1], 8));
+            result[half] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(left, right), two), 2);
+        }
+        _mm_storeu_si128((__m128i *)(output + x), _mm_packus_epi16(result[0], result[1]));
+    }
+#endif
+    for(; x < output_width; x++) {
+        const uint8_t *a = top + (size_t)x * 8;
+        const uint8_t *b = bottom + (size_t)x * 8;
+        uint8_t *o = (uint8_t *)(output + x);
+        for(int c = 0; c < 4; c++) {
+            o[c] = (uint8_t)((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+        }
+    }
+}
+
+void halve_bluegen_image(const BlueGenImage *input, BlueGenImage *output) {
+    BlueGenImage expanded;
+    const BlueGenImage *rgba = input;
+    if(input->format != BLUEGEN_FORMAT_RGBA) {
+        expand_bluegen_image(input, &expanded);
+        rgba = &expanded;
+    }
+
+    uint32_t width = rgba->width;
+    uint32_t height = rgba->height;
+    initialize_bluegen_image(output, (width + 1) / 2, (height + 1) / 2, BLUEGEN_FORMAT_RGBA);
+    BlueGenPixel *output_pixels = (BlueGenPixel *)output->pixels;
+    const BlueGenPixel *input_pixels = (const BlueGenPixel *)rgba->pixels;
+
+    // An odd last column or row is averaged with itself, so copy that column into a padded row when there is one
+    BlueGenPixel *padded = width % 2 ? malloc(((size_t)width + 1) * 2 * sizeof(*padded)) : NULL;
+    for(uint32_t y = 0; y < output->height; y++) {
+        const BlueGenPixel *top = input_pixels + (size_t)y * 2 * width;
+        const BlueGenPixel *bottom = y * 2 + 1 < height ? top + width : top;
+        if(padded) {
+            memcpy(padded, top, width * sizeof(*padded));
+            padded[width] = top[width - 1];
+            memcpy(padded + width + 1, bottom, width * sizeof(*padded));
+            padded[width * 2 + 1] = bottom[width - 1];
+            top = padded;
+            bottom = padded + width + 1;
+        }
+        halve_row(output_pixels + (size_t)y * output->width, (const uint8_t *)top, (const uint8_t *)bottom, output->width);
+    }
+    free(padded);
+
+    if(rgba != input) {
+        free_bluegen_image(&expanded);
+    }
+}
+
+// Determine if the color is safe
+bool is_safe_color(const BlueGenPixel *pixel, const uint32_t *occupancy) {
+    uint32_t index = OCCUPANCY_INDEX(pixel->red, pixel->green, pixel->blue);
+    return (occupancy[index >> 5] & ((uint32_t)1 << (index & 31))) == 0;
 }
 
-void increment_pixel(BlueGenPixel *pixel, const BlueGenPixel *dummy_space) {
+// Move on to the next candidate separator color; returns false if there are none left
+static bool increment_pixel(BlueGenPixel *pixel, const BlueGenPixel *dummy_space) {
     if(pixel->red == 0xFF) {
         pixel->red = 0x00;
         if(pixel->green == 0xFF) {
             pixel->green = 0x00;
             if(pixel->blue == 0xFF) {
-                fprintf(stderr, "(O)< Eep! I need two unused colors!\n");
-                exit(1);
+                return false;
             }
             else {
                 pixel->blue++;
@@ -69,32 +308,49 @@ void increment_pixel(BlueGenPixel *pixel, const BlueGenPixel *dummy_space) {
 
     // Skip cyan, blue, and magenta
     if(pixel->green == dummy_space->green && pixel->blue == dummy_space->blue && pixel->red == dummy_space->red) {
-        increment_pixel(pixel, dummy_space);
+        return increment_pixel(pixel, dummy_space);
     }
     if(pixel->green == 0x00 && pixel->blue == 0xFF && (pixel->red == 0x00 || pixel->red == 0xFF)) {
-        increment_pixel(pixel, dummy_space);
+        return increment_pixel(pixel, dummy_space);
     }
+    return true;
 }
 
-void generate_bluegen_image(const BlueGenImageSequence *sequences, size_t sequence_count, const BlueGenPixel *dummy_space, BlueGenImage *output) {
+void layout_bluegen_image(BlueGenLayout *layout, const BlueGenImageInfoSequence *sequences, size_t sequence_count) {
+    layout->bands = calloc(sequence_count, sizeof(*layout->bands));
+    layout->band_count = sequence_count;
+
     // Go through each sequence so we can determine how wide and tall to make our image
     size_t width = 4;
     size_t height = 1;
     for(size_t s = 0; s < sequence_count; s++) {
-        const BlueGenImageSequence *sequence = sequences + s;
+        const BlueGenImageInfoSequence *sequence = sequences + s;
+        BlueGenBand *band = layout->bands + s;
         size_t this_sequence_width = 0;
         size_t this_sequence_height = 0;
 
+        band->frames = calloc(sequence->info_count, sizeof(*band->frames));
+        band->frame_count = sequence->info_count;
+        band->y = (uint32_t)height;
+
         // If we have any images, do stuff
-        for(size_t i = 0; i < sequence->image_count; i++) {
-            const BlueGenImage *image = sequence->images + i;
-            if(image->height > this_sequence_height) {
-                this_sequence_height = image->height;
+        for(size_t i = 0; i < sequence->info_count; i++) {
+            const BlueGenImageInfo *info = sequence->infos + i;
+            BlueGenRect *frame = band->frames + i;
+            if(info->height > this_sequence_height) {
+                this_sequence_height = info->height;
             }
-            this_sequence_width += image->width + BITMAP_SPACING;
+
+            // Images start one pixel in, below the magenta and blue lines
+            frame->x = (uint32_t)(1 + this_sequence_width);
+            frame->y = (uint32_t)(height + SEQUENCE_SPACING + BLUE_GAP);
+            frame->width = info->width;
+            frame->height = info->height;
+
+            this_sequence_width += info->width + BITMAP_SPACING;
         }
 
-        if(sequence->image_count > 1) {
+        if(sequence->info_count > 1) {
             this_sequence_width -= BITMAP_SPACING;
         }
 
@@ -105,119 +361,1047 @@ void generate_bluegen_image(const BlueGenImageSequence *sequences, size_t sequen
             width = this_sequence_width;
         }
 
+        band->height = (uint32_t)this_sequence_height;
         height += this_sequence_height + COLOR_PLATE_GAP;
     }
 
+    layout->width = (uint32_t)width;
+    layout->height = (uint32_t)height;
+}
+
+void free_bluegen_layout(BlueGenLayout *layout) {
+    for(size_t s = 0; s < layout->band_count; s++) {
+        free(layout->bands[s].frames);
+    }
+    free(layout->bands);
+}
+
+void place_bluegen_frame(BlueGenImage *plate, uint32_t *occupancy, const BlueGenImage *image, const BlueGenRect *rect, size_t sequence, size_t frame) {
+    BlueGenTime start;
+    if(occupancy) {
+        bluegen_time_now(&start);
+        scan_bluegen_image(occupancy, image);
+        bluegen_stats_stage(BLUEGEN_STAGE_SCAN, &start);
+        bluegen_trace_span("scan", &start, NULL, (long)sequence, (long)frame, (uint64_t)image->width * image->height * image->format);
+    }
+
+    bluegen_time_now(&start);
+    BlueGenPixel *plate_pixels = (BlueGenPixel *)plate->pixels;
+    size_t image_stride = (size_t)image->width * image->format;
+    for(uint32_t iy = 0; iy < image->height; iy++) {
+        blit_row(plate_pixels + rect->x + (size_t)(rect->y + iy) * plate->width, image->pixels + iy * image_stride, image->width, image->format);
+    }
+    bluegen_stats_stage(BLUEGEN_STAGE_BLIT, &start);
+    bluegen_trace_span("blit", &start, NULL, (long)sequence, (long)frame, (uint64_t)image->width * image->height * sizeof(BlueGenPixel));
+}
+
+void scan_bluegen_frame(uint32_t *occupancy, const BlueGenImage *plate, const BlueGenRect *rect, size_t sequence, size_t frame) {
+    BlueGenTime start;
+    bluegen_time_now(&start);
+    const BlueGenPixel *plate_pixels = (const BlueGenPixel *)plate->pixels;
+    uint8_t alpha = 0xFF;
+    for(uint32_t y = 0; y < rect->height; y++) {
+        alpha &= scan_colors_rgba(occupancy, (const uint8_t *)(plate_pixels + rect->x + (size_t)(rect->y + y) * plate->width), rect->width);
+    }
+    if(alpha != 0xFF) {
+        occupancy[OCCUPANCY_FLAGS] |= OCCUPANCY_TRANSLUCENT;
+    }
+    BLUEGEN_STATS_COUNT(pixels_scanned, (uint64_t)rect->width * rect->height);
+    bluegen_stats_stage(BLUEGEN_STAGE_SCAN, &start);
+    bluegen_trace_span("scan", &start, NULL, (long)sequence, (long)frame, (uint64_t)rect->width * rect->height * sizeof(BlueGenPixel));
+}
+
+int choose_bluegen_separators(const uint32_t *occupancy, const BlueGenPixel *dummy_space, BlueGenPixel *blue, BlueGenPixel *magenta, bool *preferred, BlueGenError *error) {
+    BlueGenTime start;
+    bluegen_time_now(&start);
+
     // This is used as a fallback
+    uint64_t candidates_tried = 0;
+    bool found = true;
     BlueGenPixel SAFE_PIXEL = { 0x00, 0x00, 0x00, 0xFF };
 
-    // Next, find some safe colors for blue and magenta
     BlueGenPixel BLUE_PIXEL = { 0x00, 0x00, 0xFF, 0xFF };
-    while(!is_safe_color(&BLUE_PIXEL, sequences, sequence_count)) {
-        increment_pixel(&SAFE_PIXEL, dummy_space);
+    while(found && !is_safe_color(&BLUE_PIXEL, occupancy)) {
+        found = increment_pixel(&SAFE_PIXEL, dummy_space);
+        candidates_tried++;
         BLUE_PIXEL = SAFE_PIXEL;
     }
     BlueGenPixel MAGENTA_PIXEL = { 0xFF, 0x00, 0xFF, 0xFF };
-    while(!is_safe_color(&MAGENTA_PIXEL, sequences, sequence_count)) {
-        increment_pixel(&SAFE_PIXEL, dummy_space);
+    while(found && !is_safe_color(&MAGENTA_PIXEL, occupancy)) {
+        found = increment_pixel(&SAFE_PIXEL, dummy_space);
+        candidates_tried++;
         MAGENTA_PIXEL = SAFE_PIXEL;
     }
 
-    initialize_bluegen_image(output, width, height);
+    *blue = BLUE_PIXEL;
+    *magenta = MAGENTA_PIXEL;
+    if(preferred) {
+        *preferred = candidates_tried == 0;
+    }
 
-    // First, make the color plate
-    output->pixels[0] = BLUE_PIXEL;
-    output->pixels[1] = MAGENTA_PIXEL;
-    output->pixels[2] = *dummy_space;
-    for(uint32_t x = 3; x < width; x++) {
-        output->pixels[x] = BLUE_PIXEL;
+    BLUEGEN_STATS_COUNT(candidates_tried, candidates_tried);
+    bluegen_stats_stage(BLUEGEN_STAGE_SCAN, &start);
+    bluegen_trace_span("choose colors", &start, NULL, -1, -1, 0);
+    if(!found) {
+        set_bluegen_error(error, NULL, "(O)< Eep! I need two unused colors!");
+        return 1;
+    }
+    return 0;
+}
+
+// Fill part of a row with a color
+static void fill_span(BlueGenPixel *row, uint32_t from, uint32_t to, const BlueGenPixel *color) {
+    for(uint32_t x = from; x < to; x++) {
+        row[x] = *color;
+    }
+}
+
+void fill_bluegen_header(BlueGenImage *plate, const BlueGenPixel *blue, const BlueGenPixel *magenta, const BlueGenPixel *dummy_space) {
+    BlueGenPixel *output_pixels = (BlueGenPixel *)plate->pixels;
+    output_pixels[0] = *blue;
+    output_pixels[1] = *magenta;
+    output_pixels[2] = *dummy_space;
+    fill_span(output_pixels, 3, plate->width, blue);
+}
+
+void fill_bluegen_band(BlueGenImage *plate, const BlueGenLayout *layout, size_t band_index, const BlueGenPixel *blue, const BlueGenPixel *magenta) {
+    BlueGenPixel *output_pixels = (BlueGenPixel *)plate->pixels;
+    uint32_t width = plate->width;
+    const BlueGenBand *band = layout->bands + band_index;
+    uint32_t y = band->y;
+
+    BlueGenTime start;
+    bluegen_time_now(&start);
+
+    // Fill the first two lines with magenta and blue respectively
+    for(uint32_t g = 0; g < SEQUENCE_SPACING; g++, y++) {
+        fill_span(output_pixels + (size_t)y * width, 0, width, magenta);
+    }
+    for(uint32_t g = 0; g < BLUE_GAP; g++, y++) {
+        fill_span(output_pixels + (size_t)y * width, 0, width, blue);
+    }
+
+    // Fill around the images with blue pixels, leaving the images alone
+    for(uint32_t row = 0; row < band->height; row++, y++) {
+        BlueGenPixel *line = output_pixels + (size_t)y * width;
+        uint32_t x = 0;
+        for(size_t i = 0; i < band->frame_count; i++) {
+            const BlueGenRect *frame = band->frames + i;
+            if(row < frame->height) {
+                fill_span(line, x, frame->x, blue);
+                x = frame->x + frame->width;
+            }
+        }
+        fill_span(line, x, width, blue);
+    }
+
+    // Add one more blue line
+    for(uint32_t g = 0; g < BLUE_GAP; g++, y++) {
+        fill_span(output_pixels + (size_t)y * width, 0, width, blue);
     }
 
+    bluegen_stats_stage(BLUEGEN_STAGE_BLIT, &start);
+    bluegen_trace_span("fill", &start, NULL, (long)band_index, -1, (uint64_t)(y - band->y) * width * sizeof(BlueGenPixel));
+}
+
+uint32_t bluegen_band_end(const BlueGenLayout *layout, size_t band_index) {
+    return band_index + 1 < layout->band_count ? layout->bands[band_index + 1].y : layout->height;
+}
+
+void fill_bluegen_separators(BlueGenImage *plate, const BlueGenLayout *layout, const BlueGenPixel *blue, const BlueGenPixel *magenta, const BlueGenPixel *dummy_space) {
+    // First, make the color plate
+    fill_bluegen_header(plate, blue, magenta, dummy_space);
+
     // Next, go through each sequence
-    uint32_t y = 1;
+    for(size_t s = 0; s < layout->band_count; s++) {
+        fill_bluegen_band(plate, layout, s, blue, magenta);
+    }
+}
+
+// Find the first pixel in [from, to) of a row that isn't fully transparent, or to if there isn't one
+static uint32_t first_visible(const uint8_t *row, uint32_t from, uint32_t to, BlueGenPixelFormat format) {
+    uint32_t x = from;
+    if(format == BLUEGEN_FORMAT_RGBA) {
+#if defined(USE_NEON)
+        for(; x + 16 <= to; x += 16) {
+            if(vmaxvq_u8(vld4q_u8(row + (size_t)x * 4).val[3])) {
+                break;
+            }
+        }
+#elif defined(USE_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for(; x + 4 <= to; x += 4) {
+            __m128i alpha = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(row + (size_t)x * 4)), 24);
+            if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) != 0xFFFF) {
+                break;
+            }
+        }
+#endif
+    }
+    for(; x < to && row[(size_t)x * format + format - 1] == 0; x++);
+    return x;
+}
 
-    #define FILL_LINE(color, amount) for(uint32_t g = 0; g < amount; g++) { for(uint32_t x = 0; x < width; x++) { output->pixels[x + y * width] = color; } y++; }
+// Find the pixel after the last one in [from, to) of a row that isn't fully transparent, or from if there isn't one
+static uint32_t last_visible(const uint8_t *row, uint32_t from, uint32_t to, BlueGenPixelFormat format) {
+    uint32_t x = to;
+    if(format == BLUEGEN_FORMAT_RGBA) {
+#if defined(USE_NEON)
+        for(; x >= from + 16; x -= 16) {
+            if(vmaxvq_u8(vld4q_u8(row + (size_t)(x - 16) * 4).val[3])) {
+                break;
+            }
+        }
+#elif defined(USE_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for(; x >= from + 4; x -= 4) {
+            __m128i alpha = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(row + (size_t)(x - 4) * 4)), 24);
+            if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) != 0xFFFF) {
+                break;
+            }
+        }
+#endif
+    }
+    for(; x > from && row[(size_t)(x - 1) * format + format - 1] == 0; x--);
+    return x;
+}
 
-    for(size_t s = 0; s < sequence_count; s++) {
-        const BlueGenImageSequence *sequence = sequences + s;
+void summarize_bluegen_image(const BlueGenImage *image, BlueGenColorSummary *summary) {
+    size_t pixel_count = (size_t)image->width * image->height;
+    memset(summary, 0, sizeof(*summary));
+    switch(image->format) {
+        case BLUEGEN_FORMAT_GRAY:
+            summarize_colors_gray(summary, image->pixels, pixel_count);
+            break;
+        case BLUEGEN_FORMAT_GRAY_ALPHA:
+            summarize_colors_gray_alpha(summary, image->pixels, pixel_count);
+            break;
+        case BLUEGEN_FORMAT_RGB:
+            summarize_colors_rgb(summary, image->pixels, pixel_count);
+            break;
+        case BLUEGEN_FORMAT_RGBA:
+            summarize_colors_rgba(summary, image->pixels, pixel_count);
+            break;
+    }
+}
 
-        // Fill the first two lines with magenta and blue respectively
-        FILL_LINE(MAGENTA_PIXEL, SEQUENCE_SPACING);
-        FILL_LINE(BLUE_PIXEL, BLUE_GAP);
+void find_bluegen_crop(const BlueGenImage *image, BlueGenCrop *crop) {
+    BlueGenTime start;
+    bluegen_time_now(&start);
 
-        // Find out the height of this sequence
-        uint32_t sequence_height = 0;
-        for(size_t i = 0; i < sequence->image_count; i++) {
-            uint32_t image_height = sequence->images[i].height;
-            if(image_height > sequence_height) {
-                sequence_height = image_height;
+    uint32_t width = image->width, height = image->height;
+    crop->width = width;
+    crop->height = height;
+    crop->kept = (BlueGenRect){ 0, 0, width, height };
+    crop->visible = crop->kept;
+    if(image->format != BLUEGEN_FORMAT_GRAY_ALPHA && image->format != BLUEGEN_FORMAT_RGBA) {
+        return;
+    }
+
+    // Only the parts of each row outside of what's visible so far need to be looked at
+    uint32_t left = width, right = 0, top = height, bottom = 0;
+    size_t stride = (size_t)width * image->format;
+    for(uint32_t y = 0; y < height; y++) {
+        const uint8_t *row = image->pixels + y * stride;
+        uint32_t first = first_visible(row, 0, left, image->format);
+        uint32_t last;
+        if(first < left) {
+            left = first;
+            uint32_t from = right > first + 1 ? right : first + 1;
+            last = last_visible(row, from, width, image->format);
+        }
+        else {
+            // Nothing left of what's visible so far, so this row might be empty
+            last = last_visible(row, left, width, image->format);
+            if(last == left) {
+                continue;
             }
         }
+        if(last > right) {
+            right = last;
+        }
+        if(top == height) {
+            top = y;
+        }
+        bottom = y + 1;
+    }
 
-        // Fill out the sequence with blue pixels
-        FILL_LINE(BLUE_PIXEL, sequence_height);
-        y -= sequence_height;
+    bluegen_stats_stage(BLUEGEN_STAGE_SCAN, &start);
+    bluegen_trace_span("crop", &start, NULL, -1, -1, (uint64_t)width * height * image->format);
 
-        // Put the images in place
-        uint32_t x = 1;
-        for(size_t i = 0; i < sequence->image_count; i++) {
-            const BlueGenImage *image = sequence->images + i;
-            uint32_t image_height = image->height;
-            uint32_t image_width = image->width;
+    // Nothing to crop around
+    if(top == height) {
+        return;
+    }
+
+    uint32_t crop_x = left < width - right ? left : width - right;
+    uint32_t crop_y = top < height - bottom ? top : height - bottom;
+    crop->kept = (BlueGenRect){ crop_x, crop_y, width - crop_x * 2, height - crop_y * 2 };
+    crop->visible = (BlueGenRect){ left, top, right - left, bottom - top };
+}
 
-            for(uint32_t iy = 0; iy < image_height; iy++) {
-                for(uint32_t ix = 0; ix < image_width; ix++) {
+void place_bluegen_cropped_frame(BlueGenImage *plate, uint32_t *occupancy, const BlueGenImage *image, const BlueGenCrop *crop, const BlueGenPixel *dummy_space, const BlueGenRect *rect, size_t sequence, size_t frame) {
+    BlueGenTime start;
+    bluegen_time_now(&start);
+    BlueGenPixel *plate_pixels = (BlueGenPixel *)plate->pixels;
+    const BlueGenRect *kept = &crop->kept, *visible = &crop->visible;
+    uint32_t visible_left = visible->x - kept->x;
+    uint32_t visible_right = visible_left + visible->width;
+    size_t image_stride = (size_t)image->width * image->format;
+    for(uint32_t ky = 0; ky < kept->height; ky++) {
+        BlueGenPixel *line = plate_pixels + rect->x + (size_t)(rect->y + ky) * plate->width;
+        uint32_t y = kept->y + ky;
+        if(y < visible->y || y >= visible->y + visible->height) {
+            fill_span(line, 0, kept->width, dummy_space);
+            continue;
+        }
+        fill_span(line, 0, visible_left, dummy_space);
+        blit_row(line + visible_left, image->pixels + y * image_stride + (size_t)visible->x * image->format, visible->width, image->format);
+        fill_span(line, visible_right, kept->width, dummy_space);
+    }
+    bluegen_stats_stage(BLUEGEN_STAGE_BLIT, &start);
+    bluegen_trace_span("blit", &start, NULL, (long)sequence, (long)frame, (uint64_t)kept->width * kept->height * sizeof(BlueGenPixel));
 
-                    const BlueGenPixel *input_pixel = image->pixels + ix + iy * image_width;
-                    BlueGenPixel *output_pixel = output->pixels + x + ix + (y + iy) * width;
-                    *output_pixel = *input_pixel;
-                }
+    // Dummy space is never picked as a separator, so only what was copied has to be scanned
+    BlueGenRect copied = { rect->x + visible_left, rect->y + (visible->y - kept->y), visible->width, visible->height };
+    scan_bluegen_frame(occupancy, plate, &copied, sequence, frame);
+}
+
+int generate_bluegen_image(const BlueGenImageSequence *sequences, size_t sequence_count, const BlueGenPixel *dummy_space, bool crop, BlueGenImage *output, BlueGenError *error) {
+    BlueGenTime start;
+    bluegen_time_now(&start);
+
+    // Lay out the images by their dimensions, after cropping them if we're doing that
+    BlueGenImageInfoSequence *info_sequences = calloc(sequence_count, sizeof(*info_sequences));
+    BlueGenCrop **crops = crop ? calloc(sequence_count, sizeof(*crops)) : NULL;
+    for(size_t s = 0; s < sequence_count; s++) {
+        const BlueGenImageSequence *sequence = sequences + s;
+        info_sequences[s].infos = calloc(sequence->image_count, sizeof(*info_sequences[s].infos));
+        info_sequences[s].info_count = sequence->image_count;
+        if(crop) {
+            crops[s] = calloc(sequence->image_count ? sequence->image_count : 1, sizeof(**crops));
+        }
+        for(size_t i = 0; i < sequence->image_count; i++) {
+            info_sequences[s].infos[i].width = sequence->images[i].width;
+            info_sequences[s].infos[i].height = sequence->images[i].height;
+            info_sequences[s].infos[i].format = sequence->images[i].format;
+            if(crop) {
+                find_bluegen_crop(sequence->images + i, crops[s] + i);
+                info_sequences[s].infos[i].width = crops[s][i].kept.width;
+                info_sequences[s].infos[i].height = crops[s][i].kept.height;
             }
+        }
+    }
 
-            x += BITMAP_SPACING + image->width;
+    BlueGenLayout layout;
+    layout_bluegen_image(&layout, info_sequences, sequence_count);
+    for(size_t s = 0; s < sequence_count; s++) {
+        free(info_sequences[s].infos);
+    }
+    free(info_sequences);
+
+    bluegen_stats_stage(BLUEGEN_STAGE_LAYOUT, &start);
+    bluegen_trace_span("layout", &start, NULL, -1, -1, 0);
+
+    // Put each image in place, finding every color used so we can pick some safe colors for blue and magenta
+    initialize_bluegen_image(output, layout.width, layout.height, BLUEGEN_FORMAT_RGBA);
+    uint32_t *occupancy = allocate_bluegen_occupancy();
+    for(size_t s = 0; s < sequence_count; s++) {
+        for(size_t i = 0; i < sequences[s].image_count; i++) {
+            if(crop) {
+                place_bluegen_cropped_frame(output, occupancy, sequences[s].images + i, crops[s] + i, dummy_space, layout.bands[s].frames + i, s, i);
+            }
+            else {
+                place_bluegen_frame(output, occupancy, sequences[s].images + i, layout.bands[s].frames + i, s, i);
+            }
+        }
+        if(crop) {
+            free(crops[s]);
         }
+    }
+    free(crops);
 
-        y += sequence_height;
+    BlueGenPixel blue, magenta;
+    int result = choose_bluegen_separators(occupancy, dummy_space, &blue, &magenta, NULL, error);
+    free(occupancy);
 
-        // Add one more blue line
-        FILL_LINE(BLUE_PIXEL, 1);
+    if(result == 0) {
+        fill_bluegen_separators(output, &layout, &blue, &magenta, dummy_space);
     }
+    else {
+        free_bluegen_image(output);
+        memset(output, 0, sizeof(*output));
+    }
+    free_bluegen_layout(&layout);
+    return result;
 }
 
-void load_tiff(BlueGenImage *image, const char *path) {
-    // Open the tiff
+// Get the format an open TIFF can be read in natively, or 0 if it has to be converted to RGBA
+static BlueGenPixelFormat tiff_native_format(TIFF *image_tiff) {
+    uint16_t bits_per_sample, samples_per_pixel, planar_config, photometric = 0;
+    TIFFGetFieldDefaulted(image_tiff, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+    TIFFGetFieldDefaulted(image_tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+    TIFFGetFieldDefaulted(image_tiff, TIFFTAG_PLANARCONFIG, &planar_config);
+    TIFFGetField(image_tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+
+    // 8-bit, interleaved, stripped grayscale and RGB(A) can be read as-is, keeping however many channels it has
+    bool native = bits_per_sample == 8 && planar_config == PLANARCONFIG_CONTIG && !TIFFIsTiled(image_tiff) && (
+        (photometric == PHOTOMETRIC_MINISBLACK && samples_per_pixel <= 2) ||
+        (photometric == PHOTOMETRIC_RGB && (samples_per_pixel == 3 || samples_per_pixel == 4))
+    );
+
+    return native ? (BlueGenPixelFormat)samples_per_pixel : (BlueGenPixelFormat)0;
+}
+
+int probe_tiff(BlueGenImageInfo *info, const char *path, BlueGenError *error) {
     TIFF *image_tiff = TIFFOpen(path, "r");
     if(!image_tiff) {
-        fprintf(stderr, "(v)> Cannot open TIFF %s\n", path);
-        exit(EXIT_FAILURE);
+        set_bluegen_error(error, path, "(v)> Cannot open TIFF %s", path);
+        return 1;
     }
 
-    // Allocate and the image
-    uint32_t width, height;
+    info->width = 0;
+    info->height = 0;
+    TIFFGetField(image_tiff, TIFFTAG_IMAGEWIDTH, &info->width);
+    TIFFGetField(image_tiff, TIFFTAG_IMAGELENGTH, &info->height);
+    BlueGenPixelFormat format = tiff_native_format(image_tiff);
+    info->format = format ? format : BLUEGEN_FORMAT_RGBA;
+
+    TIFFClose(image_tiff);
+    return 0;
+}
+
+// Decode the current directory of an open TIFF
+static int decode_tiff_directory(BlueGenImage *image, TIFF *image_tiff, const char *path, BlueGenError *error) {
+    // Get the dimensions and layout
+    uint32_t width = 0, height = 0;
     TIFFGetField(image_tiff, TIFFTAG_IMAGEWIDTH, &width);
     TIFFGetField(image_tiff, TIFFTAG_IMAGELENGTH, &height);
-    initialize_bluegen_image(image, width, height);
+    BlueGenPixelFormat format = tiff_native_format(image_tiff);
 
-    // Force associated alpha so alpha doesn't get multiplied in TIFFReadRGBAImageOriented
-    uint16_t ua[] = { EXTRASAMPLE_ASSOCALPHA };
-    TIFFSetField(image_tiff, TIFFTAG_EXTRASAMPLES, 1, ua);
+    BlueGenImage decoded;
+    initialize_bluegen_image(&decoded, width, height, format ? format : BLUEGEN_FORMAT_RGBA);
+    if(!decoded.pixels) {
+        set_bluegen_error(error, path, "(v)> Failed to load %s! Error was: Out of memory", path);
+        return 1;
+    }
+    if(format) {
+        size_t stride = (size_t)width * format;
+        for(uint32_t y = 0; y < height; y++) {
+            if(TIFFReadScanline(image_tiff, decoded.pixels + y * stride, y, 0) < 0) {
+                free_bluegen_image(&decoded);
+                set_bluegen_error(error, path, "(v)> Failed to read TIFF %s", path);
+                return 1;
+            }
+        }
+    }
+    else {
+        // Force associated alpha so alpha doesn't get multiplied in TIFFReadRGBAImageOriented
+        uint16_t ua[] = { EXTRASAMPLE_ASSOCALPHA };
+        TIFFSetField(image_tiff, TIFFTAG_EXTRASAMPLES, 1, ua);
 
-    // Read it all
-    TIFFReadRGBAImageOriented(image_tiff, width, height, (uint32_t *)(image->pixels), ORIENTATION_TOPLEFT, 0);
+        // Read it all
+        if(!TIFFReadRGBAImageOriented(image_tiff, width, height, (uint32_t *)(decoded.pixels), ORIENTATION_TOPLEFT, 0)) {
+            free_bluegen_image(&decoded);
+            set_bluegen_error(error, path, "(v)> Failed to read TIFF %s", path);
+            return 1;
+        }
+    }
+
+    *image = decoded;
+    return 0;
+}
+
+// Decode an open TIFF, closing it afterward
+static int decode_tiff(BlueGenImage *image, TIFF *image_tiff, const char *path, BlueGenError *error) {
+    int result = decode_tiff_directory(image, image_tiff, path, error);
 
     // Close the TIFF
     TIFFClose(image_tiff);
+    return result;
+}
+
+int load_tiff(BlueGenImage *image, const char *path, BlueGenError *error) {
+    // Open the tiff
+    TIFF *image_tiff = TIFFOpen(path, "r");
+    if(!image_tiff) {
+        set_bluegen_error(error, path, "(v)> Cannot open TIFF %s", path);
+        return 1;
+    }
+    return decode_tiff(image, image_tiff, path, error);
+}
+
+// libtiff client I/O over a file that was already read into memory
+typedef struct MemoryTIFF {
+    const uint8_t *data;
+    toff_t size;
+    toff_t offset;
+} MemoryTIFF;
+
+static tmsize_t memory_tiff_read(thandle_t handle, void *buffer, tmsize_t size) {
+    MemoryTIFF *file = handle;
+    toff_t left = file->offset < file->size ? file->size - file->offset : 0;
+    if((toff_t)size > left) {
+        size = (tmsize_t)left;
+    }
+    memcpy(buffer, file->data + file->offset, (size_t)size);
+    file->offset += (toff_t)size;
+    return size;
+}
+
+static tmsize_t memory_tiff_write(thandle_t handle, void *buffer, tmsize_t size) {
+    (void)handle;
+    (void)buffer;
+    (void)size;
+    return 0;
+}
+
+static toff_t memory_tiff_seek(thandle_t handle, toff_t offset, int whence) {
+    MemoryTIFF *file = handle;
+    switch(whence) {
+        case SEEK_CUR:
+            offset += file->offset;
+            break;
+        case SEEK_END:
+            offset += file->size;
+            break;
+    }
+    file->offset = offset;
+    return offset;
+}
+
+static int memory_tiff_close(thandle_t handle) {
+    (void)handle;
+    return 0;
+}
+
+static toff_t memory_tiff_size(thandle_t handle) {
+    return ((MemoryTIFF *)handle)->size;
+}
+
+// Letting libtiff "map" the buffer saves it from copying strips out of it
+static int memory_tiff_map(thandle_t handle, void **base, toff_t *size) {
+    MemoryTIFF *file = handle;
+    *base = (void *)file->data;
+    *size = file->size;
+    return 1;
+}
+
+static void memory_tiff_unmap(thandle_t handle, void *base, toff_t size) {
+    (void)handle;
+    (void)base;
+    (void)size;
+}
+
+// Open a TIFF that was already read into memory; file has to outlive the TIFF
+static TIFF *open_memory_tiff(MemoryTIFF *file, const char *path, const uint8_t *data, size_t size, BlueGenError *error) {
+    file->data = data;
+    file->size = (toff_t)size;
+    file->offset = 0;
+    TIFF *image_tiff = TIFFClientOpen(path, "rm", file, memory_tiff_read, memory_tiff_write, memory_tiff_seek, memory_tiff_close, memory_tiff_size, memory_tiff_map, memory_tiff_unmap);
+    if(!image_tiff) {
+        set_bluegen_error(error, path, "(v)> Cannot open TIFF %s", path);
+    }
+    return image_tiff;
+}
+
+int load_tiff_from_memory(BlueGenImage *image, const char *path, const uint8_t *data, size_t size, BlueGenError *error) {
+    MemoryTIFF file;
+    TIFF *image_tiff = open_memory_tiff(&file, path, data, size, error);
+    if(!image_tiff) {
+        return 1;
+    }
+    return decode_tiff(image, image_tiff, path, error);
+}
+
+size_t probe_tiff_pages(const char *path, BlueGenImageInfo **infos, BlueGenError *error) {
+    *infos = NULL;
+    TIFF *image_tiff = TIFFOpen(path, "r");
+    if(!image_tiff) {
+        set_bluegen_error(error, path, "(v)> Cannot open TIFF %s", path);
+        return 0;
+    }
+
+    size_t page_count = 0;
+    do {
+        BlueGenImageInfo *grown = realloc(*infos, (page_count + 1) * sizeof(**infos));
+        if(!grown) {
+            free(*infos);
+            *infos = NULL;
+            TIFFClose(image_tiff);
+            set_bluegen_error(error, path, "(v)> Failed to load %s! Error was: Out of memory", path);
+            return 0;
+        }
+        *infos = grown;
+        BlueGenImageInfo *info = *infos + page_count++;
+        info->width = 0;
+        info->height = 0;
+        TIFFGetField(image_tiff, TIFFTAG_IMAGEWIDTH, &info->width);
+        TIFFGetField(image_tiff, TIFFTAG_IMAGELENGTH, &info->height);
+        BlueGenPixelFormat format = tiff_native_format(image_tiff);
+        info->format = format ? format : BLUEGEN_FORMAT_RGBA;
+    }
+    while(TIFFReadDirectory(image_tiff));
+
+    TIFFClose(image_tiff);
+    return page_count;
 }
 
-void load_image(BlueGenImage *image, const char *path) {
+int decode_tiff_pages(const char *path, const uint8_t *data, size_t size, size_t page_count, BlueGenFrameCallback callback, void *context, BlueGenError *error) {
+    MemoryTIFF file;
+    TIFF *image_tiff = open_memory_tiff(&file, path, data, size, error);
+    if(!image_tiff) {
+        return 1;
+    }
+    int result = 0;
+    for(size_t p = 0; p < page_count && result == 0; p++) {
+        BlueGenImage image;
+        if(p > 0 && !TIFFReadDirectory(image_tiff)) {
+            set_bluegen_error(error, path, "(v)> %s changed while it was being read.", path);
+            result = 1;
+        }
+        else if((result = decode_tiff_directory(&image, image_tiff, path, error)) == 0) {
+            result = callback(context, &image, p, error);
+            free_bluegen_image(&image);
+        }
+    }
+    TIFFClose(image_tiff);
+    return result;
+}
+
+int probe_image(BlueGenImageInfo *info, const char *path, BlueGenError *error) {
+    int width, height, channels = 0;
+    if(!stbi_info(path, &width, &height, &channels)) {
+        set_bluegen_error(error, path, "(v)> Failed to load %s! Error was: %s", path, stbi_failure_reason());
+        return 1;
+    }
+    // stbi_info passes along the negative height of top-down BMPs as-is, unlike stbi_load
+    info->width = (uint32_t)(width);
+    info->height = (uint32_t)(height < 0 ? -height : height);
+    info->format = (BlueGenPixelFormat)channels;
+    return 0;
+}
+
+int load_image(BlueGenImage *image, const char *path, BlueGenError *error) {
     // Load it
     int width, height, channels = 0;
-    image->pixels = (BlueGenPixel *)stbi_load(path, &width, &height, &channels, 4);
-    if(!image->pixels) {
-        fprintf(stderr, "(v)> Failed to load %s! Error was: %s\n", path, stbi_failure_reason());
-        exit(EXIT_FAILURE);
+    uint8_t *pixels = stbi_load(path, &width, &height, &channels, 0);
+    if(!pixels) {
+        set_bluegen_error(error, path, "(v)> Failed to load %s! Error was: %s", path, stbi_failure_reason());
+        return 1;
     }
+    image->pixels = pixels;
     image->width = (uint32_t)(width);
     image->height = (uint32_t)(height);
+    image->format = (BlueGenPixelFormat)channels;
     image->free = stbi_image_free;
+    return 0;
 }
+
+int load_image_from_memory(BlueGenImage *image, const char *path, const uint8_t *data, size_t size, BlueGenError *error) {
+    if(size > INT_MAX) {
+        set_bluegen_error(error, path, "(v)> Failed to load %s! Error was: file too large", path);
+        return 1;
+    }
+
+    int width, height, channels = 0;
+    uint8_t *pixels = stbi_load_from_memory(data, (int)size, &width, &height, &channels, 0);
+    if(!pixels) {
+        set_bluegen_error(error, path, "(v)> Failed to load %s! Error was: %s", path, stbi_failure_reason());
+        return 1;
+    }
+    image->pixels = pixels;
+    image->width = (uint32_t)(width);
+    image->height = (uint32_t)(height);
+    image->format = (BlueGenPixelFormat)channels;
+    image->free = stbi_image_free;
+    return 0;
+}
+
+static bool ends_with(const char *str, const char *ext) {
+    size_t str_len = strlen(str);
+    size_t ext_len = strlen(ext);
+
+    if(str_len < ext_len) {
+        return false;
+    }
+    else {
+        for(const char *i = str + str_len - ext_len, *j = ext; *i; i++, j++) {
+            if(tolower(*i) != tolower(*j)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+BlueGenFileType bluegen_file_type(const char *path) {
+    if(ends_with(path, ".tif") || ends_with(path, ".tiff")) {
+        return BLUEGEN_FILE_TIFF;
+    }
+    else if(ends_with(path, ".png") || ends_with(path, ".tga") || ends_with(path, ".bmp") || ends_with(path, ".gif")) {
+        return BLUEGEN_FILE_IMAGE;
+    }
+    else {
+        return BLUEGEN_FILE_UNKNOWN;
+    }
+}
+
+int probe_file(BlueGenImageInfo *info, const char *path, BlueGenError *error) {
+    switch(bluegen_file_type(path)) {
+        case BLUEGEN_FILE_TIFF:
+            return probe_tiff(info, path, error);
+        case BLUEGEN_FILE_IMAGE:
+            return probe_image(info, path, error);
+        case BLUEGEN_FILE_UNKNOWN:
+            break;
+    }
+    set_bluegen_error(error, path, "(v)> Failed to open %s! Unknown file type...", path);
+    return 1;
+}
+
+int load_file(BlueGenImage *image, const char *path, BlueGenError *error) {
+    switch(bluegen_file_type(path)) {
+        case BLUEGEN_FILE_TIFF:
+            return load_tiff(image, path, error);
+        case BLUEGEN_FILE_IMAGE:
+            return load_image(image, path, error);
+        case BLUEGEN_FILE_UNKNOWN:
+            break;
+    }
+    set_bluegen_error(error, path, "(v)> Failed to open %s! Unknown file type...", path);
+    return 1;
+}
+
+int load_file_from_memory(BlueGenImage *image, const char *path, const uint8_t *data, size_t size, BlueGenError *error) {
+    switch(bluegen_file_type(path)) {
+        case BLUEGEN_FILE_TIFF:
+            return load_tiff_from_memory(image, path, data, size, error);
+        case BLUEGEN_FILE_IMAGE:
+            return load_image_from_memory(image, path, data, size, error);
+        case BLUEGEN_FILE_UNKNOWN:
+            break;
+    }
+    set_bluegen_error(error, path, "(v)> Failed to open %s! Unknown file type...", path);
+    return 1;
+}
+
+int open_bluegen_tiff_writer(BlueGenTiffWriter *writer, const char *path, uint32_t width, uint32_t height, bool alpha) {
+    BlueGenTime start;
+    bluegen_time_now(&start);
+
+    FILE *f = fopen(path, "wb");
+    if(!f) {
+        return 1;
+    }
+
+    writer->file = f;
+    writer->path = path;
+    writer->width = width;
+    writer->height = height;
+    writer->samples_per_pixel = alpha ? 4 : 3;
+    writer->packed = NULL;
+    writer->packed_rows = 0;
+    writer->rows_written = 0;
+    writer->failed = false;
+    writer->rewriting = false;
+
+    uint16_t magic = 0x4949;
+    uint16_t version = 42;
+
+    // Write the TIFF header
+    fwrite(&magic, sizeof(magic), 1, f);
+    fwrite(&version, sizeof(magic), 1, f);
+
+    writer->pixel_offset = sizeof(uint32_t) + ftell(f);
+    uint32_t tag_offset = width * height * writer->samples_per_pixel + writer->pixel_offset;
+
+    // Write the offset to the tags
+    fwrite(&tag_offset, sizeof(tag_offset), 1, f);
+    bluegen_trace_span("write header", &start, path, -1, -1, writer->pixel_offset);
+    bluegen_stats_stage(BLUEGEN_STAGE_WRITE, &start);
+
+    return 0;
+}
+
+int reopen_bluegen_tiff_writer(BlueGenTiffWriter *writer, const char *path, uint32_t width, uint32_t height, bool alpha) {
+    FILE *f = fopen(path, "r+b");
+    if(!f) {
+        return 1;
+    }
+
+    // The pixels start right after the header, and the tags right after them
+    uint16_t samples_per_pixel = alpha ? 4 : 3;
+    uint16_t header[2];
+    uint32_t tag_offset;
+    uint32_t pixel_offset = sizeof(header) + sizeof(tag_offset);
+    if(fread(header, sizeof(header), 1, f) != 1 || fread(&tag_offset, sizeof(tag_offset), 1, f) != 1 ||
+       header[0] != 0x4949 || header[1] != 42 || tag_offset != width * height * samples_per_pixel + pixel_offset) {
+        fclose(f);
+        return 1;
+    }
+
+    writer->file = f;
+    writer->path = path;
+    writer->width = width;
+    writer->height = height;
+    writer->samples_per_pixel = samples_per_pixel;
+    writer->packed = NULL;
+    writer->packed_rows = 0;
+    writer->pixel_offset = pixel_offset;
+    writer->rows_written = 0;
+    writer->failed = false;
+    writer->rewriting = true;
+    return 0;
+}
+
+void seek_bluegen_tiff_writer(BlueGenTiffWriter *writer, uint32_t row) {
+    long offset = (long)writer->pixel_offset + (long)row * writer->width * writer->samples_per_pixel;
+    if(fseek(writer->file, offset, SEEK_SET) != 0) {
+        writer->failed = true;
+    }
+    writer->rows_written = row;
+}
+
+// Pack RGBA pixels down to RGB; output needs 4 bytes of room past the end for the SSSE3 stores
+static void pack_rgb(uint8_t *output, const BlueGenPixel *input, size_t pixel_count) {
+    size_t i = 0;
+#if defined(USE_NEON)
+    for(; i + 16 <= pixel_count; i += 16) {
+        uint8x16x4_t rgba = vld4q_u8((const uint8_t *)(input + i));
+        uint8x16x3_t rgb = {{ rgba.val[0], rgba.val[1], rgba.val[2] }};
+        vst3q_u8(output + i * 3, rgb);
+    }
+#elif defined(USE_SSSE3)
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    for(; i + 4 <= pixel_count; i += 4) {
+        __m128i rgba = _mm_loadu_si128((const __m128i *)(input + i));
+        _mm_storeu_si128((__m128i *)(output + i * 3), _mm_shuffle_epi8(rgba, shuffle));
+    }
+#endif
+    for(; i < pixel_count; i++) {
+        output[i * 3] = input[i].red;
+        output[i * 3 + 1] = input[i].green;
+        output[i * 3 + 2] = input[i].blue;
+    }
+}
+
+// Rows are packed to RGB this much at a time
+#define PACKED_BUFFER_SIZE (1 << 20)
+
+void write_bluegen_tiff_rows(BlueGenTiffWriter *writer, const BlueGenPixel *rows, uint32_t row_count) {
+    if(row_count == 0) {
+        return;
+    }
+
+    BlueGenTime start;
+    bluegen_time_now(&start);
+
+    size_t size = (size_t)writer->width * row_count * writer->samples_per_pixel;
+    if(writer->samples_per_pixel == 4) {
+        if(fwrite(rows, size, 1, writer->file) != 1) {
+            writer->failed = true;
+        }
+    }
+    else {
+        size_t row_size = (size_t)writer->width * 3;
+        if(!writer->packed) {
+            writer->packed_rows = row_size >= PACKED_BUFFER_SIZE ? 1 : (uint32_t)(PACKED_BUFFER_SIZE / row_size);
+            writer->packed = malloc(writer->packed_rows * row_size + 4);
+            if(!writer->packed) {
+                writer->failed = true;
+                return;
+            }
+        }
+        for(uint32_t y = 0; y < row_count; y += writer->packed_rows) {
+            uint32_t count = row_count - y < writer->packed_rows ? row_count - y : writer->packed_rows;
+            pack_rgb(writer->packed, rows + (size_t)y * writer->width, (size_t)count * writer->width);
+            if(fwrite(writer->packed, row_size * count, 1, writer->file) != 1) {
+                writer->failed = true;
+            }
+        }
+    }
+    writer->rows_written += row_count;
+
+    bluegen_trace_span("write pixels", &start, writer->path, -1, -1, size);
+    bluegen_stats_stage(BLUEGEN_STAGE_WRITE, &start);
+}
+
+int close_bluegen_tiff_writer(BlueGenTiffWriter *writer) {
+    BlueGenTime span_start;
+    bluegen_time_now(&span_start);
+    BlueGenTime write_start = span_start;
+
+    FILE *f = writer->file;
+    uint32_t width = writer->width;
+    uint32_t height = writer->height;
+    uint32_t pixel_offset = writer->pixel_offset;
+    uint16_t samples_per_pixel = writer->samples_per_pixel;
+    uint32_t tag_offset = width * height * samples_per_pixel + pixel_offset;
+    free(writer->packed);
+    writer->packed = NULL;
+
+    // The tags are already there
+    if(writer->rewriting) {
+        if(fclose(f) != 0) {
+            writer->failed = true;
+        }
+        bluegen_stats_stage(BLUEGEN_STAGE_WRITE, &write_start);
+        return writer->failed ? 1 : 0;
+    }
+
+    // Every row has to be there, or the tags would end up in the wrong place
+    if(writer->rows_written != height) {
+        writer->failed = true;
+    }
+
+    // Write however many tags we need; there are no extra samples without alpha
+    uint16_t tag_count = samples_per_pixel == 4 ? 10 : 9;
+    fwrite(&tag_count, sizeof(tag_count), 1, f);
+
+    uint32_t after_tag_offset = tag_offset + sizeof(tag_count) + sizeof(TIFFTag) * tag_count + 4;
+
+    // Write the width and height
+    {
+        TIFFTag width_tag;
+        width_tag.type = 0x100;
+        width_tag.data_offset = width;
+        width_tag.size = width >= UINT16_MAX ? 4 : 3;
+        width_tag.count = 1;
+
+        TIFFTag height_tag;
+        height_tag.type = 0x101;
+        height_tag.data_offset = height;
+        height_tag.size = height >= UINT16_MAX ? 4 : 3;
+        height_tag.count = 1;
+
+        fwrite(&width_tag, sizeof(width_tag), 1, f);
+        fwrite(&height_tag, sizeof(height_tag), 1, f);
+    }
+
+    // Write the bits per sample
+    {
+        TIFFTag bits_per_sample_tag;
+        bits_per_sample_tag.type = 0x102;
+        bits_per_sample_tag.size = 3;
+        bits_per_sample_tag.count = samples_per_pixel;
+        bits_per_sample_tag.data_offset = after_tag_offset;
+        fwrite(&bits_per_sample_tag, sizeof(bits_per_sample_tag), 1, f);
+
+        after_tag_offset += sizeof(BITS_PER_SAMPLE);
+    }
+
+    // Write the compression (1 = no compression)
+    {
+        TIFFTag compression_tag;
+        compression_tag.type = 0x103;
+        compression_tag.size = 3;
+        compression_tag.count = 1;
+        compression_tag.data_offset = 1;
+        fwrite(&compression_tag, sizeof(compression_tag), 1, f);
+
+        after_tag_offset += sizeof(BITS_PER_SAMPLE);
+    }
+
+    // Write the photometric interpretation (2 = RGB)
+    {
+        TIFFTag photometric_interpretation_tag;
+        photometric_interpretation_tag.type = 0x106;
+        photometric_interpretation_tag.size = 3;
+        photometric_interpretation_tag.count = 1;
+        photometric_interpretation_tag.data_offset = 2;
+        fwrite(&photometric_interpretation_tag, sizeof(photometric_interpretation_tag), 1, f);
+
+        after_tag_offset += sizeof(BITS_PER_SAMPLE);
+    }
+
+    // Write the strips offset
+    {
+        TIFFTag strips_tag;
+        strips_tag.type = 0x111;
+        strips_tag.data_offset = pixel_offset;
+        strips_tag.size = 4;
+        strips_tag.count = 1;
+        fwrite(&strips_tag, sizeof(strips_tag), 1, f);
+    }
+
+    // Write the orientation (1 = top-left)
+    {
+        TIFFTag strips_tag;
+        strips_tag.type = 0x112;
+        strips_tag.data_offset = 1;
+        strips_tag.size = 3;
+        strips_tag.count = 1;
+        fwrite(&strips_tag, sizeof(strips_tag), 1, f);
+    }
+
+    // Write the samples per pixel (4 samples per pixel for rgba, or 3 for rgb)
+    {
+        TIFFTag samples_per_pixel_tag;
+        samples_per_pixel_tag.type = 0x115;
+        samples_per_pixel_tag.data_offset = samples_per_pixel;
+        samples_per_pixel_tag.size = 3;
+        samples_per_pixel_tag.count = 1;
+        fwrite(&samples_per_pixel_tag, sizeof(samples_per_pixel_tag), 1, f);
+    }
+
+    // Write the strip byte counts
+    {
+        TIFFTag strip_byte_count_tag;
+        strip_byte_count_tag.type = 0x117;
+        strip_byte_count_tag.data_offset = width * height * samples_per_pixel;
+        strip_byte_count_tag.size = 4;
+        strip_byte_count_tag.count = 1;
+        fwrite(&strip_byte_count_tag, sizeof(strip_byte_count_tag), 1, f);
+    }
+
+    // Write the extra samples (2 = unassociated alpha)
+    if(samples_per_pixel == 4) {
+        TIFFTag extra_samples_tag;
+        extra_samples_tag.type = 0x152;
+        extra_samples_tag.data_offset = 2;
+        extra_samples_tag.size = 3;
+        extra_samples_tag.count = 1;
+        fwrite(&extra_samples_tag, sizeof(extra_samples_tag), 1, f);
+    }
+
+    // Next directory offset
+    uint32_t next_directory_offset = 0;
+    fwrite(&next_directory_offset, sizeof(next_directory_offset), 1, f);
+
+    // Write all those bits per sample
+    fwrite(BITS_PER_SAMPLE, sizeof(*BITS_PER_SAMPLE), samples_per_pixel, f);
+
+    uint64_t bytes_written = (uint64_t)ftell(f);
+    BLUEGEN_STATS_COUNT(bytes_written, bytes_written);
+    bluegen_trace_span("write tags", &span_start, writer->path, -1, -1, bytes_written - tag_offset);
+    bluegen_time_now(&span_start);
+    if(ferror(f)) {
+        writer->failed = true;
+    }
+    if(fclose(f) != 0) {
+        writer->failed = true;
+    }
+    writer->file = NULL;
+    bluegen_trace_span("close", &span_start, writer->path, -1, -1, 0);
+    bluegen_stats_stage(BLUEGEN_STAGE_WRITE, &write_start);
+
+    return writer->failed ? 1 : 0;
+}
+
+int write_tiff(const BlueGenImage *image, const char *path) {
+    const BlueGenPixel *pixels = (const BlueGenPixel *)image->pixels;
+    bool alpha = false;
+    for(size_t i = 0; i < (size_t)image->width * image->height && !alpha; i++) {
+        alpha = pixels[i].alpha != 0xFF;
+    }
+
+    BlueGenTiffWriter writer;
+    if(open_bluegen_tiff_writer(&writer, path, image->width, image->height, alpha) != 0) {
+        return 1;
+    }
+    write_bluegen_tiff_rows(&writer, (const BlueGenPixel *)image->pixels, image->height);
+    return close_bluegen_tiff_writer(&writer);
+}
+
@@ -4,8 +4,13 @@
  * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
  */
 
+#ifndef BLUEGEN_H
+#define BLUEGEN_H
+
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,11 +26,31 @@ typedef struct BlueGenPixel {
     uint8_t alpha;
 } BlueGenPixel;
 
+/**
+ * Channel layout of an image's pixel data; the value is the number of 8-bit channels per pixel
+ */
+typedef enum BlueGenPixelFormat {
+    /** Luminance only; expands to (y, y, y, 0xFF) */
+    BLUEGEN_FORMAT_GRAY = 1,
+
+    /** Luminance and alpha; expands to (y, y, y, a) */
+    BLUEGEN_FORMAT_GRAY_ALPHA = 2,
+
+    /** Red, green, and blue; expands to (r, g, b, 0xFF) */
+    BLUEGEN_FORMAT_RGB = 3,
+
+    /** Red, green, blue, and alpha; same layout as BlueGenPixel */
+    BLUEGEN_FORMAT_RGBA = 4
+} BlueGenPixelFormat;
+
 typedef void (*free_fn)(void *);
 
 typedef struct BlueGenImage {
-    /** Holds a pointer to pixel data */
-    BlueGenPixel *pixels;
+    /** Holds a pointer to pixel data, tightly packed in the layout given by format */
+    uint8_t *pixels;
+
+    /** Layout of each pixel in pixels */
+    BlueGenPixelFormat format;
 
     /** Width of the image in pixels */
     uint32_t width;
@@ -45,36 +70,545 @@ typedef struct BlueGenImageSequence {
     size_t image_count;
 } BlueGenImageSequence;
 
+/**
+ * Dimensions and pixel format of an image, as read from its header without decoding it
+ */
+typedef struct BlueGenImageInfo {
+    /** Width of the image in pixels */
+    uint32_t width;
+
+    /** Height of the image in pixels */
+    uint32_t height;
+
+    /** Format the image will be loaded in */
+    BlueGenPixelFormat format;
+} BlueGenImageInfo;
+
+typedef struct BlueGenImageInfoSequence {
+    /** Holds a pointer to an array of image infos */
+    BlueGenImageInfo *infos;
+
+    /** Number of image infos */
+    size_t info_count;
+} BlueGenImageInfoSequence;
+
+/**
+ * A rectangle in the color plate
+ */
+typedef struct BlueGenRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} BlueGenRect;
+
+/**
+ * The rows of the color plate taken up by one sequence
+ */
+typedef struct BlueGenBand {
+    /** First row of the band, which is the sequence separator */
+    uint32_t y;
+
+    /** Height of the tallest image in the sequence */
+    uint32_t height;
+
+    /** Where each image in the sequence goes */
+    BlueGenRect *frames;
+
+    /** Number of images */
+    size_t frame_count;
+} BlueGenBand;
+
+/**
+ * Where everything goes in a color plate
+ */
+typedef struct BlueGenLayout {
+    /** Width of the color plate in pixels */
+    uint32_t width;
+
+    /** Height of the color plate in pixels */
+    uint32_t height;
+
+    /** Holds a pointer to an array of bands, one per sequence */
+    BlueGenBand *bands;
+
+    /** Number of bands */
+    size_t band_count;
+} BlueGenLayout;
+
+/**
+ * How a frame's fully transparent borders are cropped off
+ */
+typedef struct BlueGenCrop {
+    /** Width of the whole frame in pixels */
+    uint32_t width;
+
+    /** Height of the whole frame in pixels */
+    uint32_t height;
+
+    /** Part of the frame that is kept; each side loses as much as the side across from it, so the center stays put */
+    BlueGenRect kept;
+
+    /** Part of the frame with anything that isn't fully transparent in it; the rest of kept becomes dummy space */
+    BlueGenRect visible;
+} BlueGenCrop;
+
+/**
+ * What about an image's colors matters for picking separators, so an image whose colors are already known doesn't
+ * have to be scanned again
+ */
+typedef struct BlueGenColorSummary {
+    /** Is any pixel not fully opaque? */
+    bool translucent;
+
+    /** Does any pixel use 0000FF, the preferred bitmap separator, whatever its alpha? */
+    bool blue;
+
+    /** Does any pixel use FF00FF, the preferred sequence separator, whatever its alpha? */
+    bool magenta;
+} BlueGenColorSummary;
+
+/**
+ * Longest message a BlueGenError can hold, including the terminating null
+ */
+#define BLUEGEN_ERROR_SIZE 4096
+
+/**
+ * What went wrong when something failed, so it can be shown to whoever asked for it instead of ending the process
+ */
+typedef struct BlueGenError {
+    /** Path of the file it failed on, or NULL if it wasn't any one file; this points to the path that was passed in */
+    const char *path;
+
+    /** What went wrong, ready to show, such as "(v)> Failed to load a.png! Error was: Corrupt PNG" */
+    char message[BLUEGEN_ERROR_SIZE];
+} BlueGenError;
+
+/**
+ * Called with each frame of a file as it is decoded
+ * @param context context given along with the callback
+ * @param image   decoded frame, which is only valid until the callback returns
+ * @param index   index of the frame in the file
+ * @param error   set to what went wrong, if anything
+ * @return        zero to keep going, or non-zero to stop decoding, in which case the decoder fails with the error
+ */
+typedef int (*BlueGenFrameCallback)(void *context, const BlueGenImage *image, size_t index, BlueGenError *error);
+
+/**
+ * Kinds of files that can be loaded
+ */
+typedef enum BlueGenFileType {
+    BLUEGEN_FILE_UNKNOWN,
+    BLUEGEN_FILE_TIFF,
+    BLUEGEN_FILE_IMAGE
+} BlueGenFileType;
+
+/**
+ * Number of 32-bit words in an occupancy bitmap, which has one bit for each color in the RGB space followed by a word of
+ * flags (see bluegen_occupancy_opaque())
+ */
+#define BLUEGEN_OCCUPANCY_WORDS ((1 << 24) / 32 + 1)
+
+/**
+ * Fill out an error, if there is one to fill out
+ * @param error  error to fill out, or NULL
+ * @param path   path of the file it failed on, or NULL
+ * @param format printf format of the message
+ */
+void set_bluegen_error(BlueGenError *error, const char *path, const char *format, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 3, 4)))
+#endif
+    ;
+
 /**
  * Initialize a blank image
  * @param image  pointer to a struct to hold image data
  * @param width  width of image in pixels
  * @param height height of image in pixels
+ * @param format pixel format of the image
  */
-void initialize_bluegen_image(BlueGenImage *image, uint32_t width, uint32_t height);
+void initialize_bluegen_image(BlueGenImage *image, uint32_t width, uint32_t height, BlueGenPixelFormat format);
 
 /**
- * Generate an image from sequences
+ * Generate an image from sequences; the output is always BLUEGEN_FORMAT_RGBA, and input images are expanded from their
+ * own format as they are copied in
  * @param sequences      sequence to generate image from
  * @param sequence_count number of sequences to generate image from
  * @param dummy_space    dummy space color
- * @param output         output image
+ * @param crop           crop fully transparent borders off of each image (see find_bluegen_crop())
+ * @param output         output image, which is left empty if it fails
+ * @param error          set to what went wrong, if anything
+ * @return               zero on success, non-zero if there weren't two colors left for the separators
  */
-void generate_bluegen_image(const BlueGenImageSequence *sequences, size_t sequence_count, const BlueGenPixel *dummy_space, BlueGenImage *output);
+int generate_bluegen_image(const BlueGenImageSequence *sequences, size_t sequence_count, const BlueGenPixel *dummy_space, bool crop, BlueGenImage *output, BlueGenError *error);
 
 /**
- * Load a TIFF at the given path
- * @param image image to load to
+ * Work out where each image goes in the color plate; free it with free_bluegen_layout()
+ * @param layout         layout to fill out
+ * @param sequences      dimensions of the images in each sequence
+ * @param sequence_count number of sequences
+ */
+void layout_bluegen_image(BlueGenLayout *layout, const BlueGenImageInfoSequence *sequences, size_t sequence_count);
+
+/**
+ * Free a layout
+ * @param layout layout to free
+ */
+void free_bluegen_layout(BlueGenLayout *layout);
+
+/**
+ * Allocate a cleared occupancy bitmap with BLUEGEN_OCCUPANCY_WORDS words; free it with free()
+ * @return pointer to the bitmap
+ */
+uint32_t *allocate_bluegen_occupancy(void);
+
+/**
+ * Mark every color used in another occupancy bitmap as used
+ * @param occupancy bitmap to merge into
+ * @param other     bitmap to merge from
+ */
+void merge_bluegen_occupancy(uint32_t *occupancy, const uint32_t *other);
+
+/**
+ * Check if every pixel scanned into an occupancy bitmap was fully opaque
+ * @param occupancy bitmap to check
+ * @return          true if no pixel had an alpha other than 0xFF
+ */
+bool bluegen_occupancy_opaque(const uint32_t *occupancy);
+
+/**
+ * Mark every color used by an image in an occupancy bitmap
+ * @param occupancy bitmap to mark
+ * @param image     image to scan
+ */
+void scan_bluegen_image(uint32_t *occupancy, const BlueGenImage *image);
+
+/**
+ * Scan an image's colors and copy it into its rectangle of the color plate, expanding it to RGBA; images in different
+ * rectangles can be placed from different threads as long as each thread has its own occupancy bitmap
+ * @param plate     RGBA color plate
+ * @param occupancy bitmap to mark the image's colors in, or NULL if its colors are already known
+ * @param image     image to place
+ * @param rect      where the image goes
+ * @param sequence  index of the sequence, for tracing
+ * @param frame     index of the image in the sequence, for tracing
+ */
+void place_bluegen_frame(BlueGenImage *plate, uint32_t *occupancy, const BlueGenImage *image, const BlueGenRect *rect, size_t sequence, size_t frame);
+
+/**
+ * Summarize the colors of an image the same way scanning it into an occupancy bitmap would see them
+ * @param image   image to summarize
+ * @param summary summary to fill out
+ */
+void summarize_bluegen_image(const BlueGenImage *image, BlueGenColorSummary *summary);
+
+/**
+ * Find the fully transparent borders of an image that can be cropped off without moving its registration point, which
+ * tool.exe puts in the center of the image, dummy space included
+ *
+ * The same amount is cropped off of opposite sides, and whatever is left of the wider border is filled with dummy space
+ * when the image is placed, so it is still left out of the bitmap. Images without alpha or without anything visible in
+ * them aren't cropped.
+ *
+ * @param image image to scan
+ * @param crop  crop to fill out
+ */
+void find_bluegen_crop(const BlueGenImage *image, BlueGenCrop *crop);
+
+/**
+ * Copy the kept part of an image into its rectangle of the color plate like place_bluegen_frame(), filling its
+ * transparent borders with dummy space
+ * @param plate       RGBA color plate
+ * @param occupancy   bitmap to mark the image's colors in
+ * @param image       image to place
+ * @param crop        crop from find_bluegen_crop()
+ * @param dummy_space dummy space color
+ * @param rect        where the kept part of the image goes
+ * @param sequence    index of the sequence, for tracing
+ * @param frame       index of the image in the sequence, for tracing
+ */
+void place_bluegen_cropped_frame(BlueGenImage *plate, uint32_t *occupancy, const BlueGenImage *image, const BlueGenCrop *crop, const BlueGenPixel *dummy_space, const BlueGenRect *rect, size_t sequence, size_t frame);
+
+/**
+ * Scan the colors of a frame that was decoded straight into the color plate
+ * @param occupancy occupancy bitmap to mark colors in
+ * @param plate     RGBA color plate
+ * @param rect      where the frame is in the plate
+ * @param sequence  sequence index, for tracing
+ * @param frame     frame index, for tracing
+ */
+void scan_bluegen_frame(uint32_t *occupancy, const BlueGenImage *plate, const BlueGenRect *rect, size_t sequence, size_t frame);
+
+/**
+ * Find colors for the bitmap and sequence separators that aren't used by any image, preferring blue and magenta
+ * @param occupancy   colors used by every image
+ * @param dummy_space dummy space color, which is never picked
+ * @param blue        set to the bitmap separator color
+ * @param magenta     set to the sequence separator color
+ * @param preferred   set to whether blue and magenta themselves were free, or NULL
+ * @param error       set to what went wrong, if anything
+ * @return            zero on success, non-zero if every color but one is used
+ */
+int choose_bluegen_separators(const uint32_t *occupancy, const BlueGenPixel *dummy_space, BlueGenPixel *blue, BlueGenPixel *magenta, bool *preferred, BlueGenError *error);
+
+/**
+ * Fill the first row of the color plate, which holds the separator and dummy space colors
+ * @param plate       RGBA color plate
+ * @param blue        bitmap separator color
+ * @param magenta     sequence separator color
+ * @param dummy_space dummy space color
+ */
+void fill_bluegen_header(BlueGenImage *plate, const BlueGenPixel *blue, const BlueGenPixel *magenta, const BlueGenPixel *dummy_space);
+
+/**
+ * Fill everything in one band of the color plate that isn't an image with the separator colors; bands don't overlap,
+ * so they can be filled from different threads
+ * @param plate      RGBA color plate with the band's images placed
+ * @param layout     layout of the color plate
+ * @param band_index band to fill
+ * @param blue       bitmap separator color
+ * @param magenta    sequence separator color
+ */
+void fill_bluegen_band(BlueGenImage *plate, const BlueGenLayout *layout, size_t band_index, const BlueGenPixel *blue, const BlueGenPixel *magenta);
+
+/**
+ * Get the row after the last row of a band, which is where the next band starts
+ * @param layout     layout of the color plate
+ * @param band_index band to check
+ * @return           row after the band
+ */
+uint32_t bluegen_band_end(const BlueGenLayout *layout, size_t band_index);
+
+/**
+ * Fill everything in the color plate that isn't an image with the separator colors
+ * @param plate       RGBA color plate with every image placed
+ * @param layout      layout of the color plate
+ * @param blue        bitmap separator color
+ * @param magenta     sequence separator color
+ * @param dummy_space dummy space color
+ */
+void fill_bluegen_separators(BlueGenImage *plate, const BlueGenLayout *layout, const BlueGenPixel *blue, const BlueGenPixel *magenta, const BlueGenPixel *dummy_space);
+
+/**
+ * Copy an image of any format into a new RGBA image
+ * @param input  image to copy
+ * @param output set to the new image
+ */
+void expand_bluegen_image(const BlueGenImage *input, BlueGenImage *output);
+
+/**
+ * Shrink an image to half its width and height, rounded up, by averaging each 2x2 block of pixels; halving again and
+ * again makes a mip chain for previewing the plate zoomed out
+ * @param input  image to shrink, in any format; an odd last row or column is averaged with itself
+ * @param output set to the new RGBA image
+ */
+void halve_bluegen_image(const BlueGenImage *input, BlueGenImage *output);
+
+/**
+ * Read the dimensions and format of a TIFF at the given path without decoding it
+ * @param info  info to fill out
+ * @param path  path to read from
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be read
+ */
+int probe_tiff(BlueGenImageInfo *info, const char *path, BlueGenError *error);
+
+/**
+ * Load a TIFF at the given path; 8-bit grayscale and RGB(A) images are kept in their own format, and anything else is
+ * converted to RGBA
+ * @param image image to load to, which is left alone if it fails
+ * @param path  path to read from
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be read or decoded
+ */
+int load_tiff(BlueGenImage *image, const char *path, BlueGenError *error);
+
+/**
+ * Load a TIFF that was already read into memory, like load_tiff()
+ * @param image image to load to, which is left alone if it fails
+ * @param path  path the file was read from, for error messages
+ * @param data  contents of the file
+ * @param size  size of the file in bytes
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be decoded
+ */
+int load_tiff_from_memory(BlueGenImage *image, const char *path, const uint8_t *data, size_t size, BlueGenError *error);
+
+/**
+ * Read the dimensions and format of every page of a TIFF at the given path without decoding them
+ * @param path  path to read from
+ * @param infos set to an array with one info per page; free it with free()
+ * @param error set to what went wrong, if anything
+ * @return      number of pages, or 0 if it couldn't be read, in which case infos is left NULL
+ */
+size_t probe_tiff_pages(const char *path, BlueGenImageInfo **infos, BlueGenError *error);
+
+/**
+ * Decode every page of a TIFF that was already read into memory one at a time, opening it once
+ * @param path       path the file was read from, for error messages
+ * @param data       contents of the file
+ * @param size       size of the file in bytes
+ * @param page_count number of pages, as returned by probe_tiff_pages()
+ * @param callback   called with each page
+ * @param context    passed to the callback
+ * @param error      set to what went wrong, if anything
+ * @return           zero on success, non-zero if a page couldn't be decoded or the callback stopped it
+ */
+int decode_tiff_pages(const char *path, const uint8_t *data, size_t size, size_t page_count, BlueGenFrameCallback callback, void *context, BlueGenError *error);
+
+/**
+ * Load a PNG/TGA/BMP/GIF at the given path, keeping however many channels the file has (palettes are expanded to
+ * RGB(A)); only the first frame of an animated GIF is loaded
+ * @param image image to load to, which is left alone if it fails
+ * @param path  path to read from
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be read or decoded
+ */
+int load_image(BlueGenImage *image, const char *path, BlueGenError *error);
+
+/**
+ * Load a PNG/TGA/BMP/GIF that was already read into memory, like load_image()
+ * @param image image to load to, which is left alone if it fails
+ * @param path  path the file was read from, for error messages
+ * @param data  contents of the file
+ * @param size  size of the file in bytes
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be decoded
+ */
+int load_image_from_memory(BlueGenImage *image, const char *path, const uint8_t *data, size_t size, BlueGenError *error);
+
+/**
+ * Read the dimensions and format of a PNG/TGA/BMP/GIF at the given path without decoding it
+ * @param info  info to fill out
+ * @param path  path to read from
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be read
+ */
+int probe_image(BlueGenImageInfo *info, const char *path, BlueGenError *error);
+
+/**
+ * Determine what kind of file a path is from its extension
+ * @param path path to check
+ * @return     type of file
+ */
+BlueGenFileType bluegen_file_type(const char *path);
+
+/**
+ * Read the dimensions and format of any supported file without decoding it
+ * @param info  info to fill out
  * @param path  path to read from
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be read or isn't a supported type
  */
-void load_tiff(BlueGenImage *image, const char *path);
+int probe_file(BlueGenImageInfo *info, const char *path, BlueGenError *error);
 
 /**
- * Load a PNG/TGA/BMP at the given path
- * @param image image to load to
+ * Load any supported file, picking the loader from its extension
+ * @param image image to load to, which is left alone if it fails
  * @param path  path to read from
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be read or decoded or isn't a supported type
  */
-void load_image(BlueGenImage *image, const char *path);
+int load_file(BlueGenImage *image, const char *path, BlueGenError *error);
+
+/**
+ * Load any supported file that was already read into memory, picking the loader from its path's extension
+ * @param image image to load to, which is left alone if it fails
+ * @param path  path the file was read from
+ * @param data  contents of the file
+ * @param size  size of the file in bytes
+ * @param error set to what went wrong, if anything
+ * @return      zero on success, non-zero if it couldn't be decoded or isn't a supported type
+ */
+int load_file_from_memory(BlueGenImage *image, const char *path, const uint8_t *data, size_t size, BlueGenError *error);
+
+/**
+ * Uncompressed RGB(A) TIFF being written a few rows at a time
+ */
+typedef struct BlueGenTiffWriter {
+    /** File being written */
+    FILE *file;
+
+    /** Path of the file */
+    const char *path;
+
+    /** Dimensions of the image in pixels */
+    uint32_t width;
+    uint32_t height;
+
+    /** 4 for RGBA, or 3 for RGB if alpha is left out */
+    uint16_t samples_per_pixel;
+
+    /** Rows packed down to RGB before they're written, and how many rows fit */
+    uint8_t *packed;
+    uint32_t packed_rows;
+
+    /** Offset of the first pixel in the file */
+    uint32_t pixel_offset;
+
+    /** Number of rows written so far */
+    uint32_t rows_written;
+
+    /** Did any write fail? */
+    bool failed;
+
+    /** Is this overwriting rows of a TIFF that's already complete? */
+    bool rewriting;
+} BlueGenTiffWriter;
+
+/**
+ * Open a TIFF for writing and write its header; rows are then written top to bottom with write_bluegen_tiff_rows()
+ * @param writer writer to set up
+ * @param path   path to write to
+ * @param width  width of the image in pixels
+ * @param height height of the image in pixels
+ * @param alpha  write the alpha channel; if false, only red, green, and blue are written, which is a quarter smaller
+ * @return       zero on success, non-zero if the file could not be opened
+ */
+int open_bluegen_tiff_writer(BlueGenTiffWriter *writer, const char *path, uint32_t width, uint32_t height, bool alpha);
+
+/**
+ * Open a complete TIFF that open_bluegen_tiff_writer() wrote with the same size and alpha to overwrite some of its rows
+ * in place; the tags are left as they are
+ * @param writer writer to set up
+ * @param path   path to write to
+ * @param width  width of the image in pixels
+ * @param height height of the image in pixels
+ * @param alpha  whether the alpha channel was written
+ * @return       zero on success, non-zero if the file could not be opened or isn't laid out like that
+ */
+int reopen_bluegen_tiff_writer(BlueGenTiffWriter *writer, const char *path, uint32_t width, uint32_t height, bool alpha);
+
+/**
+ * Move to a row of a TIFF being rewritten, so the next rows written go there
+ * @param writer writer opened with reopen_bluegen_tiff_writer()
+ * @param row    row to move to
+ */
+void seek_bluegen_tiff_writer(BlueGenTiffWriter *writer, uint32_t row);
+
+/**
+ * Write the next rows of a TIFF
+ * @param writer    writer to write to
+ * @param rows      RGBA pixels of the rows
+ * @param row_count number of rows
+ */
+void write_bluegen_tiff_rows(BlueGenTiffWriter *writer, const BlueGenPixel *rows, uint32_t row_count);
+
+/**
+ * Write the tags of a TIFF and close it, or just close it if it was being rewritten
+ * @param writer writer to close
+ * @return       zero on success, non-zero if anything failed to be written
+ */
+int close_bluegen_tiff_writer(BlueGenTiffWriter *writer);
+
+/**
+ * Write an RGBA image to an uncompressed TIFF at the given path, leaving out alpha if every pixel is fully opaque
+ * @param image image to write
+ * @param path  path to write to
+ * @return      zero on success, non-zero if the file could not be opened or written
+ */
+int write_tiff(const BlueGenImage *image, const char *path);
 
 /**
  * Free an image; This is required to prevent memory leakage
@@ -85,3 +619,5 @@ void free_bluegen_image(BlueGenImage *image);
 #ifdef __cplusplus
 }
 #endif
+
+#endif
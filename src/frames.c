@@ -0,0 +1,568 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "frames.h"
+#include "stb_image.h"
+
+#define PNG_TYPE(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+static const uint8_t png_signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+
+static uint32_t get32be(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void put32be(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static int fail_changed(const char *path, BlueGenError *error) {
+    set_bluegen_error(error, path, "(v)> %s changed while it was being read.", path);
+    return 1;
+}
+
+static int fail_corrupt(const char *path, const char *reason, BlueGenError *error) {
+    set_bluegen_error(error, path, "(v)> Failed to load %s! Error was: %s", path, reason);
+    return 1;
+}
+
+// Skip a run of GIF data sub-blocks, up to and including the empty one that ends it
+static bool skip_gif_blocks(FILE *file) {
+    int length;
+    while((length = getc(file)) > 0) {
+        if(fseek(file, length, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+    return length == 0;
+}
+
+// Count the image descriptors in a GIF, each of which is a frame; returns 0 if it's corrupt
+static size_t count_gif_frames(FILE *file, const char *path, BlueGenError *error) {
+    uint8_t screen[7];
+    if(fseek(file, 6, SEEK_SET) != 0 || fread(screen, sizeof(screen), 1, file) != 1) {
+        fail_corrupt(path, "Corrupt GIF", error);
+        return 0;
+    }
+    if(screen[4] & 0x80) {
+        fseek(file, 3L << ((screen[4] & 7) + 1), SEEK_CUR);
+    }
+
+    size_t frame_count = 0;
+    for(;;) {
+        switch(getc(file)) {
+            case 0x2C: {
+                uint8_t descriptor[9];
+                if(fread(descriptor, sizeof(descriptor), 1, file) != 1) {
+                    fail_corrupt(path, "Corrupt GIF", error);
+                    return 0;
+                }
+                if(descriptor[8] & 0x80) {
+                    fseek(file, 3L << ((descriptor[8] & 7) + 1), SEEK_CUR);
+                }
+
+                // Skip the LZW code size and then the image data
+                if(getc(file) == EOF || !skip_gif_blocks(file)) {
+                    fail_corrupt(path, "Corrupt GIF", error);
+                    return 0;
+                }
+                frame_count++;
+                break;
+            }
+            case 0x21:
+                if(getc(file) == EOF || !skip_gif_blocks(file)) {
+                    fail_corrupt(path, "Corrupt GIF", error);
+                    return 0;
+                }
+                break;
+            case 0x3B:
+                if(frame_count == 0) {
+                    fail_corrupt(path, "Corrupt GIF", error);
+                }
+                return frame_count;
+            default:
+                fail_corrupt(path, "Corrupt GIF", error);
+                return 0;
+        }
+    }
+}
+
+// Get the number of frames in an animated PNG, or 0 if it isn't animated; acTL says how many there are, but it can't
+// be trusted to allocate for, so it's capped at the number of fcTL chunks actually in the file
+static size_t count_apng_frames(FILE *file) {
+    uint8_t header[8];
+    bool animated = false;
+    uint32_t frame_count = 0;
+    size_t controls = 0;
+    while(fread(header, sizeof(header), 1, file) == 1) {
+        uint32_t length = get32be(header);
+        uint32_t type = get32be(header + 4);
+        if(type == PNG_TYPE('I','E','N','D')) {
+            break;
+        }
+
+        // acTL has to come before the image data
+        if(type == PNG_TYPE('a','c','T','L') && !animated) {
+            uint8_t count[4];
+            if(length < 8 || fread(count, sizeof(count), 1, file) != 1) {
+                return 0;
+            }
+            animated = true;
+            frame_count = get32be(count);
+            length -= sizeof(count);
+        }
+        else if(type == PNG_TYPE('I','D','A','T') && !animated) {
+            return 0;
+        }
+        else if(type == PNG_TYPE('f','c','T','L')) {
+            controls++;
+        }
+        if(fseek(file, (long)length + 4, SEEK_CUR) != 0) {
+            break;
+        }
+    }
+    if(!animated) {
+        return 0;
+    }
+    return frame_count < controls ? frame_count : controls;
+}
+
+size_t probe_bluegen_frames(const char *path, BlueGenImageInfo **infos, BlueGenError *error) {
+    *infos = NULL;
+    if(bluegen_file_type(path) == BLUEGEN_FILE_TIFF) {
+        return probe_tiff_pages(path, infos, error);
+    }
+
+    // This also fails on anything we can't load
+    BlueGenImageInfo info;
+    if(probe_file(&info, path, error) != 0) {
+        return 0;
+    }
+
+    size_t frame_count = 1;
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        fail_changed(path, error);
+        return 0;
+    }
+    uint8_t signature[8];
+    if(fread(signature, sizeof(signature), 1, file) == 1) {
+        size_t animated = 0;
+        if(memcmp(signature, "GIF8", 4) == 0) {
+            animated = count_gif_frames(file, path, error);
+            if(animated == 0) {
+                fclose(file);
+                return 0;
+            }
+        }
+        else if(memcmp(signature, png_signature, sizeof(png_signature)) == 0) {
+            animated = count_apng_frames(file);
+        }
+
+        // Animations are composited onto an RGBA canvas
+        if(animated) {
+            frame_count = animated;
+            info.format = BLUEGEN_FORMAT_RGBA;
+        }
+    }
+    fclose(file);
+
+    if(frame_count > SIZE_MAX / sizeof(**infos) || !(*infos = malloc(frame_count * sizeof(**infos)))) {
+        fail_corrupt(path, "Out of memory", error);
+        return 0;
+    }
+    for(size_t f = 0; f < frame_count; f++) {
+        (*infos)[f] = info;
+    }
+    return frame_count;
+}
+
+// Pass along a frame of an animation, which is always an RGBA canvas
+static int emit_canvas(const uint8_t *canvas, uint32_t width, uint32_t height, size_t frame, BlueGenFrameCallback callback, void *context, BlueGenError *error) {
+    BlueGenImage image = { (uint8_t *)canvas, BLUEGEN_FORMAT_RGBA, width, height, NULL };
+    return callback(context, &image, frame, error);
+}
+
+static int decode_gif_frames(const char *path, const uint8_t *data, size_t size, size_t frame_count, BlueGenFrameCallback callback, void *context, BlueGenError *error) {
+    BlueGenGif *gif = open_bluegen_gif(data, size);
+    if(!gif) {
+        return fail_changed(path, error);
+    }
+    int result = 0;
+    for(size_t f = 0; f < frame_count && result == 0; f++) {
+        const uint8_t *pixels;
+        uint32_t width, height;
+        int decoded = next_bluegen_gif_frame(gif, &pixels, &width, &height);
+        if(decoded < 0) {
+            result = fail_corrupt(path, stbi_failure_reason(), error);
+        }
+        else if(decoded == 0) {
+            result = fail_changed(path, error);
+        }
+        else {
+            result = emit_canvas(pixels, width, height, f, callback, context, error);
+        }
+    }
+    close_bluegen_gif(gif);
+    return result;
+}
+
+// What an fcTL chunk says about a frame of an APNG
+typedef struct ApngFrameControl {
+    uint32_t width;
+    uint32_t height;
+    uint32_t x;
+    uint32_t y;
+
+    /** 0 leaves the frame, 1 clears it to transparent black, and 2 puts back what was there before */
+    uint8_t dispose_op;
+
+    /** 0 replaces the canvas, and 1 composites over it */
+    uint8_t blend_op;
+} ApngFrameControl;
+
+// Growable buffer for putting together the PNG of each frame
+typedef struct ByteBuffer {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+// Returns false if it ran out of memory
+static bool append_bytes(ByteBuffer *buffer, const void *data, size_t size) {
+    if(size == 0) {
+        return true;
+    }
+    if(buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while(capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+        uint8_t *grown = realloc(buffer->data, capacity);
+        if(!grown) {
+            return false;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return true;
+}
+
+static bool append_chunk(ByteBuffer *buffer, uint32_t type, const uint8_t *contents, uint32_t length) {
+    // stb_image doesn't check CRCs, so they're left as zero
+    uint8_t header[8], crc[4] = { 0 };
+    put32be(header, length);
+    put32be(header + 4, type);
+    return append_bytes(buffer, header, sizeof(header)) && append_bytes(buffer, contents, length) && append_bytes(buffer, crc, sizeof(crc));
+}
+
+// Composite a decoded frame onto the canvas
+static void blend_apng_frame(uint8_t *canvas, uint32_t canvas_width, const uint8_t *frame, const ApngFrameControl *control) {
+    for(uint32_t y = 0; y < control->height; y++) {
+        uint8_t *output = canvas + ((size_t)(control->y + y) * canvas_width + control->x) * 4;
+        const uint8_t *input = frame + (size_t)y * control->width * 4;
+        if(control->blend_op == 0) {
+            memcpy(output, input, (size_t)control->width * 4);
+            continue;
+        }
+        for(uint32_t x = 0; x < control->width; x++, output += 4, input += 4) {
+            uint32_t source_alpha = input[3];
+            if(source_alpha == 0xFF) {
+                memcpy(output, input, 4);
+            }
+            else if(source_alpha != 0) {
+                // Everything here is scaled up by 255 * 255 until the end
+                uint32_t destination_alpha = output[3] * (0xFF - source_alpha);
+                uint32_t alpha = source_alpha * 0xFF + destination_alpha;
+                for(int c = 0; c < 3; c++) {
+                    output[c] = (uint8_t)((input[c] * source_alpha * 0xFF + output[c] * destination_alpha + alpha / 2) / alpha);
+                }
+                output[3] = (uint8_t)((alpha + 0x7F) / 0xFF);
+            }
+        }
+    }
+}
+
+static void copy_canvas_region(uint8_t *output, const uint8_t *input, uint32_t canvas_width, const ApngFrameControl *control) {
+    for(uint32_t y = 0; y < control->height; y++) {
+        size_t offset = ((size_t)(control->y + y) * canvas_width + control->x) * 4;
+        memcpy(output + offset, input + offset, (size_t)control->width * 4);
+    }
+}
+
+static int decode_apng_frames(const char *path, const uint8_t *data, size_t size, size_t frame_count, BlueGenFrameCallback callback, void *context, BlueGenError *error) {
+    if(size > INT_MAX) {
+        return fail_corrupt(path, "file too large", error);
+    }
+
+    const uint8_t *header = NULL, *palette = NULL, *transparency = NULL;
+    uint32_t palette_length = 0, transparency_length = 0;
+    uint32_t canvas_width = 0, canvas_height = 0;
+    uint8_t *canvas = NULL, *saved = NULL;
+
+    ByteBuffer image_data = { NULL, 0, 0 }, encoded = { NULL, 0, 0 };
+    ApngFrameControl control = { 0, 0, 0, 0, 0, 0 };
+    bool in_frame = false;
+    size_t frame = 0;
+    int result = 0;
+
+    const uint8_t *chunk = data + sizeof(png_signature);
+    const uint8_t *end = data + size;
+    for(bool done = false; !done && result == 0;) {
+        if((size_t)(end - chunk) < 12 || get32be(chunk) > (size_t)(end - chunk) - 12) {
+            result = fail_corrupt(path, "Corrupt PNG", error);
+            break;
+        }
+        uint32_t length = get32be(chunk);
+        uint32_t type = get32be(chunk + 4);
+        const uint8_t *contents = chunk + 8;
+        chunk = contents + length + 4;
+
+        switch(type) {
+            case PNG_TYPE('I','H','D','R'):
+                if(length != 13 || canvas) {
+                    result = fail_corrupt(path, "Corrupt PNG", error);
+                    continue;
+                }
+                header = contents;
+                canvas_width = get32be(contents);
+                canvas_height = get32be(contents + 4);
+                canvas = calloc((size_t)canvas_width * canvas_height, 4);
+                saved = malloc((size_t)canvas_width * canvas_height * 4);
+                if(!canvas || !saved) {
+                    result = fail_corrupt(path, "Out of memory", error);
+                }
+                continue;
+            case PNG_TYPE('P','L','T','E'):
+                palette = contents;
+                palette_length = length;
+                continue;
+            case PNG_TYPE('t','R','N','S'):
+                transparency = contents;
+                transparency_length = length;
+                continue;
+
+            // If the image data comes before the first fcTL, it's a still image that isn't part of the animation
+            case PNG_TYPE('I','D','A','T'):
+                if(in_frame && !append_bytes(&image_data, contents, length)) {
+                    result = fail_corrupt(path, "Out of memory", error);
+                }
+                continue;
+            case PNG_TYPE('f','d','A','T'):
+                if(!in_frame || length < 4) {
+                    result = fail_corrupt(path, "Corrupt APNG", error);
+                }
+                else if(!append_bytes(&image_data, contents + 4, length - 4)) {
+                    result = fail_corrupt(path, "Out of memory", error);
+                }
+                continue;
+
+            case PNG_TYPE('f','c','T','L'):
+            case PNG_TYPE('I','E','N','D'):
+                done = type == PNG_TYPE('I','E','N','D');
+                break;
+
+            default:
+                continue;
+        }
+
+        // An fcTL or IEND ends the frame before it, if any
+        if(in_frame) {
+            if(frame == frame_count) {
+                result = fail_changed(path, error);
+                break;
+            }
+
+            // Put the frame's data back together into a PNG of its own for stb_image
+            uint8_t frame_header[13];
+            memcpy(frame_header, header, sizeof(frame_header));
+            put32be(frame_header, control.width);
+            put32be(frame_header + 4, control.height);
+            encoded.size = 0;
+            bool appended = append_bytes(&encoded, png_signature, sizeof(png_signature)) &&
+                            append_chunk(&encoded, PNG_TYPE('I','H','D','R'), frame_header, sizeof(frame_header)) &&
+                            (!palette || append_chunk(&encoded, PNG_TYPE('P','L','T','E'), palette, palette_length)) &&
+                            (!transparency || append_chunk(&encoded, PNG_TYPE('t','R','N','S'), transparency, transparency_length)) &&
+                            append_chunk(&encoded, PNG_TYPE('I','D','A','T'), image_data.data, (uint32_t)image_data.size) &&
+                            append_chunk(&encoded, PNG_TYPE('I','E','N','D'), NULL, 0);
+            if(!appended || encoded.size > INT_MAX) {
+                result = fail_corrupt(path, "Out of memory", error);
+                break;
+            }
+
+            int width, height, channels;
+            uint8_t *pixels = stbi_load_from_memory(encoded.data, (int)encoded.size, &width, &height, &channels, 4);
+            if(!pixels) {
+                result = fail_corrupt(path, stbi_failure_reason(), error);
+                break;
+            }
+            if((uint32_t)width != control.width || (uint32_t)height != control.height) {
+                stbi_image_free(pixels);
+                result = fail_corrupt(path, "Corrupt APNG", error);
+                break;
+            }
+
+            // Keep what's under the frame if it's going to be put back
+            uint8_t dispose_op = control.dispose_op;
+            if(dispose_op == 2 && frame == 0) {
+                dispose_op = 1;
+            }
+            if(dispose_op == 2) {
+                copy_canvas_region(saved, canvas, canvas_width, &control);
+            }
+
+            blend_apng_frame(canvas, canvas_width, pixels, &control);
+            stbi_image_free(pixels);
+            result = emit_canvas(canvas, canvas_width, canvas_height, frame, callback, context, error);
+            if(result != 0) {
+                break;
+            }
+            frame++;
+
+            if(dispose_op == 1) {
+                for(uint32_t y = 0; y < control.height; y++) {
+                    memset(canvas + ((size_t)(control.y + y) * canvas_width + control.x) * 4, 0, (size_t)control.width * 4);
+                }
+            }
+            else if(dispose_op == 2) {
+                copy_canvas_region(canvas, saved, canvas_width, &control);
+            }
+
+            // Probing counted no more frames than acTL says there are, so anything after them is left out
+            if(frame == frame_count) {
+                break;
+            }
+        }
+
+        // Start the next frame
+        if(type == PNG_TYPE('f','c','T','L')) {
+            if(length < 26 || !canvas) {
+                result = fail_corrupt(path, "Corrupt APNG", error);
+                break;
+            }
+            control.width = get32be(contents + 4);
+            control.height = get32be(contents + 8);
+            control.x = get32be(contents + 12);
+            control.y = get32be(contents + 16);
+            control.dispose_op = contents[24];
+            control.blend_op = contents[25];
+            if(control.width == 0 || control.height == 0 ||
+               (uint64_t)control.x + control.width > canvas_width || (uint64_t)control.y + control.height > canvas_height ||
+               control.dispose_op > 2 || control.blend_op > 1) {
+                result = fail_corrupt(path, "Corrupt APNG", error);
+                break;
+            }
+            in_frame = true;
+            image_data.size = 0;
+        }
+    }
+
+    if(result == 0 && frame != frame_count) {
+        result = fail_changed(path, error);
+    }
+
+    free(image_data.data);
+    free(encoded.data);
+    free(canvas);
+    free(saved);
+    return result;
+}
+
+// Check if a PNG in memory has an acTL chunk
+static bool is_apng(const uint8_t *data, size_t size) {
+    if(size < sizeof(png_signature) || memcmp(data, png_signature, sizeof(png_signature)) != 0) {
+        return false;
+    }
+    const uint8_t *chunk = data + sizeof(png_signature);
+    const uint8_t *end = data + size;
+    while((size_t)(end - chunk) >= 12) {
+        uint32_t length = get32be(chunk);
+        uint32_t type = get32be(chunk + 4);
+        if(type == PNG_TYPE('a','c','T','L')) {
+            return length >= 8 && get32be(chunk + 8) > 0;
+        }
+        if(type == PNG_TYPE('I','D','A','T') || type == PNG_TYPE('I','E','N','D') || length > (size_t)(end - chunk) - 12) {
+            return false;
+        }
+        chunk += (size_t)length + 12;
+    }
+    return false;
+}
+
+int decode_bluegen_frames(const char *path, const uint8_t *data, size_t size, size_t frame_count, BlueGenFrameCallback callback, void *context, BlueGenError *error) {
+    if(bluegen_file_type(path) == BLUEGEN_FILE_TIFF) {
+        return decode_tiff_pages(path, data, size, frame_count, callback, context, error);
+    }
+    else if(size >= 4 && memcmp(data, "GIF8", 4) == 0) {
+        return decode_gif_frames(path, data, size, frame_count, callback, context, error);
+    }
+    else if(is_apng(data, size)) {
+        return decode_apng_frames(path, data, size, frame_count, callback, context, error);
+    }
+
+    BlueGenImage image;
+    if(load_file_from_memory(&image, path, data, size, error) != 0) {
+        return 1;
+    }
+    int result = frame_count == 1 ? callback(context, &image, 0, error) : fail_changed(path, error);
+    free_bluegen_image(&image);
+    return result;
+}
+
+// Where the frames of a file go
+typedef struct FramePlacement {
+    BlueGenImage *plate;
+    uint32_t *occupancy;
+    const char *path;
+    const BlueGenRect *rects;
+    const BlueGenCrop *crops;
+    const BlueGenPixel *dummy_space;
+    size_t sequence;
+    size_t first_frame;
+    BlueGenTime *start;
+} FramePlacement;
+
+static int place_frame(void *context, const BlueGenImage *image, size_t index, BlueGenError *error) {
+    const FramePlacement *placement = context;
+    const BlueGenRect *rect = placement->rects + index;
+    const BlueGenCrop *crop = placement->crops ? placement->crops + index : NULL;
+    uint32_t width = crop ? crop->width : rect->width;
+    uint32_t height = crop ? crop->height : rect->height;
+    if(image->width != width || image->height != height) {
+        return fail_changed(placement->path, error);
+    }
+
+    // Placing is counted as scanning and blitting, so it's left out of the decode time
+    BlueGenTime paused;
+    bool timed = bluegen_stats_enabled();
+    if(timed) {
+        bluegen_time_now(&paused);
+    }
+    if(crop) {
+        place_bluegen_cropped_frame(placement->plate, placement->occupancy, image, crop, placement->dummy_space, rect, placement->sequence, placement->first_frame + index);
+    }
+    else {
+        place_bluegen_frame(placement->plate, placement->occupancy, image, rect, placement->sequence, placement->first_frame + index);
+    }
+    if(timed) {
+        bluegen_time_skip(placement->start, &paused);
+    }
+    return 0;
+}
+
+int place_bluegen_frames(BlueGenImage *plate, uint32_t *occupancy, const char *path, const uint8_t *data, size_t size, const BlueGenRect *rects, const BlueGenCrop *crops, const BlueGenPixel *dummy_space, size_t frame_count, size_t sequence, size_t first_frame, BlueGenTime *start, BlueGenError *error) {
+    FramePlacement placement = { plate, occupancy, path, rects, crops, dummy_space, sequence, first_frame, start };
+    return decode_bluegen_frames(path, data, size, frame_count, place_frame, &placement, error);
+}
@@ -0,0 +1,97 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_FRAMES_H
+#define BLUEGEN_FRAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bluegen.h"
+#include "stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read how many frames a file holds and the dimensions and format of each, without decoding them; multi-page TIFFs
+ * have a frame per page, animated GIFs and APNGs have a frame per frame of the animation, and anything else has one
+ * @param path  path to read from
+ * @param infos set to an array with one info per frame; free it with free()
+ * @param error set to what went wrong, if anything
+ * @return      number of frames, or 0 if it couldn't be read, in which case infos is left NULL
+ */
+size_t probe_bluegen_frames(const char *path, BlueGenImageInfo **infos, BlueGenError *error);
+
+/**
+ * Decode every frame of a file that was already read into memory one at a time, using one decoder for the whole file;
+ * animations are composited onto their canvas first, so every frame is the full canvas
+ * @param path        path the file was read from
+ * @param data        contents of the file
+ * @param size        size of the file in bytes
+ * @param frame_count number of frames, as returned by probe_bluegen_frames()
+ * @param callback    called with each frame
+ * @param context     passed to the callback
+ * @param error       set to what went wrong, if anything
+ * @return            zero on success, non-zero if a frame couldn't be decoded, the file changed since it was probed, or
+ *                    the callback stopped it
+ */
+int decode_bluegen_frames(const char *path, const uint8_t *data, size_t size, size_t frame_count, BlueGenFrameCallback callback, void *context, BlueGenError *error);
+
+/**
+ * Decode every frame of a file that was already read into memory and place each one in the color plate
+ * @param plate       RGBA color plate
+ * @param occupancy   bitmap to mark the frames' colors in
+ * @param path        path the file was read from
+ * @param data        contents of the file
+ * @param size        size of the file in bytes
+ * @param rects       where each frame goes
+ * @param crops       how each frame is cropped, or NULL to not crop them
+ * @param dummy_space dummy space color, for cropped frames
+ * @param frame_count number of frames, as returned by probe_bluegen_frames()
+ * @param sequence    index of the sequence, for tracing
+ * @param first_frame index of the file's first frame in the sequence, for tracing
+ * @param start       time decoding started, from bluegen_time_now(); it's moved forward by the time spent placing
+ *                    frames while stats are enabled, so it only counts decoding
+ * @param error       set to what went wrong, if anything
+ * @return            zero on success, non-zero if a frame couldn't be decoded or isn't the size it was probed at
+ */
+int place_bluegen_frames(BlueGenImage *plate, uint32_t *occupancy, const char *path, const uint8_t *data, size_t size, const BlueGenRect *rects, const BlueGenCrop *crops, const BlueGenPixel *dummy_space, size_t frame_count, size_t sequence, size_t first_frame, BlueGenTime *start, BlueGenError *error);
+
+/**
+ * GIF being decoded a frame at a time (implemented in stb_impl.c, as it uses stb_image's GIF decoder)
+ */
+typedef struct BlueGenGif BlueGenGif;
+
+/**
+ * Start decoding a GIF that was read into memory
+ * @param data contents of the file, which must stay valid until the GIF is closed
+ * @param size size of the file in bytes
+ * @return     GIF to pass to next_bluegen_gif_frame(), or NULL if it isn't a GIF
+ */
+BlueGenGif *open_bluegen_gif(const uint8_t *data, size_t size);
+
+/**
+ * Decode the next frame of a GIF, composited onto the frames before it the same way stbi_load_gif_from_memory() does
+ * @param gif    GIF to decode
+ * @param pixels set to the RGBA pixels of the frame, which stay valid until the next call
+ * @param width  set to the width of the frame, which is the width of the GIF
+ * @param height set to the height of the frame
+ * @return       1 if a frame was decoded, 0 if there are no more, or -1 on error (see stbi_failure_reason())
+ */
+int next_bluegen_gif_frame(BlueGenGif *gif, const uint8_t **pixels, uint32_t *width, uint32_t *height);
+
+/**
+ * Free a GIF
+ * @param gif GIF to close
+ */
+void close_bluegen_gif(BlueGenGif *gif);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
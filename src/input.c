@@ -0,0 +1,679 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "input.h"
+#include "stats.h"
+#include "trace.h"
+#include "perf.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
+
+#if defined(__linux__) && defined(BLUEGEN_HAVE_IO_URING)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// IORING_OP_READ showed up in the same kernel (5.6) as this feature flag
+#ifdef IORING_FEAT_RW_CUR_POS
+#define USE_IO_URING
+#endif
+#endif
+
+// Reads mostly wait on the disk or network rather than the CPU, so use more threads than there are cores
+#define READ_THREADS 16
+
+// Most reads io_uring has in flight at once
+#define RING_DEPTH 32
+
+// Largest single read; a file bigger than this is read in pieces
+#define MAX_READ_SIZE ((size_t)1 << 30)
+
+typedef enum SlotState {
+    /** Not opened yet */
+    SLOT_PENDING,
+
+    /** Being opened by a reader thread */
+    SLOT_OPENING,
+
+    /** Opened, but waiting for room in the read-ahead window */
+    SLOT_PARKED,
+
+    /** Being read */
+    SLOT_READING,
+
+    /** Read, or failed to read */
+    SLOT_READY,
+
+    /** Released */
+    SLOT_RELEASED
+} SlotState;
+
+typedef struct Slot {
+    SlotState state;
+
+    /** Has someone asked for this file? */
+    bool wanted;
+
+    /** Open file and its contents */
+    int fd;
+    uint8_t *data;
+    size_t size;
+    size_t bytes_done;
+
+    /** Are the contents mapped rather than allocated? */
+    bool mapped;
+
+    /** errno value if reading failed */
+    int error;
+
+    /** When the file was opened */
+    BlueGenTime start;
+} Slot;
+
+#ifdef USE_IO_URING
+typedef struct Ring {
+    int fd;
+    unsigned int in_flight;
+
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+} Ring;
+#endif
+
+struct BlueGenReader {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+
+    const char *const *paths;
+    Slot *slots;
+    size_t slot_count;
+
+    /** Every slot before this is being read, has been read, or was released */
+    size_t first_unread;
+
+    /** Number of slots that are wanted but not opened yet */
+    size_t wanted_unopened;
+
+    /** Bytes held in memory, and how many of them may be for files nobody asked for yet */
+    uint64_t in_memory;
+    uint64_t read_ahead;
+
+    bool closing;
+
+    BlueGenReaderBackend backend;
+    pthread_t *threads;
+    unsigned int thread_count;
+
+#ifdef USE_IO_URING
+    Ring ring;
+#endif
+};
+
+static int open_input(const char *path, size_t *size) {
+#ifdef _WIN32
+    int fd = _open(path, _O_RDONLY | _O_BINARY);
+#else
+    int fd = open(path, O_RDONLY);
+#endif
+    if(fd < 0) {
+        return -errno;
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0) {
+        int error = errno;
+        close(fd);
+        return -error;
+    }
+    *size = (size_t)file_stat.st_size;
+    return fd;
+}
+
+static void free_slot_data(Slot *slot) {
+#ifdef USE_MMAP
+    if(slot->mapped) {
+        munmap(slot->data, slot->size);
+        slot->mapped = false;
+        slot->data = NULL;
+        return;
+    }
+#endif
+    free(slot->data);
+    slot->data = NULL;
+}
+
+static void finish_slot(BlueGenReader *reader, Slot *slot, size_t index, int error) {
+    if(slot->fd >= 0) {
+        close(slot->fd);
+        slot->fd = -1;
+    }
+    slot->error = error;
+    if(error) {
+        free_slot_data(slot);
+        reader->in_memory -= slot->size;
+        slot->size = 0;
+    }
+    slot->state = SLOT_READY;
+    bluegen_stats_stage(BLUEGEN_STAGE_READ, &slot->start);
+    bluegen_trace_span("read", &slot->start, reader->paths[index], -1, -1, slot->size);
+    pthread_cond_broadcast(&reader->changed);
+}
+
+// Start reading an opened slot if it fits in the read-ahead window or someone is waiting on it; the mutex must be held
+static bool admit_slot(BlueGenReader *reader, size_t index) {
+    Slot *slot = reader->slots + index;
+    if(!slot->wanted && reader->in_memory != 0 && reader->in_memory + slot->size > reader->read_ahead) {
+        slot->state = SLOT_PARKED;
+        return false;
+    }
+
+    // Mapped files get their memory when they're mapped
+    if(reader->backend == BLUEGEN_READER_MMAP && slot->size > 0) {
+        slot->state = SLOT_READING;
+        reader->in_memory += slot->size;
+        return true;
+    }
+
+    // Always allocate something so an empty file isn't mistaken for a missing one
+    slot->data = malloc(slot->size ? slot->size : 1);
+    if(!slot->data) {
+        slot->size = 0;
+        finish_slot(reader, slot, index, ENOMEM);
+        return false;
+    }
+    slot->state = SLOT_READING;
+    reader->in_memory += slot->size;
+    return true;
+}
+
+// Find a slot that can be worked on, opening or reading it, or return -1 if there isn't one; the mutex must be held
+static long pick_slot(BlueGenReader *reader) {
+    bool parked = false;
+    long first_pending = -1;
+
+    while(reader->first_unread < reader->slot_count && reader->slots[reader->first_unread].state >= SLOT_READING) {
+        reader->first_unread++;
+    }
+
+    for(size_t i = reader->first_unread; i < reader->slot_count; i++) {
+        Slot *slot = reader->slots + i;
+
+        // Parked files were opened but didn't fit; read them once they do, or once someone is waiting on them
+        if(slot->state == SLOT_PARKED) {
+            if(admit_slot(reader, i)) {
+                return (long)i;
+            }
+            parked = parked || slot->state == SLOT_PARKED;
+        }
+        else if(slot->state == SLOT_PENDING) {
+            if(slot->wanted) {
+                slot->state = SLOT_OPENING;
+                reader->wanted_unopened--;
+                return (long)i;
+            }
+            if(first_pending < 0) {
+                first_pending = (long)i;
+            }
+        }
+
+        if(first_pending >= 0 && reader->wanted_unopened == 0) {
+            break;
+        }
+    }
+
+    // Read ahead in order, but not past a file that's still waiting for room
+    if(first_pending >= 0 && !parked && reader->in_memory < reader->read_ahead) {
+        reader->slots[first_pending].state = SLOT_OPENING;
+        return first_pending;
+    }
+    return -1;
+}
+
+// Open a slot picked with pick_slot(), and see if it can be read now; the mutex must be held, and is unlocked while
+// the file is opened. Returns true if the slot should be read.
+static bool open_slot(BlueGenReader *reader, size_t index) {
+    Slot *slot = reader->slots + index;
+    if(slot->state == SLOT_READING) {
+        return true;
+    }
+
+    pthread_mutex_unlock(&reader->mutex);
+    bluegen_time_now(&slot->start);
+    size_t size = 0;
+    int fd = open_input(reader->paths[index], &size);
+    pthread_mutex_lock(&reader->mutex);
+
+    if(fd < 0) {
+        slot->size = 0;
+        finish_slot(reader, slot, index, -fd);
+        return false;
+    }
+
+    slot->fd = fd;
+    slot->size = size;
+    return admit_slot(reader, index);
+}
+
+// Read a whole file with pread
+static int read_slot(Slot *slot) {
+    while(slot->bytes_done < slot->size) {
+        size_t size = slot->size - slot->bytes_done;
+        if(size > MAX_READ_SIZE) {
+            size = MAX_READ_SIZE;
+        }
+#ifdef _WIN32
+        long result = _read(slot->fd, slot->data + slot->bytes_done, (unsigned int)size);
+#else
+        ssize_t result = pread(slot->fd, slot->data + slot->bytes_done, size, (off_t)slot->bytes_done);
+#endif
+        if(result < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+
+        // The file got smaller since we checked
+        if(result == 0) {
+            return EIO;
+        }
+        slot->bytes_done += (size_t)result;
+    }
+    return 0;
+}
+
+#ifdef USE_MMAP
+// Map a file instead of reading it, and let the kernel start reading it in the background
+static int map_slot(Slot *slot) {
+    void *data = mmap(NULL, slot->size, PROT_READ, MAP_PRIVATE, slot->fd, 0);
+    if(data == MAP_FAILED) {
+        return errno;
+    }
+    madvise(data, slot->size, MADV_SEQUENTIAL);
+    madvise(data, slot->size, MADV_WILLNEED);
+    slot->data = data;
+    slot->mapped = true;
+    return 0;
+}
+#endif
+
+// Read or map the whole of a slot that open_slot() said should be read; the mutex must be held, and is unlocked while
+// the file is read
+static void read_opened_slot(BlueGenReader *reader, size_t index) {
+    Slot *slot = reader->slots + index;
+    pthread_mutex_unlock(&reader->mutex);
+    int error = 0;
+#ifdef USE_MMAP
+    if(reader->backend == BLUEGEN_READER_MMAP && slot->size > 0) {
+        error = map_slot(slot);
+    }
+    else
+#endif
+    {
+        error = read_slot(slot);
+    }
+    pthread_mutex_lock(&reader->mutex);
+    finish_slot(reader, slot, index, error);
+}
+
+static void *read_thread_main(void *arg) {
+    BlueGenReader *reader = arg;
+    bluegen_perf_thread_begin();
+
+    pthread_mutex_lock(&reader->mutex);
+    while(!reader->closing) {
+        long index = pick_slot(reader);
+        if(index < 0) {
+            pthread_cond_wait(&reader->changed, &reader->mutex);
+            continue;
+        }
+        if(open_slot(reader, (size_t)index)) {
+            read_opened_slot(reader, (size_t)index);
+        }
+    }
+    pthread_mutex_unlock(&reader->mutex);
+
+    bluegen_perf_thread_end();
+    return NULL;
+}
+
+#ifdef USE_IO_URING
+static int setup_ring(Ring *ring) {
+    memset(ring, 0, sizeof(*ring));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, RING_DEPTH, &params);
+    if(ring->fd < 0) {
+        return 1;
+    }
+
+    // Older kernels can't do IORING_OP_READ
+    if(!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(ring->fd);
+        return 1;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cq_map_size > ring->sq_map_size) {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = 0;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sq_map == MAP_FAILED) {
+        close(ring->fd);
+        return 1;
+    }
+
+    if(ring->cq_map_size) {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cq_map == MAP_FAILED) {
+            munmap(ring->sq_map, ring->sq_map_size);
+            close(ring->fd);
+            return 1;
+        }
+    }
+    else {
+        ring->cq_map = ring->sq_map;
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED) {
+        if(ring->cq_map_size) {
+            munmap(ring->cq_map, ring->cq_map_size);
+        }
+        munmap(ring->sq_map, ring->sq_map_size);
+        close(ring->fd);
+        return 1;
+    }
+
+    uint8_t *sq = ring->sq_map;
+    uint8_t *cq = ring->cq_map;
+    ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+static void free_ring(Ring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if(ring->cq_map_size) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+}
+
+// Queue a read of the rest of a slot; it is submitted with the next io_uring_enter
+static void queue_read(Ring *ring, Slot *slot, size_t index) {
+    size_t size = slot->size - slot->bytes_done;
+    if(size > MAX_READ_SIZE) {
+        size = MAX_READ_SIZE;
+    }
+
+    unsigned int tail = *ring->sq_tail;
+    unsigned int sqe_index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = ring->sqes + sqe_index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->data + slot->bytes_done);
+    sqe->len = (uint32_t)size;
+    sqe->off = (uint64_t)slot->bytes_done;
+    sqe->user_data = (uint64_t)index;
+    ring->sq_array[sqe_index] = sqe_index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->in_flight++;
+}
+
+static void *ring_thread_main(void *arg) {
+    BlueGenReader *reader = arg;
+    Ring *ring = &reader->ring;
+    bluegen_perf_thread_begin();
+
+    // Reads queued but not submitted yet
+    unsigned int queued = 0;
+
+    pthread_mutex_lock(&reader->mutex);
+    for(;;) {
+        // Queue up as many reads as we can
+        while(!reader->closing && ring->in_flight < RING_DEPTH) {
+            long index = pick_slot(reader);
+            if(index < 0) {
+                break;
+            }
+            if(!open_slot(reader, (size_t)index)) {
+                continue;
+            }
+
+            Slot *slot = reader->slots + index;
+            if(slot->size == 0) {
+                finish_slot(reader, slot, (size_t)index, 0);
+                continue;
+            }
+            queue_read(ring, slot, (size_t)index);
+            queued++;
+        }
+
+        if(ring->in_flight == 0) {
+            if(reader->closing) {
+                break;
+            }
+            pthread_cond_wait(&reader->changed, &reader->mutex);
+            continue;
+        }
+
+        // Submit them and wait for at least one to finish
+        pthread_mutex_unlock(&reader->mutex);
+        long result = syscall(__NR_io_uring_enter, ring->fd, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        int error = errno;
+        pthread_mutex_lock(&reader->mutex);
+        if(result < 0) {
+            if(error == EINTR) {
+                continue;
+            }
+
+            // Something is very wrong with the ring; fail whatever is in flight
+            for(size_t i = 0; i < reader->slot_count; i++) {
+                if(reader->slots[i].state == SLOT_READING) {
+                    finish_slot(reader, reader->slots + i, i, error);
+                }
+            }
+            ring->in_flight = 0;
+            queued = 0;
+            continue;
+        }
+        queued -= (unsigned int)result;
+
+        unsigned int head = *ring->cq_head;
+        unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != tail; head++) {
+            const struct io_uring_cqe *cqe = ring->cqes + (head & *ring->cq_mask);
+            size_t index = (size_t)cqe->user_data;
+            Slot *slot = reader->slots + index;
+            ring->in_flight--;
+
+            if(cqe->res < 0) {
+                finish_slot(reader, slot, index, -cqe->res);
+            }
+            else if(cqe->res == 0) {
+                finish_slot(reader, slot, index, EIO);
+            }
+            else {
+                slot->bytes_done += (size_t)cqe->res;
+                if(slot->bytes_done == slot->size) {
+                    finish_slot(reader, slot, index, 0);
+                }
+                else {
+                    // Short read, so read the rest next time around
+                    queue_read(ring, slot, index);
+                    queued++;
+                }
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+
+    bluegen_perf_thread_end();
+    return NULL;
+}
+#endif
+
+BlueGenReader *open_bluegen_reader(const char *const *paths, size_t path_count, BlueGenReaderBackend backend, uint64_t read_ahead) {
+    BlueGenReader *reader = calloc(1, sizeof(*reader));
+    reader->paths = paths;
+    reader->slot_count = path_count;
+    reader->slots = calloc(path_count ? path_count : 1, sizeof(*reader->slots));
+    for(size_t i = 0; i < path_count; i++) {
+        reader->slots[i].fd = -1;
+    }
+    reader->read_ahead = read_ahead;
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+
+    reader->backend = BLUEGEN_READER_THREADS;
+#ifdef USE_IO_URING
+    if(backend == BLUEGEN_READER_IO_URING && setup_ring(&reader->ring) == 0) {
+        reader->backend = BLUEGEN_READER_IO_URING;
+    }
+#endif
+#ifdef USE_MMAP
+    if(backend == BLUEGEN_READER_MMAP) {
+        reader->backend = BLUEGEN_READER_MMAP;
+    }
+#endif
+
+    // One thread drives the ring; otherwise each thread reads or maps a file at a time
+    unsigned int thread_count = reader->backend == BLUEGEN_READER_IO_URING ? 1 : READ_THREADS;
+    if(reader->backend != BLUEGEN_READER_IO_URING && thread_count > path_count) {
+        thread_count = path_count ? (unsigned int)path_count : 1;
+    }
+
+    reader->threads = calloc(thread_count, sizeof(*reader->threads));
+    for(unsigned int t = 0; reader->threads && t < thread_count; t++) {
+        void *(*thread_main)(void *) = read_thread_main;
+#ifdef USE_IO_URING
+        if(reader->backend == BLUEGEN_READER_IO_URING) {
+            thread_main = ring_thread_main;
+        }
+#endif
+        if(pthread_create(reader->threads + t, NULL, thread_main, reader) != 0) {
+            break;
+        }
+        reader->thread_count++;
+    }
+
+    return reader;
+}
+
+int read_bluegen_input(BlueGenReader *reader, size_t index, const uint8_t **data, size_t *size) {
+    pthread_mutex_lock(&reader->mutex);
+    Slot *slot = reader->slots + index;
+    if(!slot->wanted) {
+        slot->wanted = true;
+        if(slot->state == SLOT_PENDING) {
+            reader->wanted_unopened++;
+        }
+        pthread_cond_broadcast(&reader->changed);
+    }
+
+    // If no thread could be started, nothing reads in the background, so read the file here instead
+    if(reader->thread_count == 0 && slot->state == SLOT_PENDING) {
+        slot->state = SLOT_OPENING;
+        reader->wanted_unopened--;
+        if(open_slot(reader, index)) {
+            read_opened_slot(reader, index);
+        }
+    }
+    while(slot->state != SLOT_READY) {
+        pthread_cond_wait(&reader->changed, &reader->mutex);
+    }
+    int error = slot->error;
+    *data = slot->data;
+    *size = slot->size;
+    pthread_mutex_unlock(&reader->mutex);
+    return error;
+}
+
+void release_bluegen_input(BlueGenReader *reader, size_t index) {
+    pthread_mutex_lock(&reader->mutex);
+    Slot *slot = reader->slots + index;
+    if(slot->state == SLOT_READY) {
+        free_slot_data(slot);
+        reader->in_memory -= slot->size;
+        slot->state = SLOT_RELEASED;
+        pthread_cond_broadcast(&reader->changed);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+}
+
+BlueGenReaderBackend bluegen_reader_backend(const BlueGenReader *reader) {
+    return reader->backend;
+}
+
+void close_bluegen_reader(BlueGenReader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    reader->closing = true;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->mutex);
+
+    for(unsigned int t = 0; t < reader->thread_count; t++) {
+        pthread_join(reader->threads[t], NULL);
+    }
+
+#ifdef USE_IO_URING
+    if(reader->backend == BLUEGEN_READER_IO_URING) {
+        free_ring(&reader->ring);
+    }
+#endif
+
+    for(size_t i = 0; i < reader->slot_count; i++) {
+        if(reader->slots[i].fd >= 0) {
+            close(reader->slots[i].fd);
+        }
+        free_slot_data(reader->slots + i);
+    }
+    free(reader->slots);
+    free(reader->threads);
+    pthread_cond_destroy(&reader->changed);
+    pthread_mutex_destroy(&reader->mutex);
+    free(reader);
+}
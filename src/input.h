@@ -0,0 +1,85 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_INPUT_H
+#define BLUEGEN_INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Ways input files can be read
+ */
+typedef enum BlueGenReaderBackend {
+    /** Use the pool of threads; io_uring isn't picked on its own yet, since its one thread opens every file itself */
+    BLUEGEN_READER_AUTO,
+
+    /** Submit reads in batches through io_uring (Linux 5.6 or newer), falling back to a pool of threads */
+    BLUEGEN_READER_IO_URING,
+
+    /** Read with a pool of threads, each reading one file at a time */
+    BLUEGEN_READER_THREADS,
+
+    /** Map each file into memory and let the kernel read it ahead (falls back to threads on Windows) */
+    BLUEGEN_READER_MMAP
+} BlueGenReaderBackend;
+
+/**
+ * Reads whole input files into memory ahead of when they are needed
+ */
+typedef struct BlueGenReader BlueGenReader;
+
+/**
+ * Start reading files in the background, in order; files are read ahead until read_ahead bytes are held in memory,
+ * and any file that is asked for with read_bluegen_input() is read right away regardless; if no thread can be
+ * started, nothing is read ahead and read_bluegen_input() reads each file itself
+ * @param paths      paths of the files, which must stay valid until the reader is closed
+ * @param path_count number of paths
+ * @param backend    how to read the files
+ * @param read_ahead most bytes to hold in memory for files nobody has asked for yet
+ * @return           reader; close it with close_bluegen_reader()
+ */
+BlueGenReader *open_bluegen_reader(const char *const *paths, size_t path_count, BlueGenReaderBackend backend, uint64_t read_ahead);
+
+/**
+ * Wait for a file to be read; this can be called from any thread, but each file can only be asked for once
+ * @param reader reader to use
+ * @param index  index of the file in the paths given to open_bluegen_reader()
+ * @param data   set to the contents of the file, which stay valid until release_bluegen_input() is called
+ * @param size   set to the size of the file in bytes
+ * @return       zero on success, or an errno value if the file could not be read
+ */
+int read_bluegen_input(BlueGenReader *reader, size_t index, const uint8_t **data, size_t *size);
+
+/**
+ * Free the contents of a file, letting more files be read ahead
+ * @param reader reader to use
+ * @param index  index of the file
+ */
+void release_bluegen_input(BlueGenReader *reader, size_t index);
+
+/**
+ * Get the backend a reader ended up using
+ * @param reader reader to check
+ * @return       BLUEGEN_READER_IO_URING, BLUEGEN_READER_THREADS, or BLUEGEN_READER_MMAP
+ */
+BlueGenReaderBackend bluegen_reader_backend(const BlueGenReader *reader);
+
+/**
+ * Stop reading and free everything, including files that were never released
+ * @param reader reader to close
+ */
+void close_bluegen_reader(BlueGenReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
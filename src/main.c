@@ -11,54 +11,101 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include "bluegen.h"
+#include "manifest.h"
+#include "progress.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "trace.h"
+#include "verify.h"
+
+// Long options without a short equivalent
+enum {
+    OPT_STATS = 0x100,
+    OPT_TRACE,
+    OPT_PERF_COUNTERS,
+    OPT_MAX_MEMORY,
+    OPT_READER,
+    OPT_MANIFEST,
+    OPT_CROP,
+    OPT_PROGRESS,
+    OPT_PROGRESS_FD,
+    OPT_VERIFY,
+    OPT_DIFF
+};
+
+typedef enum StatsFormat {
+    STATS_NONE,
+    STATS_TEXT,
+    STATS_JSON
+} StatsFormat;
+
+// Sequences start with -s, -a to take every frame of each file, or -S to take every image in a directory
+static bool starts_sequence(const char *arg) {
+    return strcmp(arg, "-s") == 0 || strcmp(arg, "-a") == 0 || strcmp(arg, "-S") == 0;
+}
 
-typedef struct TIFFTag {
-    uint16_t type;
-    uint16_t size;
-    uint32_t count;
-    uint32_t data_offset;
-} TIFFTag;
-
-static const uint16_t BITS_PER_SAMPLE[4] = { 0x8, 0x8, 0x8, 0x8 };
-
-bool ends_with(const char *str, const char *ext) {
-    size_t str_len = strlen(str);
-    size_t ext_len = strlen(ext);
-
-    if(str_len < ext_len) {
-        return false;
-    }
-    else {
-        for(const char *i = str + str_len - ext_len, *j = ext; *i; i++, j++) {
-            if(tolower(*i) != tolower(*j)) {
-                return false;
-            }
-        }
-
-        return true;
+// Show what went wrong, as a "failed" event too if progress is being written; if that's on stderr, the event is all
+// that's written so it stays one JSON object per line
+static int report_failure(const BlueGenError *error) {
+    if(!bluegen_progress_writes_to(stderr)) {
+        fprintf(stderr, "%s\n", error->message);
     }
+    bluegen_progress_close(NULL, error->message);
+    return 1;
 }
 
-int main(int argc, char **argv) {
+// Everything main() does; it returns from any number of places, so main() frees the manifest, which holds the
+// expanded arguments, and the --manifest paths, and closes what's left open after it
+static int run_bluegen(int argc, char **argv, BlueGenManifest *manifest, const char ***manifest_paths) {
     int longindex = 0, opt;
 
     BlueGenPixel dummy_color = { 0x00, 0xFF, 0xFF, 0xFF };
 
+    // Expand response files before anything else, since they can hold options as well as sequences
+    BlueGenError error;
+    argv = expand_bluegen_response_files(manifest, &argc, argv, &error);
+    if(!argv) {
+        fprintf(stderr, "%s\n", error.message);
+        return 1;
+    }
+
     char *program = argv[0];
+    StatsFormat stats_format = STATS_NONE;
+    bool progress = false;
+    int progress_fd = 2;
+    bool verify = false;
+    bool diff = false;
+    size_t manifest_count = 0;
+    BlueGenScheduleOptions schedule_options = { 0, 0, BLUEGEN_READER_AUTO, false, NULL, NULL, NULL, NULL, NULL, NULL };
+
+    BlueGenTime run_start;
+    bluegen_time_now(&run_start);
 
     static struct option options[] = {
         {"help",  no_argument, 0, 'h'},
         {"dummy-space",  required_argument, 0, 'd'},
+        {"threads",  required_argument, 0, 'j'},
+        {"max-memory",  required_argument, 0, OPT_MAX_MEMORY},
+        {"reader",  required_argument, 0, OPT_READER},
+        {"stats",  optional_argument, 0, OPT_STATS},
+        {"trace",  required_argument, 0, OPT_TRACE},
+        {"perf-counters",  no_argument, 0, OPT_PERF_COUNTERS},
+        {"manifest",  required_argument, 0, OPT_MANIFEST},
+        {"crop",  no_argument, 0, OPT_CROP},
+        {"progress",  required_argument, 0, OPT_PROGRESS},
+        {"progress-fd",  required_argument, 0, OPT_PROGRESS_FD},
+        {"verify",  no_argument, 0, OPT_VERIFY},
+        {"diff",  no_argument, 0, OPT_DIFF},
         {0, 0, 0, 0 }
     };
 
     int first_sequence = 1;
-    while(first_sequence < argc && strcmp(argv[first_sequence], "-s") != 0) {
+    while(first_sequence < argc && !starts_sequence(argv[first_sequence])) {
         first_sequence++;
     }
 
     // Go through each argument
-    while((opt = getopt_long(first_sequence, argv, "hd:", options, &longindex)) != -1) {
+    while((opt = getopt_long(first_sequence, argv, "hd:j:", options, &longindex)) != -1) {
         switch(opt) {
             case 'd':
                 for(char *c = optarg; *c; c++) {
@@ -78,220 +125,275 @@ int main(int argc, char **argv) {
                 }
                 break;
 
+            case 'j': {
+                int threads = atoi(optarg);
+                if(threads < 1) {
+                    fprintf(stderr, "(v)> Threads must be at least 1.\n");
+                    return 1;
+                }
+                schedule_options.threads = (unsigned int)threads;
+                break;
+            }
+
+            case OPT_MAX_MEMORY:
+                if(parse_bluegen_size(optarg, &schedule_options.max_memory) != 0) {
+                    fprintf(stderr, "(v)> Memory limit must be a size in bytes, optionally ending in K, M, or G (i.e. 4G).\n");
+                    return 1;
+                }
+                break;
+
+            case OPT_READER:
+                if(strcmp(optarg, "auto") == 0) {
+                    schedule_options.reader = BLUEGEN_READER_AUTO;
+                }
+                else if(strcmp(optarg, "io_uring") == 0) {
+                    schedule_options.reader = BLUEGEN_READER_IO_URING;
+                }
+                else if(strcmp(optarg, "threads") == 0) {
+                    schedule_options.reader = BLUEGEN_READER_THREADS;
+                }
+                else if(strcmp(optarg, "mmap") == 0) {
+                    schedule_options.reader = BLUEGEN_READER_MMAP;
+                }
+                else {
+                    fprintf(stderr, "(v)> Reader must be auto, io_uring, mmap, or threads.\n");
+                    return 1;
+                }
+                break;
+
+            case OPT_STATS:
+                if(!optarg || strcmp(optarg, "text") == 0) {
+                    stats_format = STATS_TEXT;
+                }
+                else if(strcmp(optarg, "json") == 0) {
+                    stats_format = STATS_JSON;
+                }
+                else {
+                    fprintf(stderr, "(v)> Stats format must be text or json.\n");
+                    return 1;
+                }
+                bluegen_stats_enable();
+                break;
+
+            case OPT_PERF_COUNTERS:
+                if(bluegen_perf_enable() == 0) {
+                    fprintf(stderr, "(v)> Performance counters aren't available here, so only times will be shown.\n");
+                }
+                if(stats_format == STATS_NONE) {
+                    stats_format = STATS_TEXT;
+                }
+                bluegen_stats_enable();
+                break;
+
+            case OPT_TRACE:
+                if(bluegen_trace_open(optarg) != 0) {
+                    fprintf(stderr, "(v)> Failed to open %s for writing.\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case OPT_CROP:
+                schedule_options.crop = true;
+                break;
+
+            case OPT_PROGRESS:
+                if(strcmp(optarg, "jsonl") != 0) {
+                    fprintf(stderr, "(v)> Progress format must be jsonl.\n");
+                    return 1;
+                }
+                progress = true;
+                break;
+
+            case OPT_PROGRESS_FD: {
+                char *end;
+                long fd = strtol(optarg, &end, 10);
+                if(end == optarg || *end || fd < 1) {
+                    fprintf(stderr, "(v)> Progress file descriptor must be at least 1.\n");
+                    return 1;
+                }
+                progress_fd = (int)fd;
+                progress = true;
+                break;
+            }
+
+            case OPT_VERIFY:
+                verify = true;
+                break;
+
+            case OPT_DIFF:
+                diff = true;
+                break;
+
+            // Manifests are read once progress is open, so anything wrong with them is reported there too
+            case OPT_MANIFEST:
+                if(!*manifest_paths) {
+                    *manifest_paths = malloc((size_t)argc * sizeof(**manifest_paths));
+                    if(!*manifest_paths) {
+                        fprintf(stderr, "(v)> Out of memory.\n");
+                        return 1;
+                    }
+                }
+                (*manifest_paths)[manifest_count++] = optarg;
+                break;
+
             case 'h':
             case 0:
                 FAIL_HELP:
                 fprintf(stderr, "Usage: %s [options] <output> -s <s1image1> [s1image2 ...] [-s <s2image1> ...]\n", program);
-                fprintf(stderr, "Takes tiff, png, bmp, and tga images as sequences (-s) and turns them into a\n");
-                fprintf(stderr, "valid sprite plate to be compiled into a Halo bitmap.\n\n");
+                fprintf(stderr, "Takes tiff, png, bmp, tga, and gif images as sequences (-s) and turns them\n");
+                fprintf(stderr, "into a valid sprite plate to be compiled into a Halo bitmap.\n\n");
+                fprintf(stderr, "Start a sequence with -a instead of -s to use every page of multi-page tiffs\n");
+                fprintf(stderr, "and every frame of animated gifs and pngs as its own image, rather than just\n");
+                fprintf(stderr, "the first one. Use -S <directory> for a sequence of every image in a\n");
+                fprintf(stderr, "directory, in order by name, with numbers in names compared by value.\n\n");
+                fprintf(stderr, "Arguments can also be read from a file, one per line, by passing @<file>\n");
+                fprintf(stderr, "in their place.\n\n");
+                fprintf(stderr, "Check color plates with %s --verify <plate> [plate ...], or compare the\n", program);
+                fprintf(stderr, "frames of two with %s --diff <plate a> <plate b>.\n\n", program);
                 fprintf(stderr, "Options:\n");
                 fprintf(stderr, "    --dummy-space,-d <color>   Set the color of the dummy space (normally cyan)\n");
                 fprintf(stderr, "                               via hex code. Default: 00FFFF (RRGGBB)\n");
+                fprintf(stderr, "    --threads,-j <n>           Decode up to n images at once. Default: one per CPU\n");
+                fprintf(stderr, "    --crop                     Crop fully transparent borders off of each image,\n");
+                fprintf(stderr, "                               keeping its center where it is and filling the\n");
+                fprintf(stderr, "                               rest of the border with dummy space. Images that\n");
+                fprintf(stderr, "                               don't fit in --max-memory are decoded twice.\n");
+                fprintf(stderr, "    --max-memory <size>        Limit how much memory decoded images and the color\n");
+                fprintf(stderr, "                               plate may use at once (i.e. 4G or 512M). Images\n");
+                fprintf(stderr, "                               wait for memory to free up before they are\n");
+                fprintf(stderr, "                               decoded. Default: no limit\n");
+                fprintf(stderr, "    --reader <reader>          How to read input files ahead of decoding them:\n");
+                fprintf(stderr, "                               io_uring (Linux 5.6+), threads, mmap, or auto,\n");
+                fprintf(stderr, "                               which uses threads.\n");
+                fprintf(stderr, "                               Default: auto\n");
+                fprintf(stderr, "    --stats[=<format>]         Print the time spent in each stage, counters, and\n");
+                fprintf(stderr, "                               peak memory usage to stderr, or stdout if progress\n");
+                fprintf(stderr, "                               is written to stderr. Format can be text or json.\n");
+                fprintf(stderr, "                               Default: text\n");
+                fprintf(stderr, "    --perf-counters            Also count cycles, instructions, cache misses,\n");
+                fprintf(stderr, "                               branch misses, and page faults for each stage in\n");
+                fprintf(stderr, "                               --stats (Linux only). Implies --stats.\n");
+                fprintf(stderr, "    --trace <file>             Write a Chrome Trace Event timeline of the run to\n");
+                fprintf(stderr, "                               a file, which can be opened in Perfetto.\n");
+                fprintf(stderr, "    --progress=jsonl           Write progress to stderr as it happens, one JSON\n");
+                fprintf(stderr, "                               object per line: files probed and decoded, bytes\n");
+                fprintf(stderr, "                               read and written, separator colors, bands written,\n");
+                fprintf(stderr, "                               and how long each stage has left, ending with a\n");
+                fprintf(stderr, "                               done event or a failed event with the error.\n");
+                fprintf(stderr, "    --progress-fd <fd>         Write progress to an open file descriptor instead\n");
+                fprintf(stderr, "                               of stderr. Implies --progress=jsonl.\n");
+                fprintf(stderr, "    --manifest <file>          Read sequences from a file, or stdin if it is -,\n");
+                fprintf(stderr, "                               with -s, -a, -S, or a path on each line. These come\n");
+                fprintf(stderr, "                               before any sequences given as arguments.\n");
+                fprintf(stderr, "    --verify                   Check that each plate is laid out the way blue-gen\n");
+                fprintf(stderr, "                               lays them out and that no frame uses a separator\n");
+                fprintf(stderr, "                               color, checking up to --threads plates at once.\n");
+                fprintf(stderr, "    --diff                     List which sequences and frames of two plates are\n");
+                fprintf(stderr, "                               different, even if frames moved. Exits with 1 if\n");
+                fprintf(stderr, "                               any are, or 2 if either plate isn't valid.\n");
                 fprintf(stderr, "    --help,-h                  Show help\n\n");
                 return 1;
         }
     }
 
-    if(first_sequence == argc || optind == first_sequence) {
-        goto FAIL_HELP;
-    }
-
-    const char *output_path = argv[first_sequence - 1];
-
-    // Figure out how many sequences we have
-    size_t sequence_count = 0;
-    for(int i = first_sequence; i < argc; i++) {
-        if(strcmp(argv[i], "-s") == 0) {
-            sequence_count++;
+    // Checking and comparing plates takes plates instead of an output and sequences
+    if(verify || diff) {
+        if(first_sequence != argc || (verify && diff) || (verify && optind >= argc) || (diff && argc - optind != 2)) {
+            goto FAIL_HELP;
         }
-    }
-
-    if(sequence_count == 0) {
-        char *new_argv[] = {program, "-h"};
-        return main(2, new_argv);
-    }
-
-    // Allocate sequences
-    BlueGenImageSequence *sequences = malloc(sequence_count * sizeof(*sequences));
-    int i = first_sequence + 1;
-    for(size_t s = 0; s < sequence_count; s++) {
-        BlueGenImageSequence *sequence = sequences + s;
-        sequence->image_count = 0;
-
-        // Get all of the images in the sequence
-        for(int is = i; is < argc; is++) {
-            if(strcmp(argv[is], "-s") == 0) {
-                break;
-            }
-            sequence->image_count++;
+        if(diff) {
+            return diff_bluegen_plates(argv[optind], argv[optind + 1], stdout);
         }
 
-        // Allocate images
-        sequence->images = malloc(sequence->image_count * sizeof(*sequence->images));
-        for(int q = 0; q < sequence->image_count; q++) {
-            const char *file = argv[i + q];
-            if(ends_with(file, ".tif") || ends_with(file, ".tiff")) {
-                load_tiff(sequence->images + q, file);
-            }
-            else if(ends_with(file, ".png") || ends_with(file, ".tga") || ends_with(file, ".bmp")) {
-                load_image(sequence->images + q, file);
-            }
-            else {
-                fprintf(stderr, "(v)> Failed to open %s! Unknown file type...\n", file);
-                return 1;
-            }
+        size_t plate_count = (size_t)(argc - optind);
+        size_t invalid = verify_bluegen_plates((const char *const *)(argv + optind), plate_count, schedule_options.threads, stderr);
+        if(invalid) {
+            fprintf(stderr, "(v)> %zu of %zu plates aren't valid.\n", invalid, plate_count);
+            return 1;
         }
-        i += 1 + sequence->image_count;
+        fprintf(stdout, "(^)> Yay! All %zu plates are valid.\n", plate_count);
+        return 0;
     }
 
-    BlueGenImage output_image;
-    generate_bluegen_image(sequences, sequence_count, &dummy_color, &output_image);
-
-    FILE *f = fopen(output_path, "wb");
-    if(!f) {
-        fprintf(stderr, "(v)> Failed to open %s for writing.\n", output_path);
-        return 1;
+    if(optind >= first_sequence) {
+        goto FAIL_HELP;
     }
 
-    uint16_t magic = 0x4949;
-    uint16_t version = 42;
-
-    // Write the TIFF header
-    fwrite(&magic, sizeof(magic), 1, f);
-    fwrite(&version, sizeof(magic), 1, f);
-
-    uint32_t width = output_image.width;
-    uint32_t height = output_image.height;
-
-    uint32_t pixel_offset = sizeof(uint32_t) + ftell(f);
-    uint32_t tag_offset = width * height * sizeof(*output_image.pixels) + pixel_offset;
-
-    // Write the offset to the tags
-    fwrite(&tag_offset, sizeof(tag_offset), 1, f);
-
-    // Write all the pixels
-    fwrite(output_image.pixels, output_image.height * output_image.width * sizeof(*output_image.pixels), 1, f);
-
-    // Write however many tags we need
-    uint16_t tag_count = 10;
-    fwrite(&tag_count, sizeof(tag_count), 1, f);
-
-    uint32_t after_tag_offset = tag_offset + sizeof(tag_count) + sizeof(TIFFTag) * tag_count + 4;
-
-    // Write the width and height
-    {
-        TIFFTag width_tag;
-        width_tag.type = 0x100;
-        width_tag.data_offset = width;
-        width_tag.size = width >= UINT16_MAX ? 4 : 3;
-        width_tag.count = 1;
-
-        TIFFTag height_tag;
-        height_tag.type = 0x101;
-        height_tag.data_offset = height;
-        height_tag.size = height >= UINT16_MAX ? 4 : 3;
-        height_tag.count = 1;
+    const char *output_path = argv[first_sequence - 1];
 
-        fwrite(&width_tag, sizeof(width_tag), 1, f);
-        fwrite(&height_tag, sizeof(height_tag), 1, f);
+    if(progress && bluegen_progress_open(progress_fd) != 0) {
+        fprintf(stderr, "(v)> Failed to open file descriptor %d for progress.\n", progress_fd);
+        return 1;
     }
 
-    // Write the bits per sample
-    {
-        TIFFTag bits_per_sample_tag;
-        bits_per_sample_tag.type = 0x102;
-        bits_per_sample_tag.size = 3;
-        bits_per_sample_tag.count = 4;
-        bits_per_sample_tag.data_offset = after_tag_offset;
-        fwrite(&bits_per_sample_tag, sizeof(bits_per_sample_tag), 1, f);
-
-        after_tag_offset += sizeof(BITS_PER_SAMPLE);
+    for(size_t m = 0; m < manifest_count; m++) {
+        const char *path = (*manifest_paths)[m];
+        FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+        if(!file) {
+            set_bluegen_error(&error, path, "(v)> Failed to open %s.", path);
+            return report_failure(&error);
+        }
+        int result = read_bluegen_manifest(manifest, file, file == stdin ? "stdin" : path, &error);
+        if(file != stdin) {
+            fclose(file);
+        }
+        if(result != 0) {
+            return report_failure(&error);
+        }
     }
 
-    // Write the compression (1 = no compression)
-    {
-        TIFFTag compression_tag;
-        compression_tag.type = 0x103;
-        compression_tag.size = 3;
-        compression_tag.count = 1;
-        compression_tag.data_offset = 1;
-        fwrite(&compression_tag, sizeof(compression_tag), 1, f);
-
-        after_tag_offset += sizeof(BITS_PER_SAMPLE);
+    // Add the sequences given as arguments after any from --manifest
+    for(int i = first_sequence; i < argc; i++) {
+        if(add_bluegen_manifest_argument(manifest, argv[i], &error) != 0) {
+            return report_failure(&error);
+        }
     }
-
-    // Write the photometric interpretation (2 = RGB)
-    {
-        TIFFTag photometric_interpretation_tag;
-        photometric_interpretation_tag.type = 0x106;
-        photometric_interpretation_tag.size = 3;
-        photometric_interpretation_tag.count = 1;
-        photometric_interpretation_tag.data_offset = 2;
-        fwrite(&photometric_interpretation_tag, sizeof(photometric_interpretation_tag), 1, f);
-
-        after_tag_offset += sizeof(BITS_PER_SAMPLE);
+    if(finish_bluegen_manifest(manifest, &error) != 0) {
+        return report_failure(&error);
     }
 
-    // Write the strips offset
-    {
-        TIFFTag strips_tag;
-        strips_tag.type = 0x111;
-        strips_tag.data_offset = pixel_offset;
-        strips_tag.size = 4;
-        strips_tag.count = 1;
-        fwrite(&strips_tag, sizeof(strips_tag), 1, f);
+    if(manifest->sequence_count == 0 && bluegen_progress_enabled()) {
+        set_bluegen_error(&error, NULL, "(v)> No sequences were given.");
+        return report_failure(&error);
     }
-
-    // Write the orientation (1 = top-left)
-    {
-        TIFFTag strips_tag;
-        strips_tag.type = 0x112;
-        strips_tag.data_offset = 1;
-        strips_tag.size = 3;
-        strips_tag.count = 1;
-        fwrite(&strips_tag, sizeof(strips_tag), 1, f);
+    if(manifest->sequence_count == 0) {
+        goto FAIL_HELP;
     }
 
-    // Write the samples per pixel (4 samples per pixel, rgba)
-    {
-        TIFFTag samples_per_pixel_tag;
-        samples_per_pixel_tag.type = 0x115;
-        samples_per_pixel_tag.data_offset = 4;
-        samples_per_pixel_tag.size = 3;
-        samples_per_pixel_tag.count = 1;
-        fwrite(&samples_per_pixel_tag, sizeof(samples_per_pixel_tag), 1, f);
+    BlueGenImage output_image;
+    if(generate_bluegen_image_from_files(manifest->sequences, manifest->sequence_count, &dummy_color, &schedule_options, &output_image, output_path, &error) != 0) {
+        return report_failure(&error);
     }
+    bluegen_trace_close();
+    bluegen_progress_close(&output_image, NULL);
+    bluegen_stats_elapsed(&run_start);
 
-    // Write the strip byte counts
-    {
-        TIFFTag strip_byte_count_tag;
-        strip_byte_count_tag.type = 0x117;
-        strip_byte_count_tag.data_offset = width * height * sizeof(*output_image.pixels);
-        strip_byte_count_tag.size = 4;
-        strip_byte_count_tag.count = 1;
-        fwrite(&strip_byte_count_tag, sizeof(strip_byte_count_tag), 1, f);
+    // Keep everything else off whichever of stdout or stderr the progress went to
+    if(!progress || progress_fd != 1) {
+        fprintf(stdout, "(^)> Yay! I made a %ux%u image.\n", output_image.width, output_image.height);
     }
+    free_bluegen_image(&output_image);
 
-    // Write the extra samples (2 = unassociated alpha)
-    {
-        TIFFTag extra_samples_tag;
-        extra_samples_tag.type = 0x152;
-        extra_samples_tag.data_offset = 2;
-        extra_samples_tag.size = 3;
-        extra_samples_tag.count = 1;
-        fwrite(&extra_samples_tag, sizeof(extra_samples_tag), 1, f);
+    FILE *stats_file = progress && progress_fd == 2 ? stdout : stderr;
+    if(stats_format == STATS_TEXT) {
+        bluegen_stats_print(stats_file);
+    }
+    else if(stats_format == STATS_JSON) {
+        bluegen_stats_print_json(stats_file);
     }
-
-    // Next directory offset
-    uint32_t next_directory_offset = 0;
-    fwrite(&next_directory_offset, sizeof(next_directory_offset), 1, f);
-
-    // Write all those bits per sample
-    fwrite(BITS_PER_SAMPLE, sizeof(BITS_PER_SAMPLE), 1, f);
-
-    fclose(f);
-
-    fprintf(stdout, "(^)> Yay! I made a %ux%u image.\n", output_image.width, output_image.height);
 
     return 0;
 }
+
+int main(int argc, char **argv) {
+    BlueGenManifest manifest;
+    const char **manifest_paths = NULL;
+    init_bluegen_manifest(&manifest);
+    int result = run_bluegen(argc, argv, &manifest, &manifest_paths);
+    free(manifest_paths);
+    free_bluegen_manifest(&manifest);
+
+    // The trace is only valid JSON once it's closed, which matters most when something failed
+    bluegen_trace_close();
+    return result;
+}
@@ -0,0 +1,317 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "manifest.h"
+
+// Paths are packed into blocks of this size rather than allocated one at a time
+#define STRING_BLOCK_SIZE (64 * 1024)
+
+struct BlueGenStringBlock {
+    struct BlueGenStringBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+static const char *store_string(BlueGenManifest *manifest, const char *string, size_t length) {
+    struct BlueGenStringBlock *block = manifest->strings;
+    if(!block || block->size - block->used < length + 1) {
+        size_t size = length + 1 > STRING_BLOCK_SIZE ? length + 1 : STRING_BLOCK_SIZE;
+        block = malloc(sizeof(*block) + size);
+        block->next = manifest->strings;
+        block->used = 0;
+        block->size = size;
+        manifest->strings = block;
+    }
+    char *stored = block->data + block->used;
+    memcpy(stored, string, length);
+    stored[length] = 0;
+    block->used += length + 1;
+    return stored;
+}
+
+// Read a line without its line ending into a buffer that grows to fit it; returns NULL at the end of the file
+static char *read_line(FILE *file, char **buffer, size_t *capacity, size_t *length) {
+    if(*capacity == 0) {
+        *capacity = 256;
+        *buffer = malloc(*capacity);
+    }
+    *length = 0;
+    while(fgets(*buffer + *length, (int)(*capacity - *length), file)) {
+        *length += strlen(*buffer + *length);
+        if(*length > 0 && (*buffer)[*length - 1] == '\n') {
+            break;
+        }
+        if(*length + 1 < *capacity) {
+            break;
+        }
+        *capacity *= 2;
+        *buffer = realloc(*buffer, *capacity);
+    }
+    if(*length == 0 && (feof(file) || ferror(file))) {
+        return NULL;
+    }
+    while(*length > 0 && ((*buffer)[*length - 1] == '\n' || (*buffer)[*length - 1] == '\r')) {
+        (*buffer)[--*length] = 0;
+    }
+    return *buffer;
+}
+
+void init_bluegen_manifest(BlueGenManifest *manifest) {
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+char **expand_bluegen_response_files(BlueGenManifest *manifest, int *argc, char **argv, BlueGenError *error) {
+    size_t count = 0;
+    size_t capacity = (size_t)*argc + 1;
+    char **arguments = malloc(capacity * sizeof(*arguments));
+    char *line = NULL;
+    size_t line_capacity = 0, length;
+
+    for(int i = 0; i < *argc; i++) {
+        if(i == 0 || argv[i][0] != '@') {
+            arguments[count++] = argv[i];
+            continue;
+        }
+
+        FILE *file = fopen(argv[i] + 1, "r");
+        if(!file) {
+            set_bluegen_error(error, argv[i] + 1, "(v)> Failed to open %s.", argv[i] + 1);
+            free(arguments);
+            free(line);
+            return NULL;
+        }
+        while(read_line(file, &line, &line_capacity, &length)) {
+            if(length == 0) {
+                continue;
+            }
+            // Leave room for the rest of argv and the NULL at the end
+            if(count + (size_t)(*argc - i) + 1 > capacity) {
+                capacity *= 2;
+                arguments = realloc(arguments, capacity * sizeof(*arguments));
+            }
+            arguments[count++] = (char *)store_string(manifest, line, length);
+        }
+        int failed = ferror(file);
+        fclose(file);
+        if(failed) {
+            set_bluegen_error(error, argv[i] + 1, "(v)> Failed to read %s.", argv[i] + 1);
+            free(arguments);
+            free(line);
+            return NULL;
+        }
+    }
+    free(line);
+
+    arguments[count] = NULL;
+    *argc = (int)count;
+    free(manifest->arguments);
+    manifest->arguments = arguments;
+    return arguments;
+}
+
+static void start_sequence(BlueGenManifest *manifest, bool all_frames) {
+    if(manifest->sequence_count == manifest->sequence_capacity) {
+        manifest->sequence_capacity = manifest->sequence_capacity ? manifest->sequence_capacity * 2 : 16;
+        manifest->sequences = realloc(manifest->sequences, manifest->sequence_capacity * sizeof(*manifest->sequences));
+    }
+    BlueGenFileSequence *sequence = manifest->sequences + manifest->sequence_count++;
+    sequence->paths = NULL;
+    sequence->path_count = 0;
+    sequence->all_frames = all_frames;
+}
+
+// Add a path that is already stored in the manifest to the last sequence
+static void add_path(BlueGenManifest *manifest, const char *path) {
+    if(manifest->path_count == manifest->path_capacity) {
+        manifest->path_capacity = manifest->path_capacity ? manifest->path_capacity * 2 : 256;
+        manifest->paths = realloc(manifest->paths, manifest->path_capacity * sizeof(*manifest->paths));
+    }
+    manifest->paths[manifest->path_count++] = path;
+    manifest->sequences[manifest->sequence_count - 1].path_count++;
+}
+
+int add_bluegen_manifest_argument(BlueGenManifest *manifest, const char *argument, BlueGenError *error) {
+    if(manifest->expecting_directory) {
+        manifest->expecting_directory = false;
+        return add_bluegen_manifest_directory(manifest, argument, error);
+    }
+    if(strcmp(argument, "-S") == 0) {
+        manifest->expecting_directory = true;
+        return 0;
+    }
+    if(strcmp(argument, "-s") == 0 || strcmp(argument, "-a") == 0) {
+        start_sequence(manifest, argument[1] == 'a');
+        return 0;
+    }
+
+    if(manifest->sequence_count == 0) {
+        set_bluegen_error(error, NULL, "(v)> %s has to come after -s, -a, or -S.", argument);
+        return 1;
+    }
+    add_path(manifest, store_string(manifest, argument, strlen(argument)));
+    return 0;
+}
+
+int compare_bluegen_natural(const char *a, const char *b) {
+    const unsigned char *x = (const unsigned char *)a;
+    const unsigned char *y = (const unsigned char *)b;
+    while(*x && *y) {
+        if(isdigit(*x) && isdigit(*y)) {
+            // Ignoring leading zeros, a longer number is a bigger one, and numbers as long as each other compare like text
+            while(*x == '0') {
+                x++;
+            }
+            while(*y == '0') {
+                y++;
+            }
+            size_t x_digits = 0, y_digits = 0;
+            while(isdigit(x[x_digits])) {
+                x_digits++;
+            }
+            while(isdigit(y[y_digits])) {
+                y_digits++;
+            }
+            if(x_digits != y_digits) {
+                return x_digits < y_digits ? -1 : 1;
+            }
+            int difference = memcmp(x, y, x_digits);
+            if(difference != 0) {
+                return difference;
+            }
+            x += x_digits;
+            y += y_digits;
+        }
+        else if(*x != *y) {
+            return *x < *y ? -1 : 1;
+        }
+        else {
+            x++;
+            y++;
+        }
+    }
+    if(*x || *y) {
+        return *x ? 1 : -1;
+    }
+
+    // Names like frame_1 and frame_01 are otherwise the same
+    return strcmp(a, b);
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return compare_bluegen_natural(*(const char * const *)a, *(const char * const *)b);
+}
+
+int add_bluegen_manifest_directory(BlueGenManifest *manifest, const char *directory, BlueGenError *error) {
+    DIR *dir = opendir(directory);
+    if(!dir) {
+        set_bluegen_error(error, directory, "(v)> Failed to open %s.", directory);
+        return 1;
+    }
+
+    size_t directory_length = strlen(directory);
+    bool has_separator = directory_length > 0 && (directory[directory_length - 1] == '/' || directory[directory_length - 1] == '\\');
+    const char **paths = NULL;
+    size_t count = 0, capacity = 0;
+    char *path = NULL;
+    size_t path_capacity = 0;
+
+    struct dirent *entry;
+    while((entry = readdir(dir))) {
+        if(entry->d_name[0] == '.' || bluegen_file_type(entry->d_name) == BLUEGEN_FILE_UNKNOWN) {
+            continue;
+        }
+
+        size_t name_length = strlen(entry->d_name);
+        size_t path_length = directory_length + !has_separator + name_length;
+        if(path_length + 1 > path_capacity) {
+            path_capacity = path_length + 1;
+            path = realloc(path, path_capacity);
+        }
+        memcpy(path, directory, directory_length);
+        if(!has_separator) {
+            path[directory_length] = '/';
+        }
+        memcpy(path + path_length - name_length, entry->d_name, name_length + 1);
+
+        struct stat info;
+        if(stat(path, &info) != 0 || S_ISDIR(info.st_mode)) {
+            continue;
+        }
+
+        if(count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            paths = realloc(paths, capacity * sizeof(*paths));
+        }
+        paths[count++] = store_string(manifest, path, path_length);
+    }
+    closedir(dir);
+    free(path);
+
+    if(count == 0) {
+        set_bluegen_error(error, directory, "(v)> %s has no images in it.", directory);
+        free(paths);
+        return 1;
+    }
+
+    // Every path starts with the directory, so this sorts by name
+    qsort(paths, count, sizeof(*paths), compare_paths);
+    start_sequence(manifest, false);
+    for(size_t i = 0; i < count; i++) {
+        add_path(manifest, paths[i]);
+    }
+    free(paths);
+    return 0;
+}
+
+int read_bluegen_manifest(BlueGenManifest *manifest, FILE *file, const char *path, BlueGenError *error) {
+    char *line = NULL;
+    size_t capacity = 0, length;
+    int result = 0;
+    while(result == 0 && read_line(file, &line, &capacity, &length)) {
+        if(length != 0) {
+            result = add_bluegen_manifest_argument(manifest, line, error);
+        }
+    }
+    free(line);
+    if(result == 0 && ferror(file)) {
+        set_bluegen_error(error, path, "(v)> Failed to read %s.", path);
+        result = 1;
+    }
+    return result;
+}
+
+int finish_bluegen_manifest(BlueGenManifest *manifest, BlueGenError *error) {
+    if(manifest->expecting_directory) {
+        set_bluegen_error(error, NULL, "(v)> -S has to be followed by a directory.");
+        return 1;
+    }
+
+    // Sequences were added in order, so each one's paths start where the last one's ended
+    size_t first_path = 0;
+    for(size_t s = 0; s < manifest->sequence_count; s++) {
+        manifest->sequences[s].paths = manifest->paths + first_path;
+        first_path += manifest->sequences[s].path_count;
+    }
+    return 0;
+}
+
+void free_bluegen_manifest(BlueGenManifest *manifest) {
+    while(manifest->strings) {
+        struct BlueGenStringBlock *next = manifest->strings->next;
+        free(manifest->strings);
+        manifest->strings = next;
+    }
+    free(manifest->sequences);
+    free(manifest->paths);
+    free(manifest->arguments);
+    init_bluegen_manifest(manifest);
+}
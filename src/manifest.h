@@ -0,0 +1,129 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_MANIFEST_H
+#define BLUEGEN_MANIFEST_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "scheduler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sequences built up one argument at a time, from the command line, response files, or manifests
+ *
+ * A manifest has one argument per line: -s or -a starts a sequence, -S starts a sequence of every image in the
+ * directory on the next line, and any other line is a path to add to the last sequence. Blank lines are skipped, and
+ * paths are taken as-is, so they can have spaces in them.
+ */
+typedef struct BlueGenManifest {
+    /** Sequences added so far; their paths are only set once finish_bluegen_manifest() is called */
+    BlueGenFileSequence *sequences;
+
+    /** Number of sequences */
+    size_t sequence_count;
+
+    /** Number of sequences there is room for */
+    size_t sequence_capacity;
+
+    /** Paths of every sequence, one after another */
+    const char **paths;
+
+    /** Number of paths */
+    size_t path_count;
+
+    /** Number of paths there is room for */
+    size_t path_capacity;
+
+    /** Arguments with response files expanded, from expand_bluegen_response_files() */
+    char **arguments;
+
+    /** Was the last argument -S? */
+    bool expecting_directory;
+
+    /** Blocks the paths and arguments are stored in */
+    struct BlueGenStringBlock *strings;
+} BlueGenManifest;
+
+/**
+ * Initialize an empty manifest
+ * @param manifest manifest to initialize
+ */
+void init_bluegen_manifest(BlueGenManifest *manifest);
+
+/**
+ * Replace every argument starting with @ with the lines of the file it names, like a response file; the lines are
+ * taken as-is, so the file can't name other response files
+ * @param manifest manifest to store the arguments in
+ * @param argc     number of arguments; set to the new number of arguments
+ * @param argv     arguments
+ * @param error    set to what went wrong, if anything
+ * @return         arguments with response files expanded, which are valid until the manifest is freed, or NULL if
+ *                 a response file can't be read
+ */
+char **expand_bluegen_response_files(BlueGenManifest *manifest, int *argc, char **argv, BlueGenError *error);
+
+/**
+ * Add an argument to a manifest
+ * @param manifest manifest to add to
+ * @param argument -s or -a to start a sequence, -S to start a sequence from the directory in the next argument, or a
+ *                 path to add to the last sequence; it is copied
+ * @param error    set to what went wrong, if anything
+ * @return         zero on success, non-zero if it is a path and no sequence has been started, or the directory can't
+ *                 be read or has no images in it
+ */
+int add_bluegen_manifest_argument(BlueGenManifest *manifest, const char *argument, BlueGenError *error);
+
+/**
+ * Add every line of a file to a manifest, a line at a time
+ * @param manifest manifest to add to
+ * @param file     file to read until the end
+ * @param path     path the file was opened from, for errors
+ * @param error    set to what went wrong, if anything
+ * @return         zero on success, non-zero if the file couldn't be read or a path came before any sequence
+ */
+int read_bluegen_manifest(BlueGenManifest *manifest, FILE *file, const char *path, BlueGenError *error);
+
+/**
+ * Start a sequence with every TIFF, PNG, BMP, TGA, and GIF in a directory, in natural order, so frame_2 comes before
+ * frame_10; subdirectories and files starting with a dot are skipped
+ * @param manifest  manifest to add to
+ * @param directory directory to read
+ * @param error     set to what went wrong, if anything
+ * @return          zero on success, non-zero if the directory can't be read or has no images in it
+ */
+int add_bluegen_manifest_directory(BlueGenManifest *manifest, const char *directory, BlueGenError *error);
+
+/**
+ * Compare two file names in natural order, where runs of digits are compared by their value
+ * @param a first name
+ * @param b second name
+ * @return  negative if a comes first, positive if b comes first, or zero if they are the same
+ */
+int compare_bluegen_natural(const char *a, const char *b);
+
+/**
+ * Point each sequence at its paths once everything has been added
+ * @param manifest manifest to finish
+ * @param error    set to what went wrong, if anything
+ * @return         zero on success, non-zero if the last argument was -S
+ */
+int finish_bluegen_manifest(BlueGenManifest *manifest, BlueGenError *error);
+
+/**
+ * Free everything in a manifest, including the arguments from expand_bluegen_response_files()
+ * @param manifest manifest to free
+ */
+void free_bluegen_manifest(BlueGenManifest *manifest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <string.h>
+#include "perf.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *COUNTER_NAMES[BLUEGEN_COUNTER_COUNT] = { "cycles", "instructions", "cache_misses", "branch_misses", "page_faults" };
+
+static int available[BLUEGEN_COUNTER_COUNT];
+static int open_count = 0;
+
+#ifdef __linux__
+// Each thread counts itself
+static __thread int counter_fds[BLUEGEN_COUNTER_COUNT] = { -1, -1, -1, -1, -1 };
+
+// Open whichever counters we can for the calling thread
+static int open_counters(void) {
+    static const struct {
+        uint32_t type;
+        uint64_t config;
+    } EVENTS[BLUEGEN_COUNTER_COUNT] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+    };
+
+    int count = 0;
+    for(int i = 0; i < BLUEGEN_COUNTER_COUNT; i++) {
+        if(counter_fds[i] != -1) {
+            count++;
+            continue;
+        }
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = EVENTS[i].type;
+        attr.config = EVENTS[i].config;
+
+        // User space only, so this works with perf_event_paranoid up to 2
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if(fd >= 0) {
+            counter_fds[i] = fd;
+            count++;
+        }
+    }
+    return count;
+}
+#endif
+
+int bluegen_perf_enable(void) {
+#ifdef __linux__
+    open_count = open_counters();
+    for(int i = 0; i < BLUEGEN_COUNTER_COUNT; i++) {
+        available[i] = counter_fds[i] != -1;
+    }
+#endif
+    return open_count;
+}
+
+void bluegen_perf_thread_begin(void) {
+#ifdef __linux__
+    if(open_count > 0) {
+        open_counters();
+    }
+#endif
+}
+
+void bluegen_perf_thread_end(void) {
+#ifdef __linux__
+    for(int i = 0; i < BLUEGEN_COUNTER_COUNT; i++) {
+        if(counter_fds[i] != -1) {
+            close(counter_fds[i]);
+            counter_fds[i] = -1;
+        }
+    }
+#endif
+}
+
+int bluegen_perf_enabled(void) {
+    return open_count > 0;
+}
+
+int bluegen_perf_available(BlueGenCounter counter) {
+    return available[counter];
+}
+
+void bluegen_perf_read(uint64_t *counters) {
+    for(int i = 0; i < BLUEGEN_COUNTER_COUNT; i++) {
+        counters[i] = 0;
+#ifdef __linux__
+        if(counter_fds[i] != -1 && read(counter_fds[i], counters + i, sizeof(*counters)) != sizeof(*counters)) {
+            counters[i] = 0;
+        }
+#endif
+    }
+}
+
+const char *bluegen_perf_counter_name(BlueGenCounter counter) {
+    return COUNTER_NAMES[counter];
+}
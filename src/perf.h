@@ -0,0 +1,89 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_PERF_H
+#define BLUEGEN_PERF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Performance counters that can be sampled for each stage
+ */
+typedef enum BlueGenCounter {
+    /** CPU cycles */
+    BLUEGEN_COUNTER_CYCLES,
+
+    /** Instructions retired */
+    BLUEGEN_COUNTER_INSTRUCTIONS,
+
+    /** Last level cache misses */
+    BLUEGEN_COUNTER_CACHE_MISSES,
+
+    /** Mispredicted branches */
+    BLUEGEN_COUNTER_BRANCH_MISSES,
+
+    /** Page faults */
+    BLUEGEN_COUNTER_PAGE_FAULTS,
+
+    BLUEGEN_COUNTER_COUNT
+} BlueGenCounter;
+
+/**
+ * Open the performance counters for the calling thread; this is only supported on Linux, using perf_event_open
+ *
+ * Counters only count the thread that opened them, so other threads need to call bluegen_perf_thread_begin(). Counters
+ * the kernel or hardware won't give us (e.g. in a VM or with a strict perf_event_paranoid) are left closed and read as
+ * zero.
+ *
+ * @return number of counters that could be opened
+ */
+int bluegen_perf_enable(void);
+
+/**
+ * Open the performance counters for the calling thread if bluegen_perf_enable() was called
+ */
+void bluegen_perf_thread_begin(void);
+
+/**
+ * Close the calling thread's performance counters
+ */
+void bluegen_perf_thread_end(void);
+
+/**
+ * Check if any performance counters are open
+ * @return non-zero if at least one counter is open
+ */
+int bluegen_perf_enabled(void);
+
+/**
+ * Check if a counter could be opened
+ * @param counter counter to check
+ * @return        non-zero if the counter is open
+ */
+int bluegen_perf_available(BlueGenCounter counter);
+
+/**
+ * Read the current value of every counter for the calling thread
+ * @param counters array to read into; closed counters are set to zero
+ */
+void bluegen_perf_read(uint64_t *counters);
+
+/**
+ * Get the name of a counter (e.g. "cycles")
+ * @param counter counter to get the name of
+ * @return        name of the counter
+ */
+const char *bluegen_perf_counter_name(BlueGenCounter counter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,551 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pngimage.h"
+
+// Prefer zlib-ng since it can inflate a row at a time; libdeflate is fast too but has to inflate the whole image at once
+#if defined(BLUEGEN_HAVE_ZLIB_NG)
+#include <zlib-ng.h>
+#define USE_FAST_PNG
+#elif defined(BLUEGEN_HAVE_LIBDEFLATE)
+#include <libdeflate.h>
+#define USE_FAST_PNG
+#endif
+
+#ifdef USE_FAST_PNG
+
+#define PNG_TYPE(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+// What stb_image multiplies grayscale samples by to bring them up to 8 bits
+static const uint8_t depth_scale[9] = { 0, 0xFF, 0x55, 0, 0x11, 0, 0, 0, 0x01 };
+
+typedef struct PngImage {
+    /** Dimensions */
+    uint32_t width;
+    uint32_t height;
+
+    /** Bits per sample and PNG color type */
+    uint8_t depth;
+    uint8_t color;
+
+    /** Samples per pixel, counting a palette index as one */
+    uint8_t samples;
+
+    /** Bytes per row, not counting the filter type byte */
+    size_t row_size;
+
+    /** How many bytes back the filters look */
+    size_t filter_distance;
+
+    /** Palette, with alpha from tRNS */
+    BlueGenPixel palette[256];
+    size_t palette_count;
+
+    /** tRNS color key for images without a palette, scaled the way stb_image scales it */
+    bool has_key;
+    uint16_t key[3];
+
+    /** First IDAT chunk, how many there are, and how much compressed data they hold */
+    const uint8_t *first_idat;
+    size_t idat_count;
+    size_t idat_size;
+} PngImage;
+
+static uint16_t get16be(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32be(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// Walk the chunks like stb_image does, giving up on anything it would reject and anything we don't handle
+static bool parse_png(PngImage *png, const uint8_t *data, size_t size, const BlueGenRect *rect) {
+    static const uint8_t signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    if(size < sizeof(signature) || memcmp(data, signature, sizeof(signature)) != 0) {
+        return false;
+    }
+
+    const uint8_t *chunk = data + sizeof(signature);
+    const uint8_t *end = data + size;
+    bool first = true, seen_palette = false, seen_transparency = false;
+    for(;;) {
+        if((size_t)(end - chunk) < 12) {
+            return false;
+        }
+        uint32_t length = get32be(chunk);
+        uint32_t type = get32be(chunk + 4);
+        const uint8_t *contents = chunk + 8;
+        if(length > (size_t)(end - contents) - 4) {
+            return false;
+        }
+
+        // This also turns away Apple's CgBI PNGs, which put a chunk before IHDR
+        if(first != (type == PNG_TYPE('I','H','D','R'))) {
+            return false;
+        }
+
+        switch(type) {
+            case PNG_TYPE('I','H','D','R'): {
+                if(length != 13) {
+                    return false;
+                }
+                first = false;
+                png->width = get32be(contents);
+                png->height = get32be(contents + 4);
+                png->depth = contents[8];
+                png->color = contents[9];
+                if(png->width != rect->width || png->height != rect->height) {
+                    return false;
+                }
+
+                // Compression and filter methods must be zero, and interlaced images are left to stb_image
+                if(contents[10] != 0 || contents[11] != 0 || contents[12] != 0) {
+                    return false;
+                }
+
+                uint8_t depth = png->depth;
+                bool low_depth = depth == 1 || depth == 2 || depth == 4;
+                switch(png->color) {
+                    case 0:
+                        png->samples = 1;
+                        break;
+                    case 3:
+                        png->samples = 1;
+                        if(depth == 16) {
+                            return false;
+                        }
+                        break;
+                    case 2:
+                        png->samples = 3;
+                        low_depth = false;
+                        break;
+                    case 4:
+                        png->samples = 2;
+                        low_depth = false;
+                        break;
+                    case 6:
+                        png->samples = 4;
+                        low_depth = false;
+                        break;
+                    default:
+                        return false;
+                }
+                if(!low_depth && depth != 8 && depth != 16) {
+                    return false;
+                }
+
+                png->row_size = ((size_t)png->width * png->samples * depth + 7) / 8;
+                png->filter_distance = depth < 8 ? 1 : (size_t)png->samples * depth / 8;
+                break;
+            }
+
+            case PNG_TYPE('P','L','T','E'):
+                if(seen_palette || png->first_idat || length > 256 * 3 || length % 3 != 0) {
+                    return false;
+                }
+                seen_palette = true;
+                png->palette_count = length / 3;
+                for(size_t i = 0; i < png->palette_count; i++) {
+                    png->palette[i].red = contents[i * 3];
+                    png->palette[i].green = contents[i * 3 + 1];
+                    png->palette[i].blue = contents[i * 3 + 2];
+                    png->palette[i].alpha = 0xFF;
+                }
+                break;
+
+            case PNG_TYPE('t','R','N','S'):
+                if(seen_transparency || png->first_idat) {
+                    return false;
+                }
+                seen_transparency = true;
+                if(png->color == 3) {
+                    if(png->palette_count == 0 || length > png->palette_count) {
+                        return false;
+                    }
+                    for(size_t i = 0; i < length; i++) {
+                        png->palette[i].alpha = contents[i];
+                    }
+                }
+                else {
+                    if(!(png->samples & 1) || length != (uint32_t)png->samples * 2) {
+                        return false;
+                    }
+                    png->has_key = true;
+                    for(size_t i = 0; i < png->samples; i++) {
+                        uint16_t key = get16be(contents + i * 2);
+                        png->key[i] = png->depth == 16 ? key : (uint8_t)((key & 0xFF) * depth_scale[png->depth]);
+                    }
+                }
+                break;
+
+            case PNG_TYPE('I','D','A','T'):
+                if(png->color == 3 && png->palette_count == 0) {
+                    return false;
+                }
+                if(!png->first_idat) {
+                    png->first_idat = chunk;
+                }
+                png->idat_count++;
+                png->idat_size += length;
+                break;
+
+            case PNG_TYPE('I','E','N','D'):
+                return png->first_idat != NULL;
+
+            default:
+                // Unknown chunks are fine as long as they aren't critical
+                if(!(type & (1u << 29))) {
+                    return false;
+                }
+                break;
+        }
+
+        chunk = contents + length + 4;
+    }
+}
+
+// Find the next IDAT chunk at or after chunk, which has already been checked by parse_png()
+static const uint8_t *find_idat(const uint8_t *chunk) {
+    for(;;) {
+        uint32_t type = get32be(chunk + 4);
+        if(type == PNG_TYPE('I','D','A','T')) {
+            return chunk;
+        }
+        if(type == PNG_TYPE('I','E','N','D')) {
+            return NULL;
+        }
+        chunk += get32be(chunk) + 12;
+    }
+}
+
+// Inflates the image data and hands out filtered rows, each starting with its filter type
+typedef struct PngStream {
+    const PngImage *png;
+
+#ifdef BLUEGEN_HAVE_ZLIB_NG
+    zng_stream zstream;
+
+    /** The chunk after the IDAT chunk being inflated */
+    const uint8_t *next_chunk;
+
+    /** The current and previous rows, swapped every row */
+    uint8_t *rows[2];
+    uint32_t row_count;
+
+    /** Did we reach the end of the deflate stream? */
+    bool ended;
+#else
+    /** Every row, inflated at once */
+    uint8_t *inflated;
+    size_t offset;
+#endif
+} PngStream;
+
+#ifdef BLUEGEN_HAVE_ZLIB_NG
+
+static bool open_png_stream(PngStream *stream, const PngImage *png) {
+    memset(stream, 0, sizeof(*stream));
+    stream->png = png;
+    stream->next_chunk = png->first_idat;
+    if(zng_inflateInit(&stream->zstream) != Z_OK) {
+        return false;
+    }
+    stream->rows[0] = malloc((png->row_size + 1) * 2);
+    stream->rows[1] = stream->rows[0] + png->row_size + 1;
+    return stream->rows[0] != NULL;
+}
+
+// Give zlib-ng the next IDAT chunk
+static bool feed_png_stream(PngStream *stream) {
+    const uint8_t *chunk = find_idat(stream->next_chunk);
+    if(!chunk) {
+        return false;
+    }
+    uint32_t length = get32be(chunk);
+    stream->zstream.next_in = chunk + 8;
+    stream->zstream.avail_in = length;
+    stream->next_chunk = chunk + length + 12;
+    return true;
+}
+
+// Inflate up to size bytes, moving on to the next IDAT chunk whenever one runs out; stops early at the end of the stream
+static bool inflate_png_bytes(PngStream *stream, uint8_t *output, size_t size) {
+    zng_stream *zstream = &stream->zstream;
+    zstream->next_out = output;
+    zstream->avail_out = (uint32_t)size;
+    while(zstream->avail_out > 0 && !stream->ended) {
+        if(zstream->avail_in == 0 && !feed_png_stream(stream)) {
+            return false;
+        }
+        int result = zng_inflate(zstream, Z_NO_FLUSH);
+        if(result == Z_STREAM_END) {
+            stream->ended = true;
+        }
+        else if(result != Z_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t *next_png_row(PngStream *stream) {
+    uint8_t *row = stream->rows[stream->row_count++ & 1];
+    if(!inflate_png_bytes(stream, row, stream->png->row_size + 1) || stream->zstream.avail_out > 0) {
+        return NULL;
+    }
+    return row;
+}
+
+// stb_image inflates the whole stream, so it has to be valid all the way to the end even if there's more than we need
+static bool finish_png_stream(PngStream *stream) {
+    while(!stream->ended) {
+        if(!inflate_png_bytes(stream, stream->rows[0], stream->png->row_size + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void close_png_stream(PngStream *stream) {
+    zng_inflateEnd(&stream->zstream);
+    free(stream->rows[0]);
+}
+
+#else
+
+static bool open_png_stream(PngStream *stream, const PngImage *png) {
+    memset(stream, 0, sizeof(*stream));
+    stream->png = png;
+
+    // libdeflate wants all of the compressed data in one place
+    const uint8_t *input = png->first_idat + 8;
+    uint8_t *joined = NULL;
+    if(png->idat_count > 1) {
+        joined = malloc(png->idat_size);
+        if(!joined) {
+            return false;
+        }
+        size_t offset = 0;
+        for(const uint8_t *chunk = find_idat(png->first_idat); chunk; chunk = find_idat(chunk + get32be(chunk) + 12)) {
+            memcpy(joined + offset, chunk + 8, get32be(chunk));
+            offset += get32be(chunk);
+        }
+        input = joined;
+    }
+
+    // Anything other than exactly the rows we need goes to stb_image, which allows extra data at the end
+    size_t inflated_size = (png->row_size + 1) * png->height;
+    size_t actual_size = 0;
+    stream->inflated = malloc(inflated_size);
+    struct libdeflate_decompressor *decompressor = libdeflate_alloc_decompressor();
+    bool inflated = stream->inflated && decompressor &&
+                    libdeflate_zlib_decompress(decompressor, input, png->idat_size, stream->inflated, inflated_size, &actual_size) == LIBDEFLATE_SUCCESS &&
+                    actual_size == inflated_size;
+    if(decompressor) {
+        libdeflate_free_decompressor(decompressor);
+    }
+    free(joined);
+    return inflated;
+}
+
+static uint8_t *next_png_row(PngStream *stream) {
+    uint8_t *row = stream->inflated + stream->offset;
+    stream->offset += stream->png->row_size + 1;
+    return row;
+}
+
+static bool finish_png_stream(PngStream *stream) {
+    (void)stream;
+    return true;
+}
+
+static void close_png_stream(PngStream *stream) {
+    free(stream->inflated);
+}
+
+#endif
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if(pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Undo a row's filter in place; the row before the first one is all zeros
+static bool unfilter_png_row(uint8_t *row, const uint8_t *prior, size_t size, size_t distance, uint8_t filter) {
+    size_t i;
+    switch(filter) {
+        case 0:
+            break;
+        case 1:
+            for(i = distance; i < size; i++) {
+                row[i] = (uint8_t)(row[i] + row[i - distance]);
+            }
+            break;
+        case 2:
+            for(i = 0; i < size; i++) {
+                row[i] = (uint8_t)(row[i] + prior[i]);
+            }
+            break;
+        case 3:
+            for(i = 0; i < distance && i < size; i++) {
+                row[i] = (uint8_t)(row[i] + (prior[i] >> 1));
+            }
+            for(; i < size; i++) {
+                row[i] = (uint8_t)(row[i] + ((row[i - distance] + prior[i]) >> 1));
+            }
+            break;
+        case 4:
+            for(i = 0; i < distance && i < size; i++) {
+                row[i] = (uint8_t)(row[i] + prior[i]);
+            }
+            for(; i < size; i++) {
+                row[i] = (uint8_t)(row[i] + paeth(row[i - distance], prior[i], prior[i - distance]));
+            }
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static uint16_t get_sample(const uint8_t *row, size_t index, uint8_t depth) {
+    switch(depth) {
+        case 16:
+            return get16be(row + index * 2);
+        case 8:
+            return row[index];
+        default: {
+            size_t bit = index * depth;
+            return (uint16_t)((row[bit / 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1));
+        }
+    }
+}
+
+// Bring a sample down (or up) to 8 bits the way stb_image does
+static uint8_t to_8_bit(uint16_t sample, uint8_t depth, uint8_t scale) {
+    return depth == 16 ? (uint8_t)(sample >> 8) : (uint8_t)(sample * scale);
+}
+
+// Convert an unfiltered row to RGBA, returning false if a palette index is out of range
+static bool expand_png_row(const PngImage *png, BlueGenPixel *output, const uint8_t *row) {
+    uint8_t depth = png->depth;
+    uint32_t width = png->width;
+    switch(png->color) {
+        case 0: {
+            uint8_t scale = depth < 8 ? depth_scale[depth] : 1;
+            for(uint32_t x = 0; x < width; x++) {
+                uint16_t sample = get_sample(row, x, depth);
+                uint8_t value = to_8_bit(sample, depth, scale);
+                output[x].red = output[x].green = output[x].blue = value;
+                output[x].alpha = png->has_key && (depth == 16 ? sample : value) == png->key[0] ? 0 : 0xFF;
+            }
+            break;
+        }
+
+        case 2:
+            if(depth == 8 && !png->has_key) {
+                for(uint32_t x = 0; x < width; x++, row += 3) {
+                    output[x].red = row[0];
+                    output[x].green = row[1];
+                    output[x].blue = row[2];
+                    output[x].alpha = 0xFF;
+                }
+                break;
+            }
+            for(uint32_t x = 0; x < width; x++) {
+                uint16_t r = get_sample(row, x * 3, depth), g = get_sample(row, x * 3 + 1, depth), b = get_sample(row, x * 3 + 2, depth);
+                output[x].red = to_8_bit(r, depth, 1);
+                output[x].green = to_8_bit(g, depth, 1);
+                output[x].blue = to_8_bit(b, depth, 1);
+                output[x].alpha = png->has_key && r == png->key[0] && g == png->key[1] && b == png->key[2] ? 0 : 0xFF;
+            }
+            break;
+
+        case 3:
+            for(uint32_t x = 0; x < width; x++) {
+                uint16_t index = get_sample(row, x, depth);
+                if(index >= png->palette_count) {
+                    return false;
+                }
+                output[x] = png->palette[index];
+            }
+            break;
+
+        case 4:
+            for(uint32_t x = 0; x < width; x++) {
+                output[x].red = output[x].green = output[x].blue = to_8_bit(get_sample(row, x * 2, depth), depth, 1);
+                output[x].alpha = to_8_bit(get_sample(row, x * 2 + 1, depth), depth, 1);
+            }
+            break;
+
+        case 6:
+            if(depth == 8) {
+                memcpy(output, row, (size_t)width * sizeof(*output));
+                break;
+            }
+            for(uint32_t x = 0; x < width; x++) {
+                output[x].red = (uint8_t)(get16be(row + x * 8) >> 8);
+                output[x].green = (uint8_t)(get16be(row + x * 8 + 2) >> 8);
+                output[x].blue = (uint8_t)(get16be(row + x * 8 + 4) >> 8);
+                output[x].alpha = (uint8_t)(get16be(row + x * 8 + 6) >> 8);
+            }
+            break;
+    }
+    return true;
+}
+
+bool decode_bluegen_png_frame(BlueGenImage *plate, const char *path, const uint8_t *data, size_t size, const BlueGenRect *rect) {
+    if(bluegen_file_type(path) != BLUEGEN_FILE_IMAGE) {
+        return false;
+    }
+
+    PngImage png;
+    memset(&png, 0, sizeof(png));
+    if(!parse_png(&png, data, size, rect)) {
+        return false;
+    }
+
+    PngStream stream;
+    uint8_t *zero_row = calloc(png.row_size + 1, 1);
+    bool decoded = zero_row && open_png_stream(&stream, &png);
+    const uint8_t *prior = zero_row;
+    for(uint32_t y = 0; decoded && y < png.height; y++) {
+        uint8_t *row = next_png_row(&stream);
+        BlueGenPixel *output = (BlueGenPixel *)plate->pixels + rect->x + (size_t)(rect->y + y) * plate->width;
+        decoded = row &&
+                  unfilter_png_row(row + 1, prior + 1, png.row_size, png.filter_distance, row[0]) &&
+                  expand_png_row(&png, output, row + 1);
+        prior = row;
+    }
+    decoded = decoded && finish_png_stream(&stream);
+    if(zero_row) {
+        close_png_stream(&stream);
+    }
+    free(zero_row);
+    return decoded;
+}
+
+#else
+
+bool decode_bluegen_png_frame(BlueGenImage *plate, const char *path, const uint8_t *data, size_t size, const BlueGenRect *rect) {
+    (void)plate;
+    (void)path;
+    (void)data;
+    (void)size;
+    (void)rect;
+    return false;
+}
+
+#endif
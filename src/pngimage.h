@@ -0,0 +1,36 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_PNGIMAGE_H
+#define BLUEGEN_PNGIMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bluegen.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Decode a non-interlaced PNG that was read into memory straight into its place in the color plate, one row at a time,
+ * using zlib-ng or libdeflate; the result is the same as decoding it with stb_image and blitting it
+ * @param plate RGBA color plate
+ * @param path  path the file was read from
+ * @param data  contents of the file
+ * @param size  size of the file in bytes
+ * @param rect  where the image goes in the plate
+ * @return      true if it was decoded, or false if it has to be decoded normally (including when blue-gen was built
+ *              without either library)
+ */
+bool decode_bluegen_png_frame(BlueGenImage *plate, const char *path, const uint8_t *data, size_t size, const BlueGenRect *rect);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
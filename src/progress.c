@@ -0,0 +1,140 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include "progress.h"
+#include "stats.h"
+
+static FILE *progress_file = NULL;
+static double progress_start = 0.0;
+static pthread_mutex_t progress_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// When the stage being reported started, for guessing how much of it is left
+static double stage_start = 0.0;
+
+// Totals so far, reported with each event
+static uint64_t bytes_read = 0;
+static uint64_t bytes_written = 0;
+
+static const char *STAGE_NAMES[] = { "probe", "decode", "write" };
+
+static double seconds_elapsed(void) {
+    BlueGenTime now;
+    bluegen_time_now(&now);
+    return now.wall - progress_start;
+}
+
+int bluegen_progress_open(int fd) {
+    progress_file = fd == 2 ? stderr : fd == 1 ? stdout : fdopen(fd, "w");
+    if(!progress_file) {
+        return 1;
+    }
+
+    BlueGenTime now;
+    bluegen_time_now(&now);
+    progress_start = now.wall;
+    stage_start = now.wall;
+    bytes_read = 0;
+    bytes_written = 0;
+    return 0;
+}
+
+int bluegen_progress_enabled(void) {
+    return progress_file != NULL;
+}
+
+int bluegen_progress_writes_to(const FILE *file) {
+    return progress_file != NULL && progress_file == file;
+}
+
+void bluegen_progress_stage(BlueGenProgressStage stage, uint64_t done, uint64_t total) {
+    if(!progress_file) {
+        return;
+    }
+
+    // Each stage is reported with nothing done first, so that's when it starts
+    pthread_mutex_lock(&progress_mutex);
+    double elapsed = seconds_elapsed();
+    if(done == 0) {
+        stage_start = elapsed;
+    }
+    fprintf(progress_file, "{\"event\":\"%s\",\"elapsed\":%.3f,\"done\":%llu,\"total\":%llu,\"bytes_read\":%llu,\"bytes_written\":%llu,\"eta\":",
+            STAGE_NAMES[stage], elapsed, (unsigned long long)done, (unsigned long long)total, (unsigned long long)bytes_read, (unsigned long long)bytes_written);
+    if(done > 0 && done <= total) {
+        fprintf(progress_file, "%.3f}\n", (elapsed - stage_start) * (double)(total - done) / (double)done);
+    }
+    else {
+        fprintf(progress_file, "null}\n");
+    }
+    fflush(progress_file);
+    pthread_mutex_unlock(&progress_mutex);
+}
+
+void bluegen_progress_read(uint64_t bytes) {
+    if(!progress_file) {
+        return;
+    }
+    pthread_mutex_lock(&progress_mutex);
+    bytes_read += bytes;
+    pthread_mutex_unlock(&progress_mutex);
+}
+
+void bluegen_progress_separators(const BlueGenPixel *blue, const BlueGenPixel *magenta) {
+    if(!progress_file) {
+        return;
+    }
+    pthread_mutex_lock(&progress_mutex);
+    fprintf(progress_file, "{\"event\":\"separators\",\"elapsed\":%.3f,\"bitmap\":\"%02X%02X%02X\",\"sequence\":\"%02X%02X%02X\"}\n",
+            seconds_elapsed(), blue->red, blue->green, blue->blue, magenta->red, magenta->green, magenta->blue);
+    fflush(progress_file);
+    pthread_mutex_unlock(&progress_mutex);
+}
+
+void bluegen_progress_over_budget(uint64_t needed, uint64_t limit) {
+    if(!progress_file) {
+        return;
+    }
+    pthread_mutex_lock(&progress_mutex);
+    fprintf(progress_file, "{\"event\":\"over_budget\",\"elapsed\":%.3f,\"needed\":%llu,\"limit\":%llu}\n",
+            seconds_elapsed(), (unsigned long long)needed, (unsigned long long)limit);
+    fflush(progress_file);
+    pthread_mutex_unlock(&progress_mutex);
+}
+
+void bluegen_progress_band(size_t band, uint32_t y, uint32_t end, uint64_t bytes) {
+    if(!progress_file) {
+        return;
+    }
+    pthread_mutex_lock(&progress_mutex);
+    bytes_written += bytes;
+    fprintf(progress_file, "{\"event\":\"band\",\"elapsed\":%.3f,\"band\":%zu,\"y\":%lu,\"height\":%lu,\"bytes\":%llu}\n",
+            seconds_elapsed(), band, (unsigned long)y, (unsigned long)(end - y), (unsigned long long)bytes);
+    fflush(progress_file);
+    pthread_mutex_unlock(&progress_mutex);
+}
+
+void bluegen_progress_close(const BlueGenImage *output, const char *message) {
+    if(!progress_file) {
+        return;
+    }
+    if(output) {
+        fprintf(progress_file, "{\"event\":\"done\",\"elapsed\":%.3f,\"width\":%lu,\"height\":%lu,\"bytes_read\":%llu,\"bytes_written\":%llu}\n",
+                seconds_elapsed(), (unsigned long)output->width, (unsigned long)output->height, (unsigned long long)bytes_read, (unsigned long long)bytes_written);
+    }
+    else {
+        fprintf(progress_file, "{\"event\":\"failed\",\"elapsed\":%.3f,\"message\":", seconds_elapsed());
+        bluegen_json_string(progress_file, message);
+        fprintf(progress_file, "}\n");
+    }
+    if(progress_file == stderr || progress_file == stdout) {
+        fflush(progress_file);
+    }
+    else {
+        fclose(progress_file);
+    }
+    progress_file = NULL;
+}
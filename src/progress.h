@@ -0,0 +1,92 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_PROGRESS_H
+#define BLUEGEN_PROGRESS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "bluegen.h"
+#include "scheduler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Start writing progress as JSON lines, one event per line, flushed as soon as it happens so a wrapper can follow along
+ * and notice if it stops; every event has an "event" name and the seconds "elapsed" since this was called
+ * @param fd file descriptor to write to, such as 2 for stderr
+ * @return   zero on success, non-zero if it could not be opened
+ */
+int bluegen_progress_open(int fd);
+
+/**
+ * Check if progress is being written
+ * @return non-zero if enabled
+ */
+int bluegen_progress_enabled(void);
+
+/**
+ * Check if progress is being written to a stream, so messages for people can be kept off it
+ * @param file stream to check, such as stderr
+ * @return     non-zero if progress is written to it
+ */
+int bluegen_progress_writes_to(const FILE *file);
+
+/**
+ * Write a "probe", "decode" or "write" event with how much of the stage is done, the bytes read from input files and
+ * written to the output so far, and the seconds left in the stage if enough of it is done to guess; does nothing if
+ * progress isn't open, and can be called from any thread
+ * @param stage stage being reported
+ * @param done  how much of the stage is done
+ * @param total how much there is to do in the stage
+ */
+void bluegen_progress_stage(BlueGenProgressStage stage, uint64_t done, uint64_t total);
+
+/**
+ * Count bytes read from an input file; they're reported with the next event
+ * @param bytes number of bytes read
+ */
+void bluegen_progress_read(uint64_t bytes);
+
+/**
+ * Write a "separators" event with the colors picked to separate bitmaps and sequences
+ * @param blue    bitmap separator color
+ * @param magenta sequence separator color
+ */
+void bluegen_progress_separators(const BlueGenPixel *blue, const BlueGenPixel *magenta);
+
+/**
+ * Write an "over_budget" event when the color plate and everything else that stays resident alone need more than the
+ * memory limit, so images will be decoded one at a time
+ * @param needed bytes needed by the color plate and everything else that stays resident
+ * @param limit  memory limit in bytes
+ */
+void bluegen_progress_over_budget(uint64_t needed, uint64_t limit);
+
+/**
+ * Write a "band" event once a band of the color plate is written
+ * @param band  index of the band, which is also its sequence
+ * @param y     first row of the band
+ * @param end   row after the last row of the band
+ * @param bytes number of bytes written for it, which is less than all of it if only changed rows were written
+ */
+void bluegen_progress_band(size_t band, uint32_t y, uint32_t end, uint64_t bytes);
+
+/**
+ * Write a "done" event with the size of the color plate, or a "failed" event, and close the file
+ * @param output  color plate, or NULL if it failed
+ * @param message what went wrong, if it failed
+ */
+void bluegen_progress_close(const BlueGenImage *output, const char *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,277 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <string.h>
+#include "rawimage.h"
+
+// BLUEGEN_NO_SIMD leaves only the plain C loops, so tests can check the SIMD ones against them
+#if !defined(BLUEGEN_NO_SIMD)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define USE_SSSE3
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define USE_NEON
+#endif
+#endif
+
+static uint16_t get16le(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32le(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Convert a row of BGR pixels to RGBA
+static void swizzle_bgr(BlueGenPixel *output, const uint8_t *input, uint32_t width) {
+    uint32_t x = 0;
+#if defined(USE_NEON)
+    uint8x16_t alpha = vdupq_n_u8(0xFF);
+    for(; x + 16 <= width; x += 16) {
+        uint8x16x3_t bgr = vld3q_u8(input + x * 3);
+        uint8x16x4_t rgba = {{ bgr.val[2], bgr.val[1], bgr.val[0], alpha }};
+        vst4q_u8((uint8_t *)(output + x), rgba);
+    }
+#elif defined(USE_SSSE3)
+    // Each load takes 16 bytes but only uses 12, so stop while there's still a whole pixel and a third past them
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    for(; x + 6 <= width; x += 4) {
+        __m128i bgr = _mm_loadu_si128((const __m128i *)(input + x * 3));
+        _mm_storeu_si128((__m128i *)(output + x), _mm_or_si128(_mm_shuffle_epi8(bgr, shuffle), alpha));
+    }
+#endif
+    for(; x < width; x++) {
+        const uint8_t *p = input + x * 3;
+        output[x].red = p[2];
+        output[x].green = p[1];
+        output[x].blue = p[0];
+        output[x].alpha = 0xFF;
+    }
+}
+
+// Convert a row of BGRA pixels to RGBA, returning every alpha value ORed together
+static uint8_t swizzle_bgra(BlueGenPixel *output, const uint8_t *input, uint32_t width) {
+    uint32_t x = 0;
+    uint8_t alpha_or = 0;
+#if defined(USE_NEON)
+    uint8x16_t alpha_acc = vdupq_n_u8(0);
+    for(; x + 16 <= width; x += 16) {
+        uint8x16x4_t bgra = vld4q_u8(input + x * 4);
+        uint8x16x4_t rgba = {{ bgra.val[2], bgra.val[1], bgra.val[0], bgra.val[3] }};
+        alpha_acc = vorrq_u8(alpha_acc, bgra.val[3]);
+        vst4q_u8((uint8_t *)(output + x), rgba);
+    }
+    alpha_or = vmaxvq_u8(alpha_acc) ? 0xFF : 0;
+#elif defined(USE_SSE2)
+    // Swap the red and blue bytes of each 32-bit pixel
+    const __m128i rb_mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i ga_mask = _mm_set1_epi32((int)0xFF00FF00);
+    __m128i acc = _mm_setzero_si128();
+    for(; x + 4 <= width; x += 4) {
+        __m128i bgra = _mm_loadu_si128((const __m128i *)(input + x * 4));
+        __m128i rb = _mm_and_si128(bgra, rb_mask);
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        acc = _mm_or_si128(acc, bgra);
+        _mm_storeu_si128((__m128i *)(output + x), _mm_or_si128(_mm_and_si128(bgra, ga_mask), rb));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    alpha_or = (uint8_t)((lanes[0] | lanes[1] | lanes[2] | lanes[3]) >> 24);
+#endif
+    for(; x < width; x++) {
+        const uint8_t *p = input + x * 4;
+        output[x].red = p[2];
+        output[x].green = p[1];
+        output[x].blue = p[0];
+        output[x].alpha = p[3];
+        alpha_or |= p[3];
+    }
+    return alpha_or;
+}
+
+static BlueGenPixel *plate_row(BlueGenImage *plate, const BlueGenRect *rect, uint32_t y) {
+    return (BlueGenPixel *)plate->pixels + rect->x + (size_t)(rect->y + y) * plate->width;
+}
+
+// Uncompressed 24-bit and 32-bit BMPs, following what stb_image accepts
+static bool decode_bmp(BlueGenImage *plate, const uint8_t *data, size_t size, const BlueGenRect *rect) {
+    if(size < 14 + 40 || data[0] != 'B' || data[1] != 'M') {
+        return false;
+    }
+
+    uint32_t offset = get32le(data + 10);
+    uint32_t header_size = get32le(data + 14);
+    if(header_size != 40 && header_size != 56 && header_size != 108 && header_size != 124) {
+        return false;
+    }
+
+    int32_t width = (int32_t)get32le(data + 18);
+    int32_t height = (int32_t)get32le(data + 22);
+    uint16_t planes = get16le(data + 26);
+    uint16_t bpp = get16le(data + 28);
+    uint32_t compression = get32le(data + 30);
+
+    // stb_image wants the pixels right after the header when there's no palette
+    if(planes != 1 || compression != 0 || (bpp != 24 && bpp != 32) || offset != 14 + header_size) {
+        return false;
+    }
+
+    bool bottom_up = height > 0;
+    uint32_t abs_height = (uint32_t)(bottom_up ? height : -height);
+    if(width <= 0 || (uint32_t)width != rect->width || abs_height != rect->height) {
+        return false;
+    }
+
+    size_t stride = ((size_t)width * (bpp / 8) + 3) & ~(size_t)3;
+    if(offset + stride * abs_height > size) {
+        return false;
+    }
+
+    const uint8_t *pixels = data + offset;
+    uint8_t alpha_or = 0;
+    for(uint32_t y = 0; y < abs_height; y++) {
+        BlueGenPixel *output = plate_row(plate, rect, bottom_up ? abs_height - 1 - y : y);
+        const uint8_t *input = pixels + y * stride;
+        if(bpp == 24) {
+            swizzle_bgr(output, input, (uint32_t)width);
+        }
+        else {
+            alpha_or |= swizzle_bgra(output, input, (uint32_t)width);
+        }
+    }
+
+    // Like stb_image, treat a 32-bit BMP whose alpha is all zero as opaque
+    if(bpp == 32 && alpha_or == 0) {
+        for(uint32_t y = 0; y < abs_height; y++) {
+            BlueGenPixel *output = plate_row(plate, rect, y);
+            for(uint32_t x = 0; x < rect->width; x++) {
+                output[x].alpha = 0xFF;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Uncompressed and RLE 24-bit and 32-bit truecolor TGAs
+static bool decode_tga(BlueGenImage *plate, const uint8_t *data, size_t size, const BlueGenRect *rect) {
+    if(size < 18) {
+        return false;
+    }
+
+    uint8_t id_length = data[0];
+    uint8_t color_map_type = data[1];
+    uint8_t image_type = data[2];
+    uint16_t width = get16le(data + 12);
+    uint16_t height = get16le(data + 14);
+    uint8_t bpp = data[16];
+    uint8_t descriptor = data[17];
+
+    // A color map type of zero also rules out every format stb_image checks before TGA
+    if(color_map_type != 0 || (image_type != 2 && image_type != 10) || (bpp != 24 && bpp != 32)) {
+        return false;
+    }
+    if(width == 0 || height == 0 || width != rect->width || height != rect->height) {
+        return false;
+    }
+
+    bool rle = image_type == 10;
+    bool bottom_up = !(descriptor & 0x20);
+    size_t channels = bpp / 8;
+    const uint8_t *input = data + 18 + id_length;
+    const uint8_t *end = data + size;
+
+    if(!rle) {
+        size_t stride = (size_t)width * channels;
+        if(18 + id_length + stride * height > size) {
+            return false;
+        }
+        for(uint32_t y = 0; y < height; y++, input += stride) {
+            BlueGenPixel *output = plate_row(plate, rect, bottom_up ? height - 1u - y : y);
+            if(channels == 3) {
+                swizzle_bgr(output, input, width);
+            }
+            else {
+                swizzle_bgra(output, input, width);
+            }
+        }
+        return true;
+    }
+
+    // RLE packets can run past the end of a row, so keep track of where we are
+    uint32_t x = 0, y = 0;
+    BlueGenPixel *output = plate_row(plate, rect, bottom_up ? height - 1u : 0);
+    while(y < height) {
+        if(input >= end) {
+            return false;
+        }
+        uint8_t packet = *input++;
+        uint32_t count = (uint32_t)(packet & 0x7F) + 1;
+
+        if(packet & 0x80) {
+            if((size_t)(end - input) < channels) {
+                return false;
+            }
+            BlueGenPixel pixel = { input[2], input[1], input[0], channels == 4 ? input[3] : 0xFF };
+            input += channels;
+            while(count > 0 && y < height) {
+                uint32_t run = width - x < count ? width - x : count;
+                for(uint32_t i = 0; i < run; i++) {
+                    output[x + i] = pixel;
+                }
+                x += run;
+                count -= run;
+                if(x == width) {
+                    x = 0;
+                    if(++y < height) {
+                        output = plate_row(plate, rect, bottom_up ? height - 1u - y : y);
+                    }
+                }
+            }
+        }
+        else {
+            if((size_t)(end - input) < count * channels) {
+                return false;
+            }
+            while(count > 0 && y < height) {
+                uint32_t run = width - x < count ? width - x : count;
+                if(channels == 3) {
+                    swizzle_bgr(output + x, input, run);
+                }
+                else {
+                    swizzle_bgra(output + x, input, run);
+                }
+                input += run * channels;
+                x += run;
+                count -= run;
+                if(x == width) {
+                    x = 0;
+                    if(++y < height) {
+                        output = plate_row(plate, rect, bottom_up ? height - 1u - y : y);
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool decode_bluegen_raw_frame(BlueGenImage *plate, const char *path, const uint8_t *data, size_t size, const BlueGenRect *rect) {
+    if(bluegen_file_type(path) != BLUEGEN_FILE_IMAGE) {
+        return false;
+    }
+
+    // stb_image goes by the contents rather than the extension, so we do too
+    return decode_bmp(plate, data, size, rect) || decode_tga(plate, data, size, rect);
+}
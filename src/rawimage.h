@@ -0,0 +1,35 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_RAWIMAGE_H
+#define BLUEGEN_RAWIMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bluegen.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Decode an uncompressed 24/32-bit BMP or TGA (including RLE TGA) that was read into memory straight into its place in
+ * the color plate, skipping the intermediate image; the result is the same as decoding it with stb_image and blitting it
+ * @param plate RGBA color plate
+ * @param path  path the file was read from
+ * @param data  contents of the file
+ * @param size  size of the file in bytes
+ * @param rect  where the image goes in the plate
+ * @return      true if it was decoded, or false if the file is anything else and has to be decoded normally
+ */
+bool decode_bluegen_raw_frame(BlueGenImage *plate, const char *path, const uint8_t *data, size_t size, const BlueGenRect *rect);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
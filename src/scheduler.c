@@ -0,0 +1,1428 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "scheduler.h"
+#include "frames.h"
+#include "input.h"
+#include "pngimage.h"
+#include "progress.h"
+#include "rawimage.h"
+#include "stats.h"
+#include "trace.h"
+#include "perf.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// How much the reader may read ahead when there's no memory limit
+#define DEFAULT_READ_AHEAD ((uint64_t)256 << 20)
+
+// What a file looked like, so a file that was changed isn't mistaken for what was there before
+typedef struct FileStamp {
+    int64_t modified;
+    uint64_t size;
+} FileStamp;
+
+// A file placed on the last color plate of a session
+typedef struct SessionFile {
+    char *path;
+    bool all_frames;
+    FileStamp stamp;
+
+    /** Info for each frame, how each is cropped if they were, and where each went on the plate */
+    BlueGenImageInfo *infos;
+    BlueGenCrop *crops;
+    BlueGenRect *rects;
+    size_t frame_count;
+} SessionFile;
+
+struct BlueGenSession {
+    /** Last color plate, if there is one */
+    BlueGenImage plate;
+    bool have_plate;
+
+    /** Files placed on it, sorted by path, and whether they were cropped and with what dummy space */
+    SessionFile *files;
+    size_t file_count;
+    bool crop;
+    BlueGenPixel dummy_space;
+
+    /** TIFF it was last written to, if any, as it was right after it was written */
+    char *written_path;
+    FileStamp written_stamp;
+    bool written_alpha;
+};
+
+typedef struct DecodeTask {
+    /** Path to decode */
+    const char *path;
+
+    /** Sequence and frame index */
+    size_t sequence;
+    size_t frame;
+
+    /** Is every frame of the file placed, and if so, how many are there? */
+    bool all_frames;
+    size_t frame_count;
+
+    /** How each frame is cropped, or NULL if they aren't */
+    BlueGenCrop *crops;
+
+    /** The kept part of each frame, if they were held onto from measuring them, and how much memory those take */
+    BlueGenImage *measured;
+    uint64_t measured_size;
+
+    /** Estimated peak memory while decoding and placing, in bytes */
+    uint64_t footprint;
+
+    /** Image found already decoded by the lookup callback, if there was one; otherwise, the index of the file in the
+        reader */
+    BlueGenImage cached;
+    bool have_cached;
+    size_t input;
+
+    /** Where each frame was on the session's last plate, if they can be copied from there instead of decoded */
+    const BlueGenRect *reused;
+
+    /** What's known about the colors of the file, if it doesn't have to be scanned */
+    BlueGenColorSummary colors;
+    bool have_colors;
+
+    /** Info for each frame, and what the file looked like when it was probed, for remembering it in the session */
+    BlueGenImageInfo *infos;
+    FileStamp stamp;
+    bool have_stamp;
+
+    /** Has a worker taken this task? */
+    bool started;
+} DecodeTask;
+
+typedef struct Scheduler {
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+
+    /** Tasks, in sequence order */
+    DecodeTask *tasks;
+    size_t task_count;
+
+    /** Every task before this has been started */
+    size_t next_task;
+
+    /** Memory available for images in flight, and how much of it is used */
+    uint64_t budget;
+    uint64_t in_use;
+    size_t in_flight;
+
+    /** Reads every file, in task order */
+    BlueGenReader *reader;
+
+    /** Color plate being built, and the session's last plate to copy unchanged frames from */
+    BlueGenImage *plate;
+    const BlueGenLayout *layout;
+    const BlueGenImage *previous;
+
+    /** Workers, and how many of them are still decoding */
+    struct Worker *workers;
+    unsigned int worker_count;
+    unsigned int decoding;
+
+    /** Images placed without being scanned, since their colors were known, and what they have between them */
+    size_t known_count;
+    bool known_translucent;
+    bool known_separators;
+
+    /** Separator colors, and whether every pixel is opaque, set once every image has been scanned */
+    const BlueGenPixel *dummy_space;
+    BlueGenPixel blue;
+    BlueGenPixel magenta;
+    bool opaque;
+    bool colors_ready;
+
+    /** Next band to fill, and which bands are filled */
+    size_t next_band;
+    bool *band_filled;
+
+    /** Where progress is reported, how many tasks are finished, and whether the callback cancelled */
+    const BlueGenScheduleOptions *options;
+    size_t finished_tasks;
+    bool cancelled;
+
+    /** Did anything fail, and what was the first thing that did? Failing stops everything like cancelling does */
+    bool failed;
+    BlueGenError error;
+} Scheduler;
+
+typedef struct Worker {
+    pthread_t thread;
+    Scheduler *scheduler;
+
+    /** Colors used by every image this worker placed */
+    uint32_t *occupancy;
+} Worker;
+
+// A file to probe, and what was found
+typedef struct ProbeTask {
+    const char *path;
+    size_t sequence;
+    size_t index;
+    bool all_frames;
+
+    /** Info for each frame of the file */
+    BlueGenImageInfo *infos;
+    size_t frame_count;
+
+    /** How each frame is cropped, if cropping */
+    BlueGenCrop *crops;
+
+    /** The kept part of each frame, if it was decoded to measure it and there was room to hold onto it until it's
+        placed, and how much memory those take */
+    BlueGenImage *measured;
+    uint64_t measured_size;
+
+    /** Image found already decoded by the lookup callback, if there was one */
+    BlueGenImage cached;
+    bool have_cached;
+
+    /** What the file looked like, and what the session knew about it if it hasn't changed since then */
+    FileStamp stamp;
+    bool have_stamp;
+    const SessionFile *reused;
+
+    /** What's known about the colors of the file, if the color lookup callback knew */
+    BlueGenColorSummary colors;
+    bool have_colors;
+} ProbeTask;
+
+typedef struct Prober {
+    pthread_mutex_t mutex;
+    const BlueGenScheduleOptions *options;
+    ProbeTask *tasks;
+    size_t task_count;
+    size_t next_task;
+    size_t finished_tasks;
+    bool cancelled;
+
+    /** Memory for decoding files to measure them and for the frames held onto from that, how much of it is used, and
+        how many files are being measured; frames are only held onto if they're going to be placed */
+    uint64_t budget;
+    uint64_t in_use;
+    size_t measuring;
+    bool keep_measured;
+    pthread_cond_t measured;
+
+    /** Did a file fail to be probed, and what was the first one that did? */
+    bool failed;
+    BlueGenError error;
+} Prober;
+
+unsigned int bluegen_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int)count : 1;
+#endif
+}
+
+int parse_bluegen_size(const char *str, uint64_t *size) {
+    char *end;
+    double value = strtod(str, &end);
+    if(end == str || value < 0) {
+        return 1;
+    }
+
+    switch(tolower(*end)) {
+        case 'g':
+            value *= 1024.0;
+            // fallthrough
+        case 'm':
+            value *= 1024.0;
+            // fallthrough
+        case 'k':
+            value *= 1024.0;
+            end++;
+            break;
+    }
+
+    // Allow a trailing B, as in 4GB
+    if(tolower(*end) == 'b') {
+        end++;
+    }
+    if(*end) {
+        return 1;
+    }
+
+    *size = (uint64_t)value;
+    return 0;
+}
+
+BlueGenSession *open_bluegen_session(void) {
+    return calloc(1, sizeof(BlueGenSession));
+}
+
+static void free_session_files(BlueGenSession *session) {
+    for(size_t f = 0; f < session->file_count; f++) {
+        free(session->files[f].path);
+        free(session->files[f].infos);
+        free(session->files[f].crops);
+        free(session->files[f].rects);
+    }
+    free(session->files);
+    session->files = NULL;
+    session->file_count = 0;
+}
+
+// Forget the TIFF the session last wrote, if it was removed or may not hold the session's plate anymore
+static void forget_written_file(BlueGenSession *session) {
+    free(session->written_path);
+    session->written_path = NULL;
+}
+
+void close_bluegen_session(BlueGenSession *session) {
+    if(!session) {
+        return;
+    }
+    free_session_files(session);
+    forget_written_file(session);
+    if(session->have_plate) {
+        free_bluegen_image(&session->plate);
+    }
+    free(session);
+}
+
+// Stat a file; modification times are only to the second on some systems, so the size is checked too
+static bool stamp_file(const char *path, FileStamp *stamp) {
+    struct stat info;
+    if(stat(path, &info) != 0) {
+        return false;
+    }
+#ifdef __linux__
+    stamp->modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#else
+    stamp->modified = (int64_t)info.st_mtime;
+#endif
+    stamp->size = (uint64_t)info.st_size;
+    return true;
+}
+
+static bool same_stamp(const FileStamp *a, const FileStamp *b) {
+    return a->modified == b->modified && a->size == b->size;
+}
+
+static int compare_session_files(const void *a, const void *b) {
+    const SessionFile *file_a = a, *file_b = b;
+    int order = strcmp(file_a->path, file_b->path);
+    return order != 0 ? order : (int)file_a->all_frames - (int)file_b->all_frames;
+}
+
+// Find a file the session placed last time, if it hasn't changed since
+static const SessionFile *find_session_file(const BlueGenSession *session, const char *path, bool all_frames, const FileStamp *stamp) {
+    SessionFile key = { 0 };
+    key.path = (char *)path;
+    key.all_frames = all_frames;
+    const SessionFile *file = bsearch(&key, session->files, session->file_count, sizeof(*session->files), compare_session_files);
+    return file && same_stamp(&file->stamp, stamp) ? file : NULL;
+}
+
+// Report progress if there's a callback; returns false if it cancelled
+static bool report_progress(const BlueGenScheduleOptions *options, BlueGenProgressStage stage, uint64_t done, uint64_t total) {
+    bluegen_progress_stage(stage, done, total);
+    return !options->progress || options->progress(options->progress_context, stage, done, total);
+}
+
+// Estimate how much memory decoding an image takes at its peak; stb keeps the inflated data around while it unfilters
+// it into the output, so count those twice
+static uint64_t estimate_footprint(const BlueGenImageInfo *info, const char *path) {
+    uint64_t decoded = (uint64_t)info->width * info->height * info->format;
+    return bluegen_file_type(path) == BLUEGEN_FILE_IMAGE ? decoded * 2 : decoded;
+}
+
+// Multi-frame files are decoded a frame at a time, but animations also keep their canvas and the last two frames around
+static uint64_t estimate_frames_footprint(const BlueGenImageInfo *infos, size_t frame_count, const char *path) {
+    uint64_t largest = 0;
+    for(size_t f = 0; f < frame_count; f++) {
+        uint64_t footprint = estimate_footprint(infos + f, path);
+        if(footprint > largest) {
+            largest = footprint;
+        }
+    }
+    return frame_count > 1 && bluegen_file_type(path) == BLUEGEN_FILE_IMAGE ? largest * 3 : largest;
+}
+
+// Take the first task that fits in the budget, or wait until one does; returns NULL when there are none left
+static DecodeTask *take_task(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->mutex);
+    for(;;) {
+        if(scheduler->next_task == scheduler->task_count || scheduler->cancelled) {
+            pthread_mutex_unlock(&scheduler->mutex);
+            return NULL;
+        }
+
+        // Prefer the earliest task so sequences finish in order, but let smaller ones past a task that doesn't fit yet
+        for(size_t t = scheduler->next_task; t < scheduler->task_count; t++) {
+            DecodeTask *task = scheduler->tasks + t;
+            if(task->started) {
+                continue;
+            }
+            if(scheduler->in_flight == 0 || scheduler->in_use + task->footprint <= scheduler->budget) {
+                task->started = true;
+                scheduler->in_use += task->footprint;
+                scheduler->in_flight++;
+                while(scheduler->next_task < scheduler->task_count && scheduler->tasks[scheduler->next_task].started) {
+                    scheduler->next_task++;
+                }
+                pthread_mutex_unlock(&scheduler->mutex);
+                return task;
+            }
+        }
+
+        pthread_cond_wait(&scheduler->done, &scheduler->mutex);
+    }
+}
+
+static void finish_task(Scheduler *scheduler, const DecodeTask *task) {
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->in_use -= task->footprint + task->measured_size;
+    scheduler->in_flight--;
+    scheduler->finished_tasks++;
+    if(task->have_colors) {
+        scheduler->known_count++;
+        scheduler->known_translucent |= task->colors.translucent;
+        scheduler->known_separators |= task->colors.blue || task->colors.magenta;
+    }
+    if(!scheduler->cancelled && !report_progress(scheduler->options, BLUEGEN_PROGRESS_DECODE, scheduler->finished_tasks, scheduler->task_count)) {
+        scheduler->cancelled = true;
+    }
+    pthread_cond_broadcast(&scheduler->done);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+// Stop everything because of an error, keeping the first one so it's what gets reported
+static void fail_scheduler(Scheduler *scheduler, const BlueGenError *error) {
+    pthread_mutex_lock(&scheduler->mutex);
+    if(!scheduler->failed) {
+        scheduler->failed = true;
+        scheduler->error = *error;
+    }
+    scheduler->cancelled = true;
+    pthread_cond_broadcast(&scheduler->done);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+// Called by each worker once there is nothing left for it to decode; the last one to finish picks the separator colors
+static void finish_decoding(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->mutex);
+    bool last = --scheduler->decoding == 0;
+    if(!last) {
+        while(!scheduler->colors_ready) {
+            pthread_cond_wait(&scheduler->done, &scheduler->mutex);
+        }
+        pthread_mutex_unlock(&scheduler->mutex);
+        return;
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    // Every other worker is waiting on us, so their bitmaps won't change; if anything was cancelled, the plate won't
+    // be written, so there's no point in picking colors for it
+    if(!scheduler->cancelled) {
+        uint32_t *occupancy = scheduler->workers[0].occupancy;
+        for(unsigned int w = 1; w < scheduler->worker_count; w++) {
+            merge_bluegen_occupancy(occupancy, scheduler->workers[w].occupancy);
+        }
+        BlueGenError error;
+        bool preferred;
+        int result = choose_bluegen_separators(occupancy, scheduler->dummy_space, &scheduler->blue, &scheduler->magenta, &preferred, &error);
+
+        // Images with known colors weren't scanned, which is fine as long as neither they nor anything else took blue
+        // or magenta; otherwise, the other candidates have to be checked against them too, so scan them after all
+        if(result == 0 && scheduler->known_count > 0 && (!preferred || scheduler->known_separators)) {
+            for(size_t t = 0; t < scheduler->task_count; t++) {
+                const DecodeTask *task = scheduler->tasks + t;
+                if(task->have_colors) {
+                    scan_bluegen_frame(occupancy, scheduler->plate, scheduler->layout->bands[task->sequence].frames + task->frame, task->sequence, task->frame);
+                }
+            }
+            result = choose_bluegen_separators(occupancy, scheduler->dummy_space, &scheduler->blue, &scheduler->magenta, NULL, &error);
+        }
+        if(result == 0) {
+            bluegen_progress_separators(&scheduler->blue, &scheduler->magenta);
+            fill_bluegen_header(scheduler->plate, &scheduler->blue, &scheduler->magenta, scheduler->dummy_space);
+            scheduler->opaque = bluegen_occupancy_opaque(occupancy) && !scheduler->known_translucent;
+        }
+        else {
+            fail_scheduler(scheduler, &error);
+        }
+    }
+
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->colors_ready = true;
+    pthread_cond_broadcast(&scheduler->done);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+// Take the next band to fill; returns false when there are none left, or nothing will be written
+static bool take_band(Scheduler *scheduler, size_t *band) {
+    pthread_mutex_lock(&scheduler->mutex);
+    bool taken = scheduler->next_band < scheduler->layout->band_count && !scheduler->cancelled;
+    if(taken) {
+        *band = scheduler->next_band++;
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+    return taken;
+}
+
+static void finish_band(Scheduler *scheduler, size_t band) {
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->band_filled[band] = true;
+    pthread_cond_broadcast(&scheduler->done);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+// Wait until a band is filled, or until the separator colors are ready if band is -1
+static void wait_for_band(Scheduler *scheduler, long band) {
+    pthread_mutex_lock(&scheduler->mutex);
+    while(band < 0 ? !scheduler->colors_ready : !scheduler->band_filled[band]) {
+        pthread_cond_wait(&scheduler->done, &scheduler->mutex);
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+// Read a whole file into memory, for finding how to crop each frame of it; returns NULL if it couldn't be read
+static uint8_t *read_whole_file(const char *path, size_t *size, BlueGenError *error) {
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        set_bluegen_error(error, path, "(v)> Failed to read %s! Error was: %s", path, strerror(errno));
+        return NULL;
+    }
+    size_t capacity = 1 << 16;
+    uint8_t *data = malloc(capacity);
+    *size = 0;
+    size_t got;
+    while(data && (got = fread(data + *size, 1, capacity - *size, file)) > 0) {
+        *size += got;
+        if(*size == capacity) {
+            capacity *= 2;
+            uint8_t *grown = realloc(data, capacity);
+            if(!grown) {
+                free(data);
+            }
+            data = grown;
+        }
+    }
+    if(!data || ferror(file)) {
+        set_bluegen_error(error, path, "(v)> Failed to read %s!", path);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+// Copy the part of a frame that's kept after cropping into an image of its own, so the rest can be freed; returns false
+// if there isn't memory for it
+static bool copy_kept_frame(const BlueGenImage *image, const BlueGenCrop *crop, BlueGenImage *kept) {
+    initialize_bluegen_image(kept, crop->kept.width, crop->kept.height, image->format);
+    if(!kept->pixels && crop->kept.width && crop->kept.height) {
+        return false;
+    }
+    size_t row_size = (size_t)crop->kept.width * image->format;
+    for(uint32_t y = 0; y < crop->kept.height; y++) {
+        memcpy(kept->pixels + y * row_size, image->pixels + ((size_t)(crop->kept.y + y) * image->width + crop->kept.x) * image->format, row_size);
+    }
+    return true;
+}
+
+// How a frame copied by copy_kept_frame() is cropped: all of it is kept, and what's visible moves along with it
+static BlueGenCrop kept_frame_crop(const BlueGenCrop *crop) {
+    BlueGenCrop kept = *crop;
+    kept.width = crop->kept.width;
+    kept.height = crop->kept.height;
+    kept.kept.x = 0;
+    kept.kept.y = 0;
+    kept.visible.x = crop->visible.x - crop->kept.x;
+    kept.visible.y = crop->visible.y - crop->kept.y;
+    return kept;
+}
+
+static void free_measured_frames(BlueGenImage *frames, size_t frame_count) {
+    for(size_t f = 0; frames && f < frame_count; f++) {
+        free_bluegen_image(frames + f);
+    }
+    free(frames);
+}
+
+// Where measure_frame() puts what it finds
+typedef struct Measurement {
+    BlueGenCrop *crops;
+
+    /** The kept part of each frame, or NULL if they aren't being kept, and how many have been copied; copying stops at
+        the first frame there isn't memory for */
+    BlueGenImage *kept;
+    size_t kept_count;
+} Measurement;
+
+static int measure_frame(void *context, const BlueGenImage *image, size_t index, BlueGenError *error) {
+    (void)error;
+    Measurement *measurement = context;
+    find_bluegen_crop(image, measurement->crops + index);
+    if(measurement->kept && measurement->kept_count == index && copy_kept_frame(image, measurement->crops + index, measurement->kept + index)) {
+        measurement->kept_count++;
+    }
+    return 0;
+}
+
+// Decode every frame of a file to find how much of it can be cropped off. Decoding waits for memory to free up like it
+// does when placing, and the kept part of each frame is held onto if there's room for it, so it isn't decoded again.
+static int find_file_crops(Prober *prober, ProbeTask *task, BlueGenError *error) {
+    BlueGenTime start;
+    bluegen_time_now(&start);
+    task->crops = calloc(task->frame_count, sizeof(*task->crops));
+    if(!task->crops) {
+        set_bluegen_error(error, task->path, "(v)> Out of memory.");
+        return 1;
+    }
+    if(task->have_cached) {
+        find_bluegen_crop(&task->cached, task->crops);
+        bluegen_trace_span("measure", &start, task->path, (long)task->sequence, (long)task->index, 0);
+        return 0;
+    }
+
+    // One file is always let through, so a file bigger than the budget can't hold everything up
+    uint64_t footprint = estimate_frames_footprint(task->infos, task->frame_count, task->path);
+    pthread_mutex_lock(&prober->mutex);
+    while(prober->measuring > 0 && prober->in_use + footprint > prober->budget && !prober->cancelled) {
+        pthread_cond_wait(&prober->measured, &prober->mutex);
+    }
+    bool cancelled = prober->cancelled;
+    if(!cancelled) {
+        prober->in_use += footprint;
+        prober->measuring++;
+    }
+    pthread_mutex_unlock(&prober->mutex);
+    if(cancelled) {
+        return 0;
+    }
+
+    BlueGenTime decode_start;
+    bluegen_time_now(&decode_start);
+    int result;
+    uint64_t size = task->have_stamp ? task->stamp.size : 0;
+    Measurement measurement = { task->crops, prober->keep_measured ? calloc(task->frame_count, sizeof(BlueGenImage)) : NULL, 0 };
+    if(!task->all_frames) {
+        BlueGenImage image;
+        result = load_file(&image, task->path, error);
+        if(result == 0) {
+            measure_frame(&measurement, &image, 0, error);
+            free_bluegen_image(&image);
+        }
+    }
+    else {
+        size_t data_size = 0;
+        uint8_t *data = read_whole_file(task->path, &data_size, error);
+        result = data ? decode_bluegen_frames(task->path, data, data_size, task->frame_count, measure_frame, &measurement, error) : 1;
+        free(data);
+        size = data_size;
+    }
+
+    // Hold onto the frames only if every one of them was copied and they still fit once decoding is done
+    uint64_t kept_size = 0;
+    for(size_t f = 0; f < measurement.kept_count; f++) {
+        kept_size += (uint64_t)measurement.kept[f].width * measurement.kept[f].height * measurement.kept[f].format;
+    }
+    bool keep = result == 0 && measurement.kept && measurement.kept_count == task->frame_count;
+    pthread_mutex_lock(&prober->mutex);
+    prober->in_use -= footprint;
+    prober->measuring--;
+    keep = keep && prober->in_use + kept_size <= prober->budget;
+    if(keep) {
+        prober->in_use += kept_size;
+    }
+    pthread_cond_broadcast(&prober->measured);
+    pthread_mutex_unlock(&prober->mutex);
+
+    // Frames that are held onto count as decoded here, since they won't be when they're placed
+    if(keep) {
+        task->measured = measurement.kept;
+        task->measured_size = kept_size;
+        bluegen_stats_file(task->path, size, &decode_start);
+        bluegen_progress_read(size);
+    }
+    else {
+        free_measured_frames(measurement.kept, measurement.kept_count);
+    }
+    bluegen_trace_span("measure", &start, task->path, (long)task->sequence, (long)task->index, size);
+    return result;
+}
+
+// Probe files until there are none left; they can be probed in any order since they only depend on the file
+static void *probe_main(void *arg) {
+    Prober *prober = arg;
+    bluegen_perf_thread_begin();
+    while(true) {
+        pthread_mutex_lock(&prober->mutex);
+        size_t t = prober->cancelled ? prober->task_count : prober->next_task++;
+        pthread_mutex_unlock(&prober->mutex);
+        if(t >= prober->task_count) {
+            break;
+        }
+
+        ProbeTask *task = prober->tasks + t;
+        const BlueGenScheduleOptions *options = prober->options;
+        BlueGenTime start;
+        bluegen_time_now(&start);
+        BlueGenError error;
+        int result = 0;
+
+        // Files the session already placed the same way don't have to be looked at again; ones that can't be stat'd
+        // are left for probing to complain about
+        const BlueGenSession *session = options->session;
+        task->have_stamp = stamp_file(task->path, &task->stamp);
+        if(task->have_stamp && session && session->have_plate && session->crop == options->crop) {
+            task->reused = find_session_file(session, task->path, task->all_frames, &task->stamp);
+        }
+        if(task->reused) {
+            task->frame_count = task->reused->frame_count;
+            task->infos = malloc(task->frame_count * sizeof(*task->infos));
+            memcpy(task->infos, task->reused->infos, task->frame_count * sizeof(*task->infos));
+            if(task->reused->crops) {
+                task->crops = malloc(task->frame_count * sizeof(*task->crops));
+                memcpy(task->crops, task->reused->crops, task->frame_count * sizeof(*task->crops));
+            }
+        }
+        else if(!task->all_frames) {
+            task->infos = malloc(sizeof(*task->infos));
+            task->have_cached = options->lookup && options->lookup(options->lookup_context, task->path, &task->cached);
+            if(task->have_cached) {
+                task->infos->width = task->cached.width;
+                task->infos->height = task->cached.height;
+                task->infos->format = task->cached.format;
+            }
+            else {
+                result = probe_file(task->infos, task->path, &error);
+            }
+            task->frame_count = 1;
+        }
+        else {
+            task->frame_count = probe_bluegen_frames(task->path, &task->infos, &error);
+            result = task->frame_count == 0;
+        }
+        bluegen_trace_span("probe", &start, task->path, (long)task->sequence, (long)task->index, 0);
+
+        if(result == 0 && options->crop && !task->reused) {
+            result = find_file_crops(prober, task, &error);
+        }
+
+        // Cropped frames are only scanned where they're visible, which a summary of the whole file can't speak for
+        if(result == 0 && !task->all_frames && !options->crop && options->color_lookup) {
+            task->have_colors = options->color_lookup(options->lookup_context, task->path, &task->colors);
+        }
+
+        // A file that can't be probed stops everything, keeping the first error
+        pthread_mutex_lock(&prober->mutex);
+        prober->finished_tasks++;
+        if(result != 0) {
+            if(!prober->failed) {
+                prober->failed = true;
+                prober->error = error;
+            }
+            prober->cancelled = true;
+        }
+        if(!prober->cancelled && !report_progress(prober->options, BLUEGEN_PROGRESS_PROBE, prober->finished_tasks, prober->task_count)) {
+            prober->cancelled = true;
+        }
+        if(prober->cancelled) {
+            pthread_cond_broadcast(&prober->measured);
+        }
+        pthread_mutex_unlock(&prober->mutex);
+    }
+    bluegen_perf_thread_end();
+    return NULL;
+}
+
+// Copy the frames of a file that hasn't changed from where they were on the session's last plate, scanning them the
+// same way as if they had just been decoded and placed
+static void reuse_frames(Scheduler *scheduler, uint32_t *occupancy, const DecodeTask *task) {
+    const BlueGenImage *plate = scheduler->plate, *previous = scheduler->previous;
+    BlueGenPixel *plate_pixels = (BlueGenPixel *)plate->pixels;
+    const BlueGenPixel *previous_pixels = (const BlueGenPixel *)previous->pixels;
+    const BlueGenRect *rects = scheduler->layout->bands[task->sequence].frames + task->frame;
+    for(size_t f = 0; f < task->frame_count; f++) {
+        BlueGenTime start;
+        bluegen_time_now(&start);
+        const BlueGenRect *rect = rects + f, *from = task->reused + f;
+        for(uint32_t y = 0; y < rect->height; y++) {
+            memcpy(plate_pixels + rect->x + (size_t)(rect->y + y) * plate->width, previous_pixels + from->x + (size_t)(from->y + y) * previous->width, (size_t)rect->width * sizeof(BlueGenPixel));
+        }
+        bluegen_stats_stage(BLUEGEN_STAGE_BLIT, &start);
+        bluegen_trace_span("reuse", &start, task->path, (long)task->sequence, (long)(task->frame + f), (uint64_t)rect->width * rect->height * sizeof(BlueGenPixel));
+
+        // Dummy space wasn't scanned when it was placed, so don't scan it now either
+        if(task->have_colors) {
+            continue;
+        }
+        BlueGenRect scanned = *rect;
+        if(task->crops) {
+            const BlueGenCrop *crop = task->crops + f;
+            scanned.x += crop->visible.x - crop->kept.x;
+            scanned.y += crop->visible.y - crop->kept.y;
+            scanned.width = crop->visible.width;
+            scanned.height = crop->visible.height;
+        }
+        scan_bluegen_frame(occupancy, plate, &scanned, task->sequence, task->frame + f);
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    Scheduler *scheduler = worker->scheduler;
+    bluegen_perf_thread_begin();
+
+    DecodeTask *task;
+    while((task = take_task(scheduler))) {
+        const BlueGenRect *rect = scheduler->layout->bands[task->sequence].frames + task->frame;
+
+        // Files that haven't changed since the last plate are already on it
+        if(task->reused) {
+            reuse_frames(scheduler, worker->occupancy, task);
+            finish_task(scheduler, task);
+            continue;
+        }
+
+        // Images that were already decoded only have to be placed
+        if(task->have_cached) {
+            if(task->crops) {
+                place_bluegen_cropped_frame(scheduler->plate, worker->occupancy, &task->cached, task->crops, scheduler->dummy_space, rect, task->sequence, task->frame);
+            }
+            else {
+                place_bluegen_frame(scheduler->plate, task->have_colors ? NULL : worker->occupancy, &task->cached, rect, task->sequence, task->frame);
+            }
+            free_bluegen_image(&task->cached);
+            task->have_cached = false;
+            finish_task(scheduler, task);
+            continue;
+        }
+
+        // So do frames held onto from measuring them, which only have what's kept after cropping
+        if(task->measured) {
+            for(size_t f = 0; f < task->frame_count; f++) {
+                BlueGenCrop crop = kept_frame_crop(task->crops + f);
+                place_bluegen_cropped_frame(scheduler->plate, worker->occupancy, task->measured + f, &crop, scheduler->dummy_space, rect + f, task->sequence, task->frame + f);
+            }
+            free_measured_frames(task->measured, task->frame_count);
+            task->measured = NULL;
+            finish_task(scheduler, task);
+            continue;
+        }
+
+        // Anything that fails stops the whole plate, but the task still has to be finished so nothing waits on it
+        BlueGenError error;
+        size_t index = task->input;
+        const uint8_t *data;
+        size_t size;
+        int read_error = read_bluegen_input(scheduler->reader, index, &data, &size);
+        if(read_error) {
+            set_bluegen_error(&error, task->path, "(v)> Failed to read %s! Error was: %s", task->path, strerror(read_error));
+            fail_scheduler(scheduler, &error);
+            finish_task(scheduler, task);
+            continue;
+        }
+
+        BlueGenTime start;
+        bluegen_time_now(&start);
+
+        // Frames of a multi-frame file are placed as they're decoded, so the trace span covers placing them too, but
+        // the decode time doesn't, since placing is already counted as scanning and blitting
+        if(task->all_frames) {
+            BlueGenTime decode_start = start;
+            if(place_bluegen_frames(scheduler->plate, worker->occupancy, task->path, data, size, rect, task->crops, scheduler->dummy_space, task->frame_count, task->sequence, task->frame, &decode_start, &error) != 0) {
+                fail_scheduler(scheduler, &error);
+            }
+            release_bluegen_input(scheduler->reader, index);
+            bluegen_trace_span("decode", &start, task->path, (long)task->sequence, (long)task->frame, size);
+            bluegen_stats_file(task->path, size, &decode_start);
+            bluegen_progress_read(size);
+            finish_task(scheduler, task);
+            continue;
+        }
+
+        // Uncompressed BMPs and TGAs, and PNGs when we have a fast inflate, go straight into the plate unless cropped
+        if(!task->crops && (decode_bluegen_raw_frame(scheduler->plate, task->path, data, size, rect) ||
+           decode_bluegen_png_frame(scheduler->plate, task->path, data, size, rect))) {
+            release_bluegen_input(scheduler->reader, index);
+            bluegen_trace_span("decode", &start, task->path, (long)task->sequence, (long)task->frame, size);
+            bluegen_stats_file(task->path, size, &start);
+            bluegen_progress_read(size);
+            if(!task->have_colors) {
+                scan_bluegen_frame(worker->occupancy, scheduler->plate, rect, task->sequence, task->frame);
+            }
+            finish_task(scheduler, task);
+            continue;
+        }
+
+        BlueGenImage image;
+        int result = load_file_from_memory(&image, task->path, data, size, &error);
+        release_bluegen_input(scheduler->reader, index);
+        if(result != 0) {
+            fail_scheduler(scheduler, &error);
+            finish_task(scheduler, task);
+            continue;
+        }
+        uint32_t width = task->crops ? task->crops->width : rect->width;
+        uint32_t height = task->crops ? task->crops->height : rect->height;
+        if(image.width != width || image.height != height) {
+            set_bluegen_error(&error, task->path, "(v)> %s changed while it was being read.", task->path);
+            fail_scheduler(scheduler, &error);
+            free_bluegen_image(&image);
+            finish_task(scheduler, task);
+            continue;
+        }
+
+        bluegen_trace_span("decode", &start, task->path, (long)task->sequence, (long)task->frame, size);
+        bluegen_stats_file(task->path, size, &start);
+        bluegen_progress_read(size);
+
+        if(task->crops) {
+            place_bluegen_cropped_frame(scheduler->plate, worker->occupancy, &image, task->crops, scheduler->dummy_space, rect, task->sequence, task->frame);
+        }
+        else {
+            place_bluegen_frame(scheduler->plate, task->have_colors ? NULL : worker->occupancy, &image, rect, task->sequence, task->frame);
+        }
+        free_bluegen_image(&image);
+        finish_task(scheduler, task);
+    }
+
+    // Once the separator colors are known, fill in the bands so they can be written
+    finish_decoding(scheduler);
+    size_t band;
+    while(take_band(scheduler, &band)) {
+        fill_bluegen_band(scheduler->plate, scheduler->layout, band, &scheduler->blue, &scheduler->magenta);
+        finish_band(scheduler, band);
+    }
+
+    bluegen_perf_thread_end();
+    return NULL;
+}
+
+// Memory that stays resident the whole time whatever is decoded: each worker's occupancy bitmap, and the session's
+// last plate
+static uint64_t resident_size(const BlueGenScheduleOptions *options, unsigned int thread_count) {
+    uint64_t size = (uint64_t)thread_count * BLUEGEN_OCCUPANCY_WORDS * sizeof(uint32_t);
+    const BlueGenSession *session = options->session;
+    if(session && session->have_plate) {
+        size += (uint64_t)session->plate.width * session->plate.height * sizeof(BlueGenPixel);
+    }
+    return size;
+}
+
+// Free what probing found out about each file
+static void free_probe_tasks(ProbeTask *tasks, size_t task_count) {
+    for(size_t t = 0; t < task_count; t++) {
+        free(tasks[t].infos);
+        free(tasks[t].crops);
+        free_measured_frames(tasks[t].measured, tasks[t].frame_count);
+        if(tasks[t].have_cached) {
+            free_bluegen_image(&tasks[t].cached);
+        }
+    }
+    free(tasks);
+}
+
+// Read every header so we know where everything goes and how big it is, and lay out the plate; with thousands of files,
+// most of this is waiting on the disk, so do it in parallel so a missing or broken file fails before anything is
+// decoded. Returns false if it was cancelled or something failed, in which case prober->failed says which and there's
+// nothing to free.
+static bool probe_files(Prober *prober, const BlueGenFileSequence *sequences, size_t sequence_count, size_t task_count, unsigned int thread_count, const BlueGenScheduleOptions *options, bool keep_measured, BlueGenLayout *layout) {
+    BlueGenTime start;
+    bluegen_time_now(&start);
+
+    prober->tasks = calloc(task_count ? task_count : 1, sizeof(*prober->tasks));
+    if(!prober->tasks) {
+        prober->failed = true;
+        set_bluegen_error(&prober->error, NULL, "(v)> Out of memory.");
+        return false;
+    }
+    prober->task_count = task_count;
+    prober->next_task = 0;
+    prober->finished_tasks = 0;
+    prober->options = options;
+    prober->cancelled = !report_progress(options, BLUEGEN_PROGRESS_PROBE, 0, task_count);
+    prober->failed = false;
+
+    // Measuring comes before the plate is allocated, so it can have everything but what's always resident
+    uint64_t resident = resident_size(options, thread_count);
+    prober->budget = options->max_memory == 0 ? UINT64_MAX : options->max_memory > resident ? options->max_memory - resident : 0;
+    prober->in_use = 0;
+    prober->measuring = 0;
+    prober->keep_measured = keep_measured;
+    for(size_t s = 0, t = 0; s < sequence_count; s++) {
+        for(size_t i = 0; i < sequences[s].path_count; i++, t++) {
+            prober->tasks[t].path = sequences[s].paths[i];
+            prober->tasks[t].sequence = s;
+            prober->tasks[t].index = i;
+            prober->tasks[t].all_frames = sequences[s].all_frames;
+        }
+    }
+
+    pthread_mutex_init(&prober->mutex, NULL);
+    pthread_cond_init(&prober->measured, NULL);
+    pthread_t *probe_threads = calloc(thread_count, sizeof(*probe_threads));
+    unsigned int started = 0;
+    while(probe_threads && started < thread_count && pthread_create(probe_threads + started, NULL, probe_main, prober) == 0) {
+        started++;
+    }
+    if(started < thread_count) {
+        pthread_mutex_lock(&prober->mutex);
+        if(!prober->failed) {
+            prober->failed = true;
+            set_bluegen_error(&prober->error, NULL, "(v)> Failed to start a worker thread.");
+        }
+        prober->cancelled = true;
+        pthread_cond_broadcast(&prober->measured);
+        pthread_mutex_unlock(&prober->mutex);
+    }
+    for(unsigned int w = 0; w < started; w++) {
+        pthread_join(probe_threads[w], NULL);
+    }
+    free(probe_threads);
+    pthread_cond_destroy(&prober->measured);
+    pthread_mutex_destroy(&prober->mutex);
+
+    if(prober->cancelled) {
+        free_probe_tasks(prober->tasks, task_count);
+        return false;
+    }
+
+    // Then put each sequence's frames together in order
+    BlueGenImageInfoSequence *info_sequences = calloc(sequence_count ? sequence_count : 1, sizeof(*info_sequences));
+    for(size_t s = 0, t = 0; s < sequence_count; s++) {
+        BlueGenImageInfoSequence *info_sequence = info_sequences + s;
+        size_t info_count = 0;
+        for(size_t i = 0; i < sequences[s].path_count; i++) {
+            info_count += prober->tasks[t + i].frame_count;
+        }
+        info_sequence->infos = calloc(info_count ? info_count : 1, sizeof(*info_sequence->infos));
+        for(size_t i = 0; i < sequences[s].path_count; i++, t++) {
+            const ProbeTask *probed = prober->tasks + t;
+            BlueGenImageInfo *infos = info_sequence->infos + info_sequence->info_count;
+            memcpy(infos, probed->infos, probed->frame_count * sizeof(*infos));
+            for(size_t f = 0; probed->crops && f < probed->frame_count; f++) {
+                infos[f].width = probed->crops[f].kept.width;
+                infos[f].height = probed->crops[f].kept.height;
+            }
+            info_sequence->info_count += probed->frame_count;
+        }
+    }
+
+    layout_bluegen_image(layout, info_sequences, sequence_count);
+    for(size_t s = 0; s < sequence_count; s++) {
+        free(info_sequences[s].infos);
+    }
+    free(info_sequences);
+    bluegen_stats_stage(BLUEGEN_STAGE_LAYOUT, &start);
+    bluegen_trace_span("layout", &start, NULL, -1, -1, 0);
+    return true;
+}
+
+// Use one thread per CPU unless told otherwise, but no more than there are files
+static unsigned int count_threads(const BlueGenScheduleOptions *options, size_t task_count) {
+    unsigned int thread_count = options->threads ? options->threads : bluegen_cpu_count();
+    if(thread_count > task_count) {
+        thread_count = task_count ? (unsigned int)task_count : 1;
+    }
+    return thread_count;
+}
+
+int layout_bluegen_files(const BlueGenFileSequence *sequences, size_t sequence_count, const BlueGenScheduleOptions *options, BlueGenLayout *layout, size_t *frame_counts, BlueGenError *error) {
+    BlueGenScheduleOptions default_options = { 0, 0, BLUEGEN_READER_AUTO, false, NULL, NULL, NULL, NULL, NULL, NULL };
+    if(!options) {
+        options = &default_options;
+    }
+
+    size_t task_count = 0;
+    for(size_t s = 0; s < sequence_count; s++) {
+        task_count += sequences[s].path_count;
+    }
+
+    Prober prober;
+    if(!probe_files(&prober, sequences, sequence_count, task_count, count_threads(options, task_count), options, false, layout)) {
+        if(prober.failed && error) {
+            *error = prober.error;
+        }
+        memset(layout, 0, sizeof(*layout));
+        return 1;
+    }
+    for(size_t t = 0; frame_counts && t < task_count; t++) {
+        frame_counts[t] = prober.tasks[t].frame_count;
+    }
+    free_probe_tasks(prober.tasks, task_count);
+    return 0;
+}
+
+// Can the TIFF at path be rewritten in place? It has to be the last one the session wrote, untouched since, and laid
+// out the same way
+static bool can_rewrite(const BlueGenSession *session, const char *path, const BlueGenLayout *layout, bool alpha) {
+    FileStamp stamp;
+    return session && session->written_path && strcmp(session->written_path, path) == 0 && session->have_plate &&
+           session->plate.width == layout->width && session->plate.height == layout->height && session->written_alpha == alpha &&
+           stamp_file(path, &stamp) && same_stamp(&stamp, &session->written_stamp);
+}
+
+// Write rows of the plate; if the TIFF is being rewritten, only write the ones that differ from the previous plate;
+// returns how many rows were written
+static uint32_t write_plate_rows(BlueGenTiffWriter *writer, const BlueGenImage *plate, const BlueGenImage *previous, uint32_t y, uint32_t end) {
+    const BlueGenPixel *pixels = (const BlueGenPixel *)plate->pixels;
+    if(!previous) {
+        write_bluegen_tiff_rows(writer, pixels + (size_t)y * plate->width, end - y);
+        return end - y;
+    }
+
+    const BlueGenPixel *previous_pixels = (const BlueGenPixel *)previous->pixels;
+    size_t row_size = (size_t)plate->width * sizeof(BlueGenPixel);
+    uint32_t written = 0;
+    while(y < end) {
+        while(y < end && memcmp(pixels + (size_t)y * plate->width, previous_pixels + (size_t)y * plate->width, row_size) == 0) {
+            y++;
+        }
+        uint32_t first = y;
+        while(y < end && memcmp(pixels + (size_t)y * plate->width, previous_pixels + (size_t)y * plate->width, row_size) != 0) {
+            y++;
+        }
+        if(first < y) {
+            if(writer->rows_written != first) {
+                seek_bluegen_tiff_writer(writer, first);
+            }
+            write_bluegen_tiff_rows(writer, pixels + (size_t)first * plate->width, y - first);
+            written += y - first;
+        }
+    }
+    return written;
+}
+
+// Remember a plate that was just generated in the session, taking the infos and crops of the tasks, along with the TIFF
+// it was written to, if it was
+static void remember_plate(BlueGenSession *session, DecodeTask *tasks, size_t task_count, const BlueGenLayout *layout, const BlueGenImage *output, bool crop, const BlueGenPixel *dummy_space, const char *path, bool alpha) {
+    // Tasks may still point into the old files, so make the new ones first
+    SessionFile *files = calloc(task_count ? task_count : 1, sizeof(*files));
+    size_t file_count = 0;
+    for(size_t t = 0; t < task_count; t++) {
+        DecodeTask *task = tasks + t;
+        if(!task->have_stamp) {
+            continue;
+        }
+        SessionFile *file = files + file_count++;
+        file->path = malloc(strlen(task->path) + 1);
+        strcpy(file->path, task->path);
+        file->all_frames = task->all_frames;
+        file->stamp = task->stamp;
+        file->infos = task->infos;
+        file->crops = task->crops;
+        file->frame_count = task->frame_count;
+        file->rects = malloc((task->frame_count ? task->frame_count : 1) * sizeof(*file->rects));
+        memcpy(file->rects, layout->bands[task->sequence].frames + task->frame, task->frame_count * sizeof(*file->rects));
+        task->infos = NULL;
+        task->crops = NULL;
+    }
+    qsort(files, file_count, sizeof(*files), compare_session_files);
+    free_session_files(session);
+    session->files = files;
+    session->file_count = file_count;
+    session->crop = crop;
+    session->dummy_space = *dummy_space;
+
+    // Keep the plate's memory if it's the same size
+    if(session->have_plate && (session->plate.width != output->width || session->plate.height != output->height)) {
+        free_bluegen_image(&session->plate);
+        session->have_plate = false;
+    }
+    if(!session->have_plate) {
+        initialize_bluegen_image(&session->plate, output->width, output->height, BLUEGEN_FORMAT_RGBA);
+        session->have_plate = true;
+    }
+    memcpy(session->plate.pixels, output->pixels, (size_t)output->width * output->height * sizeof(BlueGenPixel));
+
+    forget_written_file(session);
+    if(path && stamp_file(path, &session->written_stamp)) {
+        session->written_path = malloc(strlen(path) + 1);
+        strcpy(session->written_path, path);
+        session->written_alpha = alpha;
+    }
+}
+
+int generate_bluegen_image_from_files(const BlueGenFileSequence *sequences, size_t sequence_count, const BlueGenPixel *dummy_space, const BlueGenScheduleOptions *options, BlueGenImage *output, const char *path, BlueGenError *error) {
+    BlueGenScheduleOptions default_options = { 0, 0, BLUEGEN_READER_AUTO, false, NULL, NULL, NULL, NULL, NULL, NULL };
+    if(!options) {
+        options = &default_options;
+    }
+
+    size_t task_count = 0;
+    for(size_t s = 0; s < sequence_count; s++) {
+        task_count += sequences[s].path_count;
+    }
+    unsigned int thread_count = count_threads(options, task_count);
+
+    Prober prober;
+    BlueGenLayout layout;
+    if(!probe_files(&prober, sequences, sequence_count, task_count, thread_count, options, true, &layout)) {
+        if(prober.failed && error) {
+            *error = prober.error;
+        }
+        memset(output, 0, sizeof(*output));
+        return 1;
+    }
+
+    // Make a task for each image in sequence order
+    Scheduler scheduler;
+    scheduler.tasks = calloc(task_count ? task_count : 1, sizeof(*scheduler.tasks));
+    scheduler.band_filled = calloc(layout.band_count ? layout.band_count : 1, sizeof(*scheduler.band_filled));
+    const char **paths = calloc(task_count ? task_count : 1, sizeof(*paths));
+    if(!scheduler.tasks || !scheduler.band_filled || !paths) {
+        set_bluegen_error(error, NULL, "(v)> Out of memory.");
+        free(scheduler.tasks);
+        free(scheduler.band_filled);
+        free(paths);
+        free_probe_tasks(prober.tasks, task_count);
+        free_bluegen_layout(&layout);
+        memset(output, 0, sizeof(*output));
+        return 1;
+    }
+    scheduler.task_count = task_count;
+    scheduler.next_task = 0;
+    scheduler.in_flight = 0;
+    scheduler.plate = output;
+    scheduler.layout = &layout;
+    scheduler.previous = NULL;
+    scheduler.known_count = 0;
+    scheduler.known_translucent = false;
+    scheduler.known_separators = false;
+    scheduler.dummy_space = dummy_space;
+    scheduler.colors_ready = false;
+    scheduler.next_band = 0;
+    scheduler.options = options;
+    scheduler.finished_tasks = 0;
+    scheduler.cancelled = !report_progress(options, BLUEGEN_PROGRESS_DECODE, 0, task_count);
+    scheduler.failed = false;
+
+    // Cropped frames are placed with dummy space around them, so they can only be copied if it's the same color
+    BlueGenSession *session = options->session;
+    bool reuse = session && session->have_plate && (!options->crop || memcmp(&session->dummy_space, dummy_space, sizeof(*dummy_space)) == 0);
+    if(reuse) {
+        scheduler.previous = &session->plate;
+    }
+    for(size_t s = 0, t = 0; s < sequence_count; s++) {
+        for(size_t i = 0, frame = 0; i < sequences[s].path_count; i++, t++) {
+            DecodeTask *task = scheduler.tasks + t;
+            task->path = sequences[s].paths[i];
+            task->sequence = s;
+            task->frame = frame;
+            task->all_frames = sequences[s].all_frames;
+            task->frame_count = prober.tasks[t].frame_count;
+            task->crops = prober.tasks[t].crops;
+            task->measured = prober.tasks[t].measured;
+            task->measured_size = prober.tasks[t].measured_size;
+            task->cached = prober.tasks[t].cached;
+            task->have_cached = prober.tasks[t].have_cached;
+            task->reused = reuse && prober.tasks[t].reused ? prober.tasks[t].reused->rects : NULL;
+            task->infos = prober.tasks[t].infos;
+            task->stamp = prober.tasks[t].stamp;
+            task->have_stamp = prober.tasks[t].have_stamp;
+            task->colors = prober.tasks[t].colors;
+            task->have_colors = prober.tasks[t].have_colors;
+
+            // Frames are decoded whole, even if they're cropped afterward; images that were already decoded or held
+            // onto from measuring are already taking up memory, and ones copied from the last plate aren't decoded, so
+            // none of those take any more
+            task->footprint = task->have_cached || task->measured || task->reused ? 0 : estimate_frames_footprint(task->infos, task->frame_count, task->path);
+            frame += task->frame_count;
+        }
+    }
+    free(prober.tasks);
+
+    // The plate stays resident the whole time too; whatever is left is for images
+    uint64_t fixed = (uint64_t)layout.width * layout.height * sizeof(BlueGenPixel) + resident_size(options, thread_count);
+    if(options->max_memory == 0) {
+        scheduler.budget = UINT64_MAX;
+    }
+    else if(fixed >= options->max_memory) {
+        bluegen_progress_over_budget(fixed, options->max_memory);
+        scheduler.budget = 0;
+    }
+    else {
+        scheduler.budget = options->max_memory - fixed;
+    }
+
+    // Files read ahead come out of the same budget
+    uint64_t read_ahead = DEFAULT_READ_AHEAD;
+    if(options->max_memory != 0) {
+        read_ahead = scheduler.budget / 4;
+        scheduler.budget -= read_ahead;
+    }
+
+    // Frames held onto from measuring were kept before the plate was; if they don't all fit next to it, let go of the
+    // last ones, which are decoded again when their turn comes
+    scheduler.in_use = 0;
+    for(size_t t = 0; t < task_count; t++) {
+        scheduler.in_use += scheduler.tasks[t].measured_size;
+    }
+    for(size_t t = task_count; t-- > 0 && scheduler.in_use > scheduler.budget;) {
+        DecodeTask *task = scheduler.tasks + t;
+        if(task->measured) {
+            scheduler.in_use -= task->measured_size;
+            free_measured_frames(task->measured, task->frame_count);
+            task->measured = NULL;
+            task->measured_size = 0;
+            task->footprint = estimate_frames_footprint(task->infos, task->frame_count, task->path);
+        }
+    }
+
+    // Only read files that weren't already decoded and can't be copied
+    size_t input_count = 0;
+    for(size_t t = 0; t < task_count; t++) {
+        if(!scheduler.tasks[t].have_cached && !scheduler.tasks[t].measured && !scheduler.tasks[t].reused) {
+            scheduler.tasks[t].input = input_count;
+            paths[input_count++] = scheduler.tasks[t].path;
+        }
+    }
+    scheduler.reader = open_bluegen_reader(paths, input_count, options->reader, read_ahead);
+
+    if(bluegen_stats_enabled()) {
+        bluegen_stats_lock();
+        bluegen_stats_get()->threads = thread_count;
+        bluegen_stats_unlock();
+    }
+
+    initialize_bluegen_image(output, layout.width, layout.height, BLUEGEN_FORMAT_RGBA);
+
+    // Go!
+    pthread_mutex_init(&scheduler.mutex, NULL);
+    pthread_cond_init(&scheduler.done, NULL);
+    Worker *workers = calloc(thread_count, sizeof(*workers));
+    scheduler.workers = workers;
+    scheduler.worker_count = thread_count;
+    scheduler.decoding = thread_count;
+    for(unsigned int w = 0; w < thread_count; w++) {
+        workers[w].scheduler = &scheduler;
+        workers[w].occupancy = allocate_bluegen_occupancy();
+    }
+    unsigned int started = 0;
+    while(started < thread_count && pthread_create(&workers[started].thread, NULL, worker_main, workers + started) == 0) {
+        started++;
+    }
+
+    // The workers that did start stop once they see the failure, but they wait for every worker to finish decoding,
+    // so count the rest out here, leaving one to go through finish_decoding in case it's the last
+    if(started < thread_count) {
+        BlueGenError thread_error;
+        set_bluegen_error(&thread_error, NULL, "(v)> Failed to start a worker thread.");
+        fail_scheduler(&scheduler, &thread_error);
+        pthread_mutex_lock(&scheduler.mutex);
+        scheduler.decoding -= thread_count - started - 1;
+        pthread_mutex_unlock(&scheduler.mutex);
+        finish_decoding(&scheduler);
+    }
+
+    // Write each band as soon as it's filled while the workers fill the rest
+    // Nothing is decoded after the separator colors are picked, so whether it was cancelled is settled by then
+    int result = 0;
+    wait_for_band(&scheduler, -1);
+    if(path && !scheduler.cancelled) {
+        // Write over the TIFF from last time if nothing moved the tags, so only rows that changed have to be written
+        BlueGenTiffWriter writer;
+        bool alpha = !scheduler.opaque;
+        const BlueGenImage *previous = NULL;
+        if(can_rewrite(session, path, &layout, alpha) && reopen_bluegen_tiff_writer(&writer, path, layout.width, layout.height, alpha) == 0) {
+            previous = &session->plate;
+        }
+        if(!previous && open_bluegen_tiff_writer(&writer, path, layout.width, layout.height, alpha) != 0) {
+            set_bluegen_error(error, path, "(v)> Failed to write %s.", path);
+            result = 1;
+        }
+        else {
+            uint32_t header_end = layout.band_count ? layout.bands[0].y : layout.height;
+            bool cancelled = !report_progress(options, BLUEGEN_PROGRESS_WRITE, 0, layout.height);
+            if(!cancelled) {
+                write_plate_rows(&writer, output, previous, 0, header_end);
+            }
+            for(size_t s = 0; s < layout.band_count && !cancelled; s++) {
+                uint32_t y = layout.bands[s].y;
+                uint32_t end = bluegen_band_end(&layout, s);
+                wait_for_band(&scheduler, (long)s);
+                uint32_t written = write_plate_rows(&writer, output, previous, y, end);
+                bluegen_progress_band(s, y, end, (uint64_t)written * writer.width * writer.samples_per_pixel);
+                cancelled = !report_progress(options, BLUEGEN_PROGRESS_WRITE, end, layout.height);
+            }
+            result = close_bluegen_tiff_writer(&writer);
+            if(result != 0) {
+                set_bluegen_error(error, path, "(v)> Failed to write %s.", path);
+            }
+
+            // Bands left unfilled are never waited on, but the workers still have to stop before the plate goes away
+            if(cancelled) {
+                pthread_mutex_lock(&scheduler.mutex);
+                scheduler.cancelled = true;
+                pthread_mutex_unlock(&scheduler.mutex);
+                remove(path);
+                if(session) {
+                    forget_written_file(session);
+                }
+            }
+        }
+    }
+
+    for(unsigned int w = 0; w < started; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+    close_bluegen_reader(scheduler.reader);
+    free(paths);
+    for(unsigned int w = 0; w < thread_count; w++) {
+        free(workers[w].occupancy);
+    }
+    free(workers);
+    pthread_cond_destroy(&scheduler.done);
+    pthread_mutex_destroy(&scheduler.mutex);
+
+    // A TIFF that failed to write may not be what the plate was, so it's only remembered if it was written
+    if(session && !scheduler.cancelled) {
+        remember_plate(session, scheduler.tasks, task_count, &layout, output, options->crop, dummy_space, result == 0 ? path : NULL, !scheduler.opaque);
+    }
+
+    for(size_t t = 0; t < task_count; t++) {
+        free(scheduler.tasks[t].crops);
+        free(scheduler.tasks[t].infos);
+
+        // Images that were never placed because it was cancelled
+        free_measured_frames(scheduler.tasks[t].measured, scheduler.tasks[t].frame_count);
+        if(scheduler.tasks[t].have_cached) {
+            free_bluegen_image(&scheduler.tasks[t].cached);
+        }
+    }
+    free(scheduler.tasks);
+    free(scheduler.band_filled);
+    free_bluegen_layout(&layout);
+
+    if(scheduler.cancelled) {
+        if(scheduler.failed && error) {
+            *error = scheduler.error;
+        }
+        free_bluegen_image(output);
+        memset(output, 0, sizeof(*output));
+        return 1;
+    }
+    return result;
+}
@@ -0,0 +1,191 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_SCHEDULER_H
+#define BLUEGEN_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bluegen.h"
+#include "input.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct BlueGenFileSequence {
+    /** Holds a pointer to an array of paths */
+    const char **paths;
+
+    /** Number of paths */
+    size_t path_count;
+
+    /** Take every page of multi-page TIFFs and every frame of animated GIFs and APNGs, rather than just the first */
+    bool all_frames;
+} BlueGenFileSequence;
+
+/** What a progress callback is counting */
+typedef enum BlueGenProgressStage {
+    /** Files probed (and measured, if cropping) out of every file */
+    BLUEGEN_PROGRESS_PROBE,
+
+    /** Files decoded and placed out of every file */
+    BLUEGEN_PROGRESS_DECODE,
+
+    /** Rows written out of the height of the color plate */
+    BLUEGEN_PROGRESS_WRITE
+} BlueGenProgressStage;
+
+/**
+ * Called as an image is generated; each stage is first reported with done set to 0, and calls are never made at the
+ * same time, though they may come from any thread
+ * @param context context given in the options
+ * @param stage   stage being reported
+ * @param done    how much of the stage is done
+ * @param total   how much there is to do in the stage
+ * @return        true to keep going, or false to cancel
+ */
+typedef bool (*BlueGenProgressCallback)(void *context, BlueGenProgressStage stage, uint64_t done, uint64_t total);
+
+/**
+ * Looks up an image that was already decoded, so it doesn't have to be read, probed or decoded again; this may be
+ * called from several threads at once, and is only called for files whose frames aren't all being taken
+ * @param context context given in the options
+ * @param path    path of the file
+ * @param image   set to the image if there is one, in any format; it's freed with free_bluegen_image() once it's no
+ *                longer needed, so its pixels have to stay valid until then
+ * @return        true if the image was found
+ */
+typedef bool (*BlueGenImageLookup)(void *context, const char *path, BlueGenImage *image);
+
+/**
+ * Looks up what's known about the colors of a file that was scanned before, so its frame doesn't have to be scanned
+ * again; like a BlueGenImageLookup, this may be called from several threads at once and is only called for files
+ * whose frames aren't all being taken, and it isn't called at all when cropping
+ * @param context context given in the options
+ * @param path    path of the file
+ * @param summary set to the summary, as summarize_bluegen_image() would make it from the file as it is now
+ * @return        true if the summary was found
+ */
+typedef bool (*BlueGenColorLookup)(void *context, const char *path, BlueGenColorSummary *summary);
+
+/** What was generated last time, so generating the same files again only has to redo what changed */
+typedef struct BlueGenSession BlueGenSession;
+
+typedef struct BlueGenScheduleOptions {
+    /** Number of worker threads; 0 uses one per CPU */
+    unsigned int threads;
+
+    /** Most memory, in bytes, that decoded images and the color plate may take up at once; 0 is unlimited */
+    uint64_t max_memory;
+
+    /** How to read input files */
+    BlueGenReaderBackend reader;
+
+    /** Crop fully transparent borders off of each image (see find_bluegen_crop()); images are decoded to find their
+        borders before the plate is laid out, and what's kept of them is held onto for placing as far as max_memory
+        allows, past which they're decoded again */
+    bool crop;
+
+    /** Called to report progress and check for cancellation, or NULL */
+    BlueGenProgressCallback progress;
+
+    /** Passed to progress */
+    void *progress_context;
+
+    /** Called for each file to find it already decoded, or NULL to always decode it */
+    BlueGenImageLookup lookup;
+
+    /** Passed to lookup */
+    void *lookup_context;
+
+    /** Session to reuse the last color plate from and remember this one in, or NULL; only one generation may use a
+        session at a time */
+    BlueGenSession *session;
+
+    /** Called for each file to find its colors already summarized, or NULL to always scan it; passed lookup_context */
+    BlueGenColorLookup color_lookup;
+} BlueGenScheduleOptions;
+
+/**
+ * Generate an image from files, decoding them in parallel, and optionally write it
+ *
+ * Every file is probed first so the color plate can be laid out and allocated up front. Files are then read into
+ * memory in the background, ahead of the workers, and each worker decodes an image from memory, scans its colors,
+ * copies it into the plate, and frees it. Images are started in sequence order, and one is only started if its
+ * estimated decoded size fits in whatever the plate and the images in flight leave of max_memory; a quarter of that
+ * is set aside for reading ahead. If nothing fits, one image at a time is still decoded.
+ *
+ * The separator colors can't be picked until every image is scanned, so the last worker to finish decoding picks
+ * them. The workers then fill in the separators one band at a time while this thread writes each finished band.
+ *
+ * If the progress callback cancels, nothing more is started, and once the workers stop, output is freed and left empty
+ * and a partly written TIFF is deleted. A file that can't be read or decoded stops everything the same way, and the
+ * first such error is what gets reported.
+ *
+ * With a session, files that haven't changed since the last time it was used are neither probed nor decoded; their
+ * frames are copied out of the last color plate instead, even if they moved. If the plate is the same size and has
+ * the same alpha as the TIFF the session last wrote to path, and that file hasn't been touched since, only the rows
+ * that changed are written over it.
+ *
+ * @param sequences      sequences of files to generate image from
+ * @param sequence_count number of sequences to generate image from
+ * @param dummy_space    dummy space color
+ * @param options        threads and memory budget, or NULL for the defaults
+ * @param output         output image
+ * @param path           path to write the image to as a TIFF, or NULL to not write it
+ * @param error          set to what went wrong if it failed other than by being cancelled, or NULL
+ * @return               zero on success, non-zero if a file could not be read or decoded, the image could not be
+ *                       written, or generation was cancelled
+ */
+int generate_bluegen_image_from_files(const BlueGenFileSequence *sequences, size_t sequence_count, const BlueGenPixel *dummy_space, const BlueGenScheduleOptions *options, BlueGenImage *output, const char *path, BlueGenError *error);
+
+/**
+ * Lay out the color plate for files without decoding them, other than to find how much to crop if cropping; the files
+ * are probed in parallel, like generate_bluegen_image_from_files() does first
+ * @param sequences      sequences of files to lay out
+ * @param sequence_count number of sequences
+ * @param options        threads and cropping, or NULL for the defaults; only BLUEGEN_PROGRESS_PROBE is reported
+ * @param layout         set to the layout, which has to be freed with free_bluegen_layout()
+ * @param frame_counts   set to how many frames each file has, in the same order as the paths, or NULL
+ * @param error          set to what went wrong if a file couldn't be probed, or NULL
+ * @return               zero on success, non-zero if a file couldn't be probed or it was cancelled, in which case
+ *                       layout is left empty
+ */
+int layout_bluegen_files(const BlueGenFileSequence *sequences, size_t sequence_count, const BlueGenScheduleOptions *options, BlueGenLayout *layout, size_t *frame_counts, BlueGenError *error);
+
+/**
+ * Open an empty session
+ * @return session, which has to be closed with close_bluegen_session()
+ */
+BlueGenSession *open_bluegen_session(void);
+
+/**
+ * Close a session and free everything it kept
+ * @param session session to close, or NULL
+ */
+void close_bluegen_session(BlueGenSession *session);
+
+/**
+ * Get the number of CPUs available
+ * @return number of CPUs, at least 1
+ */
+unsigned int bluegen_cpu_count(void);
+
+/**
+ * Parse a size in bytes with an optional K, M, or G suffix (powers of 1024), such as 4G or 512M
+ * @param str  string to parse
+ * @param size set to the size in bytes
+ * @return     zero on success, non-zero if the string isn't a valid size
+ */
+int parse_bluegen_size(const char *str, uint64_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static bool enabled = false;
+static BlueGenStats stats;
+static size_t file_capacity = 0;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *STAGE_NAMES[BLUEGEN_STAGE_COUNT] = { "read", "decode", "scan", "layout", "blit", "write" };
+
+const char *bluegen_stage_name(BlueGenStage stage) {
+    return STAGE_NAMES[stage];
+}
+
+void bluegen_stats_enable(void) {
+    enabled = true;
+}
+
+void bluegen_stats_reset(void) {
+    for(size_t i = 0; i < stats.file_count; i++) {
+        free(stats.files[i].path);
+    }
+    free(stats.files);
+    memset(&stats, 0, sizeof(stats));
+    file_capacity = 0;
+}
+
+int bluegen_stats_enabled(void) {
+    return enabled;
+}
+
+void bluegen_time_now(BlueGenTime *time) {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    time->wall = (double)counter.QuadPart / (double)frequency.QuadPart;
+
+    // Kernel and user time are in 100 nanosecond intervals
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    uint64_t kernel_time = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t user_time = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    time->cpu = (double)(kernel_time + user_time) / 1.0E7;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    time->wall = (double)ts.tv_sec + (double)ts.tv_nsec / 1.0E9;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    time->cpu = (double)ts.tv_sec + (double)ts.tv_nsec / 1.0E9;
+#endif
+
+    if(bluegen_perf_enabled()) {
+        bluegen_perf_read(time->counters);
+    }
+    else {
+        memset(time->counters, 0, sizeof(time->counters));
+    }
+}
+
+// Add the time since start to total
+static void add_elapsed(BlueGenTime *total, const BlueGenTime *start, BlueGenTime *elapsed) {
+    BlueGenTime now;
+    bluegen_time_now(&now);
+    elapsed->wall = now.wall - start->wall;
+    elapsed->cpu = now.cpu - start->cpu;
+    total->wall += elapsed->wall;
+    total->cpu += elapsed->cpu;
+    for(int i = 0; i < BLUEGEN_COUNTER_COUNT; i++) {
+        elapsed->counters[i] = now.counters[i] - start->counters[i];
+        total->counters[i] += elapsed->counters[i];
+    }
+}
+
+void bluegen_time_skip(BlueGenTime *start, const BlueGenTime *paused) {
+    BlueGenTime now;
+    bluegen_time_now(&now);
+    start->wall += now.wall - paused->wall;
+    start->cpu += now.cpu - paused->cpu;
+    for(int i = 0; i < BLUEGEN_COUNTER_COUNT; i++) {
+        start->counters[i] += now.counters[i] - paused->counters[i];
+    }
+}
+
+void bluegen_stats_stage(BlueGenStage stage, const BlueGenTime *start) {
+    if(!enabled) {
+        return;
+    }
+    BlueGenTime elapsed;
+    pthread_mutex_lock(&stats_mutex);
+    add_elapsed(stats.stages + stage, start, &elapsed);
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void bluegen_stats_elapsed(const BlueGenTime *start) {
+    if(!enabled) {
+        return;
+    }
+    BlueGenTime now;
+    bluegen_time_now(&now);
+    stats.elapsed = now.wall - start->wall;
+}
+
+void bluegen_stats_lock(void) {
+    pthread_mutex_lock(&stats_mutex);
+}
+
+void bluegen_stats_unlock(void) {
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void bluegen_stats_file(const char *path, uint64_t bytes, const BlueGenTime *start) {
+    if(!enabled) {
+        return;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    if(stats.file_count == file_capacity) {
+        file_capacity = file_capacity ? file_capacity * 2 : 64;
+        stats.files = realloc(stats.files, file_capacity * sizeof(*stats.files));
+    }
+
+    BlueGenFileStats *file = stats.files + stats.file_count++;
+    file->path = malloc(strlen(path) + 1);
+    strcpy(file->path, path);
+    file->bytes = bytes;
+    add_elapsed(stats.stages + BLUEGEN_STAGE_DECODE, start, &file->time);
+
+    stats.bytes_read += bytes;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+BlueGenStats *bluegen_stats_get(void) {
+    return &stats;
+}
+
+uint64_t bluegen_stats_peak_rss(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        stats.peak_rss = counters.PeakWorkingSetSize;
+    }
+#else
+    // ru_maxrss is in kilobytes on Linux and bytes on macOS
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        stats.peak_rss = (uint64_t)usage.ru_maxrss;
+#else
+        stats.peak_rss = (uint64_t)usage.ru_maxrss * 1024;
+#endif
+    }
+#endif
+    return stats.peak_rss;
+}
+
+void bluegen_stats_print(FILE *f) {
+    bluegen_stats_peak_rss();
+    const BlueGenStats *s = &stats;
+    BlueGenTime total;
+    memset(&total, 0, sizeof(total));
+
+    fprintf(f, "Stage          Wall (ms)     CPU (ms)\n");
+    for(int i = 0; i < BLUEGEN_STAGE_COUNT; i++) {
+        fprintf(f, "%-10s %13.3f %12.3f\n", STAGE_NAMES[i], s->stages[i].wall * 1000.0, s->stages[i].cpu * 1000.0);
+        total.wall += s->stages[i].wall;
+        total.cpu += s->stages[i].cpu;
+        for(int c = 0; c < BLUEGEN_COUNTER_COUNT; c++) {
+            total.counters[c] += s->stages[i].counters[c];
+        }
+    }
+    fprintf(f, "%-10s %13.3f %12.3f\n", "total", total.wall * 1000.0, total.cpu * 1000.0);
+    fprintf(f, "%-10s %13.3f\n\n", "elapsed", s->elapsed * 1000.0);
+
+    if(bluegen_perf_enabled()) {
+        fprintf(f, "Stage     ");
+        for(int c = 0; c < BLUEGEN_COUNTER_COUNT; c++) {
+            fprintf(f, " %15s", bluegen_perf_counter_name((BlueGenCounter)c));
+        }
+        fprintf(f, "      IPC\n");
+        for(int i = 0; i <= BLUEGEN_STAGE_COUNT; i++) {
+            const BlueGenTime *t = i == BLUEGEN_STAGE_COUNT ? &total : s->stages + i;
+            fprintf(f, "%-10s", i == BLUEGEN_STAGE_COUNT ? "total" : STAGE_NAMES[i]);
+            for(int c = 0; c < BLUEGEN_COUNTER_COUNT; c++) {
+                if(bluegen_perf_available((BlueGenCounter)c)) {
+                    fprintf(f, " %15llu", (unsigned long long)t->counters[c]);
+                }
+                else {
+                    fprintf(f, " %15s", "n/a");
+                }
+            }
+            if(t->counters[BLUEGEN_COUNTER_CYCLES]) {
+                fprintf(f, " %8.3f\n", (double)t->counters[BLUEGEN_COUNTER_INSTRUCTIONS] / (double)t->counters[BLUEGEN_COUNTER_CYCLES]);
+            }
+            else {
+                fprintf(f, " %8s\n", "n/a");
+            }
+        }
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "Threads:           %u\n", s->threads);
+    fprintf(f, "Pixels scanned:    %llu\n", (unsigned long long)s->pixels_scanned);
+    fprintf(f, "Candidates tried:  %llu\n", (unsigned long long)s->candidates_tried);
+    fprintf(f, "Bytes read:        %llu\n", (unsigned long long)s->bytes_read);
+    fprintf(f, "Bytes written:     %llu\n", (unsigned long long)s->bytes_written);
+    fprintf(f, "Peak RSS:          %llu\n\n", (unsigned long long)s->peak_rss);
+
+    fprintf(f, "Decode (ms)  Bytes         File\n");
+    for(size_t i = 0; i < s->file_count; i++) {
+        const BlueGenFileStats *file = s->files + i;
+        fprintf(f, "%11.3f  %-12llu  %s\n", file->time.wall * 1000.0, (unsigned long long)file->bytes, file->path);
+    }
+}
+
+void bluegen_json_string(FILE *f, const char *str) {
+    fputc('"', f);
+    for(const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        if(*c == '"' || *c == '\\') {
+            fprintf(f, "\\%c", *c);
+        }
+        else if(*c < 0x20) {
+            fprintf(f, "\\u%04x", *c);
+        }
+        else {
+            fputc(*c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+void bluegen_json_counters(FILE *f, const uint64_t *counters) {
+    fputc('{', f);
+    for(int c = 0; c < BLUEGEN_COUNTER_COUNT; c++) {
+        fprintf(f, "%s\"%s\":", c ? "," : "", bluegen_perf_counter_name((BlueGenCounter)c));
+        if(bluegen_perf_available((BlueGenCounter)c)) {
+            fprintf(f, "%llu", (unsigned long long)counters[c]);
+        }
+        else {
+            fprintf(f, "null");
+        }
+    }
+    fputc('}', f);
+}
+
+void bluegen_stats_print_json(FILE *f) {
+    bluegen_stats_peak_rss();
+    const BlueGenStats *s = &stats;
+
+    fprintf(f, "{\"stages\":{");
+    for(int i = 0; i < BLUEGEN_STAGE_COUNT; i++) {
+        fprintf(f, "%s\"%s\":{\"wall\":%.9f,\"cpu\":%.9f", i ? "," : "", STAGE_NAMES[i], s->stages[i].wall, s->stages[i].cpu);
+        if(bluegen_perf_enabled()) {
+            fprintf(f, ",\"counters\":");
+            bluegen_json_counters(f, s->stages[i].counters);
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "},\"elapsed\":%.9f", s->elapsed);
+    fprintf(f, ",\"threads\":%u", s->threads);
+    fprintf(f, ",\"pixels_scanned\":%llu", (unsigned long long)s->pixels_scanned);
+    fprintf(f, ",\"candidates_tried\":%llu", (unsigned long long)s->candidates_tried);
+    fprintf(f, ",\"bytes_read\":%llu", (unsigned long long)s->bytes_read);
+    fprintf(f, ",\"bytes_written\":%llu", (unsigned long long)s->bytes_written);
+    fprintf(f, ",\"peak_rss\":%llu", (unsigned long long)s->peak_rss);
+    fprintf(f, ",\"files\":[");
+    for(size_t i = 0; i < s->file_count; i++) {
+        const BlueGenFileStats *file = s->files + i;
+        fprintf(f, "%s{\"path\":", i ? "," : "");
+        bluegen_json_string(f, file->path);
+        fprintf(f, ",\"bytes\":%llu,\"wall\":%.9f,\"cpu\":%.9f}", (unsigned long long)file->bytes, file->time.wall, file->time.cpu);
+    }
+    fprintf(f, "]}\n");
+}
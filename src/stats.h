@@ -0,0 +1,223 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_STATS_H
+#define BLUEGEN_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "perf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Stages of a generation run
+ */
+typedef enum BlueGenStage {
+    /** Reading each input file into memory */
+    BLUEGEN_STAGE_READ,
+
+    /** Decoding each input file */
+    BLUEGEN_STAGE_DECODE,
+
+    /** Finding the colors used by the inputs and picking separator colors */
+    BLUEGEN_STAGE_SCAN,
+
+    /** Working out the dimensions of the color plate */
+    BLUEGEN_STAGE_LAYOUT,
+
+    /** Filling the color plate and copying each input into it */
+    BLUEGEN_STAGE_BLIT,
+
+    /** Writing the color plate to disk */
+    BLUEGEN_STAGE_WRITE,
+
+    BLUEGEN_STAGE_COUNT
+} BlueGenStage;
+
+/**
+ * Time spent, in seconds, and performance counter deltas
+ */
+typedef struct BlueGenTime {
+    /** Wall clock time */
+    double wall;
+
+    /** CPU time of the calling thread */
+    double cpu;
+
+    /** Performance counters; these are zero unless bluegen_perf_enable() opened them */
+    uint64_t counters[BLUEGEN_COUNTER_COUNT];
+} BlueGenTime;
+
+/**
+ * Decode statistics for a single input file
+ */
+typedef struct BlueGenFileStats {
+    /** Path of the file */
+    char *path;
+
+    /** Size of the file in bytes */
+    uint64_t bytes;
+
+    /** Time spent decoding the file */
+    BlueGenTime time;
+} BlueGenFileStats;
+
+/**
+ * Everything collected while stats are enabled
+ */
+typedef struct BlueGenStats {
+    /** Time spent in each stage, summed over every thread that worked on it */
+    BlueGenTime stages[BLUEGEN_STAGE_COUNT];
+
+    /** Wall clock time of the whole run, in seconds */
+    double elapsed;
+
+    /** Number of worker threads used */
+    unsigned int threads;
+
+    /** Number of input pixels looked at while finding used colors */
+    uint64_t pixels_scanned;
+
+    /** Number of separator color candidates generated by increment_pixel */
+    uint64_t candidates_tried;
+
+    /** Bytes read from input files */
+    uint64_t bytes_read;
+
+    /** Bytes written to the output file */
+    uint64_t bytes_written;
+
+    /** Peak resident set size of the process in bytes, filled in by bluegen_stats_peak_rss() */
+    uint64_t peak_rss;
+
+    /** Decode statistics for each input file, in the order they were loaded */
+    BlueGenFileStats *files;
+
+    /** Number of files */
+    size_t file_count;
+} BlueGenStats;
+
+/**
+ * Get the name of a stage, as used in the stats output
+ * @param stage stage to name
+ * @return      name of the stage
+ */
+const char *bluegen_stage_name(BlueGenStage stage);
+
+/**
+ * Start recording stats; until this is called, all other bluegen_stats_* functions do nothing
+ */
+void bluegen_stats_enable(void);
+
+/**
+ * Clear everything recorded so far
+ */
+void bluegen_stats_reset(void);
+
+/**
+ * Check if stats are being recorded
+ * @return non-zero if enabled
+ */
+int bluegen_stats_enabled(void);
+
+/**
+ * Get the current time, and the performance counters if they are open; pass this to bluegen_stats_stage() or bluegen_stats_file() once the work is done
+ * @param time time to fill out
+ */
+void bluegen_time_now(BlueGenTime *time);
+
+/**
+ * Move a start time forward by the time since paused, so time spent on something else in the middle isn't counted
+ * @param start  time the work started, from bluegen_time_now()
+ * @param paused time the other work started, from bluegen_time_now()
+ */
+void bluegen_time_skip(BlueGenTime *start, const BlueGenTime *paused);
+
+/**
+ * Add the time elapsed since start to a stage; this can be called from any thread
+ * @param stage stage to add to
+ * @param start time the work started, from bluegen_time_now()
+ */
+void bluegen_stats_stage(BlueGenStage stage, const BlueGenTime *start);
+
+/**
+ * Set the wall clock time of the whole run
+ * @param start time the run started, from bluegen_time_now()
+ */
+void bluegen_stats_elapsed(const BlueGenTime *start);
+
+/**
+ * Record that a file was decoded, also adding its time to BLUEGEN_STAGE_DECODE and its size to the bytes read
+ * @param path  path of the file
+ * @param bytes size of the file in bytes
+ * @param start time the decode started, from bluegen_time_now()
+ */
+void bluegen_stats_file(const char *path, uint64_t bytes, const BlueGenTime *start);
+
+/**
+ * Add to one of the counters
+ * @param counter name of the counter in BlueGenStats
+ * @param amount  amount to add
+ */
+#define BLUEGEN_STATS_COUNT(counter, amount) do { if(bluegen_stats_enabled()) { bluegen_stats_lock(); bluegen_stats_get()->counter += (amount); bluegen_stats_unlock(); } } while(0)
+
+/**
+ * Lock the stats so they can be changed from multiple threads; all bluegen_stats_* functions do this themselves
+ */
+void bluegen_stats_lock(void);
+
+/**
+ * Unlock the stats
+ */
+void bluegen_stats_unlock(void);
+
+/**
+ * Get the stats recorded so far
+ * @return pointer to the stats
+ */
+BlueGenStats *bluegen_stats_get(void);
+
+/**
+ * Sample the peak resident set size of the process so far, which the print functions also do
+ * @return peak resident set size in bytes, or 0 if it can't be determined
+ */
+uint64_t bluegen_stats_peak_rss(void);
+
+/**
+ * Print the stats in a human readable format
+ * @param f file to print to
+ */
+void bluegen_stats_print(FILE *f);
+
+/**
+ * Print the stats as JSON
+ * @param f file to print to
+ */
+void bluegen_stats_print_json(FILE *f);
+
+/**
+ * Write a string as a quoted JSON string
+ * @param f   file to write to
+ * @param str string to write
+ */
+void bluegen_json_string(FILE *f, const char *str);
+
+/**
+ * Write performance counters as a JSON object, with null for counters that aren't available
+ * @param f        file to write to
+ * @param counters counters to write
+ */
+void bluegen_json_counters(FILE *f, const uint64_t *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,8 +1,78 @@
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_NO_JPEG
 #define STBI_NO_PSD
-#define STBI_NO_GIF
 #define STBI_NO_HDR
 #define STBI_NO_PIC
 #define STBI_NO_PNM
+#define STBI_NO_LINEAR
 #include "stb_image.h"
+
+#include <limits.h>
+#include "frames.h"
+
+// stbi_load_gif_from_memory() keeps every frame; this keeps just the last two, which is all disposal ever looks back at
+struct BlueGenGif {
+    stbi__context context;
+    stbi__gif gif;
+
+    /** Copies of the last two frames */
+    stbi_uc *previous[2];
+
+    /** Number of frames decoded so far */
+    size_t frame_count;
+};
+
+BlueGenGif *open_bluegen_gif(const uint8_t *data, size_t size) {
+    if(size > INT_MAX) {
+        return NULL;
+    }
+    BlueGenGif *gif = calloc(1, sizeof(*gif));
+    if(!gif) {
+        return NULL;
+    }
+    stbi__start_mem(&gif->context, data, (int)size);
+    if(!stbi__gif_test(&gif->context)) {
+        free(gif);
+        return NULL;
+    }
+    return gif;
+}
+
+int next_bluegen_gif_frame(BlueGenGif *gif, const uint8_t **pixels, uint32_t *width, uint32_t *height) {
+    // A frame disposed of by restoring the previous one goes back to the frame before it
+    stbi_uc *two_back = gif->frame_count >= 2 ? gif->previous[gif->frame_count & 1] : NULL;
+    int channels;
+    stbi_uc *frame = stbi__gif_load_next(&gif->context, &gif->gif, &channels, 4, two_back);
+    if(frame == (stbi_uc *)&gif->context) {
+        return 0;
+    }
+    if(!frame) {
+        return -1;
+    }
+
+    size_t frame_size = (size_t)gif->gif.w * gif->gif.h * 4;
+    if(!gif->previous[0]) {
+        gif->previous[0] = malloc(frame_size);
+        gif->previous[1] = malloc(frame_size);
+        if(!gif->previous[0] || !gif->previous[1]) {
+            stbi__err("outofmem", "Out of memory");
+            return -1;
+        }
+    }
+    memcpy(gif->previous[gif->frame_count & 1], frame, frame_size);
+    gif->frame_count++;
+
+    *pixels = frame;
+    *width = (uint32_t)gif->gif.w;
+    *height = (uint32_t)gif->gif.h;
+    return 1;
+}
+
+void close_bluegen_gif(BlueGenGif *gif) {
+    STBI_FREE(gif->gif.out);
+    STBI_FREE(gif->gif.history);
+    STBI_FREE(gif->gif.background);
+    free(gif->previous[0]);
+    free(gif->previous[1]);
+    free(gif);
+}
@@ -0,0 +1,100 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include "trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+static FILE *trace_file = NULL;
+static double trace_start = 0.0;
+static unsigned long event_count = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Get an ID for the calling thread
+static unsigned long current_thread_id(void) {
+#if defined(_WIN32)
+    return (unsigned long)GetCurrentThreadId();
+#elif defined(__linux__)
+    return (unsigned long)syscall(SYS_gettid);
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+// Get an ID for this process
+static unsigned long current_process_id(void) {
+#ifdef _WIN32
+    return (unsigned long)GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+int bluegen_trace_open(const char *path) {
+    trace_file = fopen(path, "w");
+    if(!trace_file) {
+        return 1;
+    }
+
+    BlueGenTime now;
+    bluegen_time_now(&now);
+    trace_start = now.wall;
+    event_count = 0;
+
+    fprintf(trace_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    return 0;
+}
+
+int bluegen_trace_enabled(void) {
+    return trace_file != NULL;
+}
+
+void bluegen_trace_span(const char *name, const BlueGenTime *start, const char *path, long sequence, long frame, uint64_t bytes) {
+    if(!trace_file) {
+        return;
+    }
+
+    BlueGenTime now;
+    bluegen_time_now(&now);
+
+    // Timestamps and durations are in microseconds
+    pthread_mutex_lock(&trace_mutex);
+    fprintf(trace_file, "%s{\"name\":", event_count++ ? ",\n" : "");
+    bluegen_json_string(trace_file, name);
+    fprintf(trace_file, ",\"cat\":\"bluegen\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu,\"args\":{\"bytes\":%llu,\"cpu_us\":%.3f",
+            (start->wall - trace_start) * 1.0E6, (now.wall - start->wall) * 1.0E6, current_process_id(), current_thread_id(),
+            (unsigned long long)bytes, (now.cpu - start->cpu) * 1.0E6);
+    if(path) {
+        fprintf(trace_file, ",\"path\":");
+        bluegen_json_string(trace_file, path);
+    }
+    if(sequence >= 0) {
+        fprintf(trace_file, ",\"sequence\":%ld", sequence);
+    }
+    if(frame >= 0) {
+        fprintf(trace_file, ",\"frame\":%ld", frame);
+    }
+    fprintf(trace_file, "}}");
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+void bluegen_trace_close(void) {
+    if(!trace_file) {
+        return;
+    }
+    fprintf(trace_file, "\n]}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+}
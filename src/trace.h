@@ -0,0 +1,50 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_TRACE_H
+#define BLUEGEN_TRACE_H
+
+#include <stdint.h>
+#include "stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Start writing a trace in Chrome Trace Event format, which can be loaded in Perfetto or chrome://tracing
+ * @param path path to write the trace to
+ * @return     zero on success, non-zero if the file could not be opened
+ */
+int bluegen_trace_open(const char *path);
+
+/**
+ * Check if a trace is being written
+ * @return non-zero if enabled
+ */
+int bluegen_trace_enabled(void);
+
+/**
+ * Add a span that ends now to the trace; does nothing if no trace is open, and can be called from any thread
+ * @param name     name of the span (e.g. "decode")
+ * @param start    time the span started, from bluegen_time_now()
+ * @param path     file path to tag the span with, or NULL
+ * @param sequence sequence index to tag the span with, or -1
+ * @param frame    frame index to tag the span with, or -1
+ * @param bytes    number of bytes processed
+ */
+void bluegen_trace_span(const char *name, const BlueGenTime *start, const char *path, long sequence, long frame, uint64_t bytes);
+
+/**
+ * Finish the trace and close the file
+ */
+void bluegen_trace_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
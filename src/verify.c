@@ -0,0 +1,659 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "verify.h"
+#include "input.h"
+#include "scheduler.h"
+
+// BLUEGEN_NO_SIMD skips these, as in bluegen.c
+#if !defined(BLUEGEN_NO_SIMD)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define USE_SSSE3
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define USE_NEON
+#endif
+#endif
+
+// Same spacing generate_bluegen_image() uses
+#define BITMAP_SPACING 4
+
+// Most bytes of plates to hold in memory ahead of checking them
+#define VERIFY_READ_AHEAD ((uint64_t)256 << 20)
+
+// Length of the messages saying what's wrong with a plate
+#define ERROR_SIZE 256
+
+// Colors are compared without alpha, like choosing separators does
+#define PACK_RGB(p) ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | ((uint32_t)(p)[2] << 16))
+
+// Find the first pixel in [from, to) of a row that is (if match) or isn't (if not) either color, or to if there isn't one
+static uint32_t find_pixel(const uint8_t *row, uint32_t from, uint32_t to, BlueGenPixelFormat format, uint32_t a, uint32_t b, bool match) {
+    uint32_t x = from;
+
+    // Skip ahead a few pixels at a time until a few have one, then find which one it is below
+    if(format == BLUEGEN_FORMAT_RGBA) {
+#if defined(USE_NEON)
+        uint8x16_t ar = vdupq_n_u8((uint8_t)a), ag = vdupq_n_u8((uint8_t)(a >> 8)), ab = vdupq_n_u8((uint8_t)(a >> 16));
+        uint8x16_t br = vdupq_n_u8((uint8_t)b), bg = vdupq_n_u8((uint8_t)(b >> 8)), bb = vdupq_n_u8((uint8_t)(b >> 16));
+        for(; x + 16 <= to; x += 16) {
+            uint8x16x4_t p = vld4q_u8(row + (size_t)x * 4);
+            uint8x16_t is_a = vandq_u8(vandq_u8(vceqq_u8(p.val[0], ar), vceqq_u8(p.val[1], ag)), vceqq_u8(p.val[2], ab));
+            uint8x16_t is_b = vandq_u8(vandq_u8(vceqq_u8(p.val[0], br), vceqq_u8(p.val[1], bg)), vceqq_u8(p.val[2], bb));
+            uint8x16_t found = vorrq_u8(is_a, is_b);
+            if(match ? vmaxvq_u8(found) != 0 : vminvq_u8(found) == 0) {
+                break;
+            }
+        }
+#elif defined(USE_SSE2)
+        const __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i va = _mm_set1_epi32((int)a);
+        const __m128i vb = _mm_set1_epi32((int)b);
+        for(; x + 4 <= to; x += 4) {
+            __m128i p = _mm_and_si128(_mm_loadu_si128((const __m128i *)(row + (size_t)x * 4)), mask);
+            int found = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(p, va), _mm_cmpeq_epi32(p, vb)));
+            if(match ? found != 0 : found != 0xFFFF) {
+                break;
+            }
+        }
+#endif
+    }
+    else {
+#if defined(USE_NEON)
+        uint8x16_t ar = vdupq_n_u8((uint8_t)a), ag = vdupq_n_u8((uint8_t)(a >> 8)), ab = vdupq_n_u8((uint8_t)(a >> 16));
+        uint8x16_t br = vdupq_n_u8((uint8_t)b), bg = vdupq_n_u8((uint8_t)(b >> 8)), bb = vdupq_n_u8((uint8_t)(b >> 16));
+        for(; x + 16 <= to; x += 16) {
+            uint8x16x3_t p = vld3q_u8(row + (size_t)x * 3);
+            uint8x16_t is_a = vandq_u8(vandq_u8(vceqq_u8(p.val[0], ar), vceqq_u8(p.val[1], ag)), vceqq_u8(p.val[2], ab));
+            uint8x16_t is_b = vandq_u8(vandq_u8(vceqq_u8(p.val[0], br), vceqq_u8(p.val[1], bg)), vceqq_u8(p.val[2], bb));
+            uint8x16_t found = vorrq_u8(is_a, is_b);
+            if(match ? vmaxvq_u8(found) != 0 : vminvq_u8(found) == 0) {
+                break;
+            }
+        }
+#elif defined(USE_SSSE3)
+        // Spread four RGB pixels out into RGBX lanes; loading 16 bytes for 12 means stopping two pixels early
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i va = _mm_set1_epi32((int)a);
+        const __m128i vb = _mm_set1_epi32((int)b);
+        for(; x + 6 <= to; x += 4) {
+            __m128i p = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row + (size_t)x * 3)), shuffle);
+            int found = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(p, va), _mm_cmpeq_epi32(p, vb)));
+            if(match ? found != 0 : found != 0xFFFF) {
+                break;
+            }
+        }
+#endif
+    }
+
+    for(; x < to; x++) {
+        uint32_t color = PACK_RGB(row + (size_t)x * format);
+        if((color == a || color == b) == match) {
+            return x;
+        }
+    }
+    return to;
+}
+
+// Check that [from, to) of a row is all one color
+static bool all_color(const uint8_t *row, uint32_t from, uint32_t to, BlueGenPixelFormat format, uint32_t color) {
+    return find_pixel(row, from, to, format, color, color, false) == to;
+}
+
+// Add a frame to a band, growing its array as needed
+static BlueGenRect *add_frame(BlueGenBand *band, size_t *capacity) {
+    if(band->frame_count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 8;
+        band->frames = realloc(band->frames, *capacity * sizeof(*band->frames));
+    }
+    return band->frames + band->frame_count++;
+}
+
+// Find the frames of the band whose first row of frames is y, and how tall they are; returns the row after the blue
+// row under them, or 0 if the band isn't laid out right
+static uint32_t parse_band(const BlueGenImage *plate, BlueGenBand *band, size_t sequence, uint32_t y, uint32_t blue, uint32_t magenta, char *error, size_t error_size) {
+    size_t stride = (size_t)plate->width * plate->format;
+    const uint8_t *row = plate->pixels + y * stride;
+    size_t capacity = 0;
+    uint32_t top = y;
+
+    // Every frame is at least a pixel tall, so the first row has all of them
+    uint32_t x = 0;
+    while((x = find_pixel(row, x, plate->width, plate->format, blue, blue, false)) < plate->width) {
+        uint32_t end = find_pixel(row, x, plate->width, plate->format, blue, blue, true);
+        uint32_t expected = band->frame_count ? band->frames[band->frame_count - 1].x + band->frames[band->frame_count - 1].width + BITMAP_SPACING : 1;
+        if(x != expected) {
+            snprintf(error, error_size, "frame %zu of sequence %zu starts at %u, %u instead of %u, %u", band->frame_count, sequence, x, y, expected, y);
+            return 0;
+        }
+        if(end == plate->width) {
+            snprintf(error, error_size, "frame %zu of sequence %zu runs into the right edge at row %u", band->frame_count, sequence, y);
+            return 0;
+        }
+        BlueGenRect *frame = add_frame(band, &capacity);
+        frame->x = x;
+        frame->y = y;
+        frame->width = end - x;
+        frame->height = 0;
+        x = end;
+    }
+
+    // Frames end where their first column turns blue, and the band ends with the row where every frame has
+    for(;; y++) {
+        if(y >= plate->height) {
+            snprintf(error, error_size, "the plate ends in the middle of sequence %zu", sequence);
+            return 0;
+        }
+        row = plate->pixels + y * stride;
+
+        bool open = false;
+        x = 0;
+        for(size_t f = 0; f < band->frame_count; f++) {
+            BlueGenRect *frame = band->frames + f;
+            uint32_t end = frame->x + frame->width;
+            if(!all_color(row, x, frame->x, plate->format, blue)) {
+                snprintf(error, error_size, "the bitmap separator is broken before frame %zu of sequence %zu at row %u", f, sequence, y);
+                return 0;
+            }
+            if(frame->height == y - frame->y && PACK_RGB(row + (size_t)frame->x * plate->format) != blue) {
+                uint32_t found = find_pixel(row, frame->x, end, plate->format, blue, magenta, true);
+                if(found != end) {
+                    snprintf(error, error_size, "frame %zu of sequence %zu uses a separator color at %u, %u", f, sequence, found, y);
+                    return 0;
+                }
+                frame->height++;
+                open = true;
+            }
+            else if(!all_color(row, frame->x, end, plate->format, blue)) {
+                snprintf(error, error_size, "frame %zu of sequence %zu isn't a rectangle, or uses the bitmap separator color, at row %u", f, sequence, y);
+                return 0;
+            }
+            x = end;
+        }
+        if(!all_color(row, x, plate->width, plate->format, blue)) {
+            snprintf(error, error_size, "the bitmap separator is broken after the frames of sequence %zu at row %u", sequence, y);
+            return 0;
+        }
+        if(!open) {
+            break;
+        }
+        band->height = y - top + 1;
+    }
+    return y + 1;
+}
+
+int parse_bluegen_plate(const BlueGenImage *plate, BlueGenLayout *layout, BlueGenPixel *blue, BlueGenPixel *magenta, char *error, size_t error_size) {
+    memset(layout, 0, sizeof(*layout));
+    if(plate->format != BLUEGEN_FORMAT_RGB && plate->format != BLUEGEN_FORMAT_RGBA) {
+        snprintf(error, error_size, "the plate isn't RGB or RGBA");
+        return 1;
+    }
+    if(plate->width < 4 || plate->height < 1) {
+        snprintf(error, error_size, "the plate is only %ux%u", plate->width, plate->height);
+        return 1;
+    }
+
+    // The header has the bitmap separator, sequence separator, and dummy space colors, and then bitmap separators
+    size_t stride = (size_t)plate->width * plate->format;
+    const uint8_t *row = plate->pixels;
+    uint32_t blue_color = PACK_RGB(row);
+    uint32_t magenta_color = PACK_RGB(row + plate->format);
+    if(blue_color == magenta_color) {
+        snprintf(error, error_size, "both separators are %06X", (unsigned int)blue_color);
+        return 1;
+    }
+    if(!all_color(row, 3, plate->width, plate->format, blue_color)) {
+        snprintf(error, error_size, "the header isn't the bitmap separator color after the dummy space color");
+        return 1;
+    }
+
+    // Each sequence is a row of magenta and a row of blue, then its frames, then another row of blue
+    size_t capacity = 0;
+    uint32_t width = 4;
+    uint32_t y = 1;
+    while(y < plate->height) {
+        size_t sequence = layout->band_count;
+        if(layout->band_count == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            layout->bands = realloc(layout->bands, capacity * sizeof(*layout->bands));
+        }
+        BlueGenBand *band = layout->bands + layout->band_count++;
+        memset(band, 0, sizeof(*band));
+        band->y = y;
+
+        if(!all_color(plate->pixels + y * stride, 0, plate->width, plate->format, magenta_color)) {
+            snprintf(error, error_size, "row %u should be the sequence separator color to start sequence %zu", y, sequence);
+            free_bluegen_layout(layout);
+            memset(layout, 0, sizeof(*layout));
+            return 1;
+        }
+        if(y + 1 >= plate->height || !all_color(plate->pixels + (y + 1) * stride, 0, plate->width, plate->format, blue_color)) {
+            snprintf(error, error_size, "row %u should be the bitmap separator color under the start of sequence %zu", y + 1, sequence);
+            free_bluegen_layout(layout);
+            memset(layout, 0, sizeof(*layout));
+            return 1;
+        }
+
+        y = parse_band(plate, band, sequence, y + 2, blue_color, magenta_color, error, error_size);
+        if(y == 0) {
+            free_bluegen_layout(layout);
+            memset(layout, 0, sizeof(*layout));
+            return 1;
+        }
+
+        // Sequences are as wide as their frames plus a pixel on each side
+        uint32_t sequence_width = band->frame_count ? band->frames[band->frame_count - 1].x + band->frames[band->frame_count - 1].width + 1 : 2;
+        if(sequence_width > width) {
+            width = sequence_width;
+        }
+    }
+
+    if(width != plate->width) {
+        snprintf(error, error_size, "the plate is %u pixels wide, but its widest sequence only needs %u", plate->width, width);
+        free_bluegen_layout(layout);
+        memset(layout, 0, sizeof(*layout));
+        return 1;
+    }
+
+    layout->width = plate->width;
+    layout->height = plate->height;
+    const uint8_t *header = plate->pixels;
+    *blue = (BlueGenPixel) { header[0], header[1], header[2], plate->format == BLUEGEN_FORMAT_RGBA ? header[3] : 0xFF };
+    header += plate->format;
+    *magenta = (BlueGenPixel) { header[0], header[1], header[2], plate->format == BLUEGEN_FORMAT_RGBA ? header[3] : 0xFF };
+    return 0;
+}
+
+static uint32_t read_u16(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Get a value of a little endian TIFF tag, which is either in the tag or somewhere else if it doesn't fit
+static bool read_tag_value(const uint8_t *data, size_t size, const uint8_t *tag, uint32_t index, uint32_t *value) {
+    uint32_t type = read_u16(tag + 2);
+    uint32_t count = read_u32(tag + 4);
+    size_t value_size = type == 3 ? 2 : type == 4 ? 4 : 0;
+    if(value_size == 0 || index >= count) {
+        return false;
+    }
+    const uint8_t *values = tag + 8;
+    if((uint64_t)count * value_size > 4) {
+        uint32_t offset = read_u32(tag + 8);
+        if((uint64_t)offset + (uint64_t)count * value_size > size) {
+            return false;
+        }
+        values = data + offset;
+    }
+    *value = value_size == 2 ? read_u16(values + index * 2) : read_u32(values + index * 4);
+    return true;
+}
+
+// Don't free pixels that point into a file
+static void free_nothing(void *pixels) {
+    (void)pixels;
+}
+
+// Point a plate at the pixels of a TIFF laid out like the ones blue-gen writes (uncompressed, 8-bit RGB or RGBA, with
+// every strip one after another) without copying them; returns false if it isn't one
+static bool map_plain_tiff(BlueGenImage *plate, const uint8_t *data, size_t size) {
+    if(size < 8 || read_u16(data) != 0x4949 || read_u16(data + 2) != 42) {
+        return false;
+    }
+    uint32_t directory = read_u32(data + 4);
+    if((uint64_t)directory + 2 > size) {
+        return false;
+    }
+    uint32_t tag_count = read_u16(data + directory);
+    if((uint64_t)directory + 2 + (uint64_t)tag_count * 12 > size) {
+        return false;
+    }
+
+    uint32_t width = 0, height = 0, samples = 1, compression = 1, photometric = 0, planar = 1, orientation = 1;
+    const uint8_t *bits_tag = NULL, *offsets_tag = NULL, *counts_tag = NULL;
+    for(uint32_t t = 0; t < tag_count; t++) {
+        const uint8_t *tag = data + directory + 2 + t * 12;
+        uint32_t *value = NULL;
+        switch(read_u16(tag)) {
+            case 0x100: value = &width; break;
+            case 0x101: value = &height; break;
+            case 0x102: bits_tag = tag; break;
+            case 0x103: value = &compression; break;
+            case 0x106: value = &photometric; break;
+            case 0x111: offsets_tag = tag; break;
+            case 0x112: value = &orientation; break;
+            case 0x115: value = &samples; break;
+            case 0x117: counts_tag = tag; break;
+            case 0x11C: value = &planar; break;
+        }
+        if(value && !read_tag_value(data, size, tag, 0, value)) {
+            return false;
+        }
+    }
+    if(width == 0 || height == 0 || (samples != 3 && samples != 4) || compression != 1 || photometric != 2 || planar != 1 || orientation != 1 ||
+       !bits_tag || !offsets_tag || !counts_tag || read_u32(offsets_tag + 4) != read_u32(counts_tag + 4)) {
+        return false;
+    }
+    for(uint32_t s = 0; s < samples; s++) {
+        uint32_t bits;
+        if(!read_tag_value(data, size, bits_tag, s, &bits) || bits != 8) {
+            return false;
+        }
+    }
+
+    // The strips have to add up to the whole image with nothing in between
+    uint32_t strip_count = read_u32(offsets_tag + 4);
+    uint32_t first = 0, next = 0;
+    uint64_t total = 0;
+    for(uint32_t s = 0; s < strip_count; s++) {
+        uint32_t offset, count;
+        if(!read_tag_value(data, size, offsets_tag, s, &offset) || !read_tag_value(data, size, counts_tag, s, &count) || (s > 0 && offset != next)) {
+            return false;
+        }
+        if(s == 0) {
+            first = offset;
+        }
+        next = offset + count;
+        total += count;
+    }
+    if(strip_count == 0 || total != (uint64_t)width * height * samples || (uint64_t)first + total > size) {
+        return false;
+    }
+
+    plate->width = width;
+    plate->height = height;
+    plate->format = samples == 4 ? BLUEGEN_FORMAT_RGBA : BLUEGEN_FORMAT_RGB;
+    plate->pixels = (uint8_t *)(data + first);
+    plate->free = free_nothing;
+    return true;
+}
+
+// Get the pixels of a plate that was read into memory, decoding it if it isn't laid out like blue-gen writes them;
+// returns zero on success, or non-zero if it couldn't be decoded
+static int open_plate(BlueGenImage *plate, const char *path, const uint8_t *data, size_t size, BlueGenError *error) {
+    if(map_plain_tiff(plate, data, size)) {
+        return 0;
+    }
+    if(load_file_from_memory(plate, path, data, size, error) != 0) {
+        return 1;
+    }
+    if(plate->format != BLUEGEN_FORMAT_RGB && plate->format != BLUEGEN_FORMAT_RGBA) {
+        BlueGenImage expanded;
+        expand_bluegen_image(plate, &expanded);
+        free_bluegen_image(plate);
+        *plate = expanded;
+    }
+    return 0;
+}
+
+// Make the line the report shows for a plate that isn't valid
+static char *describe_invalid_plate(const char *path, const char *error) {
+    size_t size = sizeof("(v)> : .") + strlen(path) + strlen(error);
+    char *line = malloc(size);
+    snprintf(line, size, "(v)> %s: %s.", path, error);
+    return line;
+}
+
+typedef struct Verifier {
+    const char *const *paths;
+    size_t path_count;
+    BlueGenReader *reader;
+
+    /** What's wrong with each plate as a line of the report, or NULL if nothing is */
+    char **errors;
+
+    pthread_mutex_t mutex;
+    size_t next_plate;
+} Verifier;
+
+static void *verify_main(void *arg) {
+    Verifier *verifier = arg;
+    char error[ERROR_SIZE];
+    for(;;) {
+        pthread_mutex_lock(&verifier->mutex);
+        size_t index = verifier->next_plate++;
+        pthread_mutex_unlock(&verifier->mutex);
+        if(index >= verifier->path_count) {
+            break;
+        }
+
+        const uint8_t *data;
+        size_t size;
+        int read_error = read_bluegen_input(verifier->reader, index, &data, &size);
+        if(read_error) {
+            snprintf(error, sizeof(error), "failed to read it! Error was: %s", strerror(read_error));
+            verifier->errors[index] = describe_invalid_plate(verifier->paths[index], error);
+            release_bluegen_input(verifier->reader, index);
+            continue;
+        }
+
+        // A plate that can't even be decoded is just as invalid, and the rest are still checked
+        BlueGenImage plate;
+        BlueGenLayout layout;
+        BlueGenPixel blue, magenta;
+        BlueGenError load_error;
+        if(open_plate(&plate, verifier->paths[index], data, size, &load_error) != 0) {
+            verifier->errors[index] = strdup(load_error.message);
+        }
+        else {
+            if(parse_bluegen_plate(&plate, &layout, &blue, &magenta, error, sizeof(error)) == 0) {
+                free_bluegen_layout(&layout);
+            }
+            else {
+                verifier->errors[index] = describe_invalid_plate(verifier->paths[index], error);
+                }
+            free_bluegen_image(&plate);
+        }
+        release_bluegen_input(verifier->reader, index);
+    }
+    return NULL;
+}
+
+size_t verify_bluegen_plates(const char *const *paths, size_t path_count, unsigned int threads, FILE *report) {
+    Verifier verifier;
+    verifier.paths = paths;
+    verifier.path_count = path_count;
+    verifier.reader = open_bluegen_reader(paths, path_count, BLUEGEN_READER_MMAP, VERIFY_READ_AHEAD);
+    verifier.errors = calloc(path_count ? path_count : 1, sizeof(*verifier.errors));
+    verifier.next_plate = 0;
+    pthread_mutex_init(&verifier.mutex, NULL);
+
+    unsigned int thread_count = threads ? threads : bluegen_cpu_count();
+    if(thread_count > path_count) {
+        thread_count = path_count ? (unsigned int)path_count : 1;
+    }
+    pthread_t *workers = calloc(thread_count, sizeof(*workers));
+    unsigned int started = 0;
+    while(started < thread_count && pthread_create(workers + started, NULL, verify_main, &verifier) == 0) {
+        started++;
+    }
+
+    // If a thread couldn't be started, this one checks plates too, so they still all get checked
+    if(started < thread_count) {
+        verify_main(&verifier);
+    }
+    for(unsigned int w = 0; w < started; w++) {
+        pthread_join(workers[w], NULL);
+    }
+    free(workers);
+    pthread_mutex_destroy(&verifier.mutex);
+    close_bluegen_reader(verifier.reader);
+
+    // Report them in the order they were given, no matter which finished first
+    size_t invalid = 0;
+    for(size_t p = 0; p < path_count; p++) {
+        if(verifier.errors[p]) {
+            fprintf(report, "%s\n", verifier.errors[p]);
+            free(verifier.errors[p]);
+            invalid++;
+        }
+    }
+    free(verifier.errors);
+    return invalid;
+}
+
+// Hash rows of a plate, as RGBA if format says to, so plates with and without alpha can still be compared
+static uint64_t hash_rows(uint64_t hash, const BlueGenImage *plate, uint32_t x, uint32_t y, uint32_t width, uint32_t height, BlueGenPixelFormat format, uint8_t *expanded) {
+    for(uint32_t r = 0; r < height; r++) {
+        const uint8_t *row = plate->pixels + ((size_t)(y + r) * plate->width + x) * plate->format;
+        size_t size = (size_t)width * format;
+        if(plate->format != format) {
+            for(uint32_t p = 0; p < width; p++) {
+                memcpy(expanded + (size_t)p * 4, row + (size_t)p * 3, 3);
+                expanded[(size_t)p * 4 + 3] = 0xFF;
+            }
+            row = expanded;
+        }
+
+        // Eight bytes at a time; each step can be undone, so a changed byte always changes the hash
+        size_t i = 0;
+        for(; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, row + i, sizeof(word));
+            hash = (((hash << 29) | (hash >> 35)) ^ word) * 0x9E3779B97F4A7C15ULL;
+        }
+        for(; i < size; i++) {
+            hash = (((hash << 29) | (hash >> 35)) ^ row[i]) * 0x9E3779B97F4A7C15ULL;
+        }
+    }
+    return hash;
+}
+
+// Check if two bands have their frames in the same places, so they can be compared as a whole
+static bool same_band_layout(const BlueGenLayout *layout_a, size_t band_a, const BlueGenLayout *layout_b, size_t band_b) {
+    const BlueGenBand *a = layout_a->bands + band_a;
+    const BlueGenBand *b = layout_b->bands + band_b;
+    if(layout_a->width != layout_b->width || a->height != b->height || a->frame_count != b->frame_count) {
+        return false;
+    }
+    for(size_t f = 0; f < a->frame_count; f++) {
+        if(a->frames[f].x != b->frames[f].x || a->frames[f].width != b->frames[f].width || a->frames[f].height != b->frames[f].height) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read a plate and find its layout for diffing; returns zero on success
+static int open_diff_plate(BlueGenReader *reader, size_t index, const char *path, BlueGenImage *plate, BlueGenLayout *layout, FILE *report) {
+    const uint8_t *data;
+    size_t size;
+    int read_error = read_bluegen_input(reader, index, &data, &size);
+    if(read_error) {
+        fprintf(report, "(v)> Failed to read %s! Error was: %s\n", path, strerror(read_error));
+        return 1;
+    }
+
+    BlueGenError load_error;
+    if(open_plate(plate, path, data, size, &load_error) != 0) {
+        fprintf(report, "%s\n", load_error.message);
+        return 1;
+    }
+
+    char error[ERROR_SIZE];
+    BlueGenPixel blue, magenta;
+    if(parse_bluegen_plate(plate, layout, &blue, &magenta, error, sizeof(error)) != 0) {
+        fprintf(report, "(v)> %s: %s.\n", path, error);
+        free_bluegen_image(plate);
+        return 1;
+    }
+    return 0;
+}
+
+int diff_bluegen_plates(const char *path_a, const char *path_b, FILE *report) {
+    const char *paths[] = { path_a, path_b };
+    BlueGenReader *reader = open_bluegen_reader(paths, 2, BLUEGEN_READER_MMAP, VERIFY_READ_AHEAD);
+    BlueGenImage a, b;
+    BlueGenLayout layout_a, layout_b;
+    if(open_diff_plate(reader, 0, path_a, &a, &layout_a, report) != 0) {
+        close_bluegen_reader(reader);
+        return 2;
+    }
+    if(open_diff_plate(reader, 1, path_b, &b, &layout_b, report) != 0) {
+        free_bluegen_layout(&layout_a);
+        free_bluegen_image(&a);
+        close_bluegen_reader(reader);
+        return 2;
+    }
+
+    BlueGenPixelFormat format = a.format > b.format ? a.format : b.format;
+    uint8_t *expanded = malloc((size_t)(a.width > b.width ? a.width : b.width) * 4);
+    size_t frames = 0, differences = 0;
+
+    // The header only has colors in it, so there's nothing to compare frame by frame
+    if(hash_rows(0, &a, 0, 0, 3, 1, format, expanded) != hash_rows(0, &b, 0, 0, 3, 1, format, expanded)) {
+        fprintf(report, "( ')> The separator or dummy space colors are different.\n");
+    }
+
+    size_t band_count = layout_a.band_count > layout_b.band_count ? layout_a.band_count : layout_b.band_count;
+    for(size_t s = 0; s < band_count; s++) {
+        if(s >= layout_a.band_count || s >= layout_b.band_count) {
+            const BlueGenLayout *layout = s < layout_a.band_count ? &layout_a : &layout_b;
+            fprintf(report, "(v)> Sequence %zu is only in %s.\n", s, s < layout_a.band_count ? path_a : path_b);
+            frames += layout->bands[s].frame_count;
+            differences += layout->bands[s].frame_count;
+            continue;
+        }
+
+        // Most bands of similar plates are the same, so don't look at their frames unless they differ
+        const BlueGenBand *band_a = layout_a.bands + s;
+        const BlueGenBand *band_b = layout_b.bands + s;
+        size_t frame_count = band_a->frame_count > band_b->frame_count ? band_a->frame_count : band_b->frame_count;
+        frames += frame_count;
+        if(same_band_layout(&layout_a, s, &layout_b, s) &&
+           hash_rows(0, &a, 0, band_a->y, a.width, bluegen_band_end(&layout_a, s) - band_a->y, format, expanded) ==
+           hash_rows(0, &b, 0, band_b->y, b.width, bluegen_band_end(&layout_b, s) - band_b->y, format, expanded)) {
+            continue;
+        }
+
+        for(size_t f = 0; f < frame_count; f++) {
+            if(f >= band_a->frame_count || f >= band_b->frame_count) {
+                fprintf(report, "(v)> Sequence %zu frame %zu is only in %s.\n", s, f, f < band_a->frame_count ? path_a : path_b);
+                differences++;
+                continue;
+            }
+            const BlueGenRect *frame_a = band_a->frames + f;
+            const BlueGenRect *frame_b = band_b->frames + f;
+            if(frame_a->width != frame_b->width || frame_a->height != frame_b->height) {
+                fprintf(report, "(v)> Sequence %zu frame %zu is %ux%u in %s and %ux%u in %s.\n", s, f, frame_a->width, frame_a->height, path_a, frame_b->width, frame_b->height, path_b);
+                differences++;
+            }
+            else if(hash_rows(0, &a, frame_a->x, frame_a->y, frame_a->width, frame_a->height, format, expanded) !=
+                    hash_rows(0, &b, frame_b->x, frame_b->y, frame_b->width, frame_b->height, format, expanded)) {
+                fprintf(report, "(v)> Sequence %zu frame %zu is different.\n", s, f);
+                differences++;
+            }
+        }
+    }
+
+    if(differences == 0) {
+        fprintf(report, "(^)> All %zu frames are the same.\n", frames);
+    }
+    else {
+        fprintf(report, "(v)> %zu of %zu frames are different.\n", differences, frames);
+    }
+
+    free(expanded);
+    free_bluegen_layout(&layout_a);
+    free_bluegen_layout(&layout_b);
+    free_bluegen_image(&a);
+    free_bluegen_image(&b);
+    close_bluegen_reader(reader);
+    return differences ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#ifndef BLUEGEN_VERIFY_H
+#define BLUEGEN_VERIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bluegen.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Find the layout of a color plate from its separators, checking it against the layout generate_bluegen_image() makes:
+ * the header row, the magenta and blue rows around each sequence, blue between and around frames, frames 4 pixels
+ * apart, and no frame pixel using either separator color
+ * @param plate       RGB or RGBA color plate
+ * @param layout      set to the layout if the plate is valid, which has to be freed with free_bluegen_layout()
+ * @param blue        set to the bitmap separator color
+ * @param magenta     set to the sequence separator color
+ * @param error       set to what's wrong, if anything
+ * @param error_size  size of error
+ * @return            zero if the plate is valid, non-zero if not, in which case layout is left empty
+ */
+int parse_bluegen_plate(const BlueGenImage *plate, BlueGenLayout *layout, BlueGenPixel *blue, BlueGenPixel *magenta, char *error, size_t error_size);
+
+/**
+ * Check color plates, several at once; plates written by blue-gen are checked straight out of memory-mapped files,
+ * and anything else is decoded first
+ * @param paths      paths of the plates
+ * @param path_count number of plates
+ * @param threads    number of plates to check at once; 0 uses one per CPU
+ * @param report     file to write what's wrong with each plate to
+ * @return           number of plates that aren't valid
+ */
+size_t verify_bluegen_plates(const char *const *paths, size_t path_count, unsigned int threads, FILE *report);
+
+/**
+ * Compare two color plates, hashing each sequence's band and then each frame of the bands that differ, so plates whose
+ * frames moved around can still be compared
+ * @param path_a path of the first plate
+ * @param path_b path of the second plate
+ * @param report file to write which sequences and frames differ to
+ * @return       zero if the frames are the same, 1 if any differ, or 2 if either plate isn't valid
+ */
+int diff_bluegen_plates(const char *path_a, const char *path_b, FILE *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
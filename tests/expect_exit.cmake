@@ -0,0 +1,12 @@
+#
+# blue-gen (c) 2019 Kavawuvi
+#
+# This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+#
+
+# Run PROGRAM with ARGUMENTS (separated by |, since ; would split them) and fail unless it exits with EXPECTED
+string(REPLACE "|" ";" ARGUMENTS "${ARGUMENTS}")
+execute_process(COMMAND "${PROGRAM}" ${ARGUMENTS} RESULT_VARIABLE result)
+if(NOT result EQUAL EXPECTED)
+    message(FATAL_ERROR "${PROGRAM} exited with ${result} instead of ${EXPECTED}")
+endif()
@@ -0,0 +1,490 @@
+/*
+ * blue-gen (c) 2019 Kavawuvi
+ *
+ * This program is free software under the GNU General Public License v3.0 or later. See LICENSE for more information.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
+#include "bluegen.h"
+#include "frames.h"
+#include "manifest.h"
+#include "pngimage.h"
+#include "progress.h"
+#include "rawimage.h"
+#include "scheduler.h"
+#include "verify.h"
+
+// Run from tests/fixtures with a directory to write to as the only argument; every check that fails is printed, and
+// the exit code is non-zero if any did
+
+static int failures = 0;
+static const char *scratch = ".";
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+static bool check(bool passed, const char *condition, const char *file, int line) {
+    if(!passed) {
+        fprintf(stderr, "%s:%d: %s failed\n", file, line, condition);
+        failures++;
+    }
+    return passed;
+}
+
+#define PATH_SIZE 1024
+
+static const char *scratch_path(char path[PATH_SIZE], const char *name) {
+    snprintf(path, PATH_SIZE, "%s/%s", scratch, name);
+    return path;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(*size ? *size : 1);
+    if(fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+static bool write_file(const char *path, const uint8_t *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    if(!file) {
+        return false;
+    }
+    bool written = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+static bool same_files(const char *path_a, const char *path_b) {
+    size_t size_a, size_b;
+    uint8_t *a = read_file(path_a, &size_a);
+    uint8_t *b = read_file(path_b, &size_b);
+    bool same = a && b && size_a == size_b && memcmp(a, b, size_a) == 0;
+    free(a);
+    free(b);
+    return same;
+}
+
+static bool pixel_is(const BlueGenImage *image, uint32_t x, uint32_t y, uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha) {
+    const BlueGenPixel *pixel = (const BlueGenPixel *)image->pixels + x + (size_t)y * image->width;
+    return pixel->red == red && pixel->green == green && pixel->blue == blue && pixel->alpha == alpha;
+}
+
+static void test_parse_size(void) {
+    uint64_t size = 0;
+    CHECK(parse_bluegen_size("100", &size) == 0 && size == 100);
+    CHECK(parse_bluegen_size("0", &size) == 0 && size == 0);
+    CHECK(parse_bluegen_size("2k", &size) == 0 && size == 2048);
+    CHECK(parse_bluegen_size("512M", &size) == 0 && size == 512ULL << 20);
+    CHECK(parse_bluegen_size("4G", &size) == 0 && size == 4ULL << 30);
+    CHECK(parse_bluegen_size("4GB", &size) == 0 && size == 4ULL << 30);
+    CHECK(parse_bluegen_size("1.5K", &size) == 0 && size == 1536);
+    CHECK(parse_bluegen_size("", &size) != 0);
+    CHECK(parse_bluegen_size("G", &size) != 0);
+    CHECK(parse_bluegen_size("-1", &size) != 0);
+    CHECK(parse_bluegen_size("4X", &size) != 0);
+    CHECK(parse_bluegen_size("4GBs", &size) != 0);
+}
+
+static void test_manifest(void) {
+    CHECK(compare_bluegen_natural("frame_2", "frame_10") < 0);
+    CHECK(compare_bluegen_natural("frame_10", "frame_9") > 0);
+    CHECK(compare_bluegen_natural("frame_007", "frame_7") != 0);
+    CHECK(compare_bluegen_natural("a", "a") == 0);
+    CHECK(compare_bluegen_natural("a1b", "a01c") < 0);
+
+    // Blank lines are skipped, -a takes every frame, and -S sorts by name with hidden and unknown files left out
+    BlueGenManifest manifest;
+    BlueGenError error;
+    init_bluegen_manifest(&manifest);
+    FILE *file = fopen("manifest.txt", "r");
+    if(!CHECK(file != NULL)) {
+        return;
+    }
+    CHECK(read_bluegen_manifest(&manifest, file, "manifest.txt", &error) == 0);
+    fclose(file);
+    CHECK(add_bluegen_manifest_argument(&manifest, "rgba.png", &error) == 0);
+    CHECK(finish_bluegen_manifest(&manifest, &error) == 0);
+    if(CHECK(manifest.sequence_count == 3)) {
+        const BlueGenFileSequence *sequences = manifest.sequences;
+        CHECK(sequences[0].path_count == 2 && !sequences[0].all_frames);
+        CHECK(sequences[0].path_count == 2 && strcmp(sequences[0].paths[0], "gray.png") == 0 && strcmp(sequences[0].paths[1], "rgb.png") == 0);
+        CHECK(sequences[1].path_count == 1 && sequences[1].all_frames && strcmp(sequences[1].paths[0], "multi.tif") == 0);
+        CHECK(sequences[2].path_count == 4 && !sequences[2].all_frames);
+        if(sequences[2].path_count == 4) {
+            CHECK(strcmp(sequences[2].paths[0], "sequence/frame_1.png") == 0);
+            CHECK(strcmp(sequences[2].paths[1], "sequence/frame_2.png") == 0);
+            CHECK(strcmp(sequences[2].paths[2], "sequence/frame_10.png") == 0);
+            CHECK(strcmp(sequences[2].paths[3], "rgba.png") == 0);
+        }
+    }
+    free_bluegen_manifest(&manifest);
+
+    // A path before any sequence, a directory with nothing in it, and -S with no directory are all errors
+    CHECK(add_bluegen_manifest_argument(&manifest, "rgb.png", &error) != 0);
+    CHECK(add_bluegen_manifest_argument(&manifest, "-S", &error) == 0);
+    CHECK(add_bluegen_manifest_argument(&manifest, "missing", &error) != 0 && error.path && strcmp(error.path, "missing") == 0);
+    CHECK(add_bluegen_manifest_argument(&manifest, "-S", &error) == 0);
+    CHECK(finish_bluegen_manifest(&manifest, &error) != 0);
+    free_bluegen_manifest(&manifest);
+}
+
+// Decode a file both ways into the middle of a plate filled with a pattern, so writing outside of rect is caught too
+static void check_fast_path(const char *path, bool png) {
+    size_t size;
+    uint8_t *data = read_file(path, &size);
+    BlueGenImage image;
+    BlueGenError error;
+    if(!CHECK(data != NULL) || !CHECK(load_image_from_memory(&image, path, data, size, &error) == 0)) {
+        free(data);
+        return;
+    }
+
+    BlueGenRect rect = { 1, 2, image.width, image.height };
+    BlueGenImage fast, reference;
+    initialize_bluegen_image(&fast, image.width + 3, image.height + 4, BLUEGEN_FORMAT_RGBA);
+    initialize_bluegen_image(&reference, fast.width, fast.height, BLUEGEN_FORMAT_RGBA);
+    size_t plate_size = (size_t)fast.width * fast.height * sizeof(BlueGenPixel);
+    memset(fast.pixels, 0xA5, plate_size);
+    memset(reference.pixels, 0xA5, plate_size);
+
+    place_bluegen_frame(&reference, NULL, &image, &rect, 0, 0);
+    bool decoded = png ? decode_bluegen_png_frame(&fast, path, data, size, &rect) : decode_bluegen_raw_frame(&fast, path, data, size, &rect);
+#if !defined(BLUEGEN_HAVE_ZLIB_NG) && !defined(BLUEGEN_HAVE_LIBDEFLATE)
+    // Without a fast inflate, PNGs are always left to stb_image
+    if(png) {
+        CHECK(!decoded);
+        decoded = true;
+        memcpy(fast.pixels, reference.pixels, plate_size);
+    }
+#endif
+    if(!CHECK(decoded && memcmp(fast.pixels, reference.pixels, plate_size) == 0)) {
+        fprintf(stderr, "    (decoding %s)\n", path);
+    }
+
+    free_bluegen_image(&fast);
+    free_bluegen_image(&reference);
+    free_bluegen_image(&image);
+    free(data);
+}
+
+static void test_fast_paths(void) {
+    static const char *const raw[] = {
+        "b24.bmp", "b32.bmp", "b24td.bmp", "b24wide.bmp", "b32wide.bmp",
+        "t24.tga", "t32.tga", "t24rle.tga", "t32rle.tga", "t32wide.tga"
+    };
+    static const char *const png[] = {
+        "gray.png", "ga.png", "rgb.png", "rgba.png", "pal.png",
+        "gray1.png", "gray2.png", "gray4.png", "pal1.png", "pal2.png", "pal4.png",
+        "gray16.png", "ga16.png", "rgb16.png", "rgba16.png",
+        "graykey.png", "graykey2.png", "rgbkey.png", "rgbkey16.png", "paltrns.png", "split.png"
+    };
+    for(size_t i = 0; i < sizeof(raw) / sizeof(*raw); i++) {
+        check_fast_path(raw[i], false);
+    }
+    for(size_t i = 0; i < sizeof(png) / sizeof(*png); i++) {
+        check_fast_path(png[i], true);
+    }
+
+    // Anything else is left to stb_image
+    size_t size;
+    uint8_t *data = read_file("rgb.png", &size);
+    BlueGenImage plate;
+    BlueGenRect rect = { 0, 0, 9, 6 };
+    initialize_bluegen_image(&plate, 9, 6, BLUEGEN_FORMAT_RGBA);
+    CHECK(data && !decode_bluegen_raw_frame(&plate, "rgb.png", data, size, &rect));
+    free_bluegen_image(&plate);
+    free(data);
+}
+
+static uint32_t next_random(uint32_t *state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+// Check the kernels on widths that cover their vector loops and the pixels left over after them
+static void test_kernels(void) {
+    uint32_t state = 1;
+    for(uint32_t width = 1; width <= 37; width++) {
+        for(uint32_t height = 1; height <= 3; height++) {
+            BlueGenImage image, halved;
+            initialize_bluegen_image(&image, width, height, BLUEGEN_FORMAT_RGBA);
+            for(size_t i = 0; i < (size_t)width * height * 4; i++) {
+                image.pixels[i] = (uint8_t)next_random(&state);
+            }
+
+            // Odd columns and rows are averaged with themselves
+            halve_bluegen_image(&image, &halved);
+            bool same = halved.width == (width + 1) / 2 && halved.height == (height + 1) / 2;
+            for(uint32_t y = 0; same && y < halved.height; y++) {
+                for(uint32_t x = 0; same && x < halved.width; x++) {
+                    uint32_t x0 = x * 2, x1 = x0 + 1 < width ? x0 + 1 : x0;
+                    uint32_t y0 = y * 2, y1 = y0 + 1 < height ? y0 + 1 : y0;
+                    for(int c = 0; c < 4; c++) {
+                        unsigned int sum = image.pixels[(x0 + y0 * width) * 4 + c] + image.pixels[(x1 + y0 * width) * 4 + c] +
+                                           image.pixels[(x0 + y1 * width) * 4 + c] + image.pixels[(x1 + y1 * width) * 4 + c];
+                        same = same && halved.pixels[(x + y * halved.width) * 4 + c] == (uint8_t)((sum + 2) / 4);
+                    }
+                }
+            }
+            if(!CHECK(same)) {
+                fprintf(stderr, "    (halving %ux%u)\n", (unsigned int)width, (unsigned int)height);
+            }
+            free_bluegen_image(&halved);
+
+            // Clear everything but a random box, which may be empty, and check the crop finds it
+            uint32_t left = next_random(&state) % width, right = left + next_random(&state) % (width - left + 1);
+            uint32_t top = next_random(&state) % height, bottom = top + next_random(&state) % (height - top + 1);
+            for(uint32_t y = 0; y < height; y++) {
+                for(uint32_t x = 0; x < width; x++) {
+                    uint8_t *alpha = image.pixels + (x + y * width) * 4 + 3;
+                    bool inside = x >= left && x < right && y >= top && y < bottom;
+                    *alpha = inside ? (uint8_t)(*alpha | 1) : 0;
+                }
+            }
+            BlueGenCrop crop;
+            find_bluegen_crop(&image, &crop);
+            bool empty = left == right || top == bottom;
+            if(!CHECK(empty || (crop.visible.x == left && crop.visible.y == top && crop.visible.width == right - left && crop.visible.height == bottom - top))) {
+                fprintf(stderr, "    (cropping %ux%u to %u,%u %ux%u)\n", (unsigned int)width, (unsigned int)height, (unsigned int)left, (unsigned int)top, (unsigned int)(right - left), (unsigned int)(bottom - top));
+            }
+            free_bluegen_image(&image);
+        }
+    }
+}
+
+#define MAX_FRAMES 8
+
+typedef struct DecodedFrames {
+    BlueGenImage images[MAX_FRAMES];
+    size_t count;
+} DecodedFrames;
+
+static int keep_frame(void *context, const BlueGenImage *image, size_t index, BlueGenError *error) {
+    DecodedFrames *frames = context;
+    if(index != frames->count || frames->count == MAX_FRAMES) {
+        set_bluegen_error(error, NULL, "frame %zu came out of order", index);
+        return 1;
+    }
+    expand_bluegen_image(image, frames->images + frames->count++);
+    return 0;
+}
+
+static size_t decode_frames(const char *path, DecodedFrames *frames) {
+    frames->count = 0;
+    BlueGenImageInfo *infos = NULL;
+    BlueGenError error;
+    size_t frame_count = probe_bluegen_frames(path, &infos, &error);
+    free(infos);
+
+    size_t size;
+    uint8_t *data = read_file(path, &size);
+    if(!CHECK(data != NULL) || !CHECK(decode_bluegen_frames(path, data, size, frame_count, keep_frame, frames, &error) == 0)) {
+        frames->count = 0;
+    }
+    free(data);
+    return frames->count;
+}
+
+static void free_frames(DecodedFrames *frames) {
+    for(size_t i = 0; i < frames->count; i++) {
+        free_bluegen_image(frames->images + i);
+    }
+}
+
+// Both are 6x4: a red frame, a green 2x2 at (1,1) that is disposed of afterwards, then a blue 3x3 at (2,0)
+static void test_animation(void) {
+    DecodedFrames frames;
+
+    // The APNG's green frame is cleared to transparent black, and its blue is half transparent and blended over
+    if(CHECK(decode_frames("anim.png", &frames) == 3)) {
+        CHECK(pixel_is(frames.images + 0, 0, 0, 255, 0, 0, 255) && pixel_is(frames.images + 0, 5, 3, 255, 0, 0, 255));
+        CHECK(pixel_is(frames.images + 1, 1, 1, 0, 255, 0, 255) && pixel_is(frames.images + 1, 2, 2, 0, 255, 0, 255));
+        CHECK(pixel_is(frames.images + 1, 0, 0, 255, 0, 0, 255) && pixel_is(frames.images + 1, 3, 1, 255, 0, 0, 255));
+        CHECK(pixel_is(frames.images + 2, 1, 1, 0, 0, 0, 0) && pixel_is(frames.images + 2, 1, 2, 0, 0, 0, 0));
+        CHECK(pixel_is(frames.images + 2, 2, 1, 0, 0, 255, 128) && pixel_is(frames.images + 2, 2, 2, 0, 0, 255, 128));
+        CHECK(pixel_is(frames.images + 2, 3, 0, 127, 0, 128, 255) && pixel_is(frames.images + 2, 4, 2, 127, 0, 128, 255));
+        CHECK(pixel_is(frames.images + 2, 0, 3, 255, 0, 0, 255) && pixel_is(frames.images + 2, 5, 0, 255, 0, 0, 255));
+    }
+    free_frames(&frames);
+
+    // The GIF's green frame has a transparent corner the red shows through, and stb_image restores what was under it
+    // when it's disposed of
+    if(CHECK(decode_frames("anim.gif", &frames) == 3)) {
+        CHECK(pixel_is(frames.images + 0, 0, 0, 255, 0, 0, 255) && pixel_is(frames.images + 0, 5, 3, 255, 0, 0, 255));
+        CHECK(pixel_is(frames.images + 1, 1, 1, 0, 255, 0, 255) && pixel_is(frames.images + 1, 1, 2, 0, 255, 0, 255));
+        CHECK(pixel_is(frames.images + 1, 2, 2, 255, 0, 0, 255) && pixel_is(frames.images + 1, 0, 0, 255, 0, 0, 255));
+        CHECK(pixel_is(frames.images + 2, 1, 1, 255, 0, 0, 255) && pixel_is(frames.images + 2, 1, 2, 255, 0, 0, 255));
+        CHECK(pixel_is(frames.images + 2, 2, 0, 0, 0, 255, 255) && pixel_is(frames.images + 2, 4, 2, 0, 0, 255, 255));
+        CHECK(pixel_is(frames.images + 2, 0, 0, 255, 0, 0, 255) && pixel_is(frames.images + 2, 5, 3, 255, 0, 0, 255));
+    }
+    free_frames(&frames);
+}
+
+static const char *const plate_paths[] = {
+    "gray.png", "ga.png", "rgb.png", "rgba.png", "pal.png",
+    "b24.bmp", "b32.bmp", "b24td.bmp", "t24.tga", "t32.tga", "t24rle.tga", "t32rle.tga",
+    "rgba.tif",
+    "multi.tif", "anim.png", "anim.gif"
+};
+
+static const BlueGenFileSequence plate_sequences[] = {
+    { (const char **)plate_paths, 5, false },
+    { (const char **)plate_paths + 5, 7, false },
+    { (const char **)plate_paths + 12, 1, false },
+    { (const char **)plate_paths + 13, 3, true }
+};
+
+static const char *const opaque_paths[] = { "b24.bmp", "b24wide.bmp", "t24.tga", "t24rle.tga", "rgb.png", "gray.png" };
+
+static const BlueGenFileSequence opaque_sequences[] = {
+    { (const char **)opaque_paths, 4, false },
+    { (const char **)opaque_paths + 4, 2, false }
+};
+
+static const BlueGenPixel cyan = { 0x00, 0xFF, 0xFF, 0xFF };
+
+// The checked-in plates were made by blue-gen, so generating them again has to come out the same to the byte,
+// including when RGBA is packed down to RGB for an opaque plate
+static void test_plates(void) {
+    char path[PATH_SIZE];
+    for(unsigned int threads = 1; threads <= 3; threads += 2) {
+        BlueGenScheduleOptions options = { 0 };
+        options.threads = threads;
+        BlueGenImage output;
+        BlueGenError error;
+        CHECK(generate_bluegen_image_from_files(plate_sequences, 4, &cyan, &options, &output, scratch_path(path, "plate.tif"), &error) == 0);
+        free_bluegen_image(&output);
+        CHECK(same_files("plate.tif", path));
+
+        CHECK(generate_bluegen_image_from_files(opaque_sequences, 2, &cyan, &options, &output, scratch_path(path, "plate_opaque.tif"), &error) == 0);
+        free_bluegen_image(&output);
+        CHECK(same_files("plate_opaque.tif", path));
+    }
+
+    BlueGenImage plate;
+    BlueGenError error;
+    if(CHECK(load_tiff(&plate, "plate.tif", &error) == 0)) {
+        BlueGenLayout layout;
+        BlueGenPixel blue, magenta;
+        char message[256];
+        CHECK(parse_bluegen_plate(&plate, &layout, &blue, &magenta, message, sizeof(message)) == 0 && layout.band_count == 4);
+        free_bluegen_layout(&layout);
+        free_bluegen_image(&plate);
+    }
+}
+
+// Sum the bytes of every band written according to progress written to a file
+static uint64_t band_bytes(const char *path) {
+    FILE *file = fopen(path, "r");
+    uint64_t total = 0;
+    char line[512];
+    while(file && fgets(line, sizeof(line), file)) {
+        const char *bytes = strstr(line, "\"bytes\":");
+        unsigned long long value;
+        if(strstr(line, "\"event\":\"band\"") && bytes && sscanf(bytes, "\"bytes\":%llu", &value) == 1) {
+            total += value;
+        }
+    }
+    if(file) {
+        fclose(file);
+    }
+    return total;
+}
+
+static int generate_with_progress(const BlueGenFileSequence *sequences, size_t sequence_count, BlueGenSession *session, const char *path, uint64_t *written) {
+    char progress_path[PATH_SIZE];
+    scratch_path(progress_path, "rewrite.jsonl");
+    int fd = open(progress_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || bluegen_progress_open(fd) != 0) {
+        return 1;
+    }
+
+    BlueGenScheduleOptions options = { 0 };
+    options.session = session;
+    BlueGenImage output;
+    BlueGenError error;
+    int result = generate_bluegen_image_from_files(sequences, sequence_count, &cyan, &options, &output, path, &error);
+    bluegen_progress_close(result == 0 ? &output : NULL, result == 0 ? NULL : error.message);
+    if(result == 0) {
+        free_bluegen_image(&output);
+    }
+    *written = band_bytes(progress_path);
+    return result;
+}
+
+// Generating again with a session writes only the rows that changed over the last TIFF, which has to come out the
+// same as writing it from scratch
+static void test_rewrite(void) {
+    char bmp_path[PATH_SIZE], output_path[PATH_SIZE], fresh_path[PATH_SIZE];
+    scratch_path(bmp_path, "rewrite.bmp");
+    scratch_path(output_path, "rewrite.tif");
+    scratch_path(fresh_path, "fresh.tif");
+
+    size_t size;
+    uint8_t *bmp = read_file("b24.bmp", &size);
+    if(!CHECK(bmp != NULL) || !CHECK(write_file(bmp_path, bmp, size))) {
+        free(bmp);
+        return;
+    }
+
+    const char *paths[] = { bmp_path, "t24.tga", "rgb.png" };
+    BlueGenFileSequence sequences[] = { { paths, 2, false }, { paths + 2, 1, false } };
+
+    BlueGenSession *session = open_bluegen_session();
+    uint64_t first = 0, second = 0, fresh = 0;
+    CHECK(generate_with_progress(sequences, 2, session, output_path, &first) == 0);
+
+    // Change the image's colors but not its size; the trailing bytes make sure the file looks changed even where
+    // modification times are only kept to the second
+    uint8_t *changed = malloc(size + 4);
+    memcpy(changed, bmp, size);
+    for(size_t i = 54; i < size; i++) {
+        changed[i] ^= 0x5A;
+    }
+    memset(changed + size, 0, 4);
+    CHECK(write_file(bmp_path, changed, size + 4));
+    CHECK(generate_with_progress(sequences, 2, session, output_path, &second) == 0);
+    close_bluegen_session(session);
+
+    CHECK(generate_with_progress(sequences, 2, NULL, fresh_path, &fresh) == 0);
+    CHECK(same_files(output_path, fresh_path));
+    CHECK(first == fresh && second > 0 && second < fresh);
+
+    free(changed);
+    free(bmp);
+}
+
+int main(int argc, char **argv) {
+    if(argc > 1) {
+        scratch = argv[1];
+    }
+
+    test_parse_size();
+    test_manifest();
+    test_fast_paths();
+    test_kernels();
+    test_animation();
+    test_plates();
+    test_rewrite();
+
+    if(failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}